@@ -0,0 +1,838 @@
+#include "BVH.h"
+#include "JobSystem.h"
+
+#include <geometric.hpp>
+#include <common.hpp>
+#include <vector_relational.hpp>
+#include <simd/platform.h>
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <cmath>
+
+namespace
+{
+	enum BOUNDS_CLASSIFICATION
+	{
+		BOUNDS_OUTSIDE,
+		BOUNDS_INTERSECTING,
+		BOUNDS_INSIDE,
+	};
+
+	struct Bin
+	{
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		uint32_t count;
+	};
+
+	inline float surfaceArea(const glm::vec3 & min, const glm::vec3 & max)
+	{
+		glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	// Slab test, tEnter is clamped to the ray start
+	inline bool intersectBounds(const glm::vec3 & boundsMin, const glm::vec3 & boundsMax, const glm::vec3 & origin, const glm::vec3 & inverseDirection, float closest, float & tEnter)
+	{
+		glm::vec3 t1 = (boundsMin - origin) * inverseDirection;
+		glm::vec3 t2 = (boundsMax - origin) * inverseDirection;
+		glm::vec3 tMin = glm::min(t1, t2);
+		glm::vec3 tMax = glm::max(t1, t2);
+
+		tEnter = std::max<float>(std::max<float>(tMin.x, tMin.y), std::max<float>(tMin.z, 0.0f));
+		float tExit = std::min<float>(std::min<float>(tMax.x, tMax.y), std::min<float>(tMax.z, closest));
+
+		return tEnter <= tExit;
+	}
+
+	inline int classifyBoxAgainstFrustum(const Frustum & frustum, const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+	{
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+
+		int result = BOUNDS_INSIDE;
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			glm::vec3 normal(frustum.planes[p]);
+			float distance = glm::dot(normal, center) + frustum.planes[p].w;
+			float reach = glm::dot(glm::abs(normal), extent);
+
+			if (distance + reach < 0.0f)
+			{
+				return BOUNDS_OUTSIDE;
+			}
+			if (distance - reach < 0.0f)
+			{
+				result = BOUNDS_INTERSECTING;
+			}
+		}
+
+		return result;
+	}
+
+	inline float distanceSquaredToBox(const glm::vec3 & point, const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+	{
+		glm::vec3 offset = point - glm::clamp(point, boundsMin, boundsMax);
+		return glm::dot(offset, offset);
+	}
+
+	inline glm::vec3 safeInverse(const glm::vec3 & direction)
+	{
+		// A zero component becomes a huge slope rather than inf, which keeps 0 * inf NaNs out of the slab test
+		const float tiny = 1e-30f;
+		return glm::vec3(
+			1.0f / (std::fabs(direction.x) > tiny ? direction.x : std::copysign(tiny, direction.x)),
+			1.0f / (std::fabs(direction.y) > tiny ? direction.y : std::copysign(tiny, direction.y)),
+			1.0f / (std::fabs(direction.z) > tiny ? direction.z : std::copysign(tiny, direction.z)));
+	}
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+: m_uiNodeCount(0)
+, m_uiMaxDepth(0)
+, m_uiDepth(0)
+{
+}
+
+BoundingVolumeHierarchy::~BoundingVolumeHierarchy()
+{
+
+}
+
+void BoundingVolumeHierarchy::buildFromBoxes(const glm::vec3 * mins, const glm::vec3 * maxs, size_t count)
+{
+	m_triangles.clear();
+	m_primitiveMins.assign(mins, mins + count);
+	m_primitiveMaxs.assign(maxs, maxs + count);
+
+	this->build();
+}
+
+void BoundingVolumeHierarchy::buildFromTriangles(const glm::vec3 * positions, const uint32_t * indices, size_t triangleCount)
+{
+	m_triangles.resize(triangleCount);
+	m_primitiveMins.resize(triangleCount);
+	m_primitiveMaxs.resize(triangleCount);
+
+	JobSystem::getInstance().parallelFor(0, triangleCount, 0, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			this->setTriangle((uint32_t)i, positions[indices[i * 3 + 0]], positions[indices[i * 3 + 1]], positions[indices[i * 3 + 2]]);
+		}
+	});
+
+	this->build();
+}
+
+void BoundingVolumeHierarchy::clear()
+{
+	m_nodes.clear();
+	m_primitiveIndices.clear();
+	m_primitiveMins.clear();
+	m_primitiveMaxs.clear();
+	m_triangles.clear();
+	m_uiDepth = 0;
+}
+
+void BoundingVolumeHierarchy::setPrimitiveBounds(uint32_t primitive, const glm::vec3 & min, const glm::vec3 & max)
+{
+	m_primitiveMins[primitive] = min;
+	m_primitiveMaxs[primitive] = max;
+}
+
+void BoundingVolumeHierarchy::setTriangle(uint32_t primitive, const glm::vec3 & v0, const glm::vec3 & v1, const glm::vec3 & v2)
+{
+	if (primitive >= m_triangles.size())
+	{
+		throw std::runtime_error("Setting a triangle on a BVH that wasn't built from triangles!");
+	}
+
+	m_triangles[primitive] = { v0, v1 - v0, v2 - v0 };
+	m_primitiveMins[primitive] = glm::min(v0, glm::min(v1, v2));
+	m_primitiveMaxs[primitive] = glm::max(v0, glm::max(v1, v2));
+}
+
+void BoundingVolumeHierarchy::build()
+{
+	size_t count = m_primitiveMins.size();
+
+	m_nodes.clear();
+	m_primitiveIndices.resize(count);
+	std::iota(m_primitiveIndices.begin(), m_primitiveIndices.end(), 0u);
+	m_uiDepth = 0;
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	m_centroids.resize(count);
+	JobSystem::getInstance().parallelFor(0, count, 0, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			m_centroids[i] = (m_primitiveMins[i] + m_primitiveMaxs[i]) * 0.5f;
+		}
+	});
+
+	// A binary tree with one primitive per leaf has 2n - 1 nodes, nothing the builder does can exceed that
+	m_nodes.resize(count * 2 - 1);
+	m_uiNodeCount.store(1);
+	m_uiMaxDepth.store(1);
+
+	this->buildNode(0, 0, (uint32_t)count, 1);
+
+	m_nodes.resize(m_uiNodeCount.load());
+	m_uiDepth = m_uiMaxDepth.load();
+
+	m_centroids.clear();
+	m_centroids.shrink_to_fit();
+}
+
+void BoundingVolumeHierarchy::buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, unsigned depth)
+{
+	unsigned maxDepth = m_uiMaxDepth.load(std::memory_order_relaxed);
+	while (depth > maxDepth && !m_uiMaxDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed))
+	{
+	}
+
+	uint32_t count = end - begin;
+
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (uint32_t i = begin; i < end; i++)
+	{
+		uint32_t primitive = m_primitiveIndices[i];
+		boundsMin = glm::min(boundsMin, m_primitiveMins[primitive]);
+		boundsMax = glm::max(boundsMax, m_primitiveMaxs[primitive]);
+		centroidMin = glm::min(centroidMin, m_centroids[primitive]);
+		centroidMax = glm::max(centroidMax, m_centroids[primitive]);
+	}
+
+	BVHNode & node = m_nodes[nodeIndex];
+	node.boundsMin = boundsMin;
+	node.boundsMax = boundsMax;
+	node.firstIndex = begin;
+	node.primitiveCount = (uint16_t)count;
+	node.splitAxis = 0;
+
+	if (count <= 1)
+	{
+		return;
+	}
+
+	// Binned SAH: drop the centroids into buckets along each axis and try every bucket boundary
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = FLT_MAX;
+
+	glm::vec3 centroidExtent = centroidMax - centroidMin;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (centroidExtent[axis] <= 0.0f)
+		{
+			continue;
+		}
+
+		Bin bins[BVH_SAH_BINS];
+		for (int b = 0; b < BVH_SAH_BINS; b++)
+		{
+			bins[b] = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX), 0 };
+		}
+
+		float scale = BVH_SAH_BINS / centroidExtent[axis];
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t primitive = m_primitiveIndices[i];
+			int b = std::min<int>(BVH_SAH_BINS - 1, (int)((m_centroids[primitive][axis] - centroidMin[axis]) * scale));
+
+			bins[b].boundsMin = glm::min(bins[b].boundsMin, m_primitiveMins[primitive]);
+			bins[b].boundsMax = glm::max(bins[b].boundsMax, m_primitiveMaxs[primitive]);
+			bins[b].count++;
+		}
+
+		// Sweep from the right to get the area and count of everything past each boundary
+		float rightArea[BVH_SAH_BINS];
+		uint32_t rightCount[BVH_SAH_BINS];
+		glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+		uint32_t sweepCount = 0;
+		for (int b = BVH_SAH_BINS - 1; b > 0; b--)
+		{
+			sweepMin = glm::min(sweepMin, bins[b].boundsMin);
+			sweepMax = glm::max(sweepMax, bins[b].boundsMax);
+			sweepCount += bins[b].count;
+			rightArea[b] = surfaceArea(sweepMin, sweepMax);
+			rightCount[b] = sweepCount;
+		}
+
+		sweepMin = glm::vec3(FLT_MAX);
+		sweepMax = glm::vec3(-FLT_MAX);
+		sweepCount = 0;
+		for (int b = 0; b < BVH_SAH_BINS - 1; b++)
+		{
+			sweepMin = glm::min(sweepMin, bins[b].boundsMin);
+			sweepMax = glm::max(sweepMax, bins[b].boundsMax);
+			sweepCount += bins[b].count;
+
+			if (sweepCount == 0 || rightCount[b + 1] == 0)
+			{
+				continue;
+			}
+
+			float cost = surfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[b + 1] * rightCount[b + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b + 1;
+			}
+		}
+	}
+
+	uint32_t middle;
+
+	if (bestAxis >= 0)
+	{
+		float leafCost = (float)count;
+		float splitCost = BVH_TRAVERSAL_COST + bestCost / surfaceArea(boundsMin, boundsMax);
+
+		if (splitCost >= leafCost && count <= BVH_MAX_LEAF_SIZE)
+		{
+			return;
+		}
+
+		float scale = BVH_SAH_BINS / centroidExtent[bestAxis];
+		float axisMin = centroidMin[bestAxis];
+		const std::vector<glm::vec3> & centroids = m_centroids;
+
+		uint32_t * split = std::partition(m_primitiveIndices.data() + begin, m_primitiveIndices.data() + end, [&](uint32_t primitive)
+		{
+			return std::min<int>(BVH_SAH_BINS - 1, (int)((centroids[primitive][bestAxis] - axisMin) * scale)) < bestSplit;
+		});
+
+		middle = (uint32_t)(split - m_primitiveIndices.data());
+	}
+	else
+	{
+		// Every centroid in the same spot, nothing to gain from any split beyond keeping leaves small
+		if (count <= BVH_MAX_LEAF_SIZE)
+		{
+			return;
+		}
+
+		bestAxis = 0;
+		middle = begin + count / 2;
+	}
+
+	if (depth + 1 >= BVH_STACK_SIZE)
+	{
+		throw std::runtime_error("BVH is too deep for the traversal stack!");
+	}
+
+	uint32_t left = m_uiNodeCount.fetch_add(2, std::memory_order_relaxed);
+
+	node.firstIndex = left;
+	node.primitiveCount = 0;
+	node.splitAxis = (uint16_t)bestAxis;
+
+	if (count >= BVH_PARALLEL_MIN_PRIMITIVES)
+	{
+		JobSystem & jobSystem = JobSystem::getInstance();
+		JobCounter counter;
+
+		jobSystem.run([this, left, middle, end, depth]()
+		{
+			this->buildNode(left + 1, middle, end, depth + 1);
+		}, &counter);
+
+		this->buildNode(left, begin, middle, depth + 1);
+		jobSystem.wait(counter);
+	}
+	else
+	{
+		this->buildNode(left, begin, middle, depth + 1);
+		this->buildNode(left + 1, middle, end, depth + 1);
+	}
+}
+
+void BoundingVolumeHierarchy::refit()
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	// Enough subtrees to go round every thread a few times
+	unsigned parallelDepth = 2;
+	for (unsigned threads = JobSystem::getInstance().getThreadCount(); threads > 1; threads >>= 1)
+	{
+		parallelDepth++;
+	}
+
+	this->refitNode(0, 0, m_primitiveMins.size() >= BVH_PARALLEL_MIN_PRIMITIVES ? parallelDepth : 0);
+}
+
+void BoundingVolumeHierarchy::refitNode(uint32_t nodeIndex, unsigned depth, unsigned parallelDepth)
+{
+	BVHNode & node = m_nodes[nodeIndex];
+
+	if (node.isLeaf())
+	{
+		this->updateLeafBounds(node);
+		return;
+	}
+
+	uint32_t left = node.firstIndex;
+
+	if (depth < parallelDepth)
+	{
+		JobSystem & jobSystem = JobSystem::getInstance();
+		JobCounter counter;
+
+		jobSystem.run([this, left, depth, parallelDepth]()
+		{
+			this->refitNode(left + 1, depth + 1, parallelDepth);
+		}, &counter);
+
+		this->refitNode(left, depth + 1, parallelDepth);
+		jobSystem.wait(counter);
+	}
+	else
+	{
+		this->refitNode(left, depth + 1, parallelDepth);
+		this->refitNode(left + 1, depth + 1, parallelDepth);
+	}
+
+	node.boundsMin = glm::min(m_nodes[left].boundsMin, m_nodes[left + 1].boundsMin);
+	node.boundsMax = glm::max(m_nodes[left].boundsMax, m_nodes[left + 1].boundsMax);
+}
+
+void BoundingVolumeHierarchy::updateLeafBounds(BVHNode & node) const
+{
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+
+	for (uint32_t i = node.firstIndex; i < node.firstIndex + node.primitiveCount; i++)
+	{
+		uint32_t primitive = m_primitiveIndices[i];
+		boundsMin = glm::min(boundsMin, m_primitiveMins[primitive]);
+		boundsMax = glm::max(boundsMax, m_primitiveMaxs[primitive]);
+	}
+
+	node.boundsMin = boundsMin;
+	node.boundsMax = boundsMax;
+}
+
+void BoundingVolumeHierarchy::intersectPrimitive(uint32_t primitive, const BVHRay & ray, const glm::vec3 & inverseDirection, BVHHit & hit) const
+{
+	if (m_triangles.empty())
+	{
+		float tEnter;
+		if (intersectBounds(m_primitiveMins[primitive], m_primitiveMaxs[primitive], ray.origin, inverseDirection, hit.distance, tEnter) && tEnter < hit.distance)
+		{
+			hit.distance = tEnter;
+			hit.primitive = primitive;
+		}
+		return;
+	}
+
+	// Moller-Trumbore, two sided
+	const Triangle & triangle = m_triangles[primitive];
+
+	glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+	float determinant = glm::dot(triangle.edge1, p);
+	if (std::fabs(determinant) < 1e-12f)
+	{
+		return;
+	}
+
+	float inverseDeterminant = 1.0f / determinant;
+	glm::vec3 s = ray.origin - triangle.v0;
+
+	float u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0.0f || u > 1.0f)
+	{
+		return;
+	}
+
+	glm::vec3 q = glm::cross(s, triangle.edge1);
+	float v = glm::dot(ray.direction, q) * inverseDeterminant;
+	if (v < 0.0f || u + v > 1.0f)
+	{
+		return;
+	}
+
+	float t = glm::dot(triangle.edge2, q) * inverseDeterminant;
+	if (t >= 0.0f && t < hit.distance)
+	{
+		hit.distance = t;
+		hit.primitive = primitive;
+		hit.barycentric = glm::vec2(u, v);
+	}
+}
+
+bool BoundingVolumeHierarchy::raycast(const BVHRay & ray, BVHHit & hit, float maxDistance) const
+{
+	hit = BVHHit();
+	hit.distance = maxDistance;
+
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inverseDirection = safeInverse(ray.direction);
+
+	float tEnter;
+	if (!intersectBounds(m_nodes[0].boundsMin, m_nodes[0].boundsMax, ray.origin, inverseDirection, hit.distance, tEnter))
+	{
+		return false;
+	}
+
+	uint32_t stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	uint32_t nodeIndex = 0;
+
+	while (true)
+	{
+		const BVHNode & node = m_nodes[nodeIndex];
+
+		if (node.isLeaf())
+		{
+			for (uint32_t i = node.firstIndex; i < node.firstIndex + node.primitiveCount; i++)
+			{
+				this->intersectPrimitive(m_primitiveIndices[i], ray, inverseDirection, hit);
+			}
+		}
+		else
+		{
+			// Nearer child first, the farther one waits on the stack and may get rejected by then
+			uint32_t nearChild = node.firstIndex;
+			uint32_t farChild = node.firstIndex + 1;
+
+			float tNear, tFar;
+			bool hitNear = intersectBounds(m_nodes[nearChild].boundsMin, m_nodes[nearChild].boundsMax, ray.origin, inverseDirection, hit.distance, tNear);
+			bool hitFar = intersectBounds(m_nodes[farChild].boundsMin, m_nodes[farChild].boundsMax, ray.origin, inverseDirection, hit.distance, tFar);
+
+			if (hitNear && hitFar)
+			{
+				if (tFar < tNear)
+				{
+					std::swap(nearChild, farChild);
+				}
+
+				stack[stackSize++] = farChild;
+				nodeIndex = nearChild;
+				continue;
+			}
+			if (hitNear || hitFar)
+			{
+				nodeIndex = hitNear ? nearChild : farChild;
+				continue;
+			}
+		}
+
+		// Pop the next node that can still beat the closest hit
+		bool found = false;
+		while (stackSize > 0)
+		{
+			nodeIndex = stack[--stackSize];
+			if (intersectBounds(m_nodes[nodeIndex].boundsMin, m_nodes[nodeIndex].boundsMax, ray.origin, inverseDirection, hit.distance, tEnter))
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			break;
+		}
+	}
+
+	return hit.isHit();
+}
+
+bool BoundingVolumeHierarchy::raycastAny(const BVHRay & ray, float maxDistance) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inverseDirection = safeInverse(ray.direction);
+
+	BVHHit hit;
+	hit.distance = maxDistance;
+
+	uint32_t stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BVHNode & node = m_nodes[stack[--stackSize]];
+
+		float tEnter;
+		if (!intersectBounds(node.boundsMin, node.boundsMax, ray.origin, inverseDirection, maxDistance, tEnter))
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			for (uint32_t i = node.firstIndex; i < node.firstIndex + node.primitiveCount; i++)
+			{
+				this->intersectPrimitive(m_primitiveIndices[i], ray, inverseDirection, hit);
+				if (hit.isHit())
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			// Order doesn't matter for an any hit query, the split axis sign still tends to find blockers sooner
+			bool leftFirst = ray.direction[node.splitAxis] >= 0.0f;
+			stack[stackSize++] = node.firstIndex + (leftFirst ? 1 : 0);
+			stack[stackSize++] = node.firstIndex + (leftFirst ? 0 : 1);
+		}
+	}
+
+	return false;
+}
+
+void BoundingVolumeHierarchy::raycastPacketScalar(const BVHRay * rays, size_t count, BVHHit * hits, float maxDistance) const
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		this->raycast(rays[i], hits[i], maxDistance);
+	}
+}
+
+void BoundingVolumeHierarchy::raycastPacket(const BVHRay * rays, size_t count, BVHHit * hits, float maxDistance) const
+{
+	if (count > BVH_PACKET_SIZE)
+	{
+		throw std::runtime_error("Ray packet is larger than BVH_PACKET_SIZE!");
+	}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	glm::vec3 inverseDirections[BVH_PACKET_SIZE];
+	float origins[3][BVH_PACKET_SIZE] = {};
+	float inverses[3][BVH_PACKET_SIZE] = {};
+	float closest[BVH_PACKET_SIZE];
+
+	for (size_t i = 0; i < BVH_PACKET_SIZE; i++)
+	{
+		closest[i] = -1.0f; // Unused lanes never pass the slab test
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		hits[i] = BVHHit();
+		hits[i].distance = maxDistance;
+		closest[i] = maxDistance;
+
+		inverseDirections[i] = safeInverse(rays[i].direction);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			origins[axis][i] = rays[i].origin[axis];
+			inverses[axis][i] = inverseDirections[i][axis];
+		}
+	}
+
+	if (m_nodes.empty() || count == 0)
+	{
+		return;
+	}
+
+	const __m128 originX = _mm_loadu_ps(origins[0]);
+	const __m128 originY = _mm_loadu_ps(origins[1]);
+	const __m128 originZ = _mm_loadu_ps(origins[2]);
+	const __m128 inverseX = _mm_loadu_ps(inverses[0]);
+	const __m128 inverseY = _mm_loadu_ps(inverses[1]);
+	const __m128 inverseZ = _mm_loadu_ps(inverses[2]);
+	const __m128 zero = _mm_setzero_ps();
+
+	uint32_t stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BVHNode & node = m_nodes[stack[--stackSize]];
+
+		// Slab test for all four rays at once against this node
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), originX), inverseX);
+		__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), originX), inverseX);
+		__m128 tEnter = _mm_max_ps(_mm_min_ps(t1, t2), zero);
+		__m128 tExit = _mm_min_ps(_mm_max_ps(t1, t2), _mm_loadu_ps(closest));
+
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), originY), inverseY);
+		t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), originY), inverseY);
+		tEnter = _mm_max_ps(tEnter, _mm_min_ps(t1, t2));
+		tExit = _mm_min_ps(tExit, _mm_max_ps(t1, t2));
+
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), originZ), inverseZ);
+		t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), originZ), inverseZ);
+		tEnter = _mm_max_ps(tEnter, _mm_min_ps(t1, t2));
+		tExit = _mm_min_ps(tExit, _mm_max_ps(t1, t2));
+
+		int mask = _mm_movemask_ps(_mm_cmple_ps(tEnter, tExit));
+		if (mask == 0)
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			for (size_t lane = 0; lane < count; lane++)
+			{
+				if (!(mask & (1 << lane)))
+				{
+					continue;
+				}
+
+				for (uint32_t i = node.firstIndex; i < node.firstIndex + node.primitiveCount; i++)
+				{
+					this->intersectPrimitive(m_primitiveIndices[i], rays[lane], inverseDirections[lane], hits[lane]);
+				}
+
+				closest[lane] = hits[lane].distance;
+			}
+		}
+		else
+		{
+			// The packet follows the first ray's direction, coherent packets all agree anyway
+			bool leftFirst = rays[0].direction[node.splitAxis] >= 0.0f;
+			stack[stackSize++] = node.firstIndex + (leftFirst ? 1 : 0);
+			stack[stackSize++] = node.firstIndex + (leftFirst ? 0 : 1);
+		}
+	}
+#else
+	this->raycastPacketScalar(rays, count, hits, maxDistance);
+#endif
+}
+
+void BoundingVolumeHierarchy::raycastBatch(const BVHRay * rays, size_t count, BVHHit * hits, float maxDistance) const
+{
+	size_t packetCount = (count + BVH_PACKET_SIZE - 1) / BVH_PACKET_SIZE;
+
+	JobSystem::getInstance().parallelFor(0, packetCount, 64, [&](size_t begin, size_t end)
+	{
+		for (size_t packet = begin; packet < end; packet++)
+		{
+			size_t first = packet * BVH_PACKET_SIZE;
+			this->raycastPacket(rays + first, std::min<size_t>(BVH_PACKET_SIZE, count - first), hits + first, maxDistance);
+		}
+	});
+}
+
+template <typename NodeTest, typename PrimitiveTest>
+size_t BoundingVolumeHierarchy::query(const NodeTest & nodeTest, const PrimitiveTest & primitiveTest, std::vector<uint32_t> & results) const
+{
+	if (m_nodes.empty())
+	{
+		return 0;
+	}
+
+	size_t startSize = results.size();
+
+	// Low bit marks subtrees that are already known to be fully inside
+	uint32_t stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		uint32_t entry = stack[--stackSize];
+		const BVHNode & node = m_nodes[entry >> 1];
+
+		bool inside = (entry & 1) != 0;
+		if (!inside)
+		{
+			int classification = nodeTest(node.boundsMin, node.boundsMax);
+			if (classification == BOUNDS_OUTSIDE)
+			{
+				continue;
+			}
+
+			inside = classification == BOUNDS_INSIDE;
+		}
+
+		if (node.isLeaf())
+		{
+			for (uint32_t i = node.firstIndex; i < node.firstIndex + node.primitiveCount; i++)
+			{
+				uint32_t primitive = m_primitiveIndices[i];
+				if (inside || primitiveTest(m_primitiveMins[primitive], m_primitiveMaxs[primitive]))
+				{
+					results.push_back(primitive);
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = ((node.firstIndex + 1) << 1) | (inside ? 1 : 0);
+			stack[stackSize++] = (node.firstIndex << 1) | (inside ? 1 : 0);
+		}
+	}
+
+	return results.size() - startSize;
+}
+
+size_t BoundingVolumeHierarchy::queryBox(const glm::vec3 & min, const glm::vec3 & max, std::vector<uint32_t> & results) const
+{
+	auto overlaps = [&](const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+	{
+		return glm::all(glm::lessThanEqual(boundsMin, max)) && glm::all(glm::lessThanEqual(min, boundsMax));
+	};
+
+	return this->query([&](const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+	{
+		if (!overlaps(boundsMin, boundsMax))
+		{
+			return (int)BOUNDS_OUTSIDE;
+		}
+
+		bool contained = glm::all(glm::lessThanEqual(min, boundsMin)) && glm::all(glm::lessThanEqual(boundsMax, max));
+		return (int)(contained ? BOUNDS_INSIDE : BOUNDS_INTERSECTING);
+	}, overlaps, results);
+}
+
+size_t BoundingVolumeHierarchy::querySphere(const glm::vec3 & center, float radius, std::vector<uint32_t> & results) const
+{
+	float radiusSquared = radius * radius;
+
+	auto touches = [&](const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+	{
+		return distanceSquaredToBox(center, boundsMin, boundsMax) <= radiusSquared;
+	};
+
+	return this->query([&](const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+	{
+		if (!touches(boundsMin, boundsMax))
+		{
+			return (int)BOUNDS_OUTSIDE;
+		}
+
+		// Inside once the corner furthest from the center is
+		glm::vec3 farthest = glm::max(glm::abs(boundsMin - center), glm::abs(boundsMax - center));
+		return (int)(glm::dot(farthest, farthest) <= radiusSquared ? BOUNDS_INSIDE : BOUNDS_INTERSECTING);
+	}, touches, results);
+}
+
+size_t BoundingVolumeHierarchy::queryFrustum(const Frustum & frustum, std::vector<uint32_t> & results) const
+{
+	return this->query([&](const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+	{
+		return classifyBoxAgainstFrustum(frustum, boundsMin, boundsMax);
+	}, [&](const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+	{
+		return classifyBoxAgainstFrustum(frustum, boundsMin, boundsMax) != BOUNDS_OUTSIDE;
+	}, results);
+}
@@ -0,0 +1,132 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include "Culling.h"
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec2.hpp>
+#include <vec3.hpp>
+
+#include <vector>
+#include <atomic>
+#include <cfloat>
+#include <stdint.h>
+
+#define BVH_SAH_BINS 16 // Centroid bins per axis when looking for a split
+#define BVH_MAX_LEAF_SIZE 8 // Leaves can hold more than this only when nothing can split them
+#define BVH_TRAVERSAL_COST 1.0f // Relative to one primitive test
+#define BVH_STACK_SIZE 64 // Traversal stack, deep enough for any tree the builder makes
+#define BVH_PARALLEL_MIN_PRIMITIVES 4096 // Subtrees smaller than this are built / refit on the current thread
+#define BVH_PACKET_SIZE 4 // Rays traced together by raycastPacket
+#define BVH_INVALID_PRIMITIVE 0xFFFFFFFFu
+#define BVH_MAX_DISTANCE FLT_MAX
+
+struct BVHRay
+{
+	glm::vec3 origin;
+	glm::vec3 direction; // Doesn't need to be normalized, distances come out in units of it
+};
+
+struct BVHHit
+{
+	float distance = 0.0f;
+	uint32_t primitive = BVH_INVALID_PRIMITIVE;
+	glm::vec2 barycentric = glm::vec2(0.0f); // Triangle hits only
+
+	bool isHit() const { return primitive != BVH_INVALID_PRIMITIVE; }
+};
+
+// 32 bytes, two to a cache line. Children of an interior node are always stored side by side.
+struct BVHNode
+{
+	glm::vec3 boundsMin;
+	uint32_t firstIndex; // Left child for interior nodes, first entry in the primitive index list for leaves
+	glm::vec3 boundsMax;
+	uint16_t primitiveCount; // 0 for interior nodes
+	uint16_t splitAxis;
+
+	bool isLeaf() const { return primitiveCount != 0; }
+};
+
+// Bounding volume hierarchy over either scene objects (one box per primitive) or triangles.
+// Built top down with binned SAH, the big subtrees in parallel on the job system.
+// Objects that move only need their box updated and the tree refit, which keeps the topology.
+// Ray casts against objects report where the ray enters their box; triangles are hit exactly.
+class BoundingVolumeHierarchy
+{
+public:
+	BoundingVolumeHierarchy();
+	virtual ~BoundingVolumeHierarchy();
+
+	BoundingVolumeHierarchy(const BoundingVolumeHierarchy &) = delete;
+	void operator=(const BoundingVolumeHierarchy &) = delete;
+
+	void buildFromBoxes(const glm::vec3 * mins, const glm::vec3 * maxs, size_t count);
+	void buildFromTriangles(const glm::vec3 * positions, const uint32_t * indices, size_t triangleCount);
+	void clear();
+
+	// Dynamic updates, call refit() once everything for the frame has moved
+	void setPrimitiveBounds(uint32_t primitive, const glm::vec3 & min, const glm::vec3 & max);
+	void setTriangle(uint32_t primitive, const glm::vec3 & v0, const glm::vec3 & v1, const glm::vec3 & v2);
+	void refit();
+
+	// Closest hit within maxDistance
+	bool raycast(const BVHRay & ray, BVHHit & hit, float maxDistance = BVH_MAX_DISTANCE) const;
+
+	// Any hit within maxDistance, for line of sight and shadow probes
+	bool raycastAny(const BVHRay & ray, float maxDistance = BVH_MAX_DISTANCE) const;
+
+	// Traces up to BVH_PACKET_SIZE rays down the tree together, works best when they start close and point the same way
+	void raycastPacket(const BVHRay * rays, size_t count, BVHHit * hits, float maxDistance = BVH_MAX_DISTANCE) const;
+
+	// Packets spread over the job system
+	void raycastBatch(const BVHRay * rays, size_t count, BVHHit * hits, float maxDistance = BVH_MAX_DISTANCE) const;
+
+	// Primitives whose bounds touch the region, appended to results, returns how many were added
+	size_t queryBox(const glm::vec3 & min, const glm::vec3 & max, std::vector<uint32_t> & results) const;
+	size_t querySphere(const glm::vec3 & center, float radius, std::vector<uint32_t> & results) const;
+	size_t queryFrustum(const Frustum & frustum, std::vector<uint32_t> & results) const;
+
+	size_t getPrimitiveCount() const { return m_primitiveMins.size(); }
+	size_t getNodeCount() const { return m_nodes.size(); }
+	size_t getDepth() const { return m_uiDepth; }
+	const BVHNode * getNodes() const { return m_nodes.data(); }
+
+private:
+	struct Triangle
+	{
+		glm::vec3 v0;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	void build();
+	void buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, unsigned depth);
+	void refitNode(uint32_t nodeIndex, unsigned depth, unsigned parallelDepth);
+	void updateLeafBounds(BVHNode & node) const;
+
+	void intersectPrimitive(uint32_t primitive, const BVHRay & ray, const glm::vec3 & inverseDirection, BVHHit & hit) const;
+
+	void raycastPacketScalar(const BVHRay * rays, size_t count, BVHHit * hits, float maxDistance) const;
+
+	// nodeTest returns one of the BOUNDS_ classifications, primitiveTest is only asked about primitives in partly covered leaves
+	template <typename NodeTest, typename PrimitiveTest>
+	size_t query(const NodeTest & nodeTest, const PrimitiveTest & primitiveTest, std::vector<uint32_t> & results) const;
+
+	std::vector<BVHNode> m_nodes;
+	std::vector<uint32_t> m_primitiveIndices; // Leaf order
+
+	// Primitive order
+	std::vector<glm::vec3> m_primitiveMins;
+	std::vector<glm::vec3> m_primitiveMaxs;
+	std::vector<glm::vec3> m_centroids; // Only used while building
+	std::vector<Triangle> m_triangles; // Empty for object trees
+
+	std::atomic<uint32_t> m_uiNodeCount;
+	std::atomic<unsigned> m_uiMaxDepth;
+	size_t m_uiDepth;
+};
+
+#endif
@@ -0,0 +1,862 @@
+#include "Benchmark.h"
+#include "Culling.h"
+#include "Transform.h"
+#include "Timer.h"
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+#include "DerivedDataCache.h"
+
+#include <geometric.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define BENCHMARK_RUNS 10 // Best of, so a stray context switch doesn't count
+#define BENCHMARK_CULL_TOLERANCE 1e-3 // Bounds this close to a plane may go either way in single precision
+#define BENCHMARK_TRANSFORM_TOLERANCE 1e-4f // Relative, the SIMD multiply adds in a different order
+#define BENCHMARK_TRANSFORM_ROOTS 1000
+#define BENCHMARK_IMPORT_FILENAME "benchmark_import.obj" // Written to the working directory and removed again
+#define BENCHMARK_IMPORT_CACHE "BenchmarkDerivedDataCache"
+#define BENCHMARK_ACMR_TOLERANCE 1e-4 // MeshCacheStats keeps the ratio as a float
+
+namespace
+{
+	// What the reference plane test decided for one bound, margin is the smallest distance past a
+	// plane, negative once it's outside
+	struct CullReference
+	{
+		std::vector<double> margin;
+		size_t visibleCount = 0;
+	};
+
+	CullReference referenceSpheres(const Frustum & frustum, const BoundingSphereArray & spheres)
+	{
+		CullReference reference;
+		reference.margin.resize(spheres.size());
+
+		for (size_t i = 0; i < spheres.size(); i++)
+		{
+			double margin = INFINITY;
+			for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+			{
+				const glm::vec4 & plane = frustum.planes[p];
+				double distance = (double)plane.x * spheres.centerX[i] + (double)plane.y * spheres.centerY[i] + (double)plane.z * spheres.centerZ[i] + plane.w;
+				margin = std::min(margin, distance + spheres.radius[i]);
+			}
+
+			reference.margin[i] = margin;
+			reference.visibleCount += margin >= 0.0 ? 1 : 0;
+		}
+
+		return reference;
+	}
+
+	CullReference referenceBoxes(const Frustum & frustum, const BoundingBoxArray & boxes)
+	{
+		CullReference reference;
+		reference.margin.resize(boxes.size());
+
+		for (size_t i = 0; i < boxes.size(); i++)
+		{
+			double margin = INFINITY;
+			for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+			{
+				// Of the eight corners only the one furthest along the normal decides
+				const glm::vec4 & plane = frustum.planes[p];
+				double furthest = -INFINITY;
+				for (int corner = 0; corner < 8; corner++)
+				{
+					double x = (double)boxes.centerX[i] + (corner & 1 ? boxes.extentX[i] : -boxes.extentX[i]);
+					double y = (double)boxes.centerY[i] + (corner & 2 ? boxes.extentY[i] : -boxes.extentY[i]);
+					double z = (double)boxes.centerZ[i] + (corner & 4 ? boxes.extentZ[i] : -boxes.extentZ[i]);
+					furthest = std::max(furthest, plane.x * x + plane.y * y + plane.z * z + plane.w);
+				}
+				margin = std::min(margin, furthest);
+			}
+
+			reference.margin[i] = margin;
+			reference.visibleCount += margin >= 0.0 ? 1 : 0;
+		}
+
+		return reference;
+	}
+
+	// Checks that visible holds the indices in [begin, end) the reference kept, in order. Bounds within
+	// the tolerance of a plane are counted as boundary cases rather than failures.
+	bool compare(const char * name, const CullReference & reference, size_t begin, size_t end, const uint32_t * visible, size_t visibleCount)
+	{
+		size_t mismatches = 0;
+		size_t boundary = 0;
+		size_t next = 0;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			if (next < visibleCount && visible[next] < i)
+			{
+				break; // Out of order or duplicated, caught below
+			}
+
+			bool kept = next < visibleCount && visible[next] == i;
+			next += kept ? 1 : 0;
+
+			if (kept != (reference.margin[i] >= 0.0))
+			{
+				if (std::fabs(reference.margin[i]) < BENCHMARK_CULL_TOLERANCE)
+				{
+					boundary++;
+				}
+				else
+				{
+					mismatches++;
+				}
+			}
+		}
+
+		if (next != visibleCount)
+		{
+			std::cout << "  " << name << ": FAILED, " << visibleCount - next << " indices out of order or out of range" << std::endl;
+			return false;
+		}
+
+		if (mismatches > 0)
+		{
+			std::cout << "  " << name << ": FAILED, " << mismatches << " bounds disagree with the reference" << std::endl;
+			return false;
+		}
+
+		std::cout << "  " << name << ": matches the reference (" << boundary << " boundary cases)" << std::endl;
+		return true;
+	}
+
+	template <typename Function>
+	double bestOf(const Function & function)
+	{
+		double best = INFINITY;
+		for (int run = 0; run < BENCHMARK_RUNS; run++)
+		{
+			Timer timer;
+			function();
+			best = std::min(best, timer.getElapsedSeconds());
+		}
+
+		return best;
+	}
+
+	void report(const char * name, size_t count, double seconds)
+	{
+		std::cout << "  " << name << ": " << seconds * 1000.0 << " ms, " << count / seconds / 1000000.0 << " Mbounds/s" << std::endl;
+	}
+
+	// Every path over the whole array, then the single threaded kernels over a range that doesn't
+	// start or end on a SIMD boundary so the scalar tails get checked as well
+	template <typename Kernel, typename Parallel>
+	bool cullAll(const char * kind, size_t count, const CullReference & reference, const Kernel & kernel, const Parallel & parallel)
+	{
+		std::cout << kind << ": " << count << " bounds, " << reference.visibleCount << " visible" << std::endl;
+
+		std::vector<uint32_t> visible(count);
+		std::vector<uint32_t> parallelVisible;
+		bool passed = true;
+
+		size_t begin = std::min<size_t>(3, count);
+		size_t end = std::max(begin, count - std::min<size_t>(5, count));
+
+		passed &= compare("scalar", reference, 0, count, visible.data(), kernel(0, count, visible.data(), CULL_PATH_SCALAR));
+		passed &= compare("scalar, unaligned range", reference, begin, end, visible.data(), kernel(begin, end, visible.data(), CULL_PATH_SCALAR));
+		passed &= compare("simd", reference, 0, count, visible.data(), kernel(0, count, visible.data(), CULL_PATH_SIMD));
+		passed &= compare("simd, unaligned range", reference, begin, end, visible.data(), kernel(begin, end, visible.data(), CULL_PATH_SIMD));
+		parallel(parallelVisible, CULL_PATH_SCALAR);
+		passed &= compare("scalar, job system", reference, 0, count, parallelVisible.data(), parallelVisible.size());
+		parallel(parallelVisible, CULL_PATH_SIMD);
+		passed &= compare("simd, job system", reference, 0, count, parallelVisible.data(), parallelVisible.size());
+
+		report("scalar", count, bestOf([&]() { kernel(0, count, visible.data(), CULL_PATH_SCALAR); }));
+		report("simd", count, bestOf([&]() { kernel(0, count, visible.data(), CULL_PATH_SIMD); }));
+		report("scalar, job system", count, bestOf([&]() { parallel(parallelVisible, CULL_PATH_SCALAR); }));
+		report("simd, job system", count, bestOf([&]() { parallel(parallelVisible, CULL_PATH_SIMD); }));
+
+		return passed;
+	}
+
+	// Parents are always created before their children, so handle order is an update order too
+	void referenceWorlds(const TransformHierarchy & transforms, const std::vector<TransformHandle> & parents, std::vector<glm::mat4> & worlds)
+	{
+		worlds.resize(parents.size());
+
+		for (size_t i = 0; i < parents.size(); i++)
+		{
+			TransformHandle node = (TransformHandle)i;
+			glm::mat4 local = glm::translate(glm::mat4(1.0f), transforms.getLocalPosition(node)) * glm::mat4_cast(transforms.getLocalRotation(node)) *
+				glm::scale(glm::mat4(1.0f), transforms.getLocalScale(node));
+			worlds[i] = parents[i] != INVALID_TRANSFORM ? worlds[parents[i]] * local : local;
+		}
+	}
+
+	bool compareWorlds(const char * name, const TransformHierarchy & transforms, const std::vector<TransformHandle> & parents)
+	{
+		std::vector<glm::mat4> worlds;
+		referenceWorlds(transforms, parents, worlds);
+
+		size_t mismatches = 0;
+		float worst = 0.0f;
+
+		for (size_t i = 0; i < worlds.size(); i++)
+		{
+			const glm::mat4 & world = transforms.getWorldMatrix((TransformHandle)i);
+			for (int column = 0; column < 4; column++)
+			{
+				for (int row = 0; row < 4; row++)
+				{
+					float error = std::fabs(world[column][row] - worlds[i][column][row]) / (1.0f + std::fabs(worlds[i][column][row]));
+					worst = std::max(worst, error);
+					mismatches += error > BENCHMARK_TRANSFORM_TOLERANCE ? 1 : 0;
+				}
+			}
+		}
+
+		if (mismatches > 0)
+		{
+			std::cout << "  " << name << ": FAILED, " << mismatches << " matrix elements disagree with the reference" << std::endl;
+			return false;
+		}
+
+		std::cout << "  " << name << ": matches the reference (worst relative error " << worst << ")" << std::endl;
+		return true;
+	}
+
+	// The nodes whose world matrix the last update should have recomputed, the moved ones and everything below them
+	bool compareChanged(const char * name, const TransformHierarchy & transforms, const std::vector<TransformHandle> & parents, const std::vector<uint8_t> & moved)
+	{
+		std::vector<uint8_t> changed(moved);
+		size_t mismatches = 0;
+
+		for (size_t i = 0; i < parents.size(); i++)
+		{
+			changed[i] |= parents[i] != INVALID_TRANSFORM ? changed[parents[i]] : 0;
+			mismatches += transforms.hasWorldChanged((TransformHandle)i) != (changed[i] != 0) ? 1 : 0;
+		}
+
+		if (mismatches > 0)
+		{
+			std::cout << "  " << name << ": FAILED, " << mismatches << " nodes recomputed when they shouldn't be or the other way round" << std::endl;
+			return false;
+		}
+
+		std::cout << "  " << name << ": recomputed exactly the moved subtrees" << std::endl;
+		return true;
+	}
+
+	void reportFrames(const char * name, size_t recomputed, double best, double total, unsigned frames)
+	{
+		std::cout << "  " << name << ": " << recomputed << " recomputed, " << total / frames * 1000.0 << " ms per frame (best " << best * 1000.0 << " ms";
+		if (recomputed > 0)
+		{
+			std::cout << ", " << recomputed / best / 1000000.0 << " Mnodes/s";
+		}
+		std::cout << ")" << std::endl;
+	}
+
+	// A grid of quads with every face form the importer reads: v/vt/vn quads with absolute and with
+	// negative indices, v//vn triangles and v/vt quads. The comment makes every run a new source,
+	// so the first load can't be a hit left behind by an earlier run.
+	std::string generateObj(size_t triangles, std::mt19937 & random)
+	{
+		size_t side = std::max<size_t>(1, (size_t)std::ceil(std::sqrt(triangles / 2.0)));
+		size_t rowLength = side + 1;
+		size_t vertexCount = rowLength * rowLength;
+
+		std::uniform_real_distribution<float> height(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> tilt(-0.2f, 0.2f);
+
+		std::string text = "# Benchmark::import " + std::to_string(Timer::getTimestampNs()) + "\n";
+		char line[256];
+
+		for (size_t y = 0; y < rowLength; y++)
+		{
+			for (size_t x = 0; x < rowLength; x++)
+			{
+				snprintf(line, sizeof(line), "v %.4f %.5f %.4f\nvt %.6f %.6f\nvn %.4f 1.0 %.4f\n", x * 0.01f, height(random), y * 0.01f,
+					(float)x / side, (float)y / side, tilt(random), tilt(random));
+				text += line;
+			}
+		}
+
+		for (size_t y = 0; y < side; y++)
+		{
+			for (size_t x = 0; x < side; x++)
+			{
+				// One based, counter clockwise seen from above
+				long long a = (long long)(y * rowLength + x + 1);
+				long long b = a + 1;
+				long long c = b + (long long)rowLength;
+				long long d = a + (long long)rowLength;
+
+				switch ((y * side + x) % 4)
+				{
+				case 0:
+					snprintf(line, sizeof(line), "f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n", a, a, a, b, b, b, c, c, c, d, d, d);
+					break;
+				case 1:
+					a -= (long long)vertexCount + 1;
+					b -= (long long)vertexCount + 1;
+					c -= (long long)vertexCount + 1;
+					d -= (long long)vertexCount + 1;
+					snprintf(line, sizeof(line), "f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n", a, a, a, b, b, b, c, c, c, d, d, d);
+					break;
+				case 2:
+					snprintf(line, sizeof(line), "f %lld//%lld %lld//%lld %lld//%lld\nf %lld//%lld %lld//%lld %lld//%lld\n", a, a, b, b, c, c, a, a, c, c, d, d);
+					break;
+				default:
+					snprintf(line, sizeof(line), "f %lld/%lld %lld/%lld %lld/%lld %lld/%lld\n", a, a, b, b, c, c, d, d);
+					break;
+				}
+				text += line;
+			}
+		}
+
+		return text;
+	}
+
+	// The importer without any of the speed: istream parsing, std::map deduplication by value
+	void referenceImport(const std::string & text, MeshData & mesh)
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		std::map<std::string, uint32_t> unique;
+		std::vector<uint32_t> indices;
+
+		auto resolve = [](const std::string & token, size_t count)
+		{
+			long long index = std::stoll(token);
+			return (size_t)(index > 0 ? index - 1 : (long long)count + index);
+		};
+
+		mesh.clear();
+
+		std::istringstream stream(text);
+		std::string line;
+
+		while (std::getline(stream, line))
+		{
+			std::istringstream fields(line);
+			std::string type;
+			fields >> type;
+
+			double x = 0.0, y = 0.0, z = 0.0;
+
+			if (type == "v")
+			{
+				fields >> x >> y >> z;
+				positions.push_back(glm::vec3((float)x, (float)y, (float)z));
+			}
+			else if (type == "vt")
+			{
+				fields >> x >> y;
+				uvs.push_back(glm::vec2((float)x, 1.0f - (float)y));
+			}
+			else if (type == "vn")
+			{
+				fields >> x >> y >> z;
+				normals.push_back(glm::vec3((float)x, (float)y, (float)z));
+			}
+			else if (type == "f")
+			{
+				std::vector<uint32_t> polygon;
+				std::string corner;
+
+				while (fields >> corner)
+				{
+					size_t firstSlash = corner.find('/');
+					size_t secondSlash = firstSlash != std::string::npos ? corner.find('/', firstSlash + 1) : std::string::npos;
+
+					std::string position = corner.substr(0, firstSlash);
+					std::string uv = firstSlash != std::string::npos ? corner.substr(firstSlash + 1, secondSlash - firstSlash - 1) : std::string();
+					std::string normal = secondSlash != std::string::npos ? corner.substr(secondSlash + 1) : std::string();
+
+					MeshVertex vertex;
+					vertex.position = positions.at(resolve(position, positions.size()));
+					vertex.uv = uv.empty() ? glm::vec2(0.0f) : uvs.at(resolve(uv, uvs.size()));
+					vertex.normal = normal.empty() ? glm::vec3(0.0f) : normals.at(resolve(normal, normals.size()));
+
+					std::string key(reinterpret_cast<const char *>(&vertex), sizeof(vertex));
+					auto inserted = unique.insert(std::make_pair(key, (uint32_t)mesh.vertices.size()));
+					if (inserted.second)
+					{
+						mesh.vertices.push_back(vertex);
+					}
+					polygon.push_back(inserted.first->second);
+				}
+
+				for (size_t i = 2; i < polygon.size(); i++)
+				{
+					indices.push_back(polygon[0]);
+					indices.push_back(polygon[i - 1]);
+					indices.push_back(polygon[i]);
+				}
+			}
+		}
+
+		mesh.setIndices(indices);
+		mesh.computeBounds();
+	}
+
+	bool compareMeshes(const char * name, const MeshData & mesh, const MeshData & reference, const char * referenceName)
+	{
+		bool same = mesh.indexType == reference.indexType && mesh.vertices.size() == reference.vertices.size() && mesh.indexData == reference.indexData &&
+			memcmp(mesh.vertices.data(), reference.vertices.data(), mesh.vertices.size() * sizeof(MeshVertex)) == 0 &&
+			mesh.boundsMin == reference.boundsMin && mesh.boundsMax == reference.boundsMax;
+
+		if (!same)
+		{
+			std::cout << "  " << name << ": FAILED, " << mesh.vertices.size() << " vertices and " << mesh.getTriangleCount() << " triangles, " << referenceName << " has " <<
+				reference.vertices.size() << " and " << reference.getTriangleCount() << " or they differ" << std::endl;
+			return false;
+		}
+
+		std::cout << "  " << name << ": identical to " << referenceName << std::endl;
+		return true;
+	}
+
+	// Every triangle by the values of its corners, rotated so the smallest corner comes first, which
+	// keeps the winding. Sorted, the list only depends on what is drawn and not in which order.
+	typedef std::array<MeshVertex, 3> MeshTriangle;
+
+	std::vector<MeshTriangle> sortedTriangles(const MeshData & mesh)
+	{
+		auto less = [](const MeshVertex & a, const MeshVertex & b) { return memcmp(&a, &b, sizeof(MeshVertex)) < 0; };
+
+		std::vector<MeshTriangle> triangles(mesh.getTriangleCount());
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			MeshTriangle triangle = { { mesh.vertices[mesh.getIndex(t * 3)], mesh.vertices[mesh.getIndex(t * 3 + 1)], mesh.vertices[mesh.getIndex(t * 3 + 2)] } };
+
+			size_t smallest = less(triangle[1], triangle[0]) ? 1 : 0;
+			smallest = less(triangle[2], triangle[smallest]) ? 2 : smallest;
+			std::rotate(triangle.begin(), triangle.begin() + smallest, triangle.end());
+
+			triangles[t] = triangle;
+		}
+
+		std::sort(triangles.begin(), triangles.end(), [](const MeshTriangle & a, const MeshTriangle & b)
+		{
+			return memcmp(a.data(), b.data(), sizeof(MeshTriangle)) < 0;
+		});
+
+		return triangles;
+	}
+
+	bool compareTriangles(const char * name, const MeshData & mesh, const MeshData & reference)
+	{
+		std::vector<MeshTriangle> triangles = sortedTriangles(mesh);
+		std::vector<MeshTriangle> referenceTriangles = sortedTriangles(reference);
+
+		if (triangles.size() != referenceTriangles.size() || memcmp(triangles.data(), referenceTriangles.data(), triangles.size() * sizeof(MeshTriangle)) != 0)
+		{
+			std::cout << "  " << name << ": FAILED, draws different triangles than the reference" << std::endl;
+			return false;
+		}
+
+		std::cout << "  " << name << ": draws the same " << triangles.size() << " triangles as the reference" << std::endl;
+		return true;
+	}
+
+	// Quads split into two triangles each, indexed row by row the way a naive exporter writes them
+	MeshData generateGrid(size_t triangles, std::mt19937 & random)
+	{
+		size_t side = std::max<size_t>(1, (size_t)std::ceil(std::sqrt(triangles / 2.0)));
+		size_t rowLength = side + 1;
+
+		std::uniform_real_distribution<float> height(-1.0f, 1.0f);
+
+		MeshData mesh;
+		for (size_t y = 0; y < rowLength; y++)
+		{
+			for (size_t x = 0; x < rowLength; x++)
+			{
+				MeshVertex vertex;
+				vertex.position = glm::vec3(x * 0.01f, height(random), y * 0.01f);
+				vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+				vertex.uv = glm::vec2((float)x / side, (float)y / side);
+				mesh.vertices.push_back(vertex);
+			}
+		}
+
+		std::vector<uint32_t> indices;
+		for (size_t y = 0; y < side; y++)
+		{
+			for (size_t x = 0; x < side; x++)
+			{
+				uint32_t a = (uint32_t)(y * rowLength + x);
+				uint32_t b = a + 1;
+				uint32_t c = b + (uint32_t)rowLength;
+				uint32_t d = a + (uint32_t)rowLength;
+
+				uint32_t quad[6] = { a, b, c, a, c, d };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+
+		mesh.setIndices(indices);
+		mesh.computeBounds();
+		return mesh;
+	}
+
+	// The same triangles with the vertices renumbered, the triangles in random order and each one
+	// starting from a random corner, about the worst order there is for the vertex cache
+	MeshData shuffleMesh(const MeshData & mesh, std::mt19937 & random)
+	{
+		std::vector<uint32_t> remap(mesh.vertices.size());
+		for (size_t v = 0; v < remap.size(); v++)
+		{
+			remap[v] = (uint32_t)v;
+		}
+		std::shuffle(remap.begin(), remap.end(), random);
+
+		MeshData shuffled;
+		shuffled.vertices.resize(mesh.vertices.size());
+		for (size_t v = 0; v < remap.size(); v++)
+		{
+			shuffled.vertices[remap[v]] = mesh.vertices[v];
+		}
+
+		std::vector<size_t> order(mesh.getTriangleCount());
+		for (size_t t = 0; t < order.size(); t++)
+		{
+			order[t] = t;
+		}
+		std::shuffle(order.begin(), order.end(), random);
+
+		std::vector<uint32_t> indices;
+		for (size_t t : order)
+		{
+			size_t first = random() % 3;
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				indices.push_back(remap[mesh.getIndex(t * 3 + (first + corner) % 3)]);
+			}
+		}
+
+		shuffled.setIndices(indices);
+		shuffled.computeBounds();
+		return shuffled;
+	}
+
+	// Vertices transformed per triangle through a FIFO cache of MESH_VERTEX_CACHE_SIZE entries
+	double referenceAcmr(const MeshData & mesh)
+	{
+		std::deque<uint32_t> cache;
+		size_t misses = 0;
+
+		for (size_t i = 0; i < mesh.indexCount; i++)
+		{
+			uint32_t index = mesh.getIndex(i);
+			if (std::find(cache.begin(), cache.end(), index) == cache.end())
+			{
+				misses++;
+				cache.push_back(index);
+				if (cache.size() > MESH_VERTEX_CACHE_SIZE)
+				{
+					cache.pop_front();
+				}
+			}
+		}
+
+		return mesh.getTriangleCount() > 0 ? (double)misses / mesh.getTriangleCount() : 0.0;
+	}
+
+	bool optimizeMesh(const char * name, const MeshData & mesh)
+	{
+		std::cout << name << ": " << mesh.getTriangleCount() << " triangles, " << mesh.vertices.size() << " vertices" << std::endl;
+
+		MeshData optimized = mesh;
+		Timer timer;
+		MeshOptimizeReport report = MeshOptimizer::optimize(optimized);
+		double optimizeTime = timer.getElapsedSeconds();
+
+		bool passed = compareTriangles("optimized", optimized, mesh);
+
+		double before = referenceAcmr(mesh);
+		double after = referenceAcmr(optimized);
+
+		if (std::fabs(report.before.acmr - before) > BENCHMARK_ACMR_TOLERANCE || std::fabs(report.after.acmr - after) > BENCHMARK_ACMR_TOLERANCE)
+		{
+			std::cout << "  analysis: FAILED, reported ACMR " << report.before.acmr << " -> " << report.after.acmr << ", the reference FIFO gives " <<
+				before << " -> " << after << std::endl;
+			passed = false;
+		}
+
+		if (after >= before)
+		{
+			std::cout << "  ACMR: FAILED, " << before << " -> " << after << " is no improvement" << std::endl;
+			passed = false;
+		}
+		else
+		{
+			std::cout << "  ACMR: " << before << " -> " << after << std::endl;
+		}
+
+		std::cout << "  " << report.toString() << std::endl;
+		std::cout << "  optimize: " << optimizeTime * 1000.0 << " ms, " << mesh.getTriangleCount() / optimizeTime / 1000000.0 << " Mtriangles/s" << std::endl;
+
+		return passed;
+	}
+}
+
+bool Benchmark::culling(size_t count)
+{
+	// Fixed seed, so every run culls the same scene
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> size(0.1f, 5.0f);
+
+	BoundingSphereArray spheres;
+	BoundingBoxArray boxes;
+	spheres.reserve(count);
+	boxes.reserve(count);
+
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 20.0f, 50.0f), glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+
+	FrustumCuller culler;
+	culler.setFrustum(projection * view);
+	const Frustum & frustum = culler.getFrustum();
+
+	// Scattered at random hardly any bound ends up touching a plane, so every 16th one gets moved
+	// until it just touches one, give or take a hundredth
+	std::uniform_int_distribution<int> plane(0, FRUSTUM_PLANE_COUNT - 1);
+	std::uniform_real_distribution<float> touch(-0.01f, 0.01f);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 center(position(random), position(random), position(random));
+		float radius = size(random);
+		glm::vec3 extent(size(random), size(random), size(random));
+
+		if (i % 16 == 0)
+		{
+			glm::vec4 touched = frustum.planes[plane(random)];
+			glm::vec3 normal(touched);
+			float offset = touch(random);
+			float distance = glm::dot(normal, center) + touched.w;
+
+			glm::vec3 sphereCenter = center - normal * (distance + radius + offset);
+			spheres.add(sphereCenter, radius);
+
+			glm::vec3 boxCenter = center - normal * (distance + glm::dot(glm::abs(normal), extent) + offset);
+			boxes.add(boxCenter - extent, boxCenter + extent);
+		}
+		else
+		{
+			spheres.add(center, radius);
+			boxes.add(center - extent, center + extent);
+		}
+	}
+
+	bool passed = true;
+
+	passed &= cullAll("Spheres", count, referenceSpheres(frustum, spheres),
+		[&](size_t begin, size_t end, uint32_t * out, CULL_PATH path) { return FrustumCuller::cullSpheres(frustum, spheres, begin, end, out, path); },
+		[&](std::vector<uint32_t> & visible, CULL_PATH path) { culler.setPath(path); culler.cullSpheres(spheres, visible); });
+
+	passed &= cullAll("Boxes", count, referenceBoxes(frustum, boxes),
+		[&](size_t begin, size_t end, uint32_t * out, CULL_PATH path) { return FrustumCuller::cullBoxes(frustum, boxes, begin, end, out, path); },
+		[&](std::vector<uint32_t> & visible, CULL_PATH path) { culler.setPath(path); culler.cullBoxes(boxes, visible); });
+
+	std::cout << (passed ? "Culling matches the reference" : "Culling DOES NOT match the reference") << std::endl;
+
+	return passed;
+}
+
+bool Benchmark::transforms(size_t nodeCount, unsigned frames)
+{
+	frames = std::max(frames, 1u);
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> scale(0.9f, 1.1f);
+
+	auto randomRotation = [&]()
+	{
+		glm::quat rotation(component(random), component(random), component(random), component(random));
+		float length = glm::length(rotation);
+		return length > 0.001f ? rotation / length : glm::quat();
+	};
+
+	// A forest of a thousand roots where every other node hangs off one between a quarter and half
+	// its own index, which comes out at about ten levels for a million nodes
+	TransformHierarchy transforms;
+	std::vector<TransformHandle> parents(nodeCount);
+
+	Timer timer;
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		parents[i] = i < BENCHMARK_TRANSFORM_ROOTS ? INVALID_TRANSFORM : (TransformHandle)(i / 4 + random() % (i / 2 - i / 4));
+		transforms.createNode(parents[i], glm::vec3(offset(random), offset(random), offset(random)), randomRotation(), glm::vec3(scale(random)));
+	}
+	double createTime = timer.lap();
+
+	transforms.update();
+	double firstUpdateTime = timer.lap();
+
+	std::cout << "Transforms: " << nodeCount << " nodes in " << transforms.getLevelCount() << " levels" << std::endl;
+	std::cout << "  create: " << createTime * 1000.0 << " ms, first update (sort and every matrix): " << firstUpdateTime * 1000.0 << " ms" << std::endl;
+
+	bool passed = compareWorlds("first update", transforms, parents);
+
+	// Timed frames, only update() counts, not moving the nodes
+	auto runFrames = [&](const char * name, const std::vector<TransformHandle> & moving)
+	{
+		double best = INFINITY;
+		double total = 0.0;
+
+		for (unsigned frame = 0; frame < frames; frame++)
+		{
+			for (TransformHandle node : moving)
+			{
+				transforms.setLocalRotation(node, randomRotation());
+			}
+
+			timer.reset();
+			transforms.update();
+			double elapsed = timer.getElapsedSeconds();
+
+			best = std::min(best, elapsed);
+			total += elapsed;
+		}
+
+		size_t recomputed = 0;
+		for (size_t i = 0; i < nodeCount; i++)
+		{
+			recomputed += transforms.hasWorldChanged((TransformHandle)i) ? 1 : 0;
+		}
+
+		reportFrames(name, recomputed, best, total, frames);
+	};
+
+	std::vector<TransformHandle> moving;
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		moving.push_back((TransformHandle)i);
+	}
+	runFrames("everything moving", moving);
+	passed &= compareWorlds("everything moving", transforms, parents);
+
+	moving.resize(std::min<size_t>(nodeCount, BENCHMARK_TRANSFORM_ROOTS));
+	runFrames("roots moving", moving);
+	passed &= compareWorlds("roots moving", transforms, parents);
+
+	// Random nodes anywhere in the tree, so only their subtrees are redone
+	std::vector<uint8_t> moved(nodeCount, 0);
+	moving.clear();
+	for (size_t i = 0; i < nodeCount / 100 && nodeCount > 0; i++)
+	{
+		moving.push_back((TransformHandle)(random() % nodeCount));
+		moved[moving.back()] = 1;
+	}
+	runFrames("a hundredth moving", moving);
+	passed &= compareWorlds("a hundredth moving", transforms, parents);
+	passed &= compareChanged("a hundredth moving", transforms, parents, moved);
+
+	moving.clear();
+	runFrames("nothing moving", moving);
+	passed &= compareChanged("nothing moving", transforms, parents, std::vector<uint8_t>(nodeCount, 0));
+
+	std::cout << (passed ? "Transforms match the reference" : "Transforms DO NOT match the reference") << std::endl;
+
+	return passed;
+}
+
+bool Benchmark::import(size_t triangles)
+{
+	std::mt19937 random(1234);
+	std::string text = generateObj(triangles, random);
+
+	{
+		std::ofstream file(BENCHMARK_IMPORT_FILENAME, std::ios::binary);
+		file.write(text.data(), text.size());
+		if (!file)
+		{
+			std::cout << "Import: couldn't write " << BENCHMARK_IMPORT_FILENAME << std::endl;
+			return false;
+		}
+	}
+
+	// Its own directory, so the game's cache never fills up with benchmark meshes
+	DerivedDataCache & cache = DerivedDataCache::getInstance();
+	cache.init(BENCHMARK_IMPORT_CACHE);
+
+	MeshData reference;
+	Timer timer;
+	referenceImport(text, reference);
+	double referenceTime = timer.lap();
+
+	std::cout << "Import: " << text.size() / (1024.0 * 1024.0) << " MB of OBJ, " << reference.getTriangleCount() << " triangles, " <<
+		reference.vertices.size() << " unique vertices" << std::endl;
+
+	MeshData imported;
+	double importTime = bestOf([&]() { MeshImporter::importObj(BENCHMARK_IMPORT_FILENAME, imported); });
+
+	bool passed = compareMeshes("parse and dedup", imported, reference, "the reference");
+
+	// Misses, so this imports, optimizes and publishes the result
+	MeshData cold;
+	timer.reset();
+	MeshImporter::load(BENCHMARK_IMPORT_FILENAME, cold);
+	double coldTime = timer.lap();
+
+	passed &= compareTriangles("cold load", cold, reference);
+
+	DerivedDataStats before = cache.getStats();
+	MeshData warm;
+	double warmTime = bestOf([&]() { MeshImporter::load(BENCHMARK_IMPORT_FILENAME, warm); });
+	DerivedDataStats after = cache.getStats();
+
+	if (after.hits - before.hits != BENCHMARK_RUNS)
+	{
+		std::cout << "  warm load: FAILED, " << after.hits - before.hits << " of " << BENCHMARK_RUNS << " loads came from the cache" << std::endl;
+		passed = false;
+	}
+	else
+	{
+		passed &= compareMeshes("warm load", warm, cold, "the cold load");
+	}
+
+	std::cout << "  reference: " << referenceTime * 1000.0 << " ms" << std::endl;
+	std::cout << "  parse and dedup: " << importTime * 1000.0 << " ms, " << text.size() / importTime / (1024.0 * 1024.0) << " MB/s" << std::endl;
+	std::cout << "  cold load (import, optimize, publish): " << coldTime * 1000.0 << " ms" << std::endl;
+	std::cout << "  warm load (derived data cache): " << warmTime * 1000.0 << " ms, " << coldTime / warmTime << "x faster" << std::endl;
+
+	std::remove(BENCHMARK_IMPORT_FILENAME);
+
+	std::cout << (passed ? "Import matches the reference" : "Import DOES NOT match the reference") << std::endl;
+
+	return passed;
+}
+
+bool Benchmark::optimizer(size_t triangles)
+{
+	std::mt19937 random(1234);
+	MeshData grid = generateGrid(triangles, random);
+
+	bool passed = true;
+	passed &= optimizeMesh("Grid", grid);
+	passed &= optimizeMesh("Shuffled grid", shuffleMesh(grid, random));
+
+	std::cout << (passed ? "Optimizer keeps the triangles and lowers ACMR" : "Optimizer DOES NOT keep the triangles or lower ACMR") << std::endl;
+
+	return passed;
+}
@@ -0,0 +1,27 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <stddef.h>
+
+// Measurements run from the command line instead of the game, see main.cpp. Each one prints its
+// timings and checks the optimized code against a plain reference, returning false on a mismatch.
+namespace Benchmark
+{
+	// Spheres and boxes scattered around a camera, culled by the scalar and SIMD kernels and the
+	// job system, every result compared with a double precision plane test
+	bool culling(size_t count);
+
+	// A random hierarchy of nodeCount transforms updated for frames frames with everything, the
+	// roots, a hundredth and nothing moving, world matrices compared with a node by node multiply
+	bool transforms(size_t nodeCount, unsigned frames);
+
+	// A generated OBJ of about triangles triangles imported cold and loaded back from the derived data
+	// cache, the import compared with a naive istream / std::map importer
+	bool import(size_t triangles);
+
+	// A grid of about triangles triangles in row order and shuffled, each optimized and checked to
+	// draw the same triangles with a lower ACMR than before
+	bool optimizer(size_t triangles);
+}
+
+#endif
@@ -3,6 +3,13 @@
 MVCController::MVCController(MVCModel * MVC_Model, MVCView * MVC_View)
 : MVC_Model(MVC_Model)
 , MVC_View(MVC_View)
+, m_uiPipelineDepth(DEFAULT_PIPELINE_DEPTH)
+, m_bStatsKeyHeld(false)
+, m_bReplayRealtime(true)
+, m_dFrameRateLimit(0.0)
+, m_bIdleEnabled(true)
+, m_bIdleFrameDrawn(false)
+, m_uiIdleEventId(0)
 {
 	std::cout << "Controller Created" << std::endl;
 }
@@ -27,11 +34,62 @@ void MVCController::RunLoop()
 		std::cout << "Failed to create Window" << std::endl;
 	}
 
+	if (!this->m_inputReplayFile.empty())
+	{
+		this->m_inputReplay.open(this->m_inputReplayFile);
+
+		// A different step would take a different path through the simulation
+		if (this->m_inputReplay.getTimestep() != SIMULATION_TIMESTEP)
+		{
+			throw std::runtime_error(this->m_inputReplayFile + " was recorded with a different simulation timestep!");
+		}
+
+		InputHandler::setLiveInputEnabled(false);
+
+		std::cout << "Replaying input from " << this->m_inputReplayFile << (this->m_bReplayRealtime ? " in real time" : " as fast as possible") << std::endl;
+	}
+	else if (!this->m_inputRecordFile.empty())
+	{
+		this->m_inputRecorder.open(this->m_inputRecordFile, SIMULATION_TIMESTEP);
+
+		std::cout << "Recording input to " << this->m_inputRecordFile << std::endl;
+	}
+
+	this->m_frameLimiter.calibrate();
+
+	// Simulation stays on this thread (GLFW events have to be polled here), Vulkan submission moves off it
+	this->StartRenderThread();
+
+	Timer frameTimer;
+	double accumulator = 0.0;
+	double simulationTime = 0.0;
+	uint64_t frameNumber = 0;
+
+	Timer replayTimer;
+	double replayTime = 0.0;
+	bool replayFinished = false;
+	InputLogReader::Frame replayFrame;
+
 	do
 	{
+		double frameTime = frameTimer.lap();
+
+		// Don't try to catch up on time spent stalled
+		if (frameTime > MAX_FRAME_TIME)
+		{
+			frameTime = MAX_FRAME_TIME;
+		}
 
-		if (glfwWindowShouldClose(this->MVC_View->getWindow()) || InputHandler::IsKeyPressed(GLFW_KEY_ESCAPE))
+		accumulator += frameTime;
+
+		// Live keys are off during a replay, so escape is polled directly
+		bool escapePressed = InputHandler::IsKeyPressed(GLFW_KEY_ESCAPE) ||
+			(this->m_inputReplay.isOpen() && glfwGetKey(this->MVC_View->getWindow(), GLFW_KEY_ESCAPE) == GLFW_PRESS);
+
+		if (glfwWindowShouldClose(this->MVC_View->getWindow()) || escapePressed || replayFinished)
 		{
+			// The render thread has to let go of the swap chain before the window goes
+			this->StopRenderThread();
 			glfwDestroyWindow(this->MVC_View->getWindow());
 			Loop = false;
 		}
@@ -41,10 +99,305 @@ void MVCController::RunLoop()
 			{
 
 			}
-			glfwPollEvents();
-			this->MVC_View->drawFrame();
+
+			// Dump once per key press
+			if (InputHandler::IsKeyPressed(FRAME_STATS_KEY) != this->m_bStatsKeyHeld)
+			{
+				this->m_bStatsKeyHeld = !this->m_bStatsKeyHeld;
+				if (this->m_bStatsKeyHeld)
+				{
+					this->DumpFrameStats();
+				}
+			}
+
+			if (this->IsIdle())
+			{
+				// Nothing to simulate or draw, sleep until the window has something for us.
+				// The timeout keeps the loop (and escape / close handling) ticking over.
+				glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+			}
+			else
+			{
+				this->LimitFrameRate();
+				glfwPollEvents();
+			}
+
+			// Fixed timestep simulation
+			Timer simulationTimer;
+			int steps = 0;
+			double alpha = 0.0;
+			float aspectRatio = (float)this->MVC_View->getWindowWidth() / (float)this->MVC_View->getWindowHeight();
+
+			if (this->m_inputReplay.isOpen())
+			{
+				// Same events, steps and blend as the recording, whatever this frame really took
+				if (!this->m_inputReplay.readFrame(replayFrame))
+				{
+					replayFinished = true;
+					continue;
+				}
+
+				for (const auto & tickEvents : replayFrame.ticks)
+				{
+					for (const auto & inputEvent : tickEvents)
+					{
+						InputHandler::PushEvent(inputEvent);
+					}
+
+					this->UpdateSimulation(SIMULATION_TIMESTEP);
+					simulationTime += SIMULATION_TIMESTEP;
+					steps++;
+				}
+
+				alpha = replayFrame.frame.alpha;
+				aspectRatio = replayFrame.frame.aspectRatio;
+				replayTime += replayFrame.frame.frameTime;
+				accumulator = 0.0;
+			}
+			else
+			{
+				while (accumulator >= SIMULATION_TIMESTEP && steps < MAX_SIMULATION_STEPS)
+				{
+					this->UpdateSimulation(SIMULATION_TIMESTEP);
+					accumulator -= SIMULATION_TIMESTEP;
+					simulationTime += SIMULATION_TIMESTEP;
+					steps++;
+				}
+
+				// Simulation can't keep up, drop the backlog instead of spiralling
+				if (accumulator >= SIMULATION_TIMESTEP)
+				{
+					accumulator = fmod(accumulator, SIMULATION_TIMESTEP);
+				}
+
+				alpha = accumulator / SIMULATION_TIMESTEP;
+
+				if (this->m_inputRecorder.isOpen())
+				{
+					InputLogFrame logFrame;
+					logFrame.steps = (uint32_t)steps;
+					logFrame.alpha = alpha;
+					logFrame.frameTime = frameTime;
+					logFrame.aspectRatio = aspectRatio;
+
+					this->m_inputRecorder.writeFrame(logFrame);
+				}
+			}
+			float simulationMs = (float)(simulationTimer.getElapsedSeconds() * 1000.0);
+
+			// Real time replay holds each frame back until the recording got to it
+			if (this->m_inputReplay.isOpen() && this->m_bReplayRealtime)
+			{
+				double ahead = replayTime - replayTimer.getElapsedSeconds();
+				if (ahead > 0.0)
+				{
+					std::this_thread::sleep_for(std::chrono::duration<double>(ahead));
+				}
+			}
+
+			// Once the static scene has been drawn there's nothing new to show,
+			// and nothing is visible at all while minimised
+			bool idle = this->IsIdle();
+			bool skipFrame = idle && (InputHandler::getSnapshot().windowIconified || this->m_bIdleFrameDrawn);
+
+			this->m_bIdleFrameDrawn = idle;
+			this->m_uiIdleEventId = InputHandler::getSnapshot().lastEventId;
+
+			if (skipFrame)
+			{
+				continue;
+			}
+
+			// Hand the blend between the last two simulation steps to the render thread,
+			// this blocks while the render thread is a full pipeline depth behind
+			FramePacket * packet = this->m_framePackets->beginWrite();
+
+			if (packet)
+			{
+				packet->frameNumber = frameNumber++;
+				packet->simulationTime = simulationTime;
+				packet->simulationMs = simulationMs;
+				packet->inputEventId = InputHandler::getSnapshot().lastEventId;
+				packet->inputTimestampNs = InputHandler::getSnapshot().lastEventTimestampNs;
+				this->MVC_Model->fillFramePacket(*packet, alpha, aspectRatio);
+
+				this->m_framePackets->endWrite();
+			}
+			else
+			{
+				// Ring was closed underneath us, the render thread has died
+				this->StopRenderThread();
+				glfwDestroyWindow(this->MVC_View->getWindow());
+				Loop = false;
+			}
 		}
 
 	} while (Loop);
 
+	this->m_inputRecorder.close();
+	this->m_inputReplay.close();
+	InputHandler::setLiveInputEnabled(true);
+
+	this->DumpFrameStats();
+
+	if (this->m_renderException)
+	{
+		std::rethrow_exception(this->m_renderException);
+	}
+}
+
+bool MVCController::IsIdle()
+{
+	// A replay has to produce every recorded frame
+	if (!this->m_bIdleEnabled || this->m_inputReplay.isOpen())
+	{
+		return false;
+	}
+
+	const InputSnapshot & snapshot = InputHandler::getSnapshot();
+
+	if (snapshot.windowIconified)
+	{
+		return true;
+	}
+
+	return snapshot.lastEventId == this->m_uiIdleEventId && snapshot.held.none() && this->MVC_Model->isStatic();
+}
+
+void MVCController::LimitFrameRate()
+{
+	if (this->m_inputReplay.isOpen())
+	{
+		return;
+	}
+
+	double targetFrameRate = this->m_dFrameRateLimit;
+
+	// Keep the background window from heating the machine up
+	if (!InputHandler::getSnapshot().windowFocused)
+	{
+		targetFrameRate = targetFrameRate > 0.0 ? std::min<double>(targetFrameRate, BACKGROUND_FRAME_RATE) : BACKGROUND_FRAME_RATE;
+	}
+
+	if (this->m_frameLimiter.getTargetFrameRate() != targetFrameRate)
+	{
+		this->m_frameLimiter.setTargetFrameRate(targetFrameRate);
+	}
+
+	this->m_frameLimiter.wait();
+}
+
+void MVCController::setInputRecording(const std::string & filename)
+{
+	this->m_inputRecordFile = filename;
+}
+
+void MVCController::setInputReplay(const std::string & filename, bool realtime)
+{
+	this->m_inputReplayFile = filename;
+	this->m_bReplayRealtime = realtime;
+}
+
+void MVCController::StartRenderThread()
+{
+	this->m_framePackets.reset(new FramePacketRing(this->m_uiPipelineDepth));
+	this->m_renderException = nullptr;
+	this->m_renderThread = std::thread(&MVCController::RenderLoop, this);
+
+	std::cout << "Render Thread Started, pipeline depth " << this->m_framePackets->getPipelineDepth() << std::endl;
+}
+
+void MVCController::StopRenderThread()
+{
+	if (this->m_framePackets)
+	{
+		this->m_framePackets->close();
+	}
+
+	if (this->m_renderThread.joinable())
+	{
+		this->m_renderThread.join();
+	}
+}
+
+void MVCController::RenderLoop()
+{
+	try
+	{
+		const FramePacket * packet = nullptr;
+		while ((packet = this->m_framePackets->beginRead()) != nullptr)
+		{
+			this->MVC_View->drawFrame(*packet);
+			this->m_framePackets->endRead();
+		}
+	}
+	catch (...)
+	{
+		// Rethrown on the main thread once the loop has wound down
+		this->m_renderException = std::current_exception();
+		this->m_framePackets->close();
+	}
+}
+
+void MVCController::DumpFrameStats()
+{
+	FrameStats & frameStats = FrameStats::getInstance();
+
+	frameStats.report(std::cout);
+
+	if (InputHandler::getDroppedEventCount() > 0)
+	{
+		std::cout << InputHandler::getDroppedEventCount() << " input events were dropped, the queue was full" << std::endl;
+	}
+	frameStats.dumpCSV("frame_stats.csv");
+	frameStats.dumpJSON("frame_stats.json");
+
+	std::cout << "Frame statistics written to frame_stats.csv / frame_stats.json" << std::endl;
+}
+
+void MVCController::UpdateSimulation(double dt)
+{
+	// Everything that arrived since the last step
+	InputHandler::BeginTick();
+
+	if (this->m_inputRecorder.isOpen())
+	{
+		this->m_inputRecorder.writeTick(InputHandler::getTickEvents());
+	}
+
+	InputHandler::KeyboardUpdate(this->MVC_View, dt);
+	InputHandler::MouseUpdate(this->MVC_View, dt);
+
+	glm::vec3 movement(0.0f);
+
+	if (InputHandler::IsKeyPressed(GLFW_KEY_W))
+	{
+		movement.z -= 1.0f;
+	}
+	if (InputHandler::IsKeyPressed(GLFW_KEY_S))
+	{
+		movement.z += 1.0f;
+	}
+	if (InputHandler::IsKeyPressed(GLFW_KEY_A))
+	{
+		movement.x -= 1.0f;
+	}
+	if (InputHandler::IsKeyPressed(GLFW_KEY_D))
+	{
+		movement.x += 1.0f;
+	}
+
+	this->MVC_Model->setCameraMovement(movement);
+
+	// Mouse look only while the cursor is captured
+	if (!InputHandler::isMouseEnabled())
+	{
+		this->MVC_Model->setCameraRotation((float)InputHandler::getDeltaX(), (float)InputHandler::getDeltaY());
+	}
+	else
+	{
+		this->MVC_Model->setCameraRotation(0.0f, 0.0f);
+	}
+
+	this->MVC_Model->Update(dt);
 }
\ No newline at end of file
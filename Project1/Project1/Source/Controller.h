@@ -5,6 +5,25 @@
 #include "View.h"
 
 #include "InputHandler.h"
+#include "Timer.h"
+#include "FramePacket.h"
+#include "FrameStats.h"
+#include "InputLog.h"
+#include "FrameLimiter.h"
+
+#include <thread>
+#include <memory>
+#include <exception>
+#include <string>
+#include <algorithm>
+
+#define SIMULATION_TIMESTEP (1.0 / 60.0) // Fixed simulation step in seconds
+#define MAX_SIMULATION_STEPS 5 // Catch-up steps allowed per frame before dropping time
+#define MAX_FRAME_TIME 0.25 // Longest frame we account for (breakpoints, window drags)
+#define DEFAULT_PIPELINE_DEPTH 1 // Frames the simulation may run ahead of the render thread (1 or 2)
+#define FRAME_STATS_KEY GLFW_KEY_F9 // Dumps frame statistics on demand
+#define IDLE_WAIT_TIMEOUT 0.25 // Longest the loop blocks on window events while idle, in seconds
+#define BACKGROUND_FRAME_RATE 15.0 // Frame cap while the window doesn't have focus
 
 class MVCController
 {
@@ -14,9 +33,53 @@ public:
 
 	void RunLoop();
 
+	// Only takes effect before RunLoop
+	void setPipelineDepth(unsigned depth) { m_uiPipelineDepth = depth; }
+
+	// Only take effect before RunLoop, a replay wins over a recording
+	void setInputRecording(const std::string & filename);
+	void setInputReplay(const std::string & filename, bool realtime);
+
+	// 0 runs uncapped (present mode permitting)
+	void setFrameRateLimit(double framesPerSecond) { m_dFrameRateLimit = framesPerSecond; }
+	// Idle mode blocks on window events instead of spinning while nothing changes
+	void setIdleEnabled(bool status) { m_bIdleEnabled = status; }
+
 	MVCModel * MVC_Model;
 	MVCView * MVC_View;
 private:
+	void UpdateSimulation(double dt);
+
+	// Minimised, or no new input and nothing moved in the last step
+	bool IsIdle();
+	void LimitFrameRate();
+
+	void StartRenderThread();
+	void StopRenderThread();
+	void RenderLoop();
+
+	void DumpFrameStats();
+
+	unsigned m_uiPipelineDepth;
+	std::unique_ptr<FramePacketRing> m_framePackets;
+	std::thread m_renderThread;
+	std::exception_ptr m_renderException;
+
+	bool m_bStatsKeyHeld;
+
+	std::string m_inputRecordFile;
+	std::string m_inputReplayFile;
+	bool m_bReplayRealtime;
+
+	InputLogWriter m_inputRecorder;
+	InputLogReader m_inputReplay;
+
+	FrameLimiter m_frameLimiter;
+	double m_dFrameRateLimit;
+
+	bool m_bIdleEnabled;
+	bool m_bIdleFrameDrawn; // The static scene has been handed to the render thread already
+	uint64_t m_uiIdleEventId; // Newest input event seen by the last frame
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,458 @@
+#include "Culling.h"
+#include "JobSystem.h"
+
+#include <geometric.hpp>
+#include <simd/platform.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Row i of a column major matrix
+	inline glm::vec4 matrixRow(const glm::mat4 & m, int i)
+	{
+		return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	}
+
+	inline glm::vec4 normalizePlane(const glm::vec4 & plane)
+	{
+		return plane / glm::length(glm::vec3(plane));
+	}
+
+	// Appends the indices whose bit is set without branching on each one
+	inline size_t writeVisible(uint32_t * out, size_t written, uint32_t first, int mask, int lanes)
+	{
+		for (int lane = 0; lane < lanes; lane++)
+		{
+			out[written] = first + lane;
+			written += (mask >> lane) & 1;
+		}
+
+		return written;
+	}
+
+	size_t cullSpheresScalar(const Frustum & frustum, const BoundingSphereArray & spheres, size_t begin, size_t end, uint32_t * out)
+	{
+		size_t written = 0;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			if (frustum.intersectsSphere(glm::vec3(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]), spheres.radius[i]))
+			{
+				out[written++] = (uint32_t)i;
+			}
+		}
+
+		return written;
+	}
+
+	size_t cullBoxesScalar(const Frustum & frustum, const BoundingBoxArray & boxes, size_t begin, size_t end, uint32_t * out)
+	{
+		size_t written = 0;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			if (frustum.intersectsBox(glm::vec3(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]), glm::vec3(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i])))
+			{
+				out[written++] = (uint32_t)i;
+			}
+		}
+
+		return written;
+	}
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+	size_t cullSpheresSimd(const Frustum & frustum, const BoundingSphereArray & spheres, size_t begin, size_t end, uint32_t * out)
+	{
+		__m256 planeX[FRUSTUM_PLANE_COUNT], planeY[FRUSTUM_PLANE_COUNT], planeZ[FRUSTUM_PLANE_COUNT], planeW[FRUSTUM_PLANE_COUNT];
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+		}
+
+		const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+		size_t written = 0;
+		size_t i = begin;
+
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&spheres.centerX[i]);
+			__m256 y = _mm256_loadu_ps(&spheres.centerY[i]);
+			__m256 z = _mm256_loadu_ps(&spheres.centerZ[i]);
+			__m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(&spheres.radius[i]), signBit);
+
+			__m256 outside = _mm256_setzero_ps();
+			for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+			{
+				__m256 distance = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+					_mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negativeRadius, _CMP_LT_OQ));
+			}
+
+			written = writeVisible(out, written, (uint32_t)i, ~_mm256_movemask_ps(outside), 8);
+		}
+
+		return written + cullSpheresScalar(frustum, spheres, i, end, out + written);
+	}
+
+	size_t cullBoxesSimd(const Frustum & frustum, const BoundingBoxArray & boxes, size_t begin, size_t end, uint32_t * out)
+	{
+		__m256 planeX[FRUSTUM_PLANE_COUNT], planeY[FRUSTUM_PLANE_COUNT], planeZ[FRUSTUM_PLANE_COUNT], planeW[FRUSTUM_PLANE_COUNT];
+		__m256 absX[FRUSTUM_PLANE_COUNT], absY[FRUSTUM_PLANE_COUNT], absZ[FRUSTUM_PLANE_COUNT];
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+			absX[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].x));
+			absY[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].y));
+			absZ[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].z));
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+
+		size_t written = 0;
+		size_t i = begin;
+
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&boxes.centerX[i]);
+			__m256 y = _mm256_loadu_ps(&boxes.centerY[i]);
+			__m256 z = _mm256_loadu_ps(&boxes.centerZ[i]);
+			__m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+			__m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+			__m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+
+			__m256 outside = zero;
+			for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+			{
+				// Distance of the corner furthest along the plane normal
+				__m256 distance = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+					_mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+				__m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)), _mm256_mul_ps(absZ[p], ez));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+			}
+
+			written = writeVisible(out, written, (uint32_t)i, ~_mm256_movemask_ps(outside), 8);
+		}
+
+		return written + cullBoxesScalar(frustum, boxes, i, end, out + written);
+	}
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	size_t cullSpheresSimd(const Frustum & frustum, const BoundingSphereArray & spheres, size_t begin, size_t end, uint32_t * out)
+	{
+		__m128 planeX[FRUSTUM_PLANE_COUNT], planeY[FRUSTUM_PLANE_COUNT], planeZ[FRUSTUM_PLANE_COUNT], planeW[FRUSTUM_PLANE_COUNT];
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+		}
+
+		const __m128 signBit = _mm_set1_ps(-0.0f);
+
+		size_t written = 0;
+		size_t i = begin;
+
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&spheres.centerX[i]);
+			__m128 y = _mm_loadu_ps(&spheres.centerY[i]);
+			__m128 z = _mm_loadu_ps(&spheres.centerZ[i]);
+			__m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(&spheres.radius[i]), signBit);
+
+			__m128 outside = _mm_setzero_ps();
+			for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+			{
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+					_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+			}
+
+			written = writeVisible(out, written, (uint32_t)i, ~_mm_movemask_ps(outside), 4);
+		}
+
+		return written + cullSpheresScalar(frustum, spheres, i, end, out + written);
+	}
+
+	size_t cullBoxesSimd(const Frustum & frustum, const BoundingBoxArray & boxes, size_t begin, size_t end, uint32_t * out)
+	{
+		__m128 planeX[FRUSTUM_PLANE_COUNT], planeY[FRUSTUM_PLANE_COUNT], planeZ[FRUSTUM_PLANE_COUNT], planeW[FRUSTUM_PLANE_COUNT];
+		__m128 absX[FRUSTUM_PLANE_COUNT], absY[FRUSTUM_PLANE_COUNT], absZ[FRUSTUM_PLANE_COUNT];
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+			absX[p] = _mm_set1_ps(std::fabs(frustum.planes[p].x));
+			absY[p] = _mm_set1_ps(std::fabs(frustum.planes[p].y));
+			absZ[p] = _mm_set1_ps(std::fabs(frustum.planes[p].z));
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+
+		size_t written = 0;
+		size_t i = begin;
+
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&boxes.centerX[i]);
+			__m128 y = _mm_loadu_ps(&boxes.centerY[i]);
+			__m128 z = _mm_loadu_ps(&boxes.centerZ[i]);
+			__m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+			__m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+			__m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+			__m128 outside = zero;
+			for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+			{
+				// Distance of the corner furthest along the plane normal
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+					_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+			}
+
+			written = writeVisible(out, written, (uint32_t)i, ~_mm_movemask_ps(outside), 4);
+		}
+
+		return written + cullBoxesScalar(frustum, boxes, i, end, out + written);
+	}
+#else
+	size_t cullSpheresSimd(const Frustum & frustum, const BoundingSphereArray & spheres, size_t begin, size_t end, uint32_t * out)
+	{
+		return cullSpheresScalar(frustum, spheres, begin, end, out);
+	}
+
+	size_t cullBoxesSimd(const Frustum & frustum, const BoundingBoxArray & boxes, size_t begin, size_t end, uint32_t * out)
+	{
+		return cullBoxesScalar(frustum, boxes, begin, end, out);
+	}
+#endif
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4 & viewProjection)
+{
+	glm::vec4 row0 = matrixRow(viewProjection, 0);
+	glm::vec4 row1 = matrixRow(viewProjection, 1);
+	glm::vec4 row2 = matrixRow(viewProjection, 2);
+	glm::vec4 row3 = matrixRow(viewProjection, 3);
+
+	Frustum frustum;
+	frustum.planes[FRUSTUM_PLANE_LEFT] = normalizePlane(row3 + row0);
+	frustum.planes[FRUSTUM_PLANE_RIGHT] = normalizePlane(row3 - row0);
+	frustum.planes[FRUSTUM_PLANE_BOTTOM] = normalizePlane(row3 + row1);
+	frustum.planes[FRUSTUM_PLANE_TOP] = normalizePlane(row3 - row1);
+#ifdef GLM_FORCE_DEPTH_ZERO_TO_ONE
+	frustum.planes[FRUSTUM_PLANE_NEAR] = normalizePlane(row2); // Clip space z runs 0 to w
+#else
+	frustum.planes[FRUSTUM_PLANE_NEAR] = normalizePlane(row3 + row2);
+#endif
+	frustum.planes[FRUSTUM_PLANE_FAR] = normalizePlane(row3 - row2);
+
+	return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3 & center, float radius) const
+{
+	for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+	{
+		if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Frustum::intersectsBox(const glm::vec3 & center, const glm::vec3 & extent) const
+{
+	for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+	{
+		glm::vec3 normal(planes[p]);
+		if (glm::dot(normal, center) + planes[p].w + glm::dot(glm::abs(normal), extent) < 0.0f)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+uint32_t BoundingSphereArray::add(const glm::vec3 & center, float sphereRadius)
+{
+	centerX.push_back(center.x);
+	centerY.push_back(center.y);
+	centerZ.push_back(center.z);
+	radius.push_back(sphereRadius);
+
+	return (uint32_t)radius.size() - 1;
+}
+
+void BoundingSphereArray::set(uint32_t index, const glm::vec3 & center, float sphereRadius)
+{
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	radius[index] = sphereRadius;
+}
+
+void BoundingSphereArray::reserve(size_t count)
+{
+	centerX.reserve(count);
+	centerY.reserve(count);
+	centerZ.reserve(count);
+	radius.reserve(count);
+}
+
+void BoundingSphereArray::clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	radius.clear();
+}
+
+uint32_t BoundingBoxArray::add(const glm::vec3 & min, const glm::vec3 & max)
+{
+	centerX.push_back(0.0f);
+	centerY.push_back(0.0f);
+	centerZ.push_back(0.0f);
+	extentX.push_back(0.0f);
+	extentY.push_back(0.0f);
+	extentZ.push_back(0.0f);
+
+	uint32_t index = (uint32_t)extentX.size() - 1;
+	this->set(index, min, max);
+
+	return index;
+}
+
+void BoundingBoxArray::set(uint32_t index, const glm::vec3 & min, const glm::vec3 & max)
+{
+	glm::vec3 center = (min + max) * 0.5f;
+	glm::vec3 extent = (max - min) * 0.5f;
+
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	extentX[index] = extent.x;
+	extentY[index] = extent.y;
+	extentZ[index] = extent.z;
+}
+
+void BoundingBoxArray::reserve(size_t count)
+{
+	centerX.reserve(count);
+	centerY.reserve(count);
+	centerZ.reserve(count);
+	extentX.reserve(count);
+	extentY.reserve(count);
+	extentZ.reserve(count);
+}
+
+void BoundingBoxArray::clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+FrustumCuller::FrustumCuller()
+: m_frustum(Frustum::fromMatrix(glm::mat4(1.0f)))
+, m_path(CULL_PATH_SIMD)
+{
+}
+
+FrustumCuller::~FrustumCuller()
+{
+
+}
+
+size_t FrustumCuller::cullSpheres(const BoundingSphereArray & spheres, std::vector<uint32_t> & visible, size_t chunkSize) const
+{
+	const Frustum & frustum = m_frustum;
+	CULL_PATH path = m_path;
+
+	return this->cullParallel(spheres.size(), visible, chunkSize, [&](size_t begin, size_t end, uint32_t * out)
+	{
+		return FrustumCuller::cullSpheres(frustum, spheres, begin, end, out, path);
+	});
+}
+
+size_t FrustumCuller::cullBoxes(const BoundingBoxArray & boxes, std::vector<uint32_t> & visible, size_t chunkSize) const
+{
+	const Frustum & frustum = m_frustum;
+	CULL_PATH path = m_path;
+
+	return this->cullParallel(boxes.size(), visible, chunkSize, [&](size_t begin, size_t end, uint32_t * out)
+	{
+		return FrustumCuller::cullBoxes(frustum, boxes, begin, end, out, path);
+	});
+}
+
+size_t FrustumCuller::cullSpheres(const Frustum & frustum, const BoundingSphereArray & spheres, size_t begin, size_t end, uint32_t * out, CULL_PATH path)
+{
+	return path == CULL_PATH_SIMD ? cullSpheresSimd(frustum, spheres, begin, end, out) : cullSpheresScalar(frustum, spheres, begin, end, out);
+}
+
+size_t FrustumCuller::cullBoxes(const Frustum & frustum, const BoundingBoxArray & boxes, size_t begin, size_t end, uint32_t * out, CULL_PATH path)
+{
+	return path == CULL_PATH_SIMD ? cullBoxesSimd(frustum, boxes, begin, end, out) : cullBoxesScalar(frustum, boxes, begin, end, out);
+}
+
+template <typename Kernel>
+size_t FrustumCuller::cullParallel(size_t count, std::vector<uint32_t> & visible, size_t chunkSize, const Kernel & kernel) const
+{
+	if (chunkSize == 0)
+	{
+		chunkSize = CULL_CHUNK_SIZE;
+	}
+
+	// Every chunk writes into its own slice of the output, the slices get packed together afterwards
+	visible.resize(count);
+
+	size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+	std::vector<size_t> chunkVisible(chunkCount);
+
+	JobSystem::getInstance().parallelFor(0, chunkCount, 1, [&](size_t first, size_t last)
+	{
+		for (size_t chunk = first; chunk < last; chunk++)
+		{
+			size_t begin = chunk * chunkSize;
+			size_t end = std::min<size_t>(begin + chunkSize, count);
+			chunkVisible[chunk] = kernel(begin, end, visible.data() + begin);
+		}
+	});
+
+	size_t total = 0;
+	for (size_t chunk = 0; chunk < chunkCount; chunk++)
+	{
+		if (total != chunk * chunkSize)
+		{
+			memmove(visible.data() + total, visible.data() + chunk * chunkSize, chunkVisible[chunk] * sizeof(uint32_t));
+		}
+		total += chunkVisible[chunk];
+	}
+
+	visible.resize(total);
+
+	return total;
+}
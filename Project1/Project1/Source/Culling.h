@@ -0,0 +1,109 @@
+#ifndef __CULLING_H__
+#define __CULLING_H__
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec3.hpp>
+#include <vec4.hpp>
+#include <mat4x4.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+#define CULL_CHUNK_SIZE 4096 // Bounds per job when culling in parallel
+
+enum CULL_PATH
+{
+	CULL_PATH_SCALAR,
+	CULL_PATH_SIMD, // AVX (8 wide) when GLM_ARCH has it, SSE (4 wide) otherwise
+};
+
+enum FRUSTUM_PLANE
+{
+	FRUSTUM_PLANE_LEFT,
+	FRUSTUM_PLANE_RIGHT,
+	FRUSTUM_PLANE_BOTTOM,
+	FRUSTUM_PLANE_TOP,
+	FRUSTUM_PLANE_NEAR,
+	FRUSTUM_PLANE_FAR,
+	FRUSTUM_PLANE_COUNT
+};
+
+// Six normalized planes, xyz points into the frustum and dot(xyz, p) + w is the signed distance
+struct Frustum
+{
+	glm::vec4 planes[FRUSTUM_PLANE_COUNT];
+
+	// Works in whatever space the matrix maps from, world space for projection * view
+	static Frustum fromMatrix(const glm::mat4 & viewProjection);
+
+	bool intersectsSphere(const glm::vec3 & center, float radius) const;
+	bool intersectsBox(const glm::vec3 & center, const glm::vec3 & extent) const;
+};
+
+// Bounding spheres in structure-of-arrays layout so they can be loaded a register at a time
+struct BoundingSphereArray
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+
+	uint32_t add(const glm::vec3 & center, float sphereRadius);
+	void set(uint32_t index, const glm::vec3 & center, float sphereRadius);
+	void reserve(size_t count);
+	void clear();
+	size_t size() const { return radius.size(); }
+};
+
+// Axis aligned boxes stored as center / half extent, which is what the plane test wants
+struct BoundingBoxArray
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> extentX;
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+
+	uint32_t add(const glm::vec3 & min, const glm::vec3 & max);
+	void set(uint32_t index, const glm::vec3 & min, const glm::vec3 & max);
+	void reserve(size_t count);
+	void clear();
+	size_t size() const { return extentX.size(); }
+};
+
+// Tests bounds against a frustum and writes out the indices of the ones that are at least
+// partly inside, in their original order. Conservative: a box straddling two planes outside
+// a corner of the frustum still counts as visible.
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+	virtual ~FrustumCuller();
+
+	void setFrustum(const glm::mat4 & viewProjection) { m_frustum = Frustum::fromMatrix(viewProjection); }
+	void setFrustum(const Frustum & frustum) { m_frustum = frustum; }
+	const Frustum & getFrustum() const { return m_frustum; }
+
+	void setPath(CULL_PATH path) { m_path = path; }
+	CULL_PATH getPath() const { return m_path; }
+
+	// Cuts the array into chunks of chunkSize which run on the job system, returns the visible count
+	size_t cullSpheres(const BoundingSphereArray & spheres, std::vector<uint32_t> & visible, size_t chunkSize = CULL_CHUNK_SIZE) const;
+	size_t cullBoxes(const BoundingBoxArray & boxes, std::vector<uint32_t> & visible, size_t chunkSize = CULL_CHUNK_SIZE) const;
+
+	// Single threaded kernels over [begin, end), out needs room for end - begin indices
+	static size_t cullSpheres(const Frustum & frustum, const BoundingSphereArray & spheres, size_t begin, size_t end, uint32_t * out, CULL_PATH path);
+	static size_t cullBoxes(const Frustum & frustum, const BoundingBoxArray & boxes, size_t begin, size_t end, uint32_t * out, CULL_PATH path);
+
+private:
+	template <typename Kernel>
+	size_t cullParallel(size_t count, std::vector<uint32_t> & visible, size_t chunkSize, const Kernel & kernel) const;
+
+	Frustum m_frustum;
+	CULL_PATH m_path;
+};
+
+#endif
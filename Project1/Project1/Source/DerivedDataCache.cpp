@@ -0,0 +1,560 @@
+#include "DerivedDataCache.h"
+#include "Hash.h"
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char DDC_FILE_MAGIC[4] = { 'V', 'D', 'D', 'C' };
+
+	// 64 bytes, so the data after it stays as aligned as the mapping
+	struct DerivedDataHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key[2];
+		uint64_t size;
+		uint64_t checksum; // Hash::hash64 of the data
+		uint8_t reserved[24];
+	};
+
+	static_assert(sizeof(DerivedDataHeader) == 64, "DerivedDataHeader layout changed");
+
+	const int64_t NANOSECONDS_PER_SECOND = 1000000000ll;
+	const int64_t FILE_TIME_RESOLUTION = 100; // Nanoseconds, NTFS keeps 100ns steps and ext4 / tmpfs single ones
+
+	struct CacheFile
+	{
+		std::string filename;
+		uint64_t size;
+		int64_t lastUsed; // Nanoseconds since 1970, the modification time
+		int64_t created; // Same, orders entries last used at the same time
+		bool bTemporary;
+	};
+
+	bool endsWith(const std::string & text, const char * suffix)
+	{
+		size_t length = strlen(suffix);
+		return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+	}
+
+	bool makeDirectory(const std::string & directory)
+	{
+#ifdef _WIN32
+		return CreateDirectoryA(directory.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+		return mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+
+#ifdef _WIN32
+	// FILETIME counts 100ns steps from 1601
+	int64_t toNanoseconds(const FILETIME & time)
+	{
+		uint64_t ticks = ((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime;
+		return ((int64_t)ticks - 116444736000000000ll) * 100;
+	}
+#else
+	int64_t toNanoseconds(const timespec & time)
+	{
+		return (int64_t)time.tv_sec * NANOSECONDS_PER_SECOND + time.tv_nsec;
+	}
+#endif
+
+	// In nanoseconds since 1970 like the file times, which is as fine as the file system keeps them
+	int64_t getNow()
+	{
+#ifdef _WIN32
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		return toNanoseconds(now);
+#else
+		timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		return toNanoseconds(now);
+#endif
+	}
+
+	// Modification time, false when the file doesn't exist
+	bool getLastUsed(const std::string & filename, int64_t & lastUsed)
+	{
+#ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &data))
+		{
+			return false;
+		}
+
+		lastUsed = toNanoseconds(data.ftLastWriteTime);
+#else
+		struct stat info;
+		if (stat(filename.c_str(), &info) != 0)
+		{
+			return false;
+		}
+
+		lastUsed = toNanoseconds(info.st_mtim);
+#endif
+		return true;
+	}
+
+	// Sets the modification time, in nanoseconds since 1970
+	void touch(const std::string & filename, int64_t lastUsed)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(filename.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			uint64_t ticks = (uint64_t)(lastUsed / 100 + 116444736000000000ll);
+
+			FILETIME time;
+			time.dwLowDateTime = (DWORD)ticks;
+			time.dwHighDateTime = (DWORD)(ticks >> 32);
+			SetFileTime(file, nullptr, nullptr, &time);
+			CloseHandle(file);
+		}
+#else
+		timespec times[2];
+		times[0].tv_sec = 0;
+		times[0].tv_nsec = UTIME_OMIT; // Access time
+		times[1].tv_sec = (time_t)(lastUsed / NANOSECONDS_PER_SECOND);
+		times[1].tv_nsec = (long)(lastUsed % NANOSECONDS_PER_SECOND);
+		utimensat(AT_FDCWD, filename.c_str(), times, 0);
+#endif
+	}
+
+	// Replaces filename with temporary, true when filename holds a complete entry afterwards
+	bool publish(const std::string & temporary, const std::string & filename)
+	{
+#ifdef _WIN32
+		if (MoveFileExA(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			return true;
+		}
+
+		// Someone has the entry open, but being content addressed it already holds these bytes
+		std::remove(temporary.c_str());
+		int64_t lastUsed;
+		return getLastUsed(filename, lastUsed);
+#else
+		if (std::rename(temporary.c_str(), filename.c_str()) == 0)
+		{
+			return true;
+		}
+
+		std::remove(temporary.c_str());
+		return false;
+#endif
+	}
+
+	uint64_t getProcessId()
+	{
+#ifdef _WIN32
+		return (uint64_t)GetCurrentProcessId();
+#else
+		return (uint64_t)getpid();
+#endif
+	}
+
+	// Every file in the two levels of the cache, entries and temporaries
+	void listCacheFiles(const std::string & directory, std::vector<CacheFile> & files)
+	{
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE subdirectories = FindFirstFileA((directory + "\\*").c_str(), &data);
+		if (subdirectories == INVALID_HANDLE_VALUE)
+		{
+			return;
+		}
+
+		std::vector<std::string> names;
+		do
+		{
+			if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && data.cFileName[0] != '.')
+			{
+				names.push_back(directory + "/" + data.cFileName);
+			}
+		} while (FindNextFileA(subdirectories, &data));
+		FindClose(subdirectories);
+
+		for (const std::string & subdirectory : names)
+		{
+			HANDLE find = FindFirstFileA((subdirectory + "\\*").c_str(), &data);
+			if (find == INVALID_HANDLE_VALUE)
+			{
+				continue;
+			}
+
+			do
+			{
+				std::string name = data.cFileName;
+				if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				{
+					continue;
+				}
+
+				uint64_t size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+
+				files.push_back({ subdirectory + "/" + name, size, toNanoseconds(data.ftLastWriteTime), toNanoseconds(data.ftCreationTime), endsWith(name, ".tmp") });
+			} while (FindNextFileA(find, &data));
+			FindClose(find);
+		}
+#else
+		DIR * root = opendir(directory.c_str());
+		if (!root)
+		{
+			return;
+		}
+
+		std::vector<std::string> names;
+		while (dirent * item = readdir(root))
+		{
+			if (item->d_name[0] != '.')
+			{
+				names.push_back(directory + "/" + item->d_name);
+			}
+		}
+		closedir(root);
+
+		for (const std::string & subdirectory : names)
+		{
+			DIR * dir = opendir(subdirectory.c_str());
+			if (!dir)
+			{
+				continue;
+			}
+
+			while (dirent * item = readdir(dir))
+			{
+				std::string filename = subdirectory + "/" + item->d_name;
+
+				struct stat info;
+				if (stat(filename.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+				{
+					continue;
+				}
+
+				// No creation time in stat, the change time is the closest, the rename that published the entry sets it
+				files.push_back({ filename, (uint64_t)info.st_size, toNanoseconds(info.st_mtim), toNanoseconds(info.st_ctim), endsWith(filename, ".tmp") });
+			}
+			closedir(dir);
+		}
+#endif
+	}
+}
+
+DerivedDataKey::DerivedDataKey(const std::string & importer, uint32_t importerVersion)
+{
+	m_uiHash[0] = 0;
+	m_uiHash[1] = Hash::PRIME64_5;
+
+	this->add(importer.data(), importer.size());
+	this->add(&importerVersion, sizeof(importerVersion));
+}
+
+DerivedDataKey & DerivedDataKey::addSource(const void * data, size_t size)
+{
+	this->add(data, size);
+	return *this;
+}
+
+DerivedDataKey & DerivedDataKey::addSetting(const std::string & name, const std::string & value)
+{
+	this->add(name.data(), name.size());
+	this->add(value.data(), value.size());
+	return *this;
+}
+
+std::string DerivedDataKey::toString() const
+{
+	char text[33];
+	snprintf(text, sizeof(text), "%016llx%016llx", (unsigned long long)m_uiHash[0], (unsigned long long)m_uiHash[1]);
+	return text;
+}
+
+void DerivedDataKey::add(const void * data, size_t size)
+{
+	// Every part is chained in with its length, so "ab" + "c" and "a" + "bc" give different keys
+	uint64_t length = size;
+	for (int lane = 0; lane < 2; lane++)
+	{
+		m_uiHash[lane] = Hash::hash64(&length, sizeof(length), m_uiHash[lane]);
+		m_uiHash[lane] = Hash::hash64(data, size, m_uiHash[lane]);
+	}
+}
+
+DerivedDataCache::DerivedDataCache()
+: m_bEnabled(false)
+, m_uiMaxSize(DDC_DEFAULT_MAX_SIZE)
+, m_bSizeKnown(false)
+, m_uiSize(0)
+, m_iLastPublished(0)
+, m_uiTemporaryCounter(0)
+, m_uiHits(0)
+, m_uiMisses(0)
+, m_uiWrites(0)
+, m_uiEvictions(0)
+, m_uiBytesEvicted(0)
+{
+}
+
+DerivedDataCache::~DerivedDataCache()
+{
+}
+
+void DerivedDataCache::init(const std::string & directory, uint64_t maxSize)
+{
+	if (!makeDirectory(directory))
+	{
+		throw std::runtime_error("Failed to create the derived data cache directory " + directory + "!");
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_directory = directory;
+	m_uiMaxSize = maxSize;
+	m_bSizeKnown = false;
+	m_uiSize = 0;
+	m_bEnabled = true;
+}
+
+bool DerivedDataCache::get(const DerivedDataKey & key, FileView & data)
+{
+	if (!m_bEnabled)
+	{
+		return false;
+	}
+
+	std::string filename = this->getFilename(key);
+
+	int64_t lastUsed;
+	if (!getLastUsed(filename, lastUsed))
+	{
+		m_uiMisses++;
+		return false;
+	}
+
+	FileView file;
+	try
+	{
+		file = FileView::open(filename, FILE_ACCESS_SEQUENTIAL);
+	}
+	catch (const std::runtime_error &)
+	{
+		// Evicted by another process in between
+		m_uiMisses++;
+		return false;
+	}
+
+	const DerivedDataHeader * header = file.size() >= sizeof(DerivedDataHeader) ? reinterpret_cast<const DerivedDataHeader *>(file.data()) : nullptr;
+
+	if (!header || memcmp(header->magic, DDC_FILE_MAGIC, sizeof(DDC_FILE_MAGIC)) != 0 || header->version != DDC_FILE_VERSION ||
+		header->key[0] != key.getHash(0) || header->key[1] != key.getHash(1) || header->size != file.size() - sizeof(DerivedDataHeader) ||
+		Hash::hash64(file.data() + sizeof(DerivedDataHeader), (size_t)header->size) != header->checksum)
+	{
+		// Corrupt, drop it so the next import writes a good one
+		file.reset();
+		std::remove(filename.c_str());
+
+		m_uiMisses++;
+		return false;
+	}
+
+	int64_t now = getNow();
+	if (now - lastUsed > DDC_TOUCH_INTERVAL * NANOSECONDS_PER_SECOND)
+	{
+		touch(filename, now);
+	}
+
+	data = file.subView(sizeof(DerivedDataHeader), (size_t)header->size);
+
+	m_uiHits++;
+	return true;
+}
+
+bool DerivedDataCache::put(const DerivedDataKey & key, const void * data, size_t size)
+{
+	if (!m_bEnabled)
+	{
+		return false;
+	}
+
+	std::string filename = this->getFilename(key);
+	std::string subdirectory = m_directory + "/" + key.toString().substr(0, 2);
+
+	if (!makeDirectory(subdirectory))
+	{
+		return false;
+	}
+
+	DerivedDataHeader header = {};
+	memcpy(header.magic, DDC_FILE_MAGIC, sizeof(DDC_FILE_MAGIC));
+	header.version = DDC_FILE_VERSION;
+	header.key[0] = key.getHash(0);
+	header.key[1] = key.getHash(1);
+	header.size = size;
+	header.checksum = Hash::hash64(data, size);
+
+	// Unique per process and call, so concurrent writers never share a temporary
+	std::string temporary = filename + "." + std::to_string(getProcessId()) + "." + std::to_string(m_uiTemporaryCounter++) + ".tmp";
+
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char *>(data), size);
+		file.close();
+
+		if (file.fail())
+		{
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+
+	// The file system stamps writes from a clock that only ticks every few milliseconds, so a burst of
+	// puts would all get the same time and trimming couldn't tell which came last. Every entry this
+	// process publishes gets a later time than the one before, set before the rename so it is never
+	// visible without it.
+	int64_t published;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		published = std::max(getNow(), m_iLastPublished + FILE_TIME_RESOLUTION);
+		m_iLastPublished = published;
+	}
+	touch(temporary, published);
+
+	if (!publish(temporary, filename))
+	{
+		return false;
+	}
+
+	m_uiWrites++;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_bSizeKnown)
+	{
+		this->trimLocked(filename);
+	}
+	else
+	{
+		// Only an estimate, other processes write too, trimLocked() rescans before evicting anything
+		m_uiSize += sizeof(header) + size;
+		if (m_uiSize > m_uiMaxSize)
+		{
+			this->trimLocked(filename);
+		}
+	}
+
+	return true;
+}
+
+void DerivedDataCache::trim()
+{
+	if (!m_bEnabled)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	this->trimLocked();
+}
+
+DerivedDataStats DerivedDataCache::getStats() const
+{
+	DerivedDataStats stats;
+	stats.hits = m_uiHits;
+	stats.misses = m_uiMisses;
+	stats.writes = m_uiWrites;
+	stats.evictions = m_uiEvictions;
+	stats.bytesEvicted = m_uiBytesEvicted;
+
+	return stats;
+}
+
+std::string DerivedDataCache::getFilename(const DerivedDataKey & key) const
+{
+	// The first two digits pick a subdirectory, keeping directories small enough to list quickly
+	std::string name = key.toString();
+	return m_directory + "/" + name.substr(0, 2) + "/" + name + DDC_EXTENSION;
+}
+
+void DerivedDataCache::trimLocked(const std::string & keep)
+{
+	std::vector<CacheFile> files;
+	listCacheFiles(m_directory, files);
+
+	int64_t now = getNow();
+	uint64_t total = 0;
+
+	std::vector<CacheFile> entries;
+	for (auto & file : files)
+	{
+		if (file.bTemporary)
+		{
+			if (now - file.lastUsed > DDC_STALE_TEMPORARY * NANOSECONDS_PER_SECOND)
+			{
+				std::remove(file.filename.c_str());
+			}
+			continue;
+		}
+
+		if (endsWith(file.filename, DDC_EXTENSION))
+		{
+			total += file.size;
+
+			// Counts towards the size, but is never the one to go
+			if (file.filename != keep)
+			{
+				entries.push_back(file);
+			}
+		}
+	}
+
+	if (total > m_uiMaxSize)
+	{
+		// Only entries published by different processes can share a modification time, the one created first goes first
+		std::sort(entries.begin(), entries.end(), [](const CacheFile & a, const CacheFile & b)
+		{
+			return a.lastUsed != b.lastUsed ? a.lastUsed < b.lastUsed : a.created < b.created;
+		});
+
+		uint64_t target = (uint64_t)(m_uiMaxSize * DDC_TRIM_TARGET);
+		for (size_t i = 0; i < entries.size() && total > target; i++)
+		{
+			// Fails on Windows while another process has the entry mapped, it just stays for now
+			if (std::remove(entries[i].filename.c_str()) == 0)
+			{
+				total -= entries[i].size;
+				m_uiEvictions++;
+				m_uiBytesEvicted += entries[i].size;
+			}
+		}
+	}
+
+	m_uiSize = total;
+	m_bSizeKnown = true;
+}
@@ -0,0 +1,141 @@
+#ifndef __DERIVED_DATA_CACHE_H__
+#define __DERIVED_DATA_CACHE_H__
+
+#include "FileReader.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <stdint.h>
+
+#define DDC_FILE_VERSION 1
+#define DDC_DEFAULT_DIRECTORY "DerivedDataCache"
+#define DDC_DEFAULT_MAX_SIZE (4ull << 30) // Bytes, least recently used entries are evicted past this
+#define DDC_TRIM_TARGET 0.9 // Trimming evicts down to this fraction of the limit, so it isn't needed again straight away
+#define DDC_TOUCH_INTERVAL (60 * 60) // Seconds, a hit only rewrites the entry's last use time once it is older than this
+#define DDC_STALE_TEMPORARY (60 * 60) // Seconds, temporaries older than this were left behind by a writer that died
+#define DDC_EXTENSION ".ddc"
+
+// Identifies one derived output: a 128 bit hash of the importer, its version, every source byte
+// and every setting that changes the result. Anything left out of the key can make the cache hand
+// out stale data, so when in doubt add it.
+class DerivedDataKey
+{
+public:
+	DerivedDataKey(const std::string & importer, uint32_t importerVersion);
+
+	DerivedDataKey & addSource(const void * data, size_t size);
+	DerivedDataKey & addSource(const FileView & data) { return this->addSource(data.data(), data.size()); }
+
+	DerivedDataKey & addSetting(const std::string & name, const std::string & value);
+	DerivedDataKey & addSetting(const std::string & name, const char * value) { return this->addSetting(name, std::string(value)); }
+
+	// Numbers go in as their bytes, so a float setting is never rounded off
+	template <typename T>
+	DerivedDataKey & addSetting(const std::string & name, T value);
+
+	uint64_t getHash(int lane) const { return m_uiHash[lane]; }
+
+	// 32 hex digits, also the entry's filename
+	std::string toString() const;
+
+	bool operator==(const DerivedDataKey & other) const { return m_uiHash[0] == other.m_uiHash[0] && m_uiHash[1] == other.m_uiHash[1]; }
+
+private:
+	void add(const void * data, size_t size);
+
+	uint64_t m_uiHash[2]; // Two differently seeded xxHash64 chains
+};
+
+struct DerivedDataStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t writes = 0;
+	uint64_t evictions = 0;
+	uint64_t bytesEvicted = 0;
+};
+
+// Singleton DerivedDataCache
+// Content addressed store for importer output, shared by every tool and game instance that
+// points at the same directory. Entries are named by their key (directory/ab/abcdef....ddc), so
+// a publish is writing a uniquely named temporary and renaming it into place: readers see the
+// whole entry or none of it, and two processes publishing the same key write the same bytes.
+// Least recently used entries are evicted once the directory grows past the size limit, "used"
+// being the entry's modification time. Publishing sets it, a hit only moves it forward once it is
+// more than DDC_TOUCH_INTERVAL old, so within that interval entries go in the order they were published.
+// Until init() is called the cache is disabled, every get misses and put does nothing, so
+// importers work the same with or without it.
+class DerivedDataCache
+{
+public:
+	static DerivedDataCache & getInstance()
+	{
+		static DerivedDataCache derivedDataCache;
+		return derivedDataCache;
+	}
+private:
+	DerivedDataCache();
+public:
+	~DerivedDataCache();
+
+	DerivedDataCache(const DerivedDataCache &) = delete;
+	void operator=(const DerivedDataCache &) = delete;
+
+	// Creates the directory if needed, its parent has to exist. Nothing is scanned until the first put.
+	void init(const std::string & directory = DDC_DEFAULT_DIRECTORY, uint64_t maxSize = DDC_DEFAULT_MAX_SIZE);
+
+	bool isEnabled() const { return m_bEnabled; }
+	const std::string & getDirectory() const { return m_directory; }
+
+	// A mapped view of the cached output, false when there is none or it failed its checksum
+	bool get(const DerivedDataKey & key, FileView & data);
+
+	// False when the cache is disabled or the entry couldn't be written, which callers can ignore,
+	// the next import just does the work again
+	bool put(const DerivedDataKey & key, const void * data, size_t size);
+	bool put(const DerivedDataKey & key, const std::vector<uint8_t> & data) { return this->put(key, data.data(), data.size()); }
+
+	// Scans the directory and evicts least recently used entries while it is over the limit
+	void trim();
+
+	DerivedDataStats getStats() const;
+
+private:
+	std::string getFilename(const DerivedDataKey & key) const;
+
+	// Never evicts keep, the entry put() has just published
+	void trimLocked(const std::string & keep = std::string());
+
+	bool m_bEnabled;
+	std::string m_directory;
+	uint64_t m_uiMaxSize;
+
+	std::mutex m_mutex;
+	bool m_bSizeKnown; // The directory is only scanned once something is written
+	uint64_t m_uiSize;
+	int64_t m_iLastPublished; // Modification time of this process's last put, see put()
+
+	std::atomic<uint64_t> m_uiTemporaryCounter;
+
+	std::atomic<uint64_t> m_uiHits;
+	std::atomic<uint64_t> m_uiMisses;
+	std::atomic<uint64_t> m_uiWrites;
+	std::atomic<uint64_t> m_uiEvictions;
+	std::atomic<uint64_t> m_uiBytesEvicted;
+};
+
+template <typename T>
+DerivedDataKey & DerivedDataKey::addSetting(const std::string & name, T value)
+{
+	static_assert(std::is_arithmetic<T>::value, "Settings are strings or numbers");
+
+	this->add(name.data(), name.size());
+	this->add(&value, sizeof(value));
+
+	return *this;
+}
+
+#endif
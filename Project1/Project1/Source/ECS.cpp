@@ -0,0 +1,359 @@
+#include "ECS.h"
+
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace
+{
+	uint8_t * allocateColumn(size_t bytes)
+	{
+		void * data = nullptr;
+#ifdef _WIN32
+		data = _aligned_malloc(bytes, ECS_COLUMN_ALIGNMENT);
+#else
+		if (posix_memalign(&data, ECS_COLUMN_ALIGNMENT, bytes) != 0)
+		{
+			data = nullptr;
+		}
+#endif
+		if (!data)
+		{
+			throw std::runtime_error("Failed to allocate ECS column!");
+		}
+
+		return static_cast<uint8_t *>(data);
+	}
+
+	void freeColumn(uint8_t * data)
+	{
+#ifdef _WIN32
+		_aligned_free(data);
+#else
+		free(data);
+#endif
+	}
+}
+
+ComponentId ComponentRegistry::registerComponent(size_t size, size_t alignment, const char * name)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	unsigned id = m_uiCount.load(std::memory_order_relaxed);
+
+	if (id >= ECS_MAX_COMPONENTS)
+	{
+		throw std::runtime_error("Too many ECS component types, raise ECS_MAX_COMPONENTS!");
+	}
+
+	m_components[id] = { size, alignment, name };
+	m_uiCount.store(id + 1, std::memory_order_release);
+
+	return id;
+}
+
+Archetype::Archetype(const ComponentMask & mask)
+: m_mask(mask)
+, m_uiCount(0)
+, m_uiCapacity(0)
+{
+	for (int i = 0; i < ECS_MAX_COMPONENTS; i++)
+	{
+		m_addEdges[i] = nullptr;
+		m_removeEdges[i] = nullptr;
+		m_columnIndex[i] = -1;
+	}
+
+	for (ComponentId id = 0; id < ECS_MAX_COMPONENTS; id++)
+	{
+		if (mask.test(id))
+		{
+			m_columnIndex[id] = (int8_t)m_columns.size();
+			m_componentIds.push_back(id);
+			m_columns.push_back({ nullptr, ComponentRegistry::getInstance().getInfo(id).size });
+		}
+	}
+}
+
+Archetype::~Archetype()
+{
+	for (auto & column : m_columns)
+	{
+		if (column.data)
+		{
+			freeColumn(column.data);
+		}
+	}
+}
+
+void * Archetype::getColumn(ComponentId id)
+{
+	int column = m_columnIndex[id];
+	return column >= 0 ? m_columns[column].data : nullptr;
+}
+
+void * Archetype::getComponent(ComponentId id, uint32_t row)
+{
+	int column = m_columnIndex[id];
+	return column >= 0 ? m_columns[column].data + row * m_columns[column].elementSize : nullptr;
+}
+
+void Archetype::reserve(size_t capacity)
+{
+	if (capacity <= m_uiCapacity)
+	{
+		return;
+	}
+
+	for (auto & column : m_columns)
+	{
+		// Zero sized tags still get a valid pointer
+		uint8_t * data = allocateColumn(std::max<size_t>(capacity * column.elementSize, 1));
+
+		if (column.data)
+		{
+			memcpy(data, column.data, m_uiCount * column.elementSize);
+			freeColumn(column.data);
+		}
+
+		column.data = data;
+	}
+
+	m_entities.resize(capacity);
+	m_uiCapacity = capacity;
+}
+
+uint32_t Archetype::addRow(Entity entity)
+{
+	if (m_uiCount == m_uiCapacity)
+	{
+		this->reserve(std::max<size_t>(64, m_uiCapacity * 2));
+	}
+
+	uint32_t row = (uint32_t)m_uiCount++;
+
+	m_entities[row] = entity;
+
+	for (auto & column : m_columns)
+	{
+		memset(column.data + row * column.elementSize, 0, column.elementSize);
+	}
+
+	return row;
+}
+
+Entity Archetype::removeRow(uint32_t row)
+{
+	uint32_t last = (uint32_t)m_uiCount - 1;
+	m_uiCount--;
+
+	if (row == last)
+	{
+		return NULL_ENTITY;
+	}
+
+	// Fill the hole with the last row so the columns stay packed
+	for (auto & column : m_columns)
+	{
+		memcpy(column.data + row * column.elementSize, column.data + last * column.elementSize, column.elementSize);
+	}
+
+	m_entities[row] = m_entities[last];
+
+	return m_entities[row];
+}
+
+EntityWorld::EntityWorld()
+: m_uiAliveCount(0)
+{
+	m_emptyArchetype = this->getArchetype(ComponentMask());
+}
+
+EntityWorld::~EntityWorld()
+{
+
+}
+
+Entity EntityWorld::createEntity()
+{
+	return this->allocateEntity(m_emptyArchetype);
+}
+
+void EntityWorld::destroyEntity(Entity entity)
+{
+	if (!this->isAlive(entity))
+	{
+		return;
+	}
+
+	EntityRecord & record = m_records[entity.index];
+
+	Entity moved = record.archetype->removeRow(record.row);
+	if (!moved.isNull())
+	{
+		m_records[moved.index].row = record.row;
+	}
+
+	record.archetype = nullptr;
+
+	// Invalidate every outstanding handle, skipping 0 on wrap around
+	if (++record.generation == 0)
+	{
+		record.generation = 1;
+	}
+
+	m_freeIndices.push_back(entity.index);
+	m_uiAliveCount--;
+}
+
+bool EntityWorld::isAlive(Entity entity) const
+{
+	return entity.index < m_records.size() &&
+		m_records[entity.index].generation == entity.generation &&
+		m_records[entity.index].archetype != nullptr;
+}
+
+Archetype * EntityWorld::getArchetype(const ComponentMask & mask)
+{
+	auto found = m_archetypeLookup.find(mask);
+	if (found != m_archetypeLookup.end())
+	{
+		return found->second;
+	}
+
+	m_archetypes.push_back(std::unique_ptr<Archetype>(new Archetype(mask)));
+
+	Archetype * archetype = m_archetypes.back().get();
+	m_archetypeLookup[mask] = archetype;
+
+	return archetype;
+}
+
+Archetype * EntityWorld::getArchetypeWith(Archetype * source, ComponentId id)
+{
+	if (!source->m_addEdges[id])
+	{
+		ComponentMask mask = source->getMask();
+		mask.set(id);
+
+		Archetype * destination = this->getArchetype(mask);
+		source->m_addEdges[id] = destination;
+		destination->m_removeEdges[id] = source;
+	}
+
+	return source->m_addEdges[id];
+}
+
+Archetype * EntityWorld::getArchetypeWithout(Archetype * source, ComponentId id)
+{
+	if (!source->m_removeEdges[id])
+	{
+		ComponentMask mask = source->getMask();
+		mask.reset(id);
+
+		Archetype * destination = this->getArchetype(mask);
+		source->m_removeEdges[id] = destination;
+		destination->m_addEdges[id] = source;
+	}
+
+	return source->m_removeEdges[id];
+}
+
+void * EntityWorld::addComponent(Entity entity, ComponentId id)
+{
+	if (!this->isAlive(entity))
+	{
+		throw std::runtime_error("Adding a component to an entity that isn't alive!");
+	}
+
+	EntityRecord & record = m_records[entity.index];
+
+	if (!record.archetype->hasComponent(id))
+	{
+		this->moveEntity(record, this->getArchetypeWith(record.archetype, id));
+	}
+
+	return record.archetype->getComponent(id, record.row);
+}
+
+void EntityWorld::removeComponent(Entity entity, ComponentId id)
+{
+	if (!this->isAlive(entity))
+	{
+		return;
+	}
+
+	EntityRecord & record = m_records[entity.index];
+
+	if (record.archetype->hasComponent(id))
+	{
+		this->moveEntity(record, this->getArchetypeWithout(record.archetype, id));
+	}
+}
+
+void * EntityWorld::getComponent(Entity entity, ComponentId id)
+{
+	if (!this->isAlive(entity))
+	{
+		return nullptr;
+	}
+
+	const EntityRecord & record = m_records[entity.index];
+	return record.archetype->getComponent(id, record.row);
+}
+
+Entity EntityWorld::allocateEntity(Archetype * archetype)
+{
+	uint32_t index;
+
+	if (!m_freeIndices.empty())
+	{
+		index = m_freeIndices.back();
+		m_freeIndices.pop_back();
+	}
+	else
+	{
+		index = (uint32_t)m_records.size();
+		m_records.push_back({ nullptr, 0, 1 });
+	}
+
+	EntityRecord & record = m_records[index];
+
+	Entity entity = { index, record.generation };
+
+	record.archetype = archetype;
+	record.row = archetype->addRow(entity);
+
+	m_uiAliveCount++;
+
+	return entity;
+}
+
+void EntityWorld::moveEntity(EntityRecord & record, Archetype * destination)
+{
+	Archetype * source = record.archetype;
+	Entity entity = source->getEntities()[record.row];
+
+	uint32_t row = destination->addRow(entity);
+
+	// Carry over every component the two archetypes share
+	for (ComponentId id : source->getComponentIds())
+	{
+		void * target = destination->getComponent(id, row);
+		if (target)
+		{
+			memcpy(target, source->getComponent(id, record.row), ComponentRegistry::getInstance().getInfo(id).size);
+		}
+	}
+
+	Entity moved = source->removeRow(record.row);
+	if (!moved.isNull())
+	{
+		m_records[moved.index].row = record.row;
+	}
+
+	record.archetype = destination;
+	record.row = row;
+}
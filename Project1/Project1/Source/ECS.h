@@ -0,0 +1,382 @@
+#ifndef __ECS_H__
+#define __ECS_H__
+
+#include "JobSystem.h"
+
+#include <bitset>
+#include <vector>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+#include <typeinfo>
+#include <stdexcept>
+#include <cstring>
+#include <stdint.h>
+
+#define ECS_MAX_COMPONENTS 64 // Distinct component types across the program
+#define ECS_COLUMN_ALIGNMENT 64 // Every column starts on a cache line, which covers any SIMD load too
+#define ECS_DEFAULT_CHUNK_SIZE 4096 // Rows per job in a parallel query
+
+typedef uint32_t ComponentId;
+typedef std::bitset<ECS_MAX_COMPONENTS> ComponentMask;
+
+// Stable handle to an entity. The generation is bumped whenever the index gets recycled,
+// so a handle to a destroyed entity never aliases the one that replaced it.
+struct Entity
+{
+	uint32_t index;
+	uint32_t generation; // Starts at 1, 0 is never alive
+
+	bool isNull() const { return generation == 0; }
+
+	bool operator==(const Entity & other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity & other) const { return !(*this == other); }
+};
+
+const Entity NULL_ENTITY = { 0, 0 };
+
+struct ComponentInfo
+{
+	size_t size;
+	size_t alignment;
+	const char * name;
+};
+
+// Singleton ComponentRegistry
+// Hands out a small dense id per component type the first time it is used.
+class ComponentRegistry
+{
+public:
+	static ComponentRegistry & getInstance()
+	{
+		static ComponentRegistry componentRegistry;
+		return componentRegistry;
+	}
+private:
+	ComponentRegistry() : m_uiCount(0) {}
+public:
+	ComponentRegistry(const ComponentRegistry &) = delete;
+	void operator=(const ComponentRegistry &) = delete;
+
+	template <typename T>
+	static ComponentId getId()
+	{
+		// Columns are moved around with memcpy and never constructed or destroyed
+		static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "ECS components must be plain data");
+		static_assert(alignof(T) <= ECS_COLUMN_ALIGNMENT, "ECS component is over aligned");
+
+		static const ComponentId id = ComponentRegistry::getInstance().registerComponent(sizeof(T), alignof(T), typeid(T).name());
+		return id;
+	}
+
+	const ComponentInfo & getInfo(ComponentId id) const { return m_components[id]; }
+	unsigned getCount() const { return m_uiCount.load(std::memory_order_acquire); }
+
+private:
+	ComponentId registerComponent(size_t size, size_t alignment, const char * name);
+
+	ComponentInfo m_components[ECS_MAX_COMPONENTS];
+	std::atomic<unsigned> m_uiCount;
+	std::mutex m_mutex;
+};
+
+// Every entity with exactly the same set of components lives in the same archetype,
+// one tightly packed column per component plus a column of entity handles.
+class Archetype
+{
+public:
+	Archetype(const ComponentMask & mask);
+	virtual ~Archetype();
+
+	Archetype(const Archetype &) = delete;
+	void operator=(const Archetype &) = delete;
+
+	const ComponentMask & getMask() const { return m_mask; }
+	const std::vector<ComponentId> & getComponentIds() const { return m_componentIds; }
+	bool hasComponent(ComponentId id) const { return m_mask.test(id); }
+
+	size_t getCount() const { return m_uiCount; }
+	const Entity * getEntities() const { return m_entities.data(); }
+
+	// nullptr when the archetype doesn't have the component
+	void * getColumn(ComponentId id);
+	void * getComponent(ComponentId id, uint32_t row);
+
+	template <typename T>
+	T * getColumn() { return static_cast<T *>(this->getColumn(ComponentRegistry::getId<T>())); }
+
+	void reserve(size_t capacity);
+
+	// New row with zeroed components
+	uint32_t addRow(Entity entity);
+
+	// Swap-removes the row, returns the entity that was moved into it (NULL_ENTITY if it was the last row)
+	Entity removeRow(uint32_t row);
+
+	// Cached transitions to the archetype with one component added / removed
+	Archetype * m_addEdges[ECS_MAX_COMPONENTS];
+	Archetype * m_removeEdges[ECS_MAX_COMPONENTS];
+
+private:
+	struct Column
+	{
+		uint8_t * data;
+		size_t elementSize;
+	};
+
+	ComponentMask m_mask;
+	std::vector<ComponentId> m_componentIds;
+	std::vector<Column> m_columns;
+	int8_t m_columnIndex[ECS_MAX_COMPONENTS]; // -1 when absent
+
+	std::vector<Entity> m_entities;
+	size_t m_uiCount;
+	size_t m_uiCapacity;
+};
+
+// Entity / component store.
+// Structural changes (creating, destroying, adding or removing components) move rows between
+// archetypes, so they must not happen while a query is running.
+class EntityWorld
+{
+public:
+	EntityWorld();
+	virtual ~EntityWorld();
+
+	EntityWorld(const EntityWorld &) = delete;
+	void operator=(const EntityWorld &) = delete;
+
+	Entity createEntity();
+
+	template <typename... Components>
+	Entity createEntity(const Components &... components);
+
+	void destroyEntity(Entity entity);
+	bool isAlive(Entity entity) const;
+
+	size_t getEntityCount() const { return m_uiAliveCount; }
+	size_t getArchetypeCount() const { return m_archetypes.size(); }
+
+	// Replaces the value if the entity already has the component
+	template <typename T>
+	T & addComponent(Entity entity, const T & value = T());
+
+	template <typename T>
+	void removeComponent(Entity entity);
+
+	template <typename T>
+	bool hasComponent(Entity entity) const;
+
+	// nullptr when the entity is dead or doesn't have the component
+	template <typename T>
+	T * getComponent(Entity entity);
+
+	// Pre-sizes the archetype for this component set
+	template <typename... Components>
+	void reserve(size_t entityCount);
+
+	// function(Entity, Components &...) for every entity that has all of Components
+	template <typename... Components, typename Function>
+	void forEach(const Function & function);
+
+	// function(size_t count, const Entity *, Components *...) once per matching archetype
+	template <typename... Components, typename Function>
+	void forEachChunk(const Function & function);
+
+	// Same as forEachChunk, but the archetypes are cut into chunks of up to chunkSize rows
+	// which run on the job system. function has to be safe to call concurrently.
+	template <typename... Components, typename Function>
+	void parallelForEachChunk(const Function & function, size_t chunkSize = ECS_DEFAULT_CHUNK_SIZE);
+
+	template <typename... Components>
+	size_t count();
+
+	template <typename... Components>
+	static ComponentMask getMask();
+
+private:
+	struct EntityRecord
+	{
+		Archetype * archetype; // nullptr while the index is free
+		uint32_t row;
+		uint32_t generation;
+	};
+
+	struct QueryChunk
+	{
+		Archetype * archetype;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	Archetype * getArchetype(const ComponentMask & mask);
+	Archetype * getArchetypeWith(Archetype * source, ComponentId id);
+	Archetype * getArchetypeWithout(Archetype * source, ComponentId id);
+
+	void * addComponent(Entity entity, ComponentId id);
+	void removeComponent(Entity entity, ComponentId id);
+	void * getComponent(Entity entity, ComponentId id);
+
+	Entity allocateEntity(Archetype * archetype);
+	void moveEntity(EntityRecord & record, Archetype * destination);
+
+	template <typename Function, typename Tuple, size_t... Indices>
+	static void invokeChunk(const Function & function, size_t count, const Entity * entities, const Tuple & columns, size_t offset, std::index_sequence<Indices...>)
+	{
+		function(count, entities + offset, (std::get<Indices>(columns) + offset)...);
+	}
+
+	std::vector<EntityRecord> m_records;
+	std::vector<uint32_t> m_freeIndices;
+	size_t m_uiAliveCount;
+
+	std::vector<std::unique_ptr<Archetype>> m_archetypes;
+	std::unordered_map<ComponentMask, Archetype *> m_archetypeLookup;
+	Archetype * m_emptyArchetype;
+};
+
+template <typename... Components>
+ComponentMask EntityWorld::getMask()
+{
+	ComponentMask mask;
+	int expand[] = { 0, (mask.set(ComponentRegistry::getId<Components>()), 0)... };
+	(void)expand;
+	return mask;
+}
+
+template <typename... Components>
+Entity EntityWorld::createEntity(const Components &... components)
+{
+	// Straight into the final archetype rather than hopping through one per component
+	Archetype * archetype = this->getArchetype(getMask<Components...>());
+	Entity entity = this->allocateEntity(archetype);
+	uint32_t row = m_records[entity.index].row;
+
+	int expand[] = { 0, (memcpy(archetype->getComponent(ComponentRegistry::getId<Components>(), row), &components, sizeof(Components)), 0)... };
+	(void)expand;
+
+	return entity;
+}
+
+template <typename T>
+T & EntityWorld::addComponent(Entity entity, const T & value)
+{
+	T * component = static_cast<T *>(this->addComponent(entity, ComponentRegistry::getId<T>()));
+	*component = value;
+	return *component;
+}
+
+template <typename T>
+void EntityWorld::removeComponent(Entity entity)
+{
+	this->removeComponent(entity, ComponentRegistry::getId<T>());
+}
+
+template <typename T>
+bool EntityWorld::hasComponent(Entity entity) const
+{
+	return this->isAlive(entity) && m_records[entity.index].archetype->hasComponent(ComponentRegistry::getId<T>());
+}
+
+template <typename T>
+T * EntityWorld::getComponent(Entity entity)
+{
+	return static_cast<T *>(this->getComponent(entity, ComponentRegistry::getId<T>()));
+}
+
+template <typename... Components>
+void EntityWorld::reserve(size_t entityCount)
+{
+	this->getArchetype(getMask<Components...>())->reserve(entityCount);
+}
+
+template <typename... Components, typename Function>
+void EntityWorld::forEach(const Function & function)
+{
+	this->forEachChunk<Components...>([&function](size_t count, const Entity * entities, Components *... columns)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			function(entities[i], columns[i]...);
+		}
+	});
+}
+
+template <typename... Components, typename Function>
+void EntityWorld::forEachChunk(const Function & function)
+{
+	ComponentMask mask = getMask<Components...>();
+
+	for (auto & archetype : m_archetypes)
+	{
+		if (archetype->getCount() == 0 || (archetype->getMask() & mask) != mask)
+		{
+			continue;
+		}
+
+		std::tuple<Components *...> columns(archetype->template getColumn<Components>()...);
+		invokeChunk(function, archetype->getCount(), archetype->getEntities(), columns, 0, std::index_sequence_for<Components...>());
+	}
+}
+
+template <typename... Components, typename Function>
+void EntityWorld::parallelForEachChunk(const Function & function, size_t chunkSize)
+{
+	ComponentMask mask = getMask<Components...>();
+
+	if (chunkSize == 0)
+	{
+		chunkSize = ECS_DEFAULT_CHUNK_SIZE;
+	}
+
+	// One flat list across every archetype, so lots of small archetypes still spread over the threads
+	std::vector<QueryChunk> chunks;
+
+	for (auto & archetype : m_archetypes)
+	{
+		if (archetype->getCount() == 0 || (archetype->getMask() & mask) != mask)
+		{
+			continue;
+		}
+
+		for (size_t begin = 0; begin < archetype->getCount(); begin += chunkSize)
+		{
+			size_t end = std::min<size_t>(begin + chunkSize, archetype->getCount());
+			chunks.push_back({ archetype.get(), (uint32_t)begin, (uint32_t)end });
+		}
+	}
+
+	JobSystem::getInstance().parallelFor(0, chunks.size(), 1, [&chunks, &function](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			const QueryChunk & chunk = chunks[i];
+
+			std::tuple<Components *...> columns(chunk.archetype->template getColumn<Components>()...);
+			invokeChunk(function, chunk.end - chunk.begin, chunk.archetype->getEntities(), columns, chunk.begin, std::index_sequence_for<Components...>());
+		}
+	});
+}
+
+template <typename... Components>
+size_t EntityWorld::count()
+{
+	ComponentMask mask = getMask<Components...>();
+
+	size_t total = 0;
+	for (auto & archetype : m_archetypes)
+	{
+		if ((archetype->getMask() & mask) == mask)
+		{
+			total += archetype->getCount();
+		}
+	}
+
+	return total;
+}
+
+#endif
@@ -0,0 +1,376 @@
+#include "FileReader.h"
+
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	std::vector<std::shared_ptr<FileSource>> s_fileSources;
+	std::mutex s_fileSourceMutex;
+
+#ifdef _WIN32
+	// WIN32_MEMORY_RANGE_ENTRY, which the SDK only declares when targeting Windows 8 or later
+	struct MemoryRangeEntry
+	{
+		PVOID VirtualAddress;
+		SIZE_T NumberOfBytes;
+	};
+
+	typedef BOOL (WINAPI * PrefetchVirtualMemoryFunction)(HANDLE process, ULONG_PTR entryCount, MemoryRangeEntry * entries, ULONG flags);
+
+	// Looked up at runtime so the exe still starts on Windows 7, which doesn't have it, null there
+	PrefetchVirtualMemoryFunction getPrefetchVirtualMemory()
+	{
+		static PrefetchVirtualMemoryFunction function = reinterpret_cast<PrefetchVirtualMemoryFunction>(
+			GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory"));
+		return function;
+	}
+#endif
+
+	uint8_t * allocateBuffer(size_t bytes)
+	{
+		void * data = nullptr;
+#ifdef _WIN32
+		data = _aligned_malloc(std::max<size_t>(bytes, 1), FILE_BUFFER_ALIGNMENT);
+#else
+		if (posix_memalign(&data, FILE_BUFFER_ALIGNMENT, std::max<size_t>(bytes, 1)) != 0)
+		{
+			data = nullptr;
+		}
+#endif
+		if (!data)
+		{
+			throw std::runtime_error("Failed to allocate file buffer!");
+		}
+
+		return static_cast<uint8_t *>(data);
+	}
+
+	void freeBuffer(uint8_t * buffer)
+	{
+		if (buffer)
+		{
+#ifdef _WIN32
+			_aligned_free(buffer);
+#else
+			free(buffer);
+#endif
+		}
+	}
+
+	// The mapping or buffer behind a set of views
+	class FileStorage
+	{
+	public:
+		FileStorage() : m_pMapping(nullptr), m_uiMappingSize(0), m_pBuffer(nullptr) {}
+
+		~FileStorage()
+		{
+			if (m_pMapping)
+			{
+#ifdef _WIN32
+				UnmapViewOfFile(m_pMapping);
+#else
+				munmap(m_pMapping, m_uiMappingSize);
+#endif
+			}
+
+			freeBuffer(m_pBuffer);
+		}
+
+		FileStorage(const FileStorage &) = delete;
+		void operator=(const FileStorage &) = delete;
+
+		void * m_pMapping;
+		size_t m_uiMappingSize;
+		uint8_t * m_pBuffer;
+	};
+
+	// Maps the whole file, false when the file exists but can't be mapped
+	bool mapFile(const std::string & filename, FileStorage & storage, size_t & size, FILE_ACCESS_HINT hint)
+	{
+#ifdef _WIN32
+		DWORD flags = FILE_ATTRIBUTE_NORMAL;
+		flags |= hint == FILE_ACCESS_SEQUENTIAL ? FILE_FLAG_SEQUENTIAL_SCAN : 0;
+		flags |= hint == FILE_ACCESS_RANDOM ? FILE_FLAG_RANDOM_ACCESS : 0;
+
+		// Share delete so the file can still be deleted or renamed over while it's mapped, the same as on POSIX
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, flags, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Failed to open " + filename + ", does the file exist?");
+		}
+
+		LARGE_INTEGER fileSize;
+		if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize))
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		size = (size_t)fileSize.QuadPart;
+		if (size == 0)
+		{
+			// Nothing to map, and CreateFileMapping refuses empty files anyway
+			CloseHandle(file);
+			return true;
+		}
+
+		// The view keeps the mapping object alive, neither handle is needed afterwards
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+		{
+			storage.m_pMapping = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			storage.m_uiMappingSize = size;
+			CloseHandle(mapping);
+		}
+
+		CloseHandle(file);
+		return storage.m_pMapping != nullptr;
+#else
+		(void)hint; // Given to madvise once mapped
+
+		int file = ::open(filename.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			throw std::runtime_error("Failed to open " + filename + ", does the file exist?");
+		}
+
+		struct stat info;
+		if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode))
+		{
+			::close(file);
+			return false;
+		}
+
+		size = (size_t)info.st_size;
+		if (size == 0)
+		{
+			::close(file);
+			return true;
+		}
+
+		void * data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+		::close(file);
+
+		if (data == MAP_FAILED)
+		{
+			return false;
+		}
+
+		storage.m_pMapping = data;
+		storage.m_uiMappingSize = size;
+		return true;
+#endif
+	}
+
+	// Plain reads into an aligned buffer, also for streams whose size isn't known up front
+	void readBuffered(const std::string & filename, FileStorage & storage, size_t & size)
+	{
+		std::ifstream file(filename, std::ios::binary);
+
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open " + filename + ", does the file exist?");
+		}
+
+		size_t capacity = 64 * 1024;
+		size = 0;
+		storage.m_pBuffer = allocateBuffer(capacity);
+
+		while (file)
+		{
+			if (size == capacity)
+			{
+				uint8_t * grown = allocateBuffer(capacity * 2);
+				memcpy(grown, storage.m_pBuffer, size);
+				freeBuffer(storage.m_pBuffer);
+				storage.m_pBuffer = grown;
+				capacity *= 2;
+			}
+
+			file.read(reinterpret_cast<char *>(storage.m_pBuffer + size), capacity - size);
+			size += (size_t)file.gcount();
+		}
+
+		if (file.bad())
+		{
+			throw std::runtime_error("Failed to read " + filename + "!");
+		}
+	}
+}
+
+FileView::FileView()
+: m_pData(nullptr)
+, m_uiSize(0)
+, m_bMapped(false)
+{
+}
+
+FileView FileView::open(const std::string & filename, FILE_ACCESS_HINT hint)
+{
+	std::shared_ptr<FileStorage> storage = std::make_shared<FileStorage>();
+	size_t size = 0;
+
+	FileView view;
+
+	if (mapFile(filename, *storage, size, hint))
+	{
+		view.m_pData = static_cast<const uint8_t *>(storage->m_pMapping);
+		view.m_bMapped = storage->m_pMapping != nullptr;
+	}
+	else
+	{
+		readBuffered(filename, *storage, size);
+		view.m_pData = storage->m_pBuffer;
+	}
+
+	view.m_uiSize = size;
+	view.m_owner = storage;
+
+	if (view.m_bMapped && hint != FILE_ACCESS_NORMAL)
+	{
+		view.advise(hint);
+	}
+
+	return view;
+}
+
+FileView FileView::fromMemory(const void * data, size_t size, std::shared_ptr<const void> keepAlive)
+{
+	FileView view;
+	view.m_pData = static_cast<const uint8_t *>(data);
+	view.m_uiSize = size;
+	view.m_owner = std::move(keepAlive);
+
+	return view;
+}
+
+FileView FileView::subView(size_t offset, size_t size) const
+{
+	if (offset > m_uiSize || size > m_uiSize - offset)
+	{
+		throw std::runtime_error("File sub view is out of range!");
+	}
+
+	FileView view = *this;
+	view.m_pData = m_pData + offset;
+	view.m_uiSize = size;
+
+	return view;
+}
+
+void FileView::advise(FILE_ACCESS_HINT hint) const
+{
+	if (!m_bMapped || m_uiSize == 0)
+	{
+		return;
+	}
+
+#ifndef _WIN32
+	// madvise wants a page aligned start, which a sub view might not have
+	uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t begin = reinterpret_cast<uintptr_t>(m_pData) & ~(pageSize - 1);
+	size_t length = (size_t)(reinterpret_cast<uintptr_t>(m_pData) + m_uiSize - begin);
+
+	int advice = MADV_NORMAL;
+	switch (hint)
+	{
+	case FILE_ACCESS_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+	case FILE_ACCESS_RANDOM: advice = MADV_RANDOM; break;
+	case FILE_ACCESS_WILLNEED: advice = MADV_WILLNEED; break;
+	default: break;
+	}
+
+	madvise(reinterpret_cast<void *>(begin), length, advice);
+#else
+	// Windows only has the read ahead half, and only from Windows 8 on
+	PrefetchVirtualMemoryFunction prefetchVirtualMemory = getPrefetchVirtualMemory();
+	if (hint == FILE_ACCESS_WILLNEED && prefetchVirtualMemory)
+	{
+		MemoryRangeEntry range = { const_cast<uint8_t *>(m_pData), m_uiSize };
+		prefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+#endif
+}
+
+void FileView::reset()
+{
+	m_pData = nullptr;
+	m_uiSize = 0;
+	m_bMapped = false;
+	m_owner.reset();
+}
+
+std::shared_ptr<uint8_t> allocateFileBuffer(size_t size)
+{
+	return std::shared_ptr<uint8_t>(allocateBuffer(size), freeBuffer);
+}
+
+void mountFileSource(const std::shared_ptr<FileSource> & source)
+{
+	std::lock_guard<std::mutex> lock(s_fileSourceMutex);
+	s_fileSources.push_back(source);
+}
+
+void unmountFileSource(const std::shared_ptr<FileSource> & source)
+{
+	std::lock_guard<std::mutex> lock(s_fileSourceMutex);
+	s_fileSources.erase(std::remove(s_fileSources.begin(), s_fileSources.end(), source), s_fileSources.end());
+}
+
+bool locateMountedFile(const std::string & filename, FileLocation & location)
+{
+	std::vector<std::shared_ptr<FileSource>> sources;
+	{
+		std::lock_guard<std::mutex> lock(s_fileSourceMutex);
+		sources = s_fileSources;
+	}
+
+	for (auto it = sources.rbegin(); it != sources.rend(); ++it)
+	{
+		if ((*it)->locateFile(filename, location))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+FileView readFile(const std::string & filename, FILE_ACCESS_HINT hint)
+{
+	std::vector<std::shared_ptr<FileSource>> sources;
+	{
+		// Copied so a source can be unmounted while another thread is reading from it
+		std::lock_guard<std::mutex> lock(s_fileSourceMutex);
+		sources = s_fileSources;
+	}
+
+	FileView view;
+	for (auto it = sources.rbegin(); it != sources.rend(); ++it)
+	{
+		if ((*it)->readFile(filename, hint, view))
+		{
+			return view;
+		}
+	}
+
+	return FileView::open(filename, hint);
+}
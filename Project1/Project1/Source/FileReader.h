@@ -1,27 +1,112 @@
 #ifndef __FILE_READER_H__
 #define __FILE_READER_H__
 
-#include <fstream>
-#include <vector>
+#include <memory>
 #include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <stdint.h>
 
-static std::vector<char> readFile(const std::string & filename)
+#define FILE_BUFFER_ALIGNMENT 4096 // Fallback buffers are page aligned just like a mapping
+
+enum FILE_ACCESS_HINT
 {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	FILE_ACCESS_NORMAL,
+	FILE_ACCESS_SEQUENTIAL, // Read front to back once, the OS can read ahead aggressively and drop pages behind
+	FILE_ACCESS_RANDOM, // Scattered reads, read ahead would only waste I/O
+	FILE_ACCESS_WILLNEED, // Needed soon, start paging it all in now
+};
 
-	if (!file.is_open())
-	{
-		throw std::runtime_error("Failed to open " + filename + ", does the file exist?\n");
-	}
+// Read only view of a file's contents. Normally the file is memory mapped, so opening it neither
+// allocates nor copies and pages come in as they are touched; files that can't be mapped
+// (pipes, special files, or when mapping fails) are read into a page aligned buffer instead.
+// Either way data() is at least FILE_BUFFER_ALIGNMENT aligned.
+// Views are cheap to copy, copies and sub views share the mapping, which goes away with the last of them.
+class FileView
+{
+public:
+	FileView();
+
+	// Throws when the file can't be opened
+	static FileView open(const std::string & filename, FILE_ACCESS_HINT hint = FILE_ACCESS_NORMAL);
+
+	// Wraps memory the caller owns, keepAlive is released with the last view
+	static FileView fromMemory(const void * data, size_t size, std::shared_ptr<const void> keepAlive);
+
+	const uint8_t * data() const { return m_pData; }
+	size_t size() const { return m_uiSize; }
+	bool empty() const { return m_uiSize == 0; }
+	bool isMapped() const { return m_bMapped; }
+
+	// Throws when the view isn't aligned or sized for T, e.g. SPIR-V has to be read as uint32_t
+	template <typename T>
+	const T * as() const;
+
+	// Part of this view, sharing its mapping
+	FileView subView(size_t offset, size_t size) const;
+
+	// madvise where the platform has it, a no-op otherwise
+	void advise(FILE_ACCESS_HINT hint) const;
+
+	void reset();
+
+private:
+	const uint8_t * m_pData;
+	size_t m_uiSize;
+	bool m_bMapped;
+	std::shared_ptr<const void> m_owner;
+};
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
+// FILE_BUFFER_ALIGNMENT aligned, e.g. for reads that are handed out as views with FileView::fromMemory
+std::shared_ptr<uint8_t> allocateFileBuffer(size_t size);
 
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
+// Where a FileSource keeps a file, so it can be read asynchronously (see IOService)
+struct FileLocation
+{
+	FileView data; // Set when the contents are already in memory, nothing has to be read
+
+	// Otherwise the stored bytes are size bytes at offset in filename
+	std::string filename;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+
+	// Turns the stored bytes into the contents when they differ (e.g. compressed), throws when they are corrupt
+	std::function<FileView(const FileView & stored)> decode;
+};
+
+// Somewhere other than the disk that readFile can find files, e.g. a pack archive
+class FileSource
+{
+public:
+	virtual ~FileSource() {}
+
+	// False when the source doesn't have the file
+	virtual bool readFile(const std::string & filename, FILE_ACCESS_HINT hint, FileView & view) = 0;
+
+	// Like readFile but without reading anything, false when the source doesn't have the file
+	virtual bool locateFile(const std::string & filename, FileLocation & location) = 0;
+};
+
+// Mounted sources are asked newest first, the disk only once none of them has the file
+void mountFileSource(const std::shared_ptr<FileSource> & source);
+void unmountFileSource(const std::shared_ptr<FileSource> & source);
+
+// Asks the mounted sources in the same order as readFile, false when the file is to be read from the disk
+bool locateMountedFile(const std::string & filename, FileLocation & location);
+
+// Opens the whole file, see FileView
+FileView readFile(const std::string & filename, FILE_ACCESS_HINT hint = FILE_ACCESS_SEQUENTIAL);
+
+template <typename T>
+const T * FileView::as() const
+{
+	if (reinterpret_cast<uintptr_t>(m_pData) % alignof(T) != 0 || m_uiSize % sizeof(T) != 0)
+	{
+		throw std::runtime_error("File view isn't aligned or sized for the type it is read as!");
+	}
 
-	return buffer;
+	return reinterpret_cast<const T *>(m_pData);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,106 @@
+#include "FrameLimiter.h"
+
+#include <thread>
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <mmsystem.h>
+#endif
+
+#define FRAME_LIMITER_CALIBRATION_SLEEPS 10
+
+FrameLimiter::FrameLimiter()
+: m_dTargetFrameRate(0.0)
+, m_framePeriod(0)
+, m_bStarted(false)
+, m_dSleepSlack(0.002)
+, m_bTimerResolutionSet(false)
+{
+#ifdef _WIN32
+	// The default scheduler tick is ~15.6ms, far too coarse to sleep part of a frame
+	m_bTimerResolutionSet = timeBeginPeriod(1) == TIMERR_NOERROR;
+#endif
+}
+
+FrameLimiter::~FrameLimiter()
+{
+#ifdef _WIN32
+	if (m_bTimerResolutionSet)
+	{
+		timeEndPeriod(1);
+	}
+#endif
+}
+
+void FrameLimiter::setTargetFrameRate(double framesPerSecond)
+{
+	m_dTargetFrameRate = std::max<double>(0.0, framesPerSecond);
+	m_framePeriod = m_dTargetFrameRate > 0.0 ?
+		std::chrono::duration_cast<Timer::Clock::duration>(std::chrono::duration<double>(1.0 / m_dTargetFrameRate)) :
+		Timer::Clock::duration(0);
+	m_bStarted = false;
+}
+
+void FrameLimiter::calibrate()
+{
+	double worstOvershoot = 0.0;
+
+	for (int i = 0; i < FRAME_LIMITER_CALIBRATION_SLEEPS; i++)
+	{
+		Timer sleepTimer;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		worstOvershoot = std::max<double>(worstOvershoot, sleepTimer.getElapsedSeconds() - 0.001);
+	}
+
+	m_dSleepSlack = std::min<double>(worstOvershoot, FRAME_LIMITER_MAX_SLACK);
+
+	std::cout << "Frame Limiter sleep slack " << m_dSleepSlack * 1000.0 << "ms" << std::endl;
+}
+
+double FrameLimiter::wait()
+{
+	if (m_dTargetFrameRate <= 0.0)
+	{
+		return 0.0;
+	}
+
+	Timer::Clock::time_point now = Timer::Clock::now();
+
+	// Fixed cadence, a late frame doesn't push the later ones back, but a long stall
+	// (more than a whole frame late) restarts it rather than rushing to catch up
+	if (!m_bStarted || now > m_nextFrame + m_framePeriod)
+	{
+		m_nextFrame = now;
+		m_bStarted = true;
+	}
+
+	m_nextFrame += m_framePeriod;
+
+	this->waitUntil(m_nextFrame);
+
+	return std::chrono::duration<double>(Timer::Clock::now() - now).count();
+}
+
+void FrameLimiter::waitUntil(Timer::Clock::time_point deadline)
+{
+	double remaining = std::chrono::duration<double>(deadline - Timer::Clock::now()).count();
+	double sleepTime = remaining - m_dSleepSlack - FRAME_LIMITER_SPIN_MARGIN;
+
+	if (sleepTime > 0.0)
+	{
+		Timer sleepTimer;
+		std::this_thread::sleep_for(std::chrono::duration<double>(sleepTime));
+
+		// Track the timer slack as it drifts (power states, other load), quick to grow, slow to shrink
+		double overshoot = std::min<double>(std::max<double>(sleepTimer.getElapsedSeconds() - sleepTime, 0.0), FRAME_LIMITER_MAX_SLACK);
+		m_dSleepSlack = overshoot > m_dSleepSlack ? overshoot : m_dSleepSlack * 0.95 + overshoot * 0.05;
+	}
+
+	while (Timer::Clock::now() < deadline)
+	{
+		std::this_thread::yield();
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef __FRAME_LIMITER_H__
+#define __FRAME_LIMITER_H__
+
+#include "Timer.h"
+
+#define FRAME_LIMITER_SPIN_MARGIN 0.0002 // Seconds always left to the spin, even with a perfect sleep
+#define FRAME_LIMITER_MAX_SLACK 0.004 // Cap on the measured oversleep, anything past it is treated as a one-off
+
+// Paces a loop to a target rate without burning a core.
+// Each wait sleeps until just before the deadline, leaving enough room for how late the OS
+// wakes us (measured up front, then tracked on every sleep), and spins the rest of the way.
+class FrameLimiter
+{
+public:
+	FrameLimiter();
+	virtual ~FrameLimiter();
+
+	FrameLimiter(const FrameLimiter &) = delete;
+	void operator=(const FrameLimiter &) = delete;
+
+	// 0 turns the limiter off
+	void setTargetFrameRate(double framesPerSecond);
+	double getTargetFrameRate() const { return m_dTargetFrameRate; }
+
+	// Measures how far past a short sleep the OS wakes up
+	void calibrate();
+
+	// Blocks until the next frame is due, returns the seconds spent waiting
+	double wait();
+
+	// Hybrid sleep then spin until deadline
+	void waitUntil(Timer::Clock::time_point deadline);
+
+	double getSleepSlack() const { return m_dSleepSlack; }
+
+private:
+	double m_dTargetFrameRate;
+	Timer::Clock::duration m_framePeriod;
+	Timer::Clock::time_point m_nextFrame;
+	bool m_bStarted;
+
+	double m_dSleepSlack; // Seconds a sleep has been seen to overshoot by
+
+	bool m_bTimerResolutionSet;
+};
+
+#endif
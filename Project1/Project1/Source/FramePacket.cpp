@@ -0,0 +1,68 @@
+#include "FramePacket.h"
+
+#include <algorithm>
+
+FramePacketRing::FramePacketRing(unsigned pipelineDepth)
+{
+	// We only support running one or two frames ahead
+	pipelineDepth = std::min<unsigned>(std::max<unsigned>(pipelineDepth, 1), 2);
+	m_packets.resize(pipelineDepth + 1);
+}
+
+FramePacket * FramePacketRing::beginWrite()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_condition.wait(lock, [this]() { return m_bClosed || m_uiPublished - m_uiReleased < m_packets.size(); });
+
+	if (m_bClosed)
+	{
+		return nullptr;
+	}
+
+	FramePacket * packet = &m_packets[m_uiPublished % m_packets.size()];
+	packet->clear();
+
+	return packet;
+}
+
+void FramePacketRing::endWrite()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_uiPublished++;
+	}
+	m_condition.notify_all();
+}
+
+const FramePacket * FramePacketRing::beginRead()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_condition.wait(lock, [this]() { return m_bClosed || m_uiAcquired < m_uiPublished; });
+
+	if (m_uiAcquired == m_uiPublished)
+	{
+		return nullptr;
+	}
+
+	return &m_packets[m_uiAcquired++ % m_packets.size()];
+}
+
+void FramePacketRing::endRead()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_uiReleased++;
+	}
+	m_condition.notify_all();
+}
+
+void FramePacketRing::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bClosed = true;
+	}
+	m_condition.notify_all();
+}
@@ -0,0 +1,86 @@
+#ifndef __FRAME_PACKET_H__
+#define __FRAME_PACKET_H__
+
+#include "Model.h"
+
+#include <mat4x4.hpp>
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+// Everything the render thread needs to draw one frame, written by the simulation thread
+// and never touched again once it has been published.
+struct FramePacket
+{
+	struct DrawItem
+	{
+		uint32_t meshId;
+		uint32_t vertexCount;
+		uint32_t objectIndex; // Index into objectConstants
+	};
+
+	struct ObjectConstants
+	{
+		glm::mat4 model;
+	};
+
+	uint64_t frameNumber = 0;
+	double simulationTime = 0.0; // Simulated seconds since start
+	float simulationMs = 0.0f; // CPU time spent on the simulation steps behind this frame
+
+	uint64_t inputEventId = 0; // Newest input event the simulation had consumed for this frame
+	int64_t inputTimestampNs = 0; // When that event came in
+
+	MVCModel::SimulationState camera;
+	glm::mat4 view;
+	glm::mat4 projection;
+
+	std::vector<DrawItem> drawList;
+	std::vector<ObjectConstants> objectConstants;
+
+	void clear()
+	{
+		drawList.clear();
+		objectConstants.clear();
+	}
+};
+
+// Bounded single producer / single consumer ring of frame packets.
+// pipelineDepth is how many frames the simulation may run ahead of the frame being rendered,
+// the ring holds one extra slot for the packet the render thread is working on.
+class FramePacketRing
+{
+public:
+	FramePacketRing(unsigned pipelineDepth = 1);
+
+	FramePacketRing(const FramePacketRing &) = delete;
+	void operator=(const FramePacketRing &) = delete;
+
+	// Producer: blocks until a slot is free, returns nullptr once the ring is closed
+	FramePacket * beginWrite();
+	void endWrite();
+
+	// Consumer: blocks until a packet is published, returns nullptr once the ring is closed and drained
+	const FramePacket * beginRead();
+	void endRead();
+
+	// Wakes both sides and makes every further begin call fail
+	void close();
+
+	unsigned getPipelineDepth() { return (unsigned)m_packets.size() - 1; }
+
+private:
+	std::vector<FramePacket> m_packets;
+
+	uint64_t m_uiPublished = 0; // Packets handed to the consumer
+	uint64_t m_uiAcquired = 0; // Packets the consumer has started on
+	uint64_t m_uiReleased = 0; // Packets the consumer is done with
+	bool m_bClosed = false;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+};
+
+#endif
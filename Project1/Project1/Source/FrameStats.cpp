@@ -0,0 +1,342 @@
+#include "FrameStats.h"
+
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+
+static int getHighestBit(uint64_t value)
+{
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(value);
+#else
+	int bit = 0;
+	while (value >>= 1)
+	{
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+	this->reset();
+}
+
+int LatencyHistogram::getBucketIndex(uint64_t value)
+{
+	if (value < (uint64_t)SUB_BUCKET_COUNT)
+	{
+		return (int)value;
+	}
+
+	// Shift the value down so it lands in [HALF, COUNT), every shift step adds HALF buckets
+	int shift = getHighestBit(value) - (SUB_BUCKET_BITS - 1);
+	int subBucket = (int)(value >> shift) - SUB_BUCKET_HALF;
+
+	return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF + subBucket;
+}
+
+uint64_t LatencyHistogram::getBucketUpperBound(int index)
+{
+	if (index < SUB_BUCKET_COUNT)
+	{
+		return (uint64_t)index;
+	}
+
+	int offset = index - SUB_BUCKET_COUNT;
+	int shift = offset / SUB_BUCKET_HALF + 1;
+	uint64_t subBucket = (uint64_t)(offset % SUB_BUCKET_HALF + SUB_BUCKET_HALF);
+
+	return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t valueUs)
+{
+	m_counts[getBucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+	m_uiCount.fetch_add(1, std::memory_order_relaxed);
+	m_uiSum.fetch_add(valueUs, std::memory_order_relaxed);
+
+	uint64_t currentMax = m_uiMax.load(std::memory_order_relaxed);
+	while (valueUs > currentMax && !m_uiMax.compare_exchange_weak(currentMax, valueUs, std::memory_order_relaxed))
+	{
+	}
+}
+
+void LatencyHistogram::reset()
+{
+	for (int i = 0; i < BUCKET_COUNT; i++)
+	{
+		m_counts[i].store(0, std::memory_order_relaxed);
+	}
+
+	m_uiCount.store(0, std::memory_order_relaxed);
+	m_uiSum.store(0, std::memory_order_relaxed);
+	m_uiMax.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const
+{
+	uint64_t total = this->getCount();
+
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	uint64_t target = (uint64_t)std::ceil((percentile / 100.0) * (double)total);
+	if (target == 0)
+	{
+		target = 1;
+	}
+
+	uint64_t cumulative = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++)
+	{
+		cumulative += m_counts[i].load(std::memory_order_relaxed);
+
+		if (cumulative >= target)
+		{
+			// Never report more than what was actually seen
+			uint64_t upperBound = getBucketUpperBound(i);
+			uint64_t maxValue = this->getMax();
+			return upperBound < maxValue ? upperBound : maxValue;
+		}
+	}
+
+	return this->getMax();
+}
+
+double LatencyHistogram::getMean() const
+{
+	uint64_t count = this->getCount();
+	return count > 0 ? (double)m_uiSum.load(std::memory_order_relaxed) / (double)count : 0.0;
+}
+
+FrameStats::FrameStats()
+: m_ring(new RingSlot[RING_SIZE])
+, m_uiWriteIndex(0)
+{
+	for (uint64_t i = 0; i < RING_SIZE; i++)
+	{
+		m_ring[i].sequence.store(0, std::memory_order_relaxed);
+	}
+}
+
+void FrameStats::record(const FrameSample & sample)
+{
+	uint64_t index = m_uiWriteIndex.load(std::memory_order_relaxed);
+	RingSlot & slot = m_ring[index & (RING_SIZE - 1)];
+
+	// Seqlock write, readers retry or skip the slot while the sequence is odd
+	slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.sample = sample;
+	slot.sequence.store(index * 2 + 2, std::memory_order_release);
+
+	m_uiWriteIndex.store(index + 1, std::memory_order_release);
+
+	for (int i = 0; i < METRIC_COUNT; i++)
+	{
+		float timeMs = sample.timesMs[i] > 0.0f ? sample.timesMs[i] : 0.0f;
+		m_histograms[i].record((uint64_t)(timeMs * 1000.0f));
+	}
+}
+
+void FrameStats::recordLatency(LATENCY_METRIC metric, uint64_t latencyUs)
+{
+	m_latencyHistograms[metric].record(latencyUs);
+}
+
+void FrameStats::reset()
+{
+	for (int i = 0; i < METRIC_COUNT; i++)
+	{
+		m_histograms[i].reset();
+	}
+
+	for (int i = 0; i < LATENCY_COUNT; i++)
+	{
+		m_latencyHistograms[i].reset();
+	}
+}
+
+std::vector<FrameSample> FrameStats::getSamples() const
+{
+	std::vector<FrameSample> samples;
+
+	uint64_t end = m_uiWriteIndex.load(std::memory_order_acquire);
+	uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+
+	samples.reserve((size_t)(end - begin));
+
+	for (uint64_t index = begin; index < end; index++)
+	{
+		const RingSlot & slot = m_ring[index & (RING_SIZE - 1)];
+
+		uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		FrameSample sample = slot.sample;
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// Skip anything the writer lapped while we were copying
+		if (sequence != index * 2 + 2 || slot.sequence.load(std::memory_order_relaxed) != sequence)
+		{
+			continue;
+		}
+
+		samples.push_back(sample);
+	}
+
+	return samples;
+}
+
+void FrameStats::report(std::ostream & out) const
+{
+	out << "Frame Statistics (ms)" << std::endl;
+	out << std::left << std::setw(12) << "Metric" << std::right
+		<< std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p95"
+		<< std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+
+	out << std::fixed << std::setprecision(3);
+
+	for (int i = 0; i < METRIC_COUNT; i++)
+	{
+		const LatencyHistogram & histogram = m_histograms[i];
+
+		out << std::left << std::setw(12) << getMetricName((FRAME_METRIC)i) << std::right
+			<< std::setw(10) << histogram.getMean() / 1000.0
+			<< std::setw(10) << histogram.getPercentile(50.0) / 1000.0
+			<< std::setw(10) << histogram.getPercentile(95.0) / 1000.0
+			<< std::setw(10) << histogram.getPercentile(99.0) / 1000.0
+			<< std::setw(10) << histogram.getMax() / 1000.0 << std::endl;
+	}
+
+	for (int i = 0; i < LATENCY_COUNT; i++)
+	{
+		const LatencyHistogram & histogram = m_latencyHistograms[i];
+
+		if (histogram.getCount() == 0)
+		{
+			continue;
+		}
+
+		out << std::left << std::setw(12) << getLatencyName((LATENCY_METRIC)i) << std::right
+			<< std::setw(10) << histogram.getMean() / 1000.0
+			<< std::setw(10) << histogram.getPercentile(50.0) / 1000.0
+			<< std::setw(10) << histogram.getPercentile(95.0) / 1000.0
+			<< std::setw(10) << histogram.getPercentile(99.0) / 1000.0
+			<< std::setw(10) << histogram.getMax() / 1000.0
+			<< "  (" << histogram.getCount() << " inputs)" << std::endl;
+	}
+
+	out << std::defaultfloat;
+}
+
+bool FrameStats::dumpCSV(const std::string & filename) const
+{
+	std::ofstream file(filename);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << "frame";
+	for (int i = 0; i < METRIC_COUNT; i++)
+	{
+		file << "," << getMetricName((FRAME_METRIC)i) << "_ms";
+	}
+	file << "\n";
+
+	for (const auto & sample : this->getSamples())
+	{
+		file << sample.frameNumber;
+		for (int i = 0; i < METRIC_COUNT; i++)
+		{
+			file << "," << sample.timesMs[i];
+		}
+		file << "\n";
+	}
+
+	return true;
+}
+
+bool FrameStats::dumpJSON(const std::string & filename) const
+{
+	std::ofstream file(filename);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << "{\n\t\"summary\": {\n";
+	for (int i = 0; i < METRIC_COUNT; i++)
+	{
+		const LatencyHistogram & histogram = m_histograms[i];
+
+		file << "\t\t\"" << getMetricName((FRAME_METRIC)i) << "\": { "
+			<< "\"count\": " << histogram.getCount()
+			<< ", \"mean_ms\": " << histogram.getMean() / 1000.0
+			<< ", \"p50_ms\": " << histogram.getPercentile(50.0) / 1000.0
+			<< ", \"p95_ms\": " << histogram.getPercentile(95.0) / 1000.0
+			<< ", \"p99_ms\": " << histogram.getPercentile(99.0) / 1000.0
+			<< ", \"max_ms\": " << histogram.getMax() / 1000.0 << " }"
+			<< (i + 1 < METRIC_COUNT ? ",\n" : "\n");
+	}
+	file << "\t},\n\t\"latency\": {\n";
+	for (int i = 0; i < LATENCY_COUNT; i++)
+	{
+		const LatencyHistogram & histogram = m_latencyHistograms[i];
+
+		file << "\t\t\"" << getLatencyName((LATENCY_METRIC)i) << "\": { "
+			<< "\"count\": " << histogram.getCount()
+			<< ", \"mean_ms\": " << histogram.getMean() / 1000.0
+			<< ", \"p50_ms\": " << histogram.getPercentile(50.0) / 1000.0
+			<< ", \"p95_ms\": " << histogram.getPercentile(95.0) / 1000.0
+			<< ", \"p99_ms\": " << histogram.getPercentile(99.0) / 1000.0
+			<< ", \"max_ms\": " << histogram.getMax() / 1000.0 << " }"
+			<< (i + 1 < LATENCY_COUNT ? ",\n" : "\n");
+	}
+	file << "\t},\n\t\"frames\": [\n";
+
+	std::vector<FrameSample> samples = this->getSamples();
+	for (size_t s = 0; s < samples.size(); s++)
+	{
+		file << "\t\t{ \"frame\": " << samples[s].frameNumber;
+		for (int i = 0; i < METRIC_COUNT; i++)
+		{
+			file << ", \"" << getMetricName((FRAME_METRIC)i) << "\": " << samples[s].timesMs[i];
+		}
+		file << " }" << (s + 1 < samples.size() ? ",\n" : "\n");
+	}
+
+	file << "\t]\n}\n";
+
+	return true;
+}
+
+const char * FrameStats::getMetricName(FRAME_METRIC metric)
+{
+	switch (metric)
+	{
+	case METRIC_CPU_FRAME: return "cpu_frame";
+	case METRIC_SIMULATION: return "simulation";
+	case METRIC_ACQUIRE: return "acquire";
+	case METRIC_FENCE_WAIT: return "fence_wait";
+	case METRIC_RECORD: return "record";
+	case METRIC_SUBMIT: return "submit";
+	case METRIC_PRESENT: return "present";
+	default: return "unknown";
+	}
+}
+
+const char * FrameStats::getLatencyName(LATENCY_METRIC metric)
+{
+	switch (metric)
+	{
+	case LATENCY_INPUT_TO_PRESENT: return "input_present";
+	case LATENCY_INPUT_TO_DISPLAY: return "input_display";
+	default: return "unknown";
+	}
+}
@@ -0,0 +1,126 @@
+#ifndef __FRAME_STATS_H__
+#define __FRAME_STATS_H__
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <memory>
+#include <stdint.h>
+
+// Log-linear (HDR style) histogram of microsecond values.
+// Values below 64us land in exact buckets, above that every power of two is split into 32
+// buckets, which keeps the relative error under ~3% from 1us up to hours.
+// Recording is lock free so one thread can record while any other reads.
+class LatencyHistogram
+{
+public:
+	static const int SUB_BUCKET_BITS = 6;
+	static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS; // 64
+	static const int SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2; // 32
+	static const int BUCKET_COUNT = SUB_BUCKET_COUNT + (64 - SUB_BUCKET_BITS) * SUB_BUCKET_HALF;
+
+	LatencyHistogram();
+
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	void operator=(const LatencyHistogram &) = delete;
+
+	void record(uint64_t valueUs);
+	void reset();
+
+	// Upper bound of the bucket holding the given percentile (0 - 100)
+	uint64_t getPercentile(double percentile) const;
+	uint64_t getMax() const { return m_uiMax.load(std::memory_order_relaxed); }
+	uint64_t getCount() const { return m_uiCount.load(std::memory_order_relaxed); }
+	double getMean() const;
+
+	static int getBucketIndex(uint64_t value);
+	static uint64_t getBucketUpperBound(int index);
+
+private:
+	std::atomic<uint64_t> m_counts[BUCKET_COUNT];
+	std::atomic<uint64_t> m_uiCount;
+	std::atomic<uint64_t> m_uiSum;
+	std::atomic<uint64_t> m_uiMax;
+};
+
+enum FRAME_METRIC
+{
+	METRIC_CPU_FRAME, // Render thread time from one frame to the next
+	METRIC_SIMULATION, // Simulation steps that produced the frame packet
+	METRIC_ACQUIRE, // vkAcquireNextImageKHR
+	METRIC_FENCE_WAIT, // Waiting for the command buffer's previous submission
+	METRIC_RECORD, // Command buffer recording
+	METRIC_SUBMIT, // vkQueueSubmit
+	METRIC_PRESENT, // vkQueuePresentKHR
+	METRIC_COUNT,
+};
+
+// Sparse metrics, only recorded for frames that reflect new input
+enum LATENCY_METRIC
+{
+	LATENCY_INPUT_TO_PRESENT, // Input event to vkQueuePresentKHR returning
+	LATENCY_INPUT_TO_DISPLAY, // Input event to the image reaching the display (VK_GOOGLE_display_timing)
+	LATENCY_COUNT,
+};
+
+struct FrameSample
+{
+	uint64_t frameNumber = 0;
+	float timesMs[METRIC_COUNT] = {};
+};
+
+// Singleton FrameStats
+// Per frame timings go into a lock free ring of the most recent samples plus one histogram per
+// metric. Meant to be fed by a single thread (the render thread), read from anywhere.
+class FrameStats
+{
+public:
+	static FrameStats & getInstance()
+	{
+		static FrameStats frameStats;
+		return frameStats;
+	}
+private:
+	FrameStats();
+public:
+	FrameStats(const FrameStats &) = delete;
+	void operator=(const FrameStats &) = delete;
+
+	static const uint64_t RING_SIZE = 16384; // Must be a power of two
+
+	// Single producer
+	void record(const FrameSample & sample);
+	void recordLatency(LATENCY_METRIC metric, uint64_t latencyUs);
+
+	void reset();
+
+	// Copies out the samples currently held in the ring, oldest first
+	std::vector<FrameSample> getSamples() const;
+	const LatencyHistogram & getHistogram(FRAME_METRIC metric) const { return m_histograms[metric]; }
+	const LatencyHistogram & getLatencyHistogram(LATENCY_METRIC metric) const { return m_latencyHistograms[metric]; }
+
+	// p50 / p95 / p99 / max for every metric
+	void report(std::ostream & out) const;
+
+	bool dumpCSV(const std::string & filename) const;
+	bool dumpJSON(const std::string & filename) const;
+
+	static const char * getMetricName(FRAME_METRIC metric);
+	static const char * getLatencyName(LATENCY_METRIC metric);
+
+private:
+	struct RingSlot
+	{
+		std::atomic<uint64_t> sequence; // Odd while being written
+		FrameSample sample;
+	};
+
+	std::unique_ptr<RingSlot[]> m_ring;
+	std::atomic<uint64_t> m_uiWriteIndex;
+
+	LatencyHistogram m_histograms[METRIC_COUNT];
+	LatencyHistogram m_latencyHistograms[LATENCY_COUNT];
+};
+
+#endif
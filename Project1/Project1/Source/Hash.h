@@ -0,0 +1,127 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <string>
+#include <cstring>
+#include <stdint.h>
+
+// xxHash64 (Yann Collet's XXH64, same output as the reference implementation).
+// Fast enough to checksum whole files at memory bandwidth, and good enough to key caches and
+// directories by, but not a cryptographic hash.
+namespace Hash
+{
+	const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+	const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+	const uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+	const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+	const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+	inline uint64_t rotateLeft(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	// Unaligned little endian reads, memcpy compiles down to a single mov
+	inline uint64_t read64(const uint8_t * p)
+	{
+		uint64_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t read32(const uint8_t * p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t mixRound(uint64_t accumulator, uint64_t input)
+	{
+		accumulator += input * PRIME64_2;
+		accumulator = rotateLeft(accumulator, 31);
+		return accumulator * PRIME64_1;
+	}
+
+	inline uint64_t mergeRound(uint64_t accumulator, uint64_t value)
+	{
+		accumulator ^= mixRound(0, value);
+		return accumulator * PRIME64_1 + PRIME64_4;
+	}
+
+	inline uint64_t hash64(const void * data, size_t size, uint64_t seed = 0)
+	{
+		const uint8_t * p = static_cast<const uint8_t *>(data);
+		const uint8_t * end = p + size;
+		uint64_t hash;
+
+		if (size >= 32)
+		{
+			// Four independent lanes, 32 bytes per iteration
+			const uint8_t * limit = end - 32;
+			uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+			uint64_t v2 = seed + PRIME64_2;
+			uint64_t v3 = seed;
+			uint64_t v4 = seed - PRIME64_1;
+
+			do
+			{
+				v1 = mixRound(v1, read64(p));
+				v2 = mixRound(v2, read64(p + 8));
+				v3 = mixRound(v3, read64(p + 16));
+				v4 = mixRound(v4, read64(p + 24));
+				p += 32;
+			} while (p <= limit);
+
+			hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+			hash = mergeRound(hash, v1);
+			hash = mergeRound(hash, v2);
+			hash = mergeRound(hash, v3);
+			hash = mergeRound(hash, v4);
+		}
+		else
+		{
+			hash = seed + PRIME64_5;
+		}
+
+		hash += (uint64_t)size;
+
+		// Tail
+		while (p + 8 <= end)
+		{
+			hash ^= mixRound(0, read64(p));
+			hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+			p += 8;
+		}
+
+		if (p + 4 <= end)
+		{
+			hash ^= (uint64_t)read32(p) * PRIME64_1;
+			hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+			p += 4;
+		}
+
+		while (p < end)
+		{
+			hash ^= (*p) * PRIME64_5;
+			hash = rotateLeft(hash, 11) * PRIME64_1;
+			p++;
+		}
+
+		// Avalanche
+		hash ^= hash >> 33;
+		hash *= PRIME64_2;
+		hash ^= hash >> 29;
+		hash *= PRIME64_3;
+		hash ^= hash >> 32;
+
+		return hash;
+	}
+
+	inline uint64_t hash64(const std::string & text, uint64_t seed = 0)
+	{
+		return hash64(text.data(), text.size(), seed);
+	}
+}
+
+#endif
@@ -0,0 +1,1062 @@
+#include "IOService.h"
+
+#include <iostream>
+#include <algorithm>
+#include <list>
+#include <iterator>
+#include <deque>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define IO_HAS_URING
+#endif
+#endif
+#endif
+
+namespace
+{
+#ifdef _WIN32
+	typedef HANDLE IOFile;
+	const IOFile IO_INVALID_FILE = INVALID_HANDLE_VALUE;
+#else
+	typedef int IOFile;
+	const IOFile IO_INVALID_FILE = -1;
+#endif
+
+	IOFile openFile(const std::string & filename)
+	{
+#ifdef _WIN32
+		// Same sharing as mapFile, a pending read mustn't stop the file being replaced
+		return CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+		return ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+	}
+
+	void closeFile(IOFile file)
+	{
+#ifdef _WIN32
+		CloseHandle(file);
+#else
+		::close(file);
+#endif
+	}
+
+	bool getFileSize(IOFile file, uint64_t & size)
+	{
+#ifdef _WIN32
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize))
+		{
+			return false;
+		}
+		size = (uint64_t)fileSize.QuadPart;
+#else
+		struct stat info;
+		if (fstat(file, &info) != 0)
+		{
+			return false;
+		}
+		size = (uint64_t)info.st_size;
+#endif
+		return true;
+	}
+
+	// Positional read that leaves the file pointer alone, 0 at the end of the file and -1 on failure
+	int64_t readAt(IOFile file, uint8_t * buffer, uint64_t size, uint64_t offset)
+	{
+#ifdef _WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+		DWORD bytesRead = 0;
+		if (!ReadFile(file, buffer, (DWORD)std::min<uint64_t>(size, 1u << 30), &bytesRead, &overlapped))
+		{
+			return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+		}
+		return (int64_t)bytesRead;
+#else
+		ssize_t bytesRead;
+		do
+		{
+			bytesRead = pread(file, buffer, (size_t)std::min<uint64_t>(size, 1u << 30), (off_t)offset);
+		} while (bytesRead < 0 && errno == EINTR);
+		return (int64_t)bytesRead;
+#endif
+	}
+
+	std::string getReadError(const std::string & filename)
+	{
+#ifdef _WIN32
+		return "Failed to read " + filename + ", error " + std::to_string(GetLastError()) + "!";
+#else
+		return "Failed to read " + filename + ", " + strerror(errno) + "!";
+#endif
+	}
+}
+
+#ifdef IO_HAS_URING
+// Just enough of io_uring to queue reads and reap their completions, set up with the raw system
+// calls so there is no liburing dependency
+struct IOUring
+{
+	IOUring() : fd(-1), pSqRing(nullptr), pSqes(nullptr), pCqRing(nullptr) {}
+	~IOUring() { this->destroy(); }
+
+	bool init(unsigned entries)
+	{
+		io_uring_params params = {};
+		fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+		if (fd < 0)
+		{
+			// Kernel too old, or io_uring is blocked (containers often do)
+			return false;
+		}
+
+		uiSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		uiCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (singleMapping)
+		{
+			uiSqRingSize = uiCqRingSize = std::max<size_t>(uiSqRingSize, uiCqRingSize);
+		}
+
+		pSqRing = mmap(nullptr, uiSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (pSqRing == MAP_FAILED)
+		{
+			pSqRing = nullptr;
+			this->destroy();
+			return false;
+		}
+
+		pCqRing = singleMapping ? pSqRing : mmap(nullptr, uiCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (pCqRing == MAP_FAILED)
+		{
+			pCqRing = nullptr;
+			this->destroy();
+			return false;
+		}
+
+		uiSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		void * sqes = mmap(nullptr, uiSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED)
+		{
+			this->destroy();
+			return false;
+		}
+		pSqes = static_cast<io_uring_sqe *>(sqes);
+
+		uint8_t * sq = static_cast<uint8_t *>(pSqRing);
+		pSqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+		uiSqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+		pSqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+		uint8_t * cq = static_cast<uint8_t *>(pCqRing);
+		pCqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+		pCqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+		uiCqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+		pCqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+		return true;
+	}
+
+	void destroy()
+	{
+		if (pSqes)
+		{
+			munmap(pSqes, uiSqesSize);
+		}
+		if (pCqRing && pCqRing != pSqRing)
+		{
+			munmap(pCqRing, uiCqRingSize);
+		}
+		if (pSqRing)
+		{
+			munmap(pSqRing, uiSqRingSize);
+		}
+		if (fd >= 0)
+		{
+			::close(fd);
+		}
+
+		fd = -1;
+		pSqRing = pCqRing = nullptr;
+		pSqes = nullptr;
+	}
+
+	// The caller never queues more than the ring holds, the kernel consumes entries on enter()
+	void queueRead(int file, const iovec * iov, uint64_t offset, uint64_t userData)
+	{
+		unsigned tail = *pSqTail;
+		unsigned index = tail & uiSqMask;
+
+		io_uring_sqe & sqe = pSqes[index];
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READV; // Rather than IORING_OP_READ, which needs 5.6
+		sqe.fd = file;
+		sqe.addr = (uint64_t)(uintptr_t)iov;
+		sqe.len = 1;
+		sqe.off = offset;
+		sqe.user_data = userData;
+
+		pSqArray[index] = index;
+		__atomic_store_n(pSqTail, tail + 1, __ATOMIC_RELEASE);
+	}
+
+	// Submits what was queued and waits for at least one completion, how many were submitted or -errno
+	int enter(unsigned submitCount)
+	{
+		int result = (int)syscall(__NR_io_uring_enter, fd, submitCount, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		return result < 0 ? -errno : result;
+	}
+
+	// Calls complete(userData, result) for every finished read
+	template <typename Complete>
+	void reap(const Complete & complete)
+	{
+		unsigned head = *pCqHead;
+		unsigned tail = __atomic_load_n(pCqTail, __ATOMIC_ACQUIRE);
+
+		while (head != tail)
+		{
+			const io_uring_cqe & cqe = pCqes[head & uiCqMask];
+			complete(cqe.user_data, cqe.res);
+			head++;
+		}
+
+		__atomic_store_n(pCqHead, head, __ATOMIC_RELEASE);
+	}
+
+	int fd;
+
+	void * pSqRing;
+	size_t uiSqRingSize;
+	unsigned * pSqTail;
+	unsigned uiSqMask;
+	unsigned * pSqArray;
+	io_uring_sqe * pSqes;
+	size_t uiSqesSize;
+
+	void * pCqRing;
+	size_t uiCqRingSize;
+	unsigned * pCqHead;
+	unsigned * pCqTail;
+	unsigned uiCqMask;
+	io_uring_cqe * pCqes;
+};
+#else
+struct IOUring
+{
+};
+#endif
+
+IOService::IOService()
+: m_backend(IO_BACKEND_NONE)
+, m_uiThreadCount(0)
+, m_uiNextId(IO_INVALID_REQUEST + 1)
+, m_bRunning(false)
+, m_uiRequestCount(0)
+, m_uiReadCount(0)
+, m_uiBytesRead(0)
+, m_uiCancelledCount(0)
+, m_uiFailedCount(0)
+{
+}
+
+IOService::~IOService()
+{
+	this->shutdown();
+}
+
+void IOService::init(unsigned threadCount, bool allowUring)
+{
+	if (m_bRunning)
+	{
+		return;
+	}
+
+	m_bRunning = true;
+	m_uiThreadCount = std::max<unsigned>(threadCount, 1);
+
+#ifdef IO_HAS_URING
+	if (allowUring)
+	{
+		std::unique_ptr<IOUring> uring(new IOUring());
+		if (uring->init(IO_URING_DEPTH))
+		{
+			m_pUring = std::move(uring);
+			m_backend = IO_BACKEND_URING;
+			m_threads.push_back(std::thread(&IOService::uringLoop, this));
+
+			std::cout << "IOService running on io_uring" << std::endl;
+			return;
+		}
+	}
+#else
+	(void)allowUring;
+#endif
+
+	m_backend = IO_BACKEND_THREAD_POOL;
+
+	for (unsigned i = 0; i < m_uiThreadCount; i++)
+	{
+		m_threads.push_back(std::thread(&IOService::workerLoop, this));
+	}
+
+	std::cout << "IOService running with " << m_uiThreadCount << " I/O threads" << std::endl;
+}
+
+void IOService::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_bRunning)
+		{
+			return;
+		}
+		m_bRunning = false;
+	}
+	m_condition.notify_all();
+
+	for (auto & thread : m_threads)
+	{
+		thread.join();
+	}
+
+	m_threads.clear();
+	m_pUring.reset();
+	m_backend = IO_BACKEND_NONE;
+
+	// Whatever is still queued never started
+	std::vector<std::shared_ptr<Request>> remaining;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto & entry : m_queue)
+		{
+			remaining.push_back(m_requests[entry.second]);
+			remaining.back()->bQueued = false;
+			remaining.back()->bCancelled = true;
+		}
+		m_queue.clear();
+		m_fileRequests.clear();
+	}
+
+	for (auto & request : remaining)
+	{
+		this->complete(request, IO_STATUS_CANCELLED, FileView(), std::string());
+	}
+}
+
+IORequestId IOService::read(const std::string & filename, uint64_t offset, uint64_t size, IO_PRIORITY priority, IOCallback callback, JobCounter * counter)
+{
+	if (priority >= IO_PRIORITY_COUNT)
+	{
+		throw std::runtime_error("Invalid I/O priority!");
+	}
+
+	std::shared_ptr<Request> request = std::make_shared<Request>();
+	request->id = m_uiNextId++;
+	request->filename = filename;
+	request->offset = offset;
+	request->size = size;
+	request->priority = priority;
+	request->callback = std::move(callback);
+	request->counter = counter;
+	request->bQueued = true;
+	request->bCancelled = false;
+	request->decodedOffset = 0;
+	request->decodedSize = 0;
+
+	// Only looks in memory, the sources say where the file is without reading it
+	FileLocation location;
+	bool bLocated = locateMountedFile(filename, location);
+
+	if (bLocated && location.filename.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_bRunning)
+			{
+				throw std::runtime_error("IOService has to be initialised before reading!");
+			}
+		}
+
+		if (counter)
+		{
+			counter->increment();
+		}
+		m_uiRequestCount++;
+
+		// Nothing to read, it only has to go through the callback like any other request
+		uint64_t start = std::min<uint64_t>(offset, location.data.size());
+		FileView view = location.data.subView((size_t)start, (size_t)std::min<uint64_t>(size, location.data.size() - start));
+		this->complete(request, IO_STATUS_COMPLETED, view, std::string());
+
+		return request->id;
+	}
+
+	if (bLocated && location.decode)
+	{
+		// All of the stored bytes are needed to decode any of them
+		request->filename = location.filename;
+		request->offset = location.offset;
+		request->size = location.size;
+		request->decode = location.decode;
+		request->decodedOffset = offset;
+		request->decodedSize = size;
+	}
+	else if (bLocated)
+	{
+		uint64_t start = std::min<uint64_t>(offset, location.size);
+		request->filename = location.filename;
+		request->offset = location.offset + start;
+		request->size = std::min<uint64_t>(size, location.size - start);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_bRunning)
+		{
+			throw std::runtime_error("IOService has to be initialised before reading!");
+		}
+
+		m_requests[request->id] = request;
+		m_queue.insert(std::make_pair((uint32_t)priority, request->id));
+		m_fileRequests[request->filename].push_back(request->id);
+	}
+
+	if (counter)
+	{
+		counter->increment();
+	}
+
+	m_uiRequestCount++;
+	m_condition.notify_one();
+
+	return request->id;
+}
+
+IORequestId IOService::readFile(const std::string & filename, IO_PRIORITY priority, IOCallback callback, JobCounter * counter)
+{
+	return this->read(filename, 0, IO_WHOLE_FILE, priority, std::move(callback), counter);
+}
+
+bool IOService::cancel(IORequestId id)
+{
+	std::shared_ptr<Request> request;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_requests.find(id);
+		if (it == m_requests.end())
+		{
+			return false;
+		}
+
+		request = it->second;
+		request->bCancelled = true;
+
+		if (!request->bQueued)
+		{
+			// complete() reports it as cancelled once the read is done
+			return true;
+		}
+
+		m_queue.erase(std::make_pair((uint32_t)request->priority, id));
+
+		auto file = m_fileRequests.find(request->filename);
+		file->second.erase(std::find(file->second.begin(), file->second.end(), id));
+		if (file->second.empty())
+		{
+			m_fileRequests.erase(file);
+		}
+
+		request->bQueued = false;
+	}
+
+	this->complete(request, IO_STATUS_CANCELLED, FileView(), std::string());
+	return true;
+}
+
+bool IOService::setPriority(IORequestId id, IO_PRIORITY priority)
+{
+	if (priority >= IO_PRIORITY_COUNT)
+	{
+		throw std::runtime_error("Invalid I/O priority!");
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_requests.find(id);
+	if (it == m_requests.end() || !it->second->bQueued)
+	{
+		return false;
+	}
+
+	m_queue.erase(std::make_pair((uint32_t)it->second->priority, id));
+	it->second->priority = priority;
+	m_queue.insert(std::make_pair((uint32_t)priority, id));
+
+	return true;
+}
+
+size_t IOService::getQueuedCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_queue.size();
+}
+
+IOStats IOService::getStats() const
+{
+	IOStats stats;
+	stats.requests = m_uiRequestCount;
+	stats.reads = m_uiReadCount;
+	stats.bytesRead = m_uiBytesRead;
+	stats.cancelled = m_uiCancelledCount;
+	stats.failed = m_uiFailedCount;
+
+	return stats;
+}
+
+bool IOService::takeBatch(Batch & batch, bool block)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (block)
+	{
+		m_condition.wait(lock, [this]() { return !m_bRunning || !m_queue.empty(); });
+	}
+
+	if (!m_bRunning || m_queue.empty())
+	{
+		return false;
+	}
+
+	// The most urgent request decides the file. Other requests for the file come along while they
+	// are as urgent and the batch has room, so nothing less urgent is read ahead of it.
+	std::shared_ptr<Request> first = m_requests[m_queue.begin()->second];
+	auto file = m_fileRequests.find(first->filename);
+	std::vector<IORequestId> & ids = file->second;
+
+	batch.filename = first->filename;
+	batch.requests.clear();
+	batch.ranges.clear();
+	batch.error.clear();
+
+	uint64_t batchSize = 0;
+
+	auto take = [&](const std::shared_ptr<Request> & request)
+	{
+		m_queue.erase(std::make_pair((uint32_t)request->priority, request->id));
+		request->bQueued = false;
+		batch.requests.push_back(request);
+
+		// A whole file read is only sized once the file is open, so it fills the batch
+		uint64_t size = request->size == IO_WHOLE_FILE ? IO_MAX_BATCH_SIZE : request->size;
+		batchSize = std::min<uint64_t>(batchSize + std::min<uint64_t>(size, IO_MAX_BATCH_SIZE), IO_MAX_BATCH_SIZE);
+	};
+
+	take(first);
+	ids.erase(std::find(ids.begin(), ids.end(), first->id));
+
+	for (auto it = ids.begin(); it != ids.end() && batchSize < IO_MAX_BATCH_SIZE;)
+	{
+		std::shared_ptr<Request> & request = m_requests[*it];
+		uint64_t size = request->size == IO_WHOLE_FILE ? IO_MAX_BATCH_SIZE : request->size;
+
+		if (request->priority > first->priority || batchSize + size > IO_MAX_BATCH_SIZE)
+		{
+			++it;
+			continue;
+		}
+
+		take(request);
+		it = ids.erase(it);
+	}
+
+	if (ids.empty())
+	{
+		m_fileRequests.erase(file);
+	}
+
+	return true;
+}
+
+void IOService::prepareBatch(Batch & batch, uint64_t fileSize)
+{
+	std::vector<std::shared_ptr<Request>> & requests = batch.requests;
+
+	std::sort(requests.begin(), requests.end(), [](const std::shared_ptr<Request> & a, const std::shared_ptr<Request> & b)
+	{
+		return a->offset < b->offset;
+	});
+
+	for (auto & request : requests)
+	{
+		// From here on size is what is actually there to read
+		uint64_t offset = std::min<uint64_t>(request->offset, fileSize);
+		request->size = std::min<uint64_t>(request->size, fileSize - offset);
+
+		if (request->size == 0 || request->bCancelled)
+		{
+			// Nothing to read, still goes through a range so finishRange() completes it
+			batch.ranges.push_back(Range{ offset, 0, 0, nullptr, { request }, std::string() });
+			continue;
+		}
+
+		Range * last = nullptr;
+		for (auto it = batch.ranges.rbegin(); it != batch.ranges.rend(); ++it)
+		{
+			if (it->size > 0)
+			{
+				last = &*it;
+				break;
+			}
+		}
+
+		uint64_t end = request->offset + request->size;
+
+		if (last && request->offset <= last->offset + last->size + IO_COALESCE_GAP &&
+			std::max<uint64_t>(end, last->offset + last->size) - last->offset <= IO_MAX_COALESCED_READ)
+		{
+			last->size = std::max<uint64_t>(end, last->offset + last->size) - last->offset;
+			last->requests.push_back(request);
+			continue;
+		}
+
+		batch.ranges.push_back(Range{ request->offset, request->size, 0, nullptr, { request }, std::string() });
+	}
+
+	requests.clear();
+
+	for (auto & range : batch.ranges)
+	{
+		if (range.size > 0)
+		{
+			range.buffer = allocateFileBuffer((size_t)range.size);
+			m_uiReadCount++;
+		}
+	}
+}
+
+void IOService::finishRange(Range & range)
+{
+	m_uiBytesRead += range.done;
+
+	for (auto & request : range.requests)
+	{
+		if (!range.error.empty())
+		{
+			this->complete(request, IO_STATUS_FAILED, FileView(), range.error);
+			continue;
+		}
+
+		// The file can shrink between the size check and the read, so only hand out what arrived
+		uint64_t start = request->offset - range.offset;
+		uint64_t available = range.done > start ? std::min<uint64_t>(request->size, range.done - start) : 0;
+
+		FileView view = available > 0 ? FileView::fromMemory(range.buffer.get() + start, (size_t)available, range.buffer) : FileView();
+		this->complete(request, IO_STATUS_COMPLETED, view, std::string());
+	}
+
+	// The views hold on to the buffer for as long as they need it
+	range.requests.clear();
+	range.buffer.reset();
+}
+
+void IOService::failBatch(Batch & batch)
+{
+	for (auto & request : batch.requests)
+	{
+		this->complete(request, IO_STATUS_FAILED, FileView(), batch.error);
+	}
+
+	batch.requests.clear();
+}
+
+void IOService::complete(const std::shared_ptr<Request> & request, IO_STATUS status, const FileView & data, const std::string & error)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.erase(request->id);
+	}
+
+	// Checked after the erase, any cancel() that got in first has set it by now
+	if (request->bCancelled)
+	{
+		status = IO_STATUS_CANCELLED;
+	}
+
+	if (status == IO_STATUS_CANCELLED)
+	{
+		m_uiCancelledCount++;
+	}
+	else if (status == IO_STATUS_FAILED)
+	{
+		m_uiFailedCount++;
+	}
+
+	IOResult result;
+	result.id = request->id;
+	result.status = status;
+	result.data = status == IO_STATUS_COMPLETED ? data : FileView();
+	result.error = error;
+
+	if (!request->callback)
+	{
+		if (request->counter)
+		{
+			request->counter->decrement();
+		}
+		return;
+	}
+
+	JobSystem::getInstance().run([this, request, result]() mutable
+	{
+		if (result.status == IO_STATUS_COMPLETED && request->decode)
+		{
+			try
+			{
+				FileView decoded = request->decode(result.data);
+				uint64_t start = std::min<uint64_t>(request->decodedOffset, decoded.size());
+				result.data = decoded.subView((size_t)start, (size_t)std::min<uint64_t>(request->decodedSize, decoded.size() - start));
+			}
+			catch (const std::runtime_error & error)
+			{
+				result.status = IO_STATUS_FAILED;
+				result.data.reset();
+				result.error = error.what();
+				m_uiFailedCount++;
+			}
+		}
+
+		try
+		{
+			request->callback(result);
+		}
+		catch (...)
+		{
+			// The counter was incremented by read(), so it is ours to fail and release
+			if (!request->counter)
+			{
+				throw;
+			}
+			request->counter->fail(std::current_exception());
+		}
+
+		if (request->counter)
+		{
+			request->counter->decrement();
+		}
+	});
+}
+
+void IOService::workerLoop()
+{
+	Batch batch;
+
+	while (this->takeBatch(batch, true))
+	{
+		IOFile file = openFile(batch.filename);
+		uint64_t fileSize = 0;
+
+		if (file == IO_INVALID_FILE)
+		{
+			batch.error = "Failed to open " + batch.filename + ", does the file exist?";
+		}
+		else if (!getFileSize(file, fileSize))
+		{
+			batch.error = getReadError(batch.filename);
+		}
+		else
+		{
+			this->prepareBatch(batch, fileSize);
+
+			// Each range is handed out as soon as it is in, not once the whole batch is
+			for (auto & range : batch.ranges)
+			{
+				while (range.done < range.size)
+				{
+					int64_t bytesRead = readAt(file, range.buffer.get() + range.done, range.size - range.done, range.offset + range.done);
+					if (bytesRead <= 0)
+					{
+						if (bytesRead < 0)
+						{
+							range.error = getReadError(batch.filename);
+						}
+						break;
+					}
+
+					range.done += (uint64_t)bytesRead;
+				}
+
+				this->finishRange(range);
+			}
+		}
+
+		if (file != IO_INVALID_FILE)
+		{
+			closeFile(file);
+		}
+
+		if (!batch.error.empty())
+		{
+			this->failBatch(batch);
+		}
+	}
+}
+
+void IOService::uringLoop()
+{
+#ifdef IO_HAS_URING
+	struct UringBatch
+	{
+		Batch batch;
+		int file;
+		size_t outstanding; // Ranges still being read
+	};
+
+	struct UringRead
+	{
+		std::list<UringBatch>::iterator batch;
+		Range * range;
+		iovec iov;
+	};
+
+	std::list<UringBatch> batches;
+	std::deque<UringRead> waiting; // Ranges, or what is left of them, that don't have a slot yet
+	std::vector<UringRead> slots(IO_URING_DEPTH);
+	std::vector<unsigned> freeSlots;
+	for (unsigned i = 0; i < IO_URING_DEPTH; i++)
+	{
+		freeSlots.push_back(IO_URING_DEPTH - 1 - i);
+	}
+
+	unsigned unsubmitted = 0;
+	bool bDone = false;
+	bool bFailed = false;
+
+	// Completes the range straight away, the file is closed once its last range is done
+	auto finishRange = [this, &batches](std::list<UringBatch>::iterator batch, Range & range)
+	{
+		this->finishRange(range);
+
+		if (--batch->outstanding == 0)
+		{
+			::close(batch->file);
+			batches.erase(batch);
+		}
+	};
+
+	auto reapRead = [&](uint64_t userData, int32_t result)
+	{
+		UringRead read = slots[(size_t)userData];
+		freeSlots.push_back((unsigned)userData);
+
+		if (result == -EINTR || result == -EAGAIN)
+		{
+			waiting.push_front(read);
+			return;
+		}
+
+		if (result < 0)
+		{
+			read.range->error = "Failed to read " + read.batch->batch.filename + ", " + strerror(-result) + "!";
+		}
+		else if (result > 0)
+		{
+			read.range->done += (uint64_t)result;
+			if (read.range->done < read.range->size)
+			{
+				// Short read, queue the rest
+				waiting.push_front(read);
+				return;
+			}
+		}
+
+		finishRange(read.batch, *read.range);
+	};
+
+	while (!bDone || freeSlots.size() < IO_URING_DEPTH)
+	{
+		// Take new work only once everything taken so far has a slot, and only wait for it when idle
+		while (!bDone && waiting.empty() && !freeSlots.empty())
+		{
+			Batch batch;
+			bool bIdle = freeSlots.size() == IO_URING_DEPTH;
+			if (!this->takeBatch(batch, bIdle))
+			{
+				// A blocking take only comes back empty handed when shutting down
+				bDone = bIdle;
+				break;
+			}
+
+			batches.push_back(UringBatch{ std::move(batch), -1, 0 });
+			auto active = std::prev(batches.end());
+
+			uint64_t fileSize = 0;
+			active->file = openFile(active->batch.filename);
+
+			if (active->file == IO_INVALID_FILE)
+			{
+				active->batch.error = "Failed to open " + active->batch.filename + ", does the file exist?";
+			}
+			else if (!getFileSize(active->file, fileSize))
+			{
+				active->batch.error = getReadError(active->batch.filename);
+			}
+			else
+			{
+				this->prepareBatch(active->batch, fileSize);
+
+				for (auto & range : active->batch.ranges)
+				{
+					if (range.size > 0)
+					{
+						waiting.push_back(UringRead{ active, &range, iovec() });
+						active->outstanding++;
+					}
+				}
+
+				// Cancelled and empty requests don't wait for the reads
+				for (auto & range : active->batch.ranges)
+				{
+					if (range.size == 0)
+					{
+						this->finishRange(range);
+					}
+				}
+			}
+
+			if (active->outstanding == 0)
+			{
+				if (active->file != IO_INVALID_FILE)
+				{
+					::close(active->file);
+				}
+				if (!active->batch.error.empty())
+				{
+					this->failBatch(active->batch);
+				}
+				batches.erase(active);
+			}
+		}
+
+		while (!waiting.empty() && !freeSlots.empty())
+		{
+			unsigned slot = freeSlots.back();
+			freeSlots.pop_back();
+
+			UringRead & read = slots[slot];
+			read = waiting.front();
+			waiting.pop_front();
+
+			read.iov.iov_base = read.range->buffer.get() + read.range->done;
+			read.iov.iov_len = (size_t)(read.range->size - read.range->done);
+
+			m_pUring->queueRead(read.batch->file, &read.iov, read.range->offset + read.range->done, slot);
+			unsubmitted++;
+		}
+
+		if (freeSlots.size() == IO_URING_DEPTH)
+		{
+			continue;
+		}
+
+		int submitted = m_pUring->enter(unsubmitted);
+		if (submitted < 0)
+		{
+			if (submitted != -EINTR && submitted != -EAGAIN && submitted != -EBUSY)
+			{
+				std::cout << "io_uring_enter failed, " << strerror(-submitted) << ", falling back to I/O threads" << std::endl;
+				bFailed = true;
+				break;
+			}
+		}
+		else
+		{
+			unsubmitted -= (unsigned)submitted;
+		}
+
+		m_pUring->reap(reapRead);
+	}
+
+	if (!bFailed)
+	{
+		return;
+	}
+
+	// Reads the kernel already took keep writing into their buffers, give them a moment to land.
+	// Completions are posted to the ring without entering it.
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(IO_URING_DRAIN_TIMEOUT);
+	while (IO_URING_DEPTH - freeSlots.size() > unsubmitted && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		m_pUring->reap(reapRead);
+	}
+
+	bool bAbandoned = IO_URING_DEPTH - freeSlots.size() > unsubmitted;
+
+	// Everything still being read fails, queued requests stay queued for the threads
+	std::vector<bool> slotFree(IO_URING_DEPTH, false);
+	for (unsigned slot : freeSlots)
+	{
+		slotFree[slot] = true;
+	}
+
+	std::vector<UringRead> failed(waiting.begin(), waiting.end());
+	for (unsigned slot = 0; slot < IO_URING_DEPTH; slot++)
+	{
+		if (!slotFree[slot])
+		{
+			if (bAbandoned)
+			{
+				// The kernel may still write here, so the buffer is leaked rather than reused
+				new std::shared_ptr<uint8_t>(slots[slot].range->buffer);
+			}
+			failed.push_back(slots[slot]);
+		}
+	}
+
+	for (auto & read : failed)
+	{
+		read.range->error = "Failed to read " + read.batch->batch.filename + ", io_uring stopped working!";
+		finishRange(read.batch, *read.range);
+	}
+
+	m_pUring->destroy();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_backend = IO_BACKEND_THREAD_POOL;
+
+		// Not once shutdown() has started joining
+		for (unsigned i = 1; m_bRunning && i < m_uiThreadCount; i++)
+		{
+			m_threads.push_back(std::thread(&IOService::workerLoop, this));
+		}
+	}
+
+	this->workerLoop();
+#endif
+}
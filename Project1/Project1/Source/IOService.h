@@ -0,0 +1,203 @@
+#ifndef __IO_SERVICE_H__
+#define __IO_SERVICE_H__
+
+#include "FileReader.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+#define IO_DEFAULT_THREAD_COUNT 2 // Thread pool backend, the threads mostly wait on the disk so a couple is enough
+#define IO_WHOLE_FILE 0xFFFFFFFFFFFFFFFFull // Size that reads from the offset to the end of the file
+#define IO_INVALID_REQUEST 0
+#define IO_COALESCE_GAP (64 * 1024) // Requests on the same file closer together than this are done as one read
+#define IO_MAX_COALESCED_READ (16 * 1024 * 1024) // Merged reads stop growing past this, a single bigger request is still read whole
+#define IO_MAX_BATCH_SIZE (16 * 1024 * 1024) // Bytes taken from one file at a time, a single bigger request still goes whole
+#define IO_URING_DEPTH 64 // Reads in flight at once on the io_uring backend
+#define IO_URING_DRAIN_TIMEOUT 1000 // Milliseconds given to reads already in the kernel when io_uring stops working
+
+enum IO_PRIORITY
+{
+	IO_PRIORITY_URGENT, // Needed for the frame being built, e.g. visible now, goes ahead of everything queued
+	IO_PRIORITY_HIGH,
+	IO_PRIORITY_NORMAL,
+	IO_PRIORITY_LOW, // Prefetching and background streaming
+	IO_PRIORITY_COUNT,
+};
+
+enum IO_STATUS
+{
+	IO_STATUS_COMPLETED,
+	IO_STATUS_CANCELLED,
+	IO_STATUS_FAILED,
+};
+
+enum IO_BACKEND
+{
+	IO_BACKEND_NONE,
+	IO_BACKEND_THREAD_POOL,
+	IO_BACKEND_URING,
+};
+
+typedef uint64_t IORequestId;
+
+struct IOResult
+{
+	IORequestId id;
+	IO_STATUS status;
+	FileView data; // Completed only, shorter than asked for when the file ends first
+	std::string error; // Failed only
+};
+
+typedef std::function<void(const IOResult &)> IOCallback;
+
+struct IOStats
+{
+	uint64_t requests = 0;
+	uint64_t reads = 0; // After coalescing
+	uint64_t bytesRead = 0;
+	uint64_t cancelled = 0;
+	uint64_t failed = 0;
+};
+
+struct IOUring;
+
+// Singleton IOService
+// Asynchronous file reads. Submitting only queues the request, the file isn't opened or even
+// stat'ed on the calling thread, so it is safe from the frame thread. Filenames are looked up in
+// the mounted FileSources first, like readFile: a packed file becomes a read of its range of the
+// pack (decompressed on the job system before the callback), or completes straight away when the
+// pack already has it in memory. Requests are served by
+// priority (then in order). Requests queued for the same file at the same priority are taken
+// together, up to IO_MAX_BATCH_SIZE, so the file is opened once and nearby ranges become one read;
+// less urgent requests never ride along and hold up an urgent one. Each read's data is handed to
+// the callbacks on a JobSystem worker as soon as it lands, as a view of an aligned buffer that
+// several requests may share.
+// On Linux reads go through io_uring when the kernel allows it, otherwise (or once io_uring fails)
+// through a small pool of threads doing positional reads (pread / ReadFile with an offset).
+// Shut this down before the JobSystem, completions are delivered through it.
+class IOService
+{
+public:
+	static IOService & getInstance()
+	{
+		static IOService ioService;
+		return ioService;
+	}
+private:
+	IOService();
+public:
+	~IOService();
+
+	IOService(const IOService &) = delete;
+	void operator=(const IOService &) = delete;
+
+	// threadCount is for the thread pool backend, the io_uring one needs only a single thread
+	void init(unsigned threadCount = IO_DEFAULT_THREAD_COUNT, bool allowUring = true);
+
+	// Reads already started finish, anything still queued is cancelled
+	void shutdown();
+
+	// Reads size bytes (IO_WHOLE_FILE for the rest of the file) at offset. The callback runs on a
+	// JobSystem worker, counter (if any) is incremented now and decremented once the callback returned.
+	IORequestId read(const std::string & filename, uint64_t offset, uint64_t size, IO_PRIORITY priority, IOCallback callback, JobCounter * counter = nullptr);
+	IORequestId readFile(const std::string & filename, IO_PRIORITY priority, IOCallback callback, JobCounter * counter = nullptr);
+
+	// The callback gets IO_STATUS_CANCELLED, straight away when the request was still queued. A read
+	// that has already started still finishes but its data is dropped. False when the request has completed.
+	bool cancel(IORequestId id);
+
+	// E.g. something streaming in the background just became visible, false once the read has started
+	bool setPriority(IORequestId id, IO_PRIORITY priority);
+
+	IO_BACKEND getBackend() const { return m_backend; }
+	size_t getQueuedCount();
+	IOStats getStats() const;
+
+private:
+	struct Request
+	{
+		IORequestId id;
+		std::string filename;
+		uint64_t offset;
+		uint64_t size;
+		IO_PRIORITY priority;
+		IOCallback callback;
+		JobCounter * counter;
+
+		// Set when a FileSource stores the file differently, offset and size then cover the stored
+		// bytes and are applied to what decode returns
+		std::function<FileView(const FileView &)> decode;
+		uint64_t decodedOffset;
+		uint64_t decodedSize;
+		bool bQueued;
+		std::atomic<bool> bCancelled;
+	};
+
+	// One read serving one or more requests
+	struct Range
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint64_t done; // Less than size once the read hit the end of the file
+		std::shared_ptr<uint8_t> buffer;
+		std::vector<std::shared_ptr<Request>> requests;
+		std::string error;
+	};
+
+	// Everything that was queued for one file
+	struct Batch
+	{
+		std::string filename;
+		std::vector<std::shared_ptr<Request>> requests;
+		std::vector<Range> ranges;
+		std::string error; // The file couldn't be opened, fails every request
+	};
+
+	// Waits for work when block is set, false when there is none (or, blocking, when shutting down)
+	bool takeBatch(Batch & batch, bool block);
+
+	// Resolves the sizes against the file and merges the requests into ranges
+	void prepareBatch(Batch & batch, uint64_t fileSize);
+
+	// Completes the requests of a range that is done reading, or has failed
+	void finishRange(Range & range);
+
+	// The file couldn't be opened, every request fails with batch.error
+	void failBatch(Batch & batch);
+	void complete(const std::shared_ptr<Request> & request, IO_STATUS status, const FileView & data, const std::string & error);
+
+	void workerLoop();
+	void uringLoop();
+
+	std::atomic<IO_BACKEND> m_backend; // Changes from io_uring to the thread pool if io_uring fails
+	unsigned m_uiThreadCount;
+	std::vector<std::thread> m_threads;
+	std::unique_ptr<IOUring> m_pUring;
+
+	std::atomic<IORequestId> m_uiNextId;
+	std::unordered_map<IORequestId, std::shared_ptr<Request>> m_requests; // Queued and in flight
+	std::set<std::pair<uint32_t, IORequestId>> m_queue; // Priority then id, so urgent requests come first and equal ones in order
+	std::unordered_map<std::string, std::vector<IORequestId>> m_fileRequests; // Queued requests by file, what gets coalesced
+
+	bool m_bRunning;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+
+	std::atomic<uint64_t> m_uiRequestCount;
+	std::atomic<uint64_t> m_uiReadCount;
+	std::atomic<uint64_t> m_uiBytesRead;
+	std::atomic<uint64_t> m_uiCancelledCount;
+	std::atomic<uint64_t> m_uiFailedCount;
+};
+
+#endif
@@ -1,10 +1,15 @@
 #include "InputHandler.h"
 #include "View.h"
+#include "Timer.h"
 //#include "CharBuffer.h"
 
-bool InputHandler::m_pressedKeys[348];
-bool InputHandler::m_triggeredKeys[348];
-bool InputHandler::m_repeatedKeys[348];
+SPSCQueue<InputEvent> InputHandler::s_eventQueue(INPUT_QUEUE_SIZE);
+uint64_t InputHandler::s_uiNextEventId = 1;
+std::atomic<uint64_t> InputHandler::s_uiDroppedEvents(0);
+std::atomic<bool> InputHandler::s_bLiveInputEnabled(true);
+
+InputSnapshot InputHandler::m_snapshot;
+std::vector<InputEvent> InputHandler::m_tickEvents;
 
 double InputHandler::mX = 0.0;
 double InputHandler::mY = 0.0;
@@ -23,100 +28,217 @@ InputHandler::InputHandler()
 {
 	std::cout << "InputHandler Created" << std::endl;
 
-	for (int i = 0; i < GLFW_KEY_LAST; i++)
-	{
-		m_pressedKeys[i] = false;
-		m_triggeredKeys[i] = false;
-		m_repeatedKeys[i] = false;
-	}
+	m_tickEvents.reserve(INPUT_QUEUE_SIZE);
 }
 
 void InputHandler::Key_Callback(int key, int scancode, int action, int mods)
 {
-	if (m_bKeyboardEnabled)
+	if (m_bKeyboardEnabled && s_bLiveInputEnabled)
 	{
-		if (action == GLFW_PRESS)
-		{
-			{
-				PressKey(key);
-			}
-		}
-		else if (action == GLFW_RELEASE)
-		{
-			{
-				PressKey(key, false);
-			}
-		}
-		else if (action == GLFW_REPEAT)
-		{
-			{
-				PressKey(key);
-			}
-		}
+		InputEvent inputEvent = {};
+		inputEvent.type = InputEvent::INPUT_KEY;
+		inputEvent.code = key;
+		inputEvent.action = action;
+		inputEvent.mods = mods;
+
+		PushEvent(inputEvent);
 	}
 }
 
 void InputHandler::Mouse_Callback(int button, int action, int mods)
 {
-	if (m_bMouseEnabled)
+	if (m_bMouseEnabled && s_bLiveInputEnabled)
 	{
-		if (action == GLFW_PRESS)
-		{
-			PressKey(button);
-		}
-		else if (action == GLFW_RELEASE)
-		{
-			PressKey(button, false);
-		}
-		else if (action == GLFW_REPEAT)
-		{
-			PressKey(button);
-		}
+		InputEvent inputEvent = {};
+		inputEvent.type = InputEvent::INPUT_MOUSE_BUTTON;
+		inputEvent.code = button;
+		inputEvent.action = action;
+		inputEvent.mods = mods;
+
+		PushEvent(inputEvent);
 	}
 }
 
-void InputHandler::PressKey(int key, bool status)
+void InputHandler::Cursor_Callback(double x, double y)
+{
+	if (!s_bLiveInputEnabled)
+	{
+		return;
+	}
+
+	InputEvent inputEvent = {};
+	inputEvent.type = InputEvent::INPUT_CURSOR;
+	inputEvent.x = x;
+	inputEvent.y = y;
+
+	PushEvent(inputEvent);
+}
+
+void InputHandler::Scroll_Callback(double xOffset, double yOffset)
+{
+	if (!s_bLiveInputEnabled)
+	{
+		return;
+	}
+
+	InputEvent inputEvent = {};
+	inputEvent.type = InputEvent::INPUT_SCROLL;
+	inputEvent.x = xOffset;
+	inputEvent.y = yOffset;
+
+	PushEvent(inputEvent);
+}
+
+void InputHandler::Focus_Callback(int focused)
+{
+	if (!s_bLiveInputEnabled)
+	{
+		return;
+	}
+
+	InputEvent inputEvent = {};
+	inputEvent.type = InputEvent::INPUT_WINDOW_FOCUS;
+	inputEvent.code = focused ? 1 : 0;
+
+	PushEvent(inputEvent);
+}
+
+void InputHandler::Iconify_Callback(int iconified)
+{
+	if (!s_bLiveInputEnabled)
+	{
+		return;
+	}
+
+	InputEvent inputEvent = {};
+	inputEvent.type = InputEvent::INPUT_WINDOW_ICONIFY;
+	inputEvent.code = iconified ? 1 : 0;
+
+	PushEvent(inputEvent);
+}
+
+void InputHandler::setLiveInputEnabled(bool status)
+{
+	s_bLiveInputEnabled = status;
+}
+
+bool InputHandler::isLiveInputEnabled()
+{
+	return s_bLiveInputEnabled;
+}
+
+bool InputHandler::PushEvent(InputEvent inputEvent)
+{
+	inputEvent.id = s_uiNextEventId++;
+	inputEvent.timestampNs = Timer::getTimestampNs();
+
+	if (!s_eventQueue.push(inputEvent))
+	{
+		s_uiDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	return true;
+}
+
+void InputHandler::BeginTick()
+{
+	// Edges only last for the tick that saw them
+	m_snapshot.pressed.reset();
+	m_snapshot.released.reset();
+	m_snapshot.repeated.reset();
+	m_snapshot.scrollDelta = 0.0;
+	m_snapshot.eventCount = 0;
+	m_tickEvents.clear();
+
+	InputEvent inputEvent;
+	while (s_eventQueue.pop(inputEvent))
+	{
+		ApplyEvent(inputEvent);
+		m_tickEvents.push_back(inputEvent);
+	}
+
+	mX = m_snapshot.mouseX;
+	mY = m_snapshot.mouseY;
+	dScroll = m_snapshot.scrollDelta;
+}
+
+void InputHandler::ApplyEvent(const InputEvent & inputEvent)
 {
-	if (status)
+	switch (inputEvent.type)
 	{
-		// Check if key is pressed
-		if (m_pressedKeys[key] == false)
+	case InputEvent::INPUT_KEY:
+	case InputEvent::INPUT_MOUSE_BUTTON:
+		// GLFW_KEY_UNKNOWN is -1
+		if (IsValidKey(inputEvent.code))
 		{
-			// Set to true
-			m_pressedKeys[key] = true;
-			if (m_triggeredKeys[key] == false)
+			if (inputEvent.action == GLFW_PRESS)
 			{
-				m_triggeredKeys[key] = true;
+				m_snapshot.held.set(inputEvent.code);
+				m_snapshot.pressed.set(inputEvent.code);
 #if _DEBUG
-				std::cout << key << " has been triggered" << std::endl;
+				std::cout << inputEvent.code << " has been pressed" << std::endl;
 #endif
 			}
-			else
+			else if (inputEvent.action == GLFW_RELEASE)
 			{
-				m_triggeredKeys[key] = false;
+				m_snapshot.held.reset(inputEvent.code);
+				m_snapshot.released.set(inputEvent.code);
 #if _DEBUG
-				std::cout << key << " has been un-triggered" << std::endl;
+				std::cout << inputEvent.code << " has been released" << std::endl;
 #endif
 			}
+			else if (inputEvent.action == GLFW_REPEAT)
+			{
+				m_snapshot.held.set(inputEvent.code);
+				m_snapshot.repeated.set(inputEvent.code);
+			}
 		}
-		else
-		{
-			// Key is still being pressed
-			m_repeatedKeys[key] = true;
-#if _DEBUG
-			std::cout << key << " is being pressed repeatedly" << std::endl;
-#endif
-		}
-	}
-	else
-	{
-		// Key is not pressed anymore
-		m_pressedKeys[key] = false;
-		m_repeatedKeys[key] = false;
-#if _DEBUG
-		std::cout << "Setting " << key << " to false" << std::endl;
-#endif
+		break;
+	case InputEvent::INPUT_CURSOR:
+		m_snapshot.mouseX = inputEvent.x;
+		m_snapshot.mouseY = inputEvent.y;
+		break;
+	case InputEvent::INPUT_SCROLL:
+		m_snapshot.scrollDelta += inputEvent.y;
+		break;
+	case InputEvent::INPUT_WINDOW_FOCUS:
+		m_snapshot.windowFocused = inputEvent.code != 0;
+		break;
+	case InputEvent::INPUT_WINDOW_ICONIFY:
+		m_snapshot.windowIconified = inputEvent.code != 0;
+		break;
 	}
+
+	m_snapshot.lastEventId = inputEvent.id;
+	m_snapshot.lastEventTimestampNs = inputEvent.timestampNs;
+	m_snapshot.eventCount++;
+}
+
+const InputSnapshot & InputHandler::getSnapshot()
+{
+	return m_snapshot;
+}
+
+const std::vector<InputEvent> & InputHandler::getTickEvents()
+{
+	return m_tickEvents;
+}
+
+uint64_t InputHandler::getDroppedEventCount()
+{
+	return s_uiDroppedEvents.load(std::memory_order_relaxed);
+}
+
+void InputHandler::PressKey(int key, bool status)
+{
+	// Goes through the queue like a real key, so it takes effect on the next tick
+	InputEvent inputEvent = {};
+	inputEvent.type = InputEvent::INPUT_KEY;
+	inputEvent.code = key;
+	inputEvent.action = status ? GLFW_PRESS : GLFW_RELEASE;
+
+	PushEvent(inputEvent);
 }
 
 void InputHandler::KeyboardUpdate(MVCView * theView, double dt)
@@ -131,8 +253,7 @@ void InputHandler::MouseUpdate(MVCView * theView, double dt)
 		m_dClickDelay -= dt;
 	}
 
-	glfwGetCursorPos(theView->getWindow(), &mX, &mY);
-
+	// mX / mY are the last cursor event drained by BeginTick
 	float screenXmid = (float)theView->getWindowWidth() * 0.5f;
 	float screenYmid = (float)theView->getWindowHeight() * 0.5f;
 
@@ -147,6 +268,10 @@ void InputHandler::MouseUpdate(MVCView * theView, double dt)
 	{
 		glfwSetInputMode(theView->getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 		glfwSetCursorPos(theView->getWindow(), screenXmid, screenYmid);
+
+		// Re-centring doesn't raise a cursor event, so the next tick starts from the centre
+		m_snapshot.mouseX = mX = screenXmid;
+		m_snapshot.mouseY = mY = screenYmid;
 	}
 	else
 	{
@@ -156,17 +281,22 @@ void InputHandler::MouseUpdate(MVCView * theView, double dt)
 
 bool InputHandler::IsKeyPressed(int key)
 {
-	return m_pressedKeys[key];
+	return IsValidKey(key) && m_snapshot.held.test(key);
 }
 
 bool InputHandler::IsKeyTriggered(int key)
 {
-	return m_triggeredKeys[key];
+	return IsValidKey(key) && m_snapshot.pressed.test(key);
+}
+
+bool InputHandler::IsKeyReleased(int key)
+{
+	return IsValidKey(key) && m_snapshot.released.test(key);
 }
 
 bool InputHandler::IsKeyRepeating(int key) 
 {
-	return m_repeatedKeys[key];
+	return IsValidKey(key) && m_snapshot.repeated.test(key);
 }
 
 bool InputHandler::isKeyboardEnabled()
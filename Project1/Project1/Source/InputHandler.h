@@ -7,9 +7,61 @@
 #define PRESS_DELAY 0.25
 
 #include <iostream>
+#include <bitset>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+#include "SPSCQueue.h"
+
+#define INPUT_KEY_COUNT 349 // GLFW_KEY_LAST + 1, mouse buttons share the low slots
+#define INPUT_QUEUE_SIZE 1024 // Events buffered between two simulation ticks
 
 class MVCView;
 
+// One raw input event, stamped when the GLFW callback fired
+struct InputEvent
+{
+	enum TYPE
+	{
+		INPUT_KEY,
+		INPUT_MOUSE_BUTTON,
+		INPUT_CURSOR,
+		INPUT_SCROLL,
+		INPUT_WINDOW_FOCUS, // code is 1 when focused
+		INPUT_WINDOW_ICONIFY, // code is 1 when iconified
+	};
+
+	TYPE type;
+	int code; // Key or mouse button
+	int action; // GLFW_PRESS, GLFW_RELEASE, GLFW_REPEAT
+	int mods;
+	double x, y; // Cursor position or scroll offset
+
+	uint64_t id; // Increases by one for every event
+	int64_t timestampNs;
+};
+
+// Input state as seen by one simulation tick
+struct InputSnapshot
+{
+	std::bitset<INPUT_KEY_COUNT> held; // Down at the end of the tick
+	std::bitset<INPUT_KEY_COUNT> pressed; // Went down during the tick
+	std::bitset<INPUT_KEY_COUNT> released; // Went up during the tick
+	std::bitset<INPUT_KEY_COUNT> repeated; // OS key repeat during the tick
+
+	double mouseX = 0.0;
+	double mouseY = 0.0;
+	double scrollDelta = 0.0;
+
+	bool windowFocused = true;
+	bool windowIconified = false;
+
+	uint64_t lastEventId = 0; // Newest event consumed so far
+	int64_t lastEventTimestampNs = 0;
+	unsigned eventCount = 0; // Events consumed by this tick
+};
+
 //#include "CharBuffer.h"
 
 // Singleton InputHandler
@@ -28,15 +80,33 @@ public:
 	InputHandler(InputHandler & const) = delete;
 	void operator=(InputHandler & const) = delete;
 
-	// Callbacks
+	// Callbacks (producer, the thread calling glfwPollEvents)
 	static void Key_Callback(int key, int scancode, int action, int mods);
 	static void Mouse_Callback(int button, int action, int mods);
+	static void Cursor_Callback(double x, double y);
+	static void Scroll_Callback(double xOffset, double yOffset);
+	static void Focus_Callback(int focused);
+	static void Iconify_Callback(int iconified);
+
+	// Callbacks are ignored while live input is off (input replay)
+	static void setLiveInputEnabled(bool status);
+	static bool isLiveInputEnabled();
+
+	// Stamps and queues an event, returns false if the queue was full and it got dropped
+	static bool PushEvent(InputEvent inputEvent);
+
+	// Consumer, once at the start of every simulation tick: drains the queue into the snapshot
+	static void BeginTick();
+	static const InputSnapshot & getSnapshot();
+	static const std::vector<InputEvent> & getTickEvents(); // Events drained by the last BeginTick
+	static uint64_t getDroppedEventCount();
 
 	// Keyboard
 	static void PressKey(int key, bool status = true);
 
-	static bool IsKeyPressed(int key);
-	static bool IsKeyTriggered(int key);
+	static bool IsKeyPressed(int key); // Held down
+	static bool IsKeyTriggered(int key); // Went down this tick
+	static bool IsKeyReleased(int key); // Went up this tick
 	static bool IsKeyRepeating(int key);
 
 	static bool isKeyboardEnabled();
@@ -74,9 +144,16 @@ public:
 	bool getBufferMode();
 	void resetBuffer();*/
 private:
-	static bool m_pressedKeys[348];
-	static bool m_triggeredKeys[348];
-	static bool m_repeatedKeys[348];
+	static void ApplyEvent(const InputEvent & inputEvent);
+	static bool IsValidKey(int key) { return key >= 0 && key < INPUT_KEY_COUNT; }
+
+	static SPSCQueue<InputEvent> s_eventQueue;
+	static uint64_t s_uiNextEventId; // Producer only
+	static std::atomic<uint64_t> s_uiDroppedEvents;
+	static std::atomic<bool> s_bLiveInputEnabled;
+
+	static InputSnapshot m_snapshot; // Consumer only
+	static std::vector<InputEvent> m_tickEvents; // Consumer only
 
 	static double mX, mY;
 	static double dX, dY;
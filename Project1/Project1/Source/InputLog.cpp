@@ -0,0 +1,297 @@
+#include "InputLog.h"
+
+#include <stdexcept>
+#include <cstring>
+
+namespace
+{
+	const char INPUT_LOG_MAGIC[4] = { 'V', 'I', 'P', 'L' };
+
+	enum LOG_TAG
+	{
+		LOG_EVENT = 1,
+		LOG_TICK,
+		LOG_FRAME,
+		LOG_END,
+	};
+}
+
+InputLogWriter::InputLogWriter()
+: m_iLastTimestampNs(0)
+{
+}
+
+InputLogWriter::~InputLogWriter()
+{
+	this->close();
+}
+
+void InputLogWriter::open(const std::string & filename, double timestep)
+{
+	this->close();
+
+	m_file.open(filename, std::ios::binary | std::ios::trunc);
+
+	if (!m_file.is_open())
+	{
+		throw std::runtime_error("Failed to open " + filename + " for input recording!");
+	}
+
+	m_file.write(INPUT_LOG_MAGIC, sizeof(INPUT_LOG_MAGIC));
+	this->write<uint32_t>(INPUT_LOG_VERSION);
+	this->write<double>(timestep);
+
+	m_iLastTimestampNs = 0;
+}
+
+void InputLogWriter::close()
+{
+	if (m_file.is_open())
+	{
+		this->write<uint8_t>(LOG_END);
+		m_file.close();
+	}
+}
+
+void InputLogWriter::writeTick(const std::vector<InputEvent> & events)
+{
+	for (const auto & inputEvent : events)
+	{
+		this->writeEvent(inputEvent);
+	}
+
+	this->write<uint8_t>(LOG_TICK);
+}
+
+void InputLogWriter::writeFrame(const InputLogFrame & frame)
+{
+	this->write<uint8_t>(LOG_FRAME);
+	this->write<uint8_t>((uint8_t)frame.steps);
+	this->write<double>(frame.alpha);
+	this->write<double>(frame.frameTime);
+	this->write<float>(frame.aspectRatio);
+}
+
+void InputLogWriter::writeEvent(const InputEvent & inputEvent)
+{
+	this->write<uint8_t>(LOG_EVENT);
+	this->write<uint8_t>((uint8_t)inputEvent.type);
+
+	switch (inputEvent.type)
+	{
+	case InputEvent::INPUT_KEY:
+	case InputEvent::INPUT_MOUSE_BUTTON:
+		this->write<int16_t>((int16_t)inputEvent.code);
+		this->write<uint8_t>((uint8_t)inputEvent.action);
+		this->write<uint8_t>((uint8_t)inputEvent.mods);
+		break;
+	case InputEvent::INPUT_CURSOR:
+	case InputEvent::INPUT_SCROLL:
+		this->write<double>(inputEvent.x);
+		this->write<double>(inputEvent.y);
+		break;
+	case InputEvent::INPUT_WINDOW_FOCUS:
+	case InputEvent::INPUT_WINDOW_ICONIFY:
+		this->write<uint8_t>((uint8_t)inputEvent.code);
+		break;
+	}
+
+	// Timestamps only ever go forwards, so the delta is small and unsigned
+	int64_t delta = inputEvent.timestampNs - m_iLastTimestampNs;
+	this->writeVarint(m_iLastTimestampNs == 0 || delta < 0 ? 0 : (uint64_t)delta);
+	m_iLastTimestampNs = inputEvent.timestampNs;
+}
+
+void InputLogWriter::writeVarint(uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		this->write<uint8_t>((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+
+	this->write<uint8_t>((uint8_t)value);
+}
+
+InputLogReader::InputLogReader()
+: m_dTimestep(0.0)
+, m_iLastTimestampNs(0)
+, m_uiNextEventId(1)
+{
+}
+
+InputLogReader::~InputLogReader()
+{
+	this->close();
+}
+
+void InputLogReader::open(const std::string & filename)
+{
+	this->close();
+
+	m_file.open(filename, std::ios::binary);
+
+	if (!m_file.is_open())
+	{
+		throw std::runtime_error("Failed to open " + filename + ", does the file exist?\n");
+	}
+
+	char magic[sizeof(INPUT_LOG_MAGIC)] = {};
+	uint32_t version = 0;
+
+	m_file.read(magic, sizeof(magic));
+
+	if (!m_file || memcmp(magic, INPUT_LOG_MAGIC, sizeof(magic)) != 0)
+	{
+		throw std::runtime_error(filename + " is not an input log!");
+	}
+
+	if (!this->read(version) || version != INPUT_LOG_VERSION)
+	{
+		throw std::runtime_error(filename + " was recorded with an unsupported input log version!");
+	}
+
+	if (!this->read(m_dTimestep))
+	{
+		throw std::runtime_error(filename + " is truncated!");
+	}
+
+	m_iLastTimestampNs = 0;
+	m_uiNextEventId = 1;
+}
+
+void InputLogReader::close()
+{
+	if (m_file.is_open())
+	{
+		m_file.close();
+	}
+}
+
+bool InputLogReader::readFrame(Frame & frame)
+{
+	frame.ticks.clear();
+
+	std::vector<InputEvent> tickEvents;
+
+	uint8_t tag = 0;
+	while (this->read(tag))
+	{
+		switch (tag)
+		{
+		case LOG_EVENT:
+		{
+			InputEvent inputEvent = {};
+			if (!this->readEvent(inputEvent))
+			{
+				return false;
+			}
+			tickEvents.push_back(inputEvent);
+			break;
+		}
+		case LOG_TICK:
+			frame.ticks.push_back(tickEvents);
+			tickEvents.clear();
+			break;
+		case LOG_FRAME:
+		{
+			uint8_t steps = 0;
+			if (!this->read(steps) || !this->read(frame.frame.alpha) || !this->read(frame.frame.frameTime) || !this->read(frame.frame.aspectRatio))
+			{
+				return false;
+			}
+			frame.frame.steps = steps;
+
+			if (frame.ticks.size() != steps)
+			{
+				throw std::runtime_error("Input log frame doesn't match its simulation steps!");
+			}
+			return true;
+		}
+		case LOG_END:
+			return false;
+		default:
+			throw std::runtime_error("Input log is corrupt!");
+		}
+	}
+
+	// Recording was cut short, the partial frame is dropped
+	return false;
+}
+
+bool InputLogReader::readEvent(InputEvent & inputEvent)
+{
+	uint8_t type = 0;
+	if (!this->read(type))
+	{
+		return false;
+	}
+
+	inputEvent.type = (InputEvent::TYPE)type;
+
+	switch (inputEvent.type)
+	{
+	case InputEvent::INPUT_KEY:
+	case InputEvent::INPUT_MOUSE_BUTTON:
+	{
+		int16_t code = 0;
+		uint8_t action = 0, mods = 0;
+		if (!this->read(code) || !this->read(action) || !this->read(mods))
+		{
+			return false;
+		}
+		inputEvent.code = code;
+		inputEvent.action = action;
+		inputEvent.mods = mods;
+		break;
+	}
+	case InputEvent::INPUT_CURSOR:
+	case InputEvent::INPUT_SCROLL:
+		if (!this->read(inputEvent.x) || !this->read(inputEvent.y))
+		{
+			return false;
+		}
+		break;
+	case InputEvent::INPUT_WINDOW_FOCUS:
+	case InputEvent::INPUT_WINDOW_ICONIFY:
+	{
+		uint8_t code = 0;
+		if (!this->read(code))
+		{
+			return false;
+		}
+		inputEvent.code = code;
+		break;
+	}
+	default:
+		throw std::runtime_error("Input log is corrupt!");
+	}
+
+	m_iLastTimestampNs += (int64_t)this->readVarint();
+
+	inputEvent.timestampNs = m_iLastTimestampNs; // Relative to the first recorded event
+	inputEvent.id = m_uiNextEventId++;
+
+	return (bool)m_file;
+}
+
+uint64_t InputLogReader::readVarint()
+{
+	uint64_t value = 0;
+	int shift = 0;
+
+	uint8_t byte = 0;
+	while (shift < 64 && this->read(byte))
+	{
+		value |= (uint64_t)(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+		{
+			break;
+		}
+
+		shift += 7;
+	}
+
+	return value;
+}
@@ -0,0 +1,97 @@
+#ifndef __INPUT_LOG_H__
+#define __INPUT_LOG_H__
+
+#include "InputHandler.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define INPUT_LOG_VERSION 1
+
+// How the main loop turned one frame's worth of time into simulation steps.
+// Replaying the same steps, events and alpha reproduces the same frame packets bit for bit.
+struct InputLogFrame
+{
+	uint32_t steps = 0; // Simulation steps run this frame
+	double alpha = 0.0; // Render interpolation between the last two steps
+	double frameTime = 0.0; // Wall clock seconds the frame accounted for
+	float aspectRatio = 1.0f;
+};
+
+// Binary log layout
+//   header : "VIPL", uint32 version, double timestep
+//   records: uint8 tag followed by its payload
+//     LOG_EVENT : uint8 type, payload by type, varint nanoseconds since the previous event
+//     LOG_TICK  : end of one simulation step's events
+//     LOG_FRAME : uint8 steps, double alpha, double frameTime, float aspectRatio
+//     LOG_END
+class InputLogWriter
+{
+public:
+	InputLogWriter();
+	virtual ~InputLogWriter();
+
+	InputLogWriter(const InputLogWriter &) = delete;
+	void operator=(const InputLogWriter &) = delete;
+
+	void open(const std::string & filename, double timestep);
+	void close();
+
+	bool isOpen() const { return m_file.is_open(); }
+
+	// Everything InputHandler::BeginTick drained for one simulation step
+	void writeTick(const std::vector<InputEvent> & events);
+	void writeFrame(const InputLogFrame & frame);
+
+private:
+	void writeEvent(const InputEvent & inputEvent);
+	void writeVarint(uint64_t value);
+
+	template <typename T>
+	void write(const T & value) { m_file.write(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+	std::ofstream m_file;
+	int64_t m_iLastTimestampNs;
+};
+
+class InputLogReader
+{
+public:
+	// One frame of the log, the events for each of its simulation steps in order
+	struct Frame
+	{
+		InputLogFrame frame;
+		std::vector<std::vector<InputEvent>> ticks;
+	};
+
+	InputLogReader();
+	virtual ~InputLogReader();
+
+	InputLogReader(const InputLogReader &) = delete;
+	void operator=(const InputLogReader &) = delete;
+
+	void open(const std::string & filename);
+	void close();
+
+	bool isOpen() const { return m_file.is_open(); }
+	double getTimestep() const { return m_dTimestep; }
+
+	// False once the log has run out
+	bool readFrame(Frame & frame);
+
+private:
+	bool readEvent(InputEvent & inputEvent);
+	uint64_t readVarint();
+
+	template <typename T>
+	bool read(T & value) { return (bool)m_file.read(reinterpret_cast<char *>(&value), sizeof(T)); }
+
+	std::ifstream m_file;
+	double m_dTimestep;
+	int64_t m_iLastTimestampNs;
+	uint64_t m_uiNextEventId;
+};
+
+#endif
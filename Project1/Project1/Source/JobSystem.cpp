@@ -0,0 +1,487 @@
+#include "JobSystem.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define JOB_SPIN_COUNT 64 // Failed attempts to find work before a worker goes to sleep
+
+thread_local int JobSystem::s_iThreadIndex = -1;
+thread_local uint32_t JobSystem::s_uiRandomState = 0;
+
+JobCounter::~JobCounter()
+{
+	// Only left when the count never got back to zero
+	for (Job * job : m_continuations)
+	{
+		delete job;
+	}
+}
+
+void JobCounter::decrement()
+{
+	// Not the last one, nobody can be waiting on us to finish
+	int count = m_count.load(std::memory_order_relaxed);
+	while (count > 1)
+	{
+		if (m_count.compare_exchange_weak(count, count - 1, std::memory_order_release, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+
+	// Possibly the last one. A waiter that sees zero takes the mutex before it returns, so the
+	// counter stays alive until we are out of it.
+	std::vector<Job *> continuations;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			continuations.swap(m_continuations);
+		}
+	}
+
+	// The counter may be gone by now
+	for (Job * job : continuations)
+	{
+		JobSystem::getInstance().submit(job);
+	}
+}
+
+void JobCounter::fail(std::exception_ptr exception)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_exception)
+	{
+		m_exception = exception;
+	}
+}
+
+bool JobCounter::addContinuation(Job * job)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_count.load(std::memory_order_acquire) == 0)
+	{
+		return false;
+	}
+
+	m_continuations.push_back(job);
+	return true;
+}
+
+std::exception_ptr JobCounter::takeException()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::exception_ptr exception = m_exception;
+	m_exception = nullptr;
+	return exception;
+}
+
+JobQueue::JobQueue()
+: m_top(0)
+, m_bottom(0)
+{
+	for (int64_t i = 0; i < CAPACITY; i++)
+	{
+		m_jobs[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+bool JobQueue::push(Job * job)
+{
+	int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+	int64_t top = m_top.load(std::memory_order_acquire);
+
+	if (bottom - top >= CAPACITY)
+	{
+		return false;
+	}
+
+	m_jobs[bottom & MASK].store(job, std::memory_order_relaxed);
+
+	// The job has to be visible before a thief can see the new bottom
+	std::atomic_thread_fence(std::memory_order_release);
+	m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+	return true;
+}
+
+Job * JobQueue::pop()
+{
+	int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+	m_bottom.store(bottom, std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	int64_t top = m_top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		// Empty
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job * job = m_jobs[bottom & MASK].load(std::memory_order_relaxed);
+
+	if (top == bottom)
+	{
+		// Last job, race the thieves for it
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job * JobQueue::steal()
+{
+	int64_t top = m_top.load(std::memory_order_acquire);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+	if (top >= bottom)
+	{
+		return nullptr;
+	}
+
+	Job * job = m_jobs[top & MASK].load(std::memory_order_relaxed);
+
+	// Lost to the owner or another thief
+	if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+
+	return job;
+}
+
+bool JobQueue::isEmpty() const
+{
+	return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+}
+
+JobSystem::JobSystem()
+: m_iExternalJobCount(0)
+, m_bRunning(false)
+, m_iSleepingWorkers(0)
+{
+	// Queue for the main thread, so jobs can run inline before (or without) init
+	m_queues.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+
+	std::cout << "JobSystem Created" << std::endl;
+}
+
+JobSystem::~JobSystem()
+{
+	this->shutdown();
+}
+
+void JobSystem::init(unsigned workerCount, bool pinThreads)
+{
+	if (m_bRunning)
+	{
+		return;
+	}
+
+	if (workerCount == 0)
+	{
+		unsigned hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	s_iThreadIndex = 0;
+	s_uiRandomState = 0x9E3779B9u;
+
+	for (unsigned i = 0; i < workerCount; i++)
+	{
+		m_queues.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+	}
+
+	m_bRunning = true;
+
+	for (unsigned i = 1; i <= workerCount; i++)
+	{
+		m_workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+
+		if (pinThreads)
+		{
+			// Worker i gets core i, leaving core 0 to the main thread
+			unsigned core = i % std::max<unsigned>(1, std::thread::hardware_concurrency());
+#ifdef _WIN32
+			SetThreadAffinityMask(m_workers.back().native_handle(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+			cpu_set_t cpuSet;
+			CPU_ZERO(&cpuSet);
+			CPU_SET(core, &cpuSet);
+			pthread_setaffinity_np(m_workers.back().native_handle(), sizeof(cpu_set_t), &cpuSet);
+#endif
+		}
+	}
+
+	std::cout << "JobSystem running with " << workerCount << " worker threads" << std::endl;
+}
+
+void JobSystem::shutdown()
+{
+	if (!m_bRunning)
+	{
+		return;
+	}
+
+	// Let the workers finish whatever has been queued
+	Job * job = nullptr;
+	while ((job = this->getJob()) != nullptr)
+	{
+		this->execute(job);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_bRunning = false;
+	}
+	m_wakeCondition.notify_all();
+
+	for (auto & worker : m_workers)
+	{
+		worker.join();
+	}
+
+	m_workers.clear();
+	m_queues.resize(1);
+}
+
+void JobSystem::run(JobFunction function, JobCounter * counter)
+{
+	if (counter)
+	{
+		counter->increment();
+	}
+
+	this->submit(new Job{ std::move(function), counter });
+}
+
+void JobSystem::runAfter(JobCounter & dependency, JobFunction function, JobCounter * counter)
+{
+	if (counter)
+	{
+		counter->increment();
+	}
+
+	Job * job = new Job{ std::move(function), counter };
+
+	// Parked on the dependency rather than waiting in a worker, so chains can't tie up the pool
+	if (!dependency.addContinuation(job))
+	{
+		this->submit(job);
+	}
+}
+
+void JobSystem::submit(Job * job)
+{
+	int threadIndex = s_iThreadIndex;
+
+	if (threadIndex >= 0 && threadIndex < (int)m_queues.size())
+	{
+		if (!m_queues[threadIndex]->push(job))
+		{
+			// Queue is full, do it now rather than block
+			this->execute(job);
+			return;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(m_externalMutex);
+		m_externalJobs.push_back(job);
+		m_iExternalJobCount++;
+	}
+
+	this->wakeWorkers();
+}
+
+void JobSystem::wait(JobCounter & counter)
+{
+	while (!counter.isDone())
+	{
+		Job * job = this->getJob();
+
+		if (job)
+		{
+			this->execute(job);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// Also waits out the last decrement, the caller is free to destroy the counter after this
+	std::exception_ptr exception = counter.takeException();
+	if (exception)
+	{
+		std::rethrow_exception(exception);
+	}
+}
+
+bool JobSystem::isLocalQueueEmpty()
+{
+	int threadIndex = s_iThreadIndex;
+
+	if (threadIndex >= 0 && threadIndex < (int)m_queues.size())
+	{
+		return m_queues[threadIndex]->isEmpty();
+	}
+
+	return m_iExternalJobCount.load(std::memory_order_relaxed) == 0;
+}
+
+void JobSystem::workerLoop(unsigned threadIndex)
+{
+	s_iThreadIndex = (int)threadIndex;
+	s_uiRandomState = 0x9E3779B9u * (threadIndex + 1);
+
+	int failedAttempts = 0;
+
+	while (m_bRunning)
+	{
+		Job * job = this->getJob();
+
+		if (job)
+		{
+			this->execute(job);
+			failedAttempts = 0;
+			continue;
+		}
+
+		if (++failedAttempts < JOB_SPIN_COUNT)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Nothing to do for a while, sleep until run() wakes us (the timeout covers a missed wake)
+		std::unique_lock<std::mutex> lock(m_wakeMutex);
+		m_iSleepingWorkers++;
+		m_wakeCondition.wait_for(lock, std::chrono::milliseconds(1));
+		m_iSleepingWorkers--;
+		failedAttempts = 0;
+	}
+}
+
+Job * JobSystem::getJob()
+{
+	int threadIndex = s_iThreadIndex;
+	int queueCount = (int)m_queues.size();
+
+	// Own work first, newest job is the one most likely still in cache
+	if (threadIndex >= 0 && threadIndex < queueCount)
+	{
+		Job * job = m_queues[threadIndex]->pop();
+		if (job)
+		{
+			return job;
+		}
+	}
+
+	// Only take the lock when there is something to take
+	if (m_iExternalJobCount.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_externalMutex);
+		if (!m_externalJobs.empty())
+		{
+			Job * job = m_externalJobs.front();
+			m_externalJobs.pop_front();
+			m_iExternalJobCount--;
+			return job;
+		}
+	}
+
+	// Steal from everyone else starting at a random victim
+	if (queueCount > 0)
+	{
+		uint32_t random = s_uiRandomState != 0 ? s_uiRandomState : 0x9E3779B9u;
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		s_uiRandomState = random;
+
+		int start = (int)(random % (uint32_t)queueCount);
+
+		for (int i = 0; i < queueCount; i++)
+		{
+			int victim = (start + i) % queueCount;
+			if (victim == threadIndex)
+			{
+				continue;
+			}
+
+			Job * job = m_queues[victim]->steal();
+			if (job)
+			{
+				return job;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+void JobSystem::execute(Job * job)
+{
+	try
+	{
+		job->function();
+	}
+	catch (const std::exception & exception)
+	{
+		// Whoever waits on the counter gets it, the counter still has to reach zero
+		if (job->counter)
+		{
+			job->counter->fail(std::current_exception());
+		}
+		else
+		{
+			std::cout << "Job failed: " << exception.what() << std::endl;
+		}
+	}
+	catch (...)
+	{
+		if (job->counter)
+		{
+			job->counter->fail(std::current_exception());
+		}
+		else
+		{
+			std::cout << "Job failed" << std::endl;
+		}
+	}
+
+	JobCounter * counter = job->counter;
+	delete job;
+
+	if (counter)
+	{
+		counter->decrement();
+	}
+}
+
+void JobSystem::wakeWorkers()
+{
+	if (m_iSleepingWorkers.load(std::memory_order_relaxed) > 0)
+	{
+		m_wakeCondition.notify_one();
+	}
+}
@@ -0,0 +1,223 @@
+#ifndef __JOB_SYSTEM_H__
+#define __JOB_SYSTEM_H__
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <exception>
+#include <stdint.h>
+
+typedef std::function<void()> JobFunction;
+
+struct Job;
+
+// Number of jobs still outstanding, a job decrements it once it has finished running.
+// Jobs queued with runAfter are kept here and only queued once the count reaches zero, and the
+// first exception thrown by a job is kept until wait() rethrows it.
+class JobCounter
+{
+public:
+	JobCounter() : m_count(0) {}
+	~JobCounter();
+
+	JobCounter(const JobCounter &) = delete;
+	void operator=(const JobCounter &) = delete;
+
+	bool isDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+
+	void increment(int amount = 1) { m_count.fetch_add(amount, std::memory_order_relaxed); }
+
+	// The last decrement queues the continuations
+	void decrement();
+
+	// Keeps the first failure, wait() rethrows it
+	void fail(std::exception_ptr exception);
+
+private:
+	friend class JobSystem;
+
+	// False when the count is already zero, the caller queues the job itself
+	bool addContinuation(Job * job);
+
+	// Returns once no decrement is still inside the counter, so it can be destroyed
+	std::exception_ptr takeException();
+
+	std::atomic<int> m_count;
+
+	// Both only touched under the mutex, the last decrement happens under it too
+	std::mutex m_mutex;
+	std::vector<Job *> m_continuations;
+	std::exception_ptr m_exception;
+};
+
+struct Job
+{
+	JobFunction function;
+	JobCounter * counter;
+};
+
+// Chase-Lev work-stealing deque. The owning thread pushes and pops at the bottom,
+// every other thread steals from the top.
+class JobQueue
+{
+public:
+	static const int64_t CAPACITY = 4096; // Must be a power of two
+	static const int64_t MASK = CAPACITY - 1;
+
+	JobQueue();
+
+	bool push(Job * job); // Owner only, fails when full
+	Job * pop(); // Owner only
+	Job * steal(); // Any thread
+
+	bool isEmpty() const;
+
+private:
+	// Kept on separate cache lines, the thieves hammer m_top while the owner works on m_bottom
+	std::atomic<int64_t> m_top;
+	char m_padding0[64 - sizeof(std::atomic<int64_t>)];
+	std::atomic<int64_t> m_bottom;
+	char m_padding1[64 - sizeof(std::atomic<int64_t>)];
+
+	std::atomic<Job *> m_jobs[CAPACITY];
+};
+
+// Singleton JobSystem
+// A fixed pool of worker threads, one per core, each with its own work-stealing queue.
+// The thread that calls init() becomes thread 0 and takes part whenever it waits.
+class JobSystem
+{
+public:
+	static JobSystem & getInstance()
+	{
+		static JobSystem jobSystem;
+		return jobSystem;
+	}
+private:
+	JobSystem();
+public:
+	~JobSystem();
+
+	JobSystem(const JobSystem &) = delete;
+	void operator=(const JobSystem &) = delete;
+
+	// workerCount of 0 uses one worker per remaining hardware thread
+	void init(unsigned workerCount = 0, bool pinThreads = true);
+	void shutdown();
+
+	// Queue a job, the counter (if any) is incremented now and decremented when the job is done
+	void run(JobFunction function, JobCounter * counter = nullptr);
+
+	// Queue a job that only starts once dependency has reached zero. Nothing waits in the meantime,
+	// the job is parked on the counter, which has to live until it gets there.
+	void runAfter(JobCounter & dependency, JobFunction function, JobCounter * counter = nullptr);
+
+	// Runs other jobs until the counter reaches zero, then rethrows the first exception a job threw
+	void wait(JobCounter & counter);
+
+	// Calls function(begin, end) over sub ranges of [begin, end) on every thread and waits for them.
+	// Ranges are split lazily, only while other threads are out of work, and never below minGrain
+	// (0 picks a grain from the thread count).
+	template <typename Function>
+	void parallelFor(size_t begin, size_t end, size_t minGrain, const Function & function);
+
+	unsigned getThreadCount() { return (unsigned)m_queues.size(); }
+	static int getThreadIndex() { return s_iThreadIndex; }
+
+	bool isLocalQueueEmpty();
+
+private:
+	friend class JobCounter;
+
+	// Queues a job whose counter has already been incremented
+	void submit(Job * job);
+
+	void workerLoop(unsigned threadIndex);
+	Job * getJob();
+	void execute(Job * job);
+	void wakeWorkers();
+
+	template <typename Function>
+	void parallelForRange(size_t begin, size_t end, size_t grain, const Function & function, JobCounter & counter);
+
+	std::vector<std::unique_ptr<JobQueue>> m_queues; // Index 0 belongs to the thread that called init()
+	std::vector<std::thread> m_workers;
+
+	// Jobs queued from threads that don't own a queue
+	std::deque<Job *> m_externalJobs;
+	std::atomic<int> m_iExternalJobCount;
+	std::mutex m_externalMutex;
+
+	std::atomic<bool> m_bRunning;
+	std::atomic<int> m_iSleepingWorkers;
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wakeCondition;
+
+	static thread_local int s_iThreadIndex;
+	static thread_local uint32_t s_uiRandomState;
+};
+
+template <typename Function>
+void JobSystem::parallelFor(size_t begin, size_t end, size_t minGrain, const Function & function)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	size_t grain = minGrain;
+	if (grain == 0)
+	{
+		// Enough pieces for stealing to balance uneven work, few enough to keep overhead down
+		grain = std::max<size_t>(1, (end - begin) / (this->getThreadCount() * 16));
+	}
+
+	JobCounter counter;
+
+	try
+	{
+		this->parallelForRange(begin, end, grain, function, counter);
+	}
+	catch (...)
+	{
+		// The jobs already queued still reference function and counter, let them finish first
+		counter.fail(std::current_exception());
+	}
+
+	this->wait(counter);
+}
+
+template <typename Function>
+void JobSystem::parallelForRange(size_t begin, size_t end, size_t grain, const Function & function, JobCounter & counter)
+{
+	while (begin < end)
+	{
+		// Lazy binary splitting: only hand off half the range when our queue has run dry,
+		// which is exactly when someone has stolen from us or nobody has work yet
+		if (end - begin > grain && this->isLocalQueueEmpty())
+		{
+			size_t middle = begin + (end - begin) / 2;
+			size_t rangeEnd = end;
+
+			this->run([this, middle, rangeEnd, grain, &function, &counter]()
+			{
+				this->parallelForRange(middle, rangeEnd, grain, function, counter);
+			}, &counter);
+
+			end = middle;
+			continue;
+		}
+
+		size_t chunkEnd = std::min<size_t>(begin + grain, end);
+		function(begin, chunkEnd);
+		begin = chunkEnd;
+	}
+}
+
+#endif
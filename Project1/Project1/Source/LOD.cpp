@@ -0,0 +1,211 @@
+#include "LOD.h"
+#include "JobSystem.h"
+
+#include <geometric.hpp>
+#include <matrix.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#define LOD_CHANGED_BIT 0x80000000u
+
+LODView LODView::fromCamera(const glm::mat4 & view, const glm::mat4 & projection, float viewportHeight)
+{
+	LODView lodView;
+	lodView.cameraPosition = glm::vec3(glm::inverse(view)[3]);
+
+	// projection[1][1] is cot(fovy / 2), negative once Y has been flipped for Vulkan
+	lodView.projectionScale = std::fabs(projection[1][1]) * viewportHeight * 0.5f;
+
+	return lodView;
+}
+
+LODSelector::LODSelector()
+{
+}
+
+LODSelector::~LODSelector()
+{
+
+}
+
+uint32_t LODSelector::addChain(const LODChain & chain)
+{
+	if (chain.levels.empty() || chain.levels.size() > LOD_MAX_LEVELS)
+	{
+		throw std::runtime_error("LOD chain needs between 1 and LOD_MAX_LEVELS levels!");
+	}
+
+	for (size_t i = 1; i < chain.levels.size(); i++)
+	{
+		if (chain.levels[i].geometricError < chain.levels[i - 1].geometricError)
+		{
+			throw std::runtime_error("LOD chain errors have to grow from the finest level to the coarsest!");
+		}
+	}
+
+	uint32_t offset = m_chainOffsets.empty() ? 0 : m_chainOffsets.back() + (uint32_t)m_chains.back().levels.size();
+
+	m_chains.push_back(chain);
+	m_chainOffsets.push_back(offset);
+
+	return (uint32_t)m_chains.size() - 1;
+}
+
+void LODSelector::resetObject(uint32_t objectId)
+{
+	if (objectId < m_currentLevels.size())
+	{
+		m_currentLevels[objectId] = LOD_NO_LEVEL;
+	}
+}
+
+uint32_t LODSelector::getCurrentLevel(uint32_t objectId) const
+{
+	return objectId < m_currentLevels.size() ? m_currentLevels[objectId] : LOD_NO_LEVEL;
+}
+
+float LODSelector::projectError(const LODView & view, float error, float distance)
+{
+	return error * view.projectionScale / std::max<float>(distance, 1e-3f);
+}
+
+uint8_t LODSelector::selectLevel(const LODView & view, const LODCandidate & candidate, uint8_t current) const
+{
+	const std::vector<LODLevel> & levels = m_chains[candidate.chainId].levels;
+	uint8_t levelCount = (uint8_t)levels.size();
+
+	// Nearest point of the bounding sphere, everything inside it gets the same error
+	float distance = glm::length(candidate.center - view.cameraPosition) - candidate.radius;
+
+	float projected[LOD_MAX_LEVELS];
+	for (uint8_t level = 0; level < levelCount; level++)
+	{
+		projected[level] = projectError(view, levels[level].geometricError * candidate.scale, distance);
+	}
+
+	// Coarsest level that is still within the threshold
+	uint8_t desired = 0;
+	for (uint8_t level = 1; level < levelCount && projected[level] <= view.errorThresholdPixels; level++)
+	{
+		desired = level;
+	}
+
+	if (current >= levelCount)
+	{
+		return desired;
+	}
+
+	if (desired > current)
+	{
+		// Only drop detail once the coarser level is comfortably under the threshold
+		uint8_t coarser = current;
+		for (uint8_t level = current + 1; level <= desired; level++)
+		{
+			if (projected[level] <= view.errorThresholdPixels * (1.0f - view.hysteresis))
+			{
+				coarser = level;
+			}
+		}
+		return coarser;
+	}
+
+	if (desired < current && projected[current] > view.errorThresholdPixels * (1.0f + view.hysteresis))
+	{
+		// Only add detail once the current level is clearly over it
+		return desired;
+	}
+
+	return current;
+}
+
+void LODSelector::select(const LODView & view, const LODCandidate * candidates, size_t count, std::vector<LODDrawBatch> & batches, std::vector<uint32_t> & instances)
+{
+	batches.clear();
+	instances.clear();
+	m_stats = LODStats();
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	uint32_t maxObjectId = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (candidates[i].chainId >= m_chains.size())
+		{
+			throw std::runtime_error("LOD candidate refers to a chain that doesn't exist!");
+		}
+		maxObjectId = std::max<uint32_t>(maxObjectId, candidates[i].objectId);
+	}
+
+	if (maxObjectId >= m_currentLevels.size())
+	{
+		m_currentLevels.resize(maxObjectId + 1, LOD_NO_LEVEL);
+	}
+
+	// Every candidate is its own object, so the jobs never touch the same level slot
+	m_selected.resize(count);
+	JobSystem::getInstance().parallelFor(0, count, LOD_SELECT_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const LODCandidate & candidate = candidates[i];
+
+			uint8_t previous = m_currentLevels[candidate.objectId];
+			uint8_t level = this->selectLevel(view, candidate, previous);
+			m_currentLevels[candidate.objectId] = level;
+
+			m_selected[i] = (m_chainOffsets[candidate.chainId] + level) | (previous != LOD_NO_LEVEL && previous != level ? LOD_CHANGED_BIT : 0);
+		}
+	});
+
+	// Counting sort by level, which gives one contiguous run of instances per batch
+	uint32_t totalLevels = m_chainOffsets.back() + (uint32_t)m_chains.back().levels.size();
+	m_levelCounts.assign(totalLevels, 0);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		m_levelCounts[m_selected[i] & ~LOD_CHANGED_BIT]++;
+
+		if (m_selected[i] & LOD_CHANGED_BIT)
+		{
+			m_stats.levelChanges++;
+		}
+	}
+
+	uint32_t first = 0;
+	for (uint32_t chainId = 0; chainId < m_chains.size(); chainId++)
+	{
+		const LODChain & chain = m_chains[chainId];
+
+		for (uint32_t level = 0; level < chain.levels.size(); level++)
+		{
+			uint32_t & levelCount = m_levelCounts[m_chainOffsets[chainId] + level];
+			if (levelCount == 0)
+			{
+				continue;
+			}
+
+			batches.push_back({ chain.levels[level].meshId, chain.levels[level].vertexCount, first, levelCount });
+
+			m_stats.vertexCount += (uint64_t)chain.levels[level].vertexCount * levelCount;
+			m_stats.fullDetailVertexCount += (uint64_t)chain.levels[0].vertexCount * levelCount;
+
+			// From here on the count is the write cursor for that level
+			uint32_t start = first;
+			first += levelCount;
+			levelCount = start;
+		}
+	}
+
+	instances.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		instances[m_levelCounts[m_selected[i] & ~LOD_CHANGED_BIT]++] = candidates[i].objectIndex;
+	}
+
+	m_stats.objectCount = count;
+}
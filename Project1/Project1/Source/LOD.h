@@ -0,0 +1,112 @@
+#ifndef __LOD_H__
+#define __LOD_H__
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec3.hpp>
+#include <mat4x4.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+#define LOD_MAX_LEVELS 8
+#define LOD_NO_LEVEL 0xFF // Object hasn't been selected yet
+#define LOD_DEFAULT_ERROR_PIXELS 1.0f // Largest screen space error allowed before a finer level is needed
+#define LOD_DEFAULT_HYSTERESIS 0.25f // Fraction of the threshold an error has to cross before the level changes again
+#define LOD_SELECT_GRAIN 1024 // Candidates per job
+
+// One level of a mesh. geometricError is how far (in object space units) the level deviates
+// from the full detail mesh at most, so level 0 normally has 0.
+struct LODLevel
+{
+	uint32_t meshId;
+	uint32_t vertexCount;
+	float geometricError;
+};
+
+// Levels ordered finest first, errors must not decrease along the chain
+struct LODChain
+{
+	std::vector<LODLevel> levels;
+};
+
+// Camera values the selection needs, taken once per frame
+struct LODView
+{
+	glm::vec3 cameraPosition;
+	float projectionScale; // Pixels per unit of error at distance 1
+	float errorThresholdPixels = LOD_DEFAULT_ERROR_PIXELS;
+	float hysteresis = LOD_DEFAULT_HYSTERESIS;
+
+	static LODView fromCamera(const glm::mat4 & view, const glm::mat4 & projection, float viewportHeight);
+};
+
+struct LODCandidate
+{
+	uint32_t objectId; // Stable across frames, the hysteresis state is kept per object
+	uint32_t chainId;
+	uint32_t objectIndex; // Passed through to the draw, e.g. into FramePacket::objectConstants
+	glm::vec3 center; // World space bounding sphere
+	float radius;
+	float scale; // Largest axis scale of the object's transform, errors are in object space
+};
+
+// All visible instances of one LOD level, objects [firstInstance, firstInstance + instanceCount) of the instance list
+struct LODDrawBatch
+{
+	uint32_t meshId;
+	uint32_t vertexCount;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+struct LODStats
+{
+	size_t objectCount = 0;
+	size_t levelChanges = 0;
+	uint64_t vertexCount = 0; // What was selected
+	uint64_t fullDetailVertexCount = 0; // What level 0 everywhere would have cost
+};
+
+// Picks a level per object from its geometric error projected to the screen, then groups the
+// objects into one instanced batch per level.
+class LODSelector
+{
+public:
+	LODSelector();
+	virtual ~LODSelector();
+
+	LODSelector(const LODSelector &) = delete;
+	void operator=(const LODSelector &) = delete;
+
+	uint32_t addChain(const LODChain & chain);
+	const LODChain & getChain(uint32_t chainId) const { return m_chains[chainId]; }
+
+	// Objects that went away, so a new object reusing the id starts from scratch
+	void resetObject(uint32_t objectId);
+
+	// Runs the per object selection on the job system. batches and instances are overwritten,
+	// instances holds the candidates' objectIndex values grouped by batch.
+	void select(const LODView & view, const LODCandidate * candidates, size_t count, std::vector<LODDrawBatch> & batches, std::vector<uint32_t> & instances);
+
+	uint32_t getCurrentLevel(uint32_t objectId) const;
+	const LODStats & getStats() const { return m_stats; }
+
+	// Screen space size in pixels of a world space error at the given distance
+	static float projectError(const LODView & view, float error, float distance);
+
+private:
+	uint8_t selectLevel(const LODView & view, const LODCandidate & candidate, uint8_t current) const;
+
+	std::vector<LODChain> m_chains;
+	std::vector<uint32_t> m_chainOffsets; // First global level index of each chain
+
+	std::vector<uint8_t> m_currentLevels; // By object id, LOD_NO_LEVEL until first selected
+	std::vector<uint32_t> m_selected; // Global level index per candidate for this frame, top bit set when the level changed
+	std::vector<uint32_t> m_levelCounts;
+
+	LODStats m_stats;
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include "LZ.h"
+#include "Hash.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	inline uint32_t hashSequence(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+	}
+
+	// Writes a length that didn't fit its nibble as a run of 255s and a remainder
+	inline uint8_t * writeLength(uint8_t * out, size_t length)
+	{
+		while (length >= 255)
+		{
+			*out++ = 255;
+			length -= 255;
+		}
+		*out++ = (uint8_t)length;
+		return out;
+	}
+
+	inline size_t getLengthBytes(size_t length)
+	{
+		return length >= 15 ? (length - 15) / 255 + 1 : 0;
+	}
+
+	// False when the sequence doesn't fit
+	bool writeSequence(const uint8_t * literals, size_t literalCount, size_t offset, size_t matchLength, uint8_t *& out, const uint8_t * outEnd)
+	{
+		size_t matchCode = matchLength > 0 ? matchLength - LZ_MIN_MATCH : 0;
+		size_t required = 1 + getLengthBytes(literalCount) + literalCount + (matchLength > 0 ? 2 + getLengthBytes(matchCode) : 0);
+
+		if (required > (size_t)(outEnd - out))
+		{
+			return false;
+		}
+
+		uint8_t * token = out++;
+		*token = (uint8_t)((literalCount >= 15 ? 15 : literalCount) << 4);
+
+		if (literalCount >= 15)
+		{
+			out = writeLength(out, literalCount - 15);
+		}
+
+		if (literalCount > 0)
+		{
+			memcpy(out, literals, literalCount);
+			out += literalCount;
+		}
+
+		if (matchLength == 0)
+		{
+			return true;
+		}
+
+		*out++ = (uint8_t)offset;
+		*out++ = (uint8_t)(offset >> 8);
+
+		*token |= (uint8_t)(matchCode >= 15 ? 15 : matchCode);
+		if (matchCode >= 15)
+		{
+			out = writeLength(out, matchCode - 15);
+		}
+
+		return true;
+	}
+
+	// Reads the extra bytes of a length whose nibble was 15, false when the input runs out
+	inline bool readLength(const uint8_t *& in, const uint8_t * inEnd, size_t & length)
+	{
+		uint8_t value;
+		do
+		{
+			if (in >= inEnd)
+			{
+				return false;
+			}
+			value = *in++;
+			length += value;
+		} while (value == 255);
+
+		return true;
+	}
+}
+
+namespace LZ
+{
+	size_t getMaxCompressedSize(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	size_t compress(const uint8_t * source, size_t size, uint8_t * destination, size_t capacity)
+	{
+		uint8_t * out = destination;
+		const uint8_t * outEnd = destination + capacity;
+
+		const uint8_t * anchor = source;
+		const uint8_t * end = source + size;
+
+		if (size > LZ_MATCH_START_LIMIT)
+		{
+			// Positions relative to source, 0 doubles as "nothing yet" since every candidate is checked anyway
+			std::vector<uint32_t> table((size_t)1 << LZ_HASH_BITS, 0);
+
+			const uint8_t * matchLimit = end - LZ_LAST_LITERALS;
+			const uint8_t * startLimit = end - LZ_MATCH_START_LIMIT;
+			const uint8_t * in = source + 1;
+
+			while (in < startLimit)
+			{
+				uint32_t sequence = Hash::read32(in);
+				uint32_t & slot = table[hashSequence(sequence)];
+				const uint8_t * candidate = source + slot;
+				slot = (uint32_t)(in - source);
+
+				if (candidate >= in || (size_t)(in - candidate) > LZ_MAX_OFFSET || Hash::read32(candidate) != sequence)
+				{
+					// Step further the longer nothing has matched, incompressible data goes by quickly
+					in += 1 + ((in - anchor) >> 6);
+					continue;
+				}
+
+				// Grow the match backwards into the pending literals, then forwards
+				while (in > anchor && candidate > source && in[-1] == candidate[-1])
+				{
+					in--;
+					candidate--;
+				}
+
+				const uint8_t * matchEnd = in + LZ_MIN_MATCH;
+				const uint8_t * reference = candidate + LZ_MIN_MATCH;
+				while (matchEnd < matchLimit && *matchEnd == *reference)
+				{
+					matchEnd++;
+					reference++;
+				}
+
+				if (!writeSequence(anchor, (size_t)(in - anchor), (size_t)(in - candidate), (size_t)(matchEnd - in), out, outEnd))
+				{
+					return 0;
+				}
+
+				in = matchEnd;
+				anchor = in;
+
+				// Cheap extra candidate that helps the next few positions
+				if (in < startLimit)
+				{
+					table[hashSequence(Hash::read32(in - 2))] = (uint32_t)(in - 2 - source);
+				}
+			}
+		}
+
+		if (!writeSequence(anchor, (size_t)(end - anchor), 0, 0, out, outEnd))
+		{
+			return 0;
+		}
+
+		return (size_t)(out - destination);
+	}
+
+	bool decompress(const uint8_t * source, size_t sourceSize, uint8_t * destination, size_t size)
+	{
+		const uint8_t * in = source;
+		const uint8_t * inEnd = source + sourceSize;
+		uint8_t * out = destination;
+		uint8_t * outEnd = destination + size;
+
+		while (in < inEnd)
+		{
+			uint8_t token = *in++;
+
+			size_t literalCount = token >> 4;
+			if (literalCount == 15 && !readLength(in, inEnd, literalCount))
+			{
+				return false;
+			}
+
+			if (literalCount > (size_t)(inEnd - in) || literalCount > (size_t)(outEnd - out))
+			{
+				return false;
+			}
+
+			if (literalCount > 0)
+			{
+				memcpy(out, in, literalCount);
+				in += literalCount;
+				out += literalCount;
+			}
+
+			if (in == inEnd)
+			{
+				// Only the last sequence stops after its literals
+				break;
+			}
+
+			if (inEnd - in < 2)
+			{
+				return false;
+			}
+
+			size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+			in += 2;
+
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !readLength(in, inEnd, matchLength))
+			{
+				return false;
+			}
+			matchLength += LZ_MIN_MATCH;
+
+			if (offset == 0 || offset > (size_t)(out - destination) || matchLength > (size_t)(outEnd - out))
+			{
+				return false;
+			}
+
+			const uint8_t * match = out - offset;
+			if (offset >= matchLength)
+			{
+				memcpy(out, match, matchLength);
+				out += matchLength;
+			}
+			else
+			{
+				// Overlapping, the match repeats its first offset bytes. Whatever has been copied can be
+				// copied again, so the chunks double instead of going byte by byte.
+				size_t copied = 0;
+				while (copied < matchLength)
+				{
+					size_t chunk = std::min<size_t>(matchLength - copied, offset + copied);
+					memcpy(out, match, chunk);
+					out += chunk;
+					copied += chunk;
+				}
+			}
+		}
+
+		return out == outEnd;
+	}
+}
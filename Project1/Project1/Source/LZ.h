@@ -0,0 +1,31 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xFFFF // Matches reach back at most this far
+#define LZ_HASH_BITS 14 // Match finder table entries, 64KB of positions
+#define LZ_LAST_LITERALS 5 // The end of a block is always literals, so the decoder can copy in whole words
+#define LZ_MATCH_START_LIMIT 12 // No match starts closer than this to the end
+
+// Byte oriented LZ77 in the LZ4 block layout: a sequence is a token (literal count in the high
+// nibble, match length - 4 in the low one, 15 meaning more length bytes follow), the literals, a
+// 16 bit little endian offset and the extra match length bytes. The last sequence is literals only.
+// Greedy matching from a single hash table, so it compresses at hundreds of MB/s per thread and
+// decompresses at several GB/s, trading ratio for speed.
+namespace LZ
+{
+	// Worst case output of compress() for size bytes of input
+	size_t getMaxCompressedSize(size_t size);
+
+	// Compressed size, 0 when it doesn't fit in capacity (callers then store the data as it is)
+	size_t compress(const uint8_t * source, size_t size, uint8_t * destination, size_t capacity);
+
+	// False when the input is malformed or doesn't decompress to exactly size bytes, never reads or
+	// writes out of bounds either way
+	bool decompress(const uint8_t * source, size_t sourceSize, uint8_t * destination, size_t size);
+}
+
+#endif
@@ -0,0 +1,69 @@
+#include "Mesh.h"
+
+#include <common.hpp>
+
+#include <cstring>
+
+void MeshData::setIndices(const uint32_t * indices, size_t count)
+{
+	indexCount = count;
+
+	if (vertices.size() <= MESH_MAX_16BIT_VERTICES)
+	{
+		indexType = MESH_INDEX_16;
+		indexData.resize(count * sizeof(uint16_t));
+
+		uint16_t * out = reinterpret_cast<uint16_t *>(indexData.data());
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = (uint16_t)indices[i];
+		}
+	}
+	else
+	{
+		indexType = MESH_INDEX_32;
+		indexData.resize(count * sizeof(uint32_t));
+
+		if (count > 0)
+		{
+			memcpy(indexData.data(), indices, count * sizeof(uint32_t));
+		}
+	}
+}
+
+std::vector<uint32_t> MeshData::getIndices() const
+{
+	std::vector<uint32_t> indices(indexCount);
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		indices[i] = this->getIndex(i);
+	}
+
+	return indices;
+}
+
+void MeshData::computeBounds()
+{
+	if (vertices.empty())
+	{
+		boundsMin = boundsMax = glm::vec3(0.0f);
+		return;
+	}
+
+	boundsMin = boundsMax = vertices[0].position;
+	for (const auto & vertex : vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+}
+
+void MeshData::clear()
+{
+	vertices.clear();
+	indexData.clear();
+	indexType = MESH_INDEX_32;
+	indexCount = 0;
+	boundsMin = boundsMax = glm::vec3(0.0f);
+}
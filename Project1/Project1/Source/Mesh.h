@@ -0,0 +1,63 @@
+#ifndef __MESH_H__
+#define __MESH_H__
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec2.hpp>
+#include <vec3.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+#define MESH_MAX_16BIT_VERTICES 0xFFFF // 0xFFFF itself is left free as the primitive restart index
+
+enum MESH_INDEX_TYPE
+{
+	MESH_INDEX_16,
+	MESH_INDEX_32,
+};
+
+// Interleaved, one of these per unique position / normal / uv combination
+struct MeshVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;
+};
+
+static_assert(sizeof(MeshVertex) == 32, "MeshVertex is expected to be tightly packed");
+
+// Indexed triangle list, ready to be copied into vertex and index buffers as is
+struct MeshData
+{
+	std::vector<MeshVertex> vertices;
+
+	// uint16_t or uint32_t per index, depending on indexType
+	std::vector<uint8_t> indexData;
+	MESH_INDEX_TYPE indexType = MESH_INDEX_32;
+	size_t indexCount = 0;
+
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+
+	size_t getIndexSize() const { return indexType == MESH_INDEX_16 ? sizeof(uint16_t) : sizeof(uint32_t); }
+	size_t getTriangleCount() const { return indexCount / 3; }
+
+	const uint16_t * getIndices16() const { return reinterpret_cast<const uint16_t *>(indexData.data()); }
+	const uint32_t * getIndices32() const { return reinterpret_cast<const uint32_t *>(indexData.data()); }
+
+	uint32_t getIndex(size_t i) const { return indexType == MESH_INDEX_16 ? getIndices16()[i] : getIndices32()[i]; }
+
+	// Stores the indices as 16 bit whenever the vertex count allows it
+	void setIndices(const uint32_t * indices, size_t count);
+	void setIndices(const std::vector<uint32_t> & indices) { this->setIndices(indices.data(), indices.size()); }
+
+	// Widened copy, for tools that would rather not deal with both index sizes
+	std::vector<uint32_t> getIndices() const;
+
+	void computeBounds();
+	void clear();
+};
+
+#endif
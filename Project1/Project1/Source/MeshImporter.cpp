@@ -0,0 +1,693 @@
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+#include "FileReader.h"
+#include "JobSystem.h"
+#include "Hash.h"
+#include "DerivedDataCache.h"
+
+#include <iostream>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+namespace
+{
+	const char MESH_CACHE_MAGIC[4] = { 'V', 'M', 'S', 'H' };
+
+	// The derived data cache checksums whole entries, so there is no checksum of its own
+	struct MeshCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t indexType;
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	// Positive OBJ indices are absolute, negative ones count back from the last element parsed so
+	// far, which a chunk only knows relative to its own first element. Those stay chunk relative
+	// (biased into the negative range below OBJ_MISSING) until every chunk's base is known.
+	const int32_t OBJ_MISSING = -1;
+	const int64_t OBJ_RELATIVE_BIAS = 1 << 29;
+	const uint32_t MESH_NO_ATTRIBUTE = 0xFFFFFFFFu;
+	const uint32_t MESH_NO_CORNER = 0xFFFFFFFFu;
+
+	struct ObjCorner
+	{
+		int32_t position;
+		int32_t uv;
+		int32_t normal;
+	};
+
+	struct ResolvedCorner
+	{
+		uint32_t position;
+		uint32_t uv;
+		uint32_t normal;
+	};
+
+	struct ObjChunk
+	{
+		const char * begin;
+		const char * end;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		std::vector<ObjCorner> corners; // Three per triangle
+
+		size_t positionBase;
+		size_t uvBase;
+		size_t normalBase;
+		size_t cornerBase;
+
+		bool bMalformed;
+	};
+
+	const double POWERS_OF_TEN[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return (unsigned)(c - '0') < 10;
+	}
+
+	inline const char * skipSpaces(const char * p, const char * end)
+	{
+		while (p < end && isSpace(*p))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	// Decimal mantissa and power of ten, scaled by an exactly representable power when it fits
+	// (which covers anything an exporter writes) and by std::pow otherwise
+	const char * parseFloat(const char * p, const char * end, float & value)
+	{
+		p = skipSpaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+
+		for (; p < end && isDigit(*p); p++)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0 ? 1 : 0;
+			}
+			else
+			{
+				exponent++;
+			}
+		}
+
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && isDigit(*p); p++)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					digits += mantissa != 0 ? 1 : 0;
+					exponent--;
+				}
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				p++;
+			}
+
+			int power = 0;
+			for (; p < end && isDigit(*p); p++)
+			{
+				power = std::min<int>(power * 10 + (*p - '0'), 9999);
+			}
+
+			exponent += negativeExponent ? -power : power;
+		}
+
+		double result = (double)mantissa;
+		if (exponent < 0)
+		{
+			result = exponent >= -22 ? result / POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+		}
+		else if (exponent > 0)
+		{
+			result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+		}
+
+		value = (float)(negative ? -result : result);
+		return p;
+	}
+
+	const char * parseInt(const char * p, const char * end, int32_t & value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+
+		int64_t result = 0;
+		for (; p < end && isDigit(*p); p++)
+		{
+			result = std::min<int64_t>(result * 10 + (*p - '0'), INT32_MAX);
+		}
+
+		value = (int32_t)(negative ? -result : result);
+		return p;
+	}
+
+	inline int32_t encodeIndex(int32_t objIndex, size_t localCount)
+	{
+		if (objIndex > 0)
+		{
+			return objIndex - 1;
+		}
+
+		int64_t local = (int64_t)localCount + objIndex;
+		return (int32_t)(-2 - (local + OBJ_RELATIVE_BIAS));
+	}
+
+	// MESH_NO_ATTRIBUTE when the index was left out, count when it is out of range
+	inline uint32_t resolveIndex(int32_t stored, size_t base, size_t count)
+	{
+		if (stored == OBJ_MISSING)
+		{
+			return MESH_NO_ATTRIBUTE;
+		}
+
+		int64_t index = stored >= 0 ? stored : (int64_t)base + (-2 - (int64_t)stored - OBJ_RELATIVE_BIAS);
+		return index >= 0 && index < (int64_t)count ? (uint32_t)index : (uint32_t)count;
+	}
+
+	void parseChunk(ObjChunk & chunk)
+	{
+		const char * p = chunk.begin;
+		const char * end = chunk.end;
+
+		ObjCorner polygon[3];
+
+		while (p < end)
+		{
+			const char * lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+			if (!lineEnd)
+			{
+				lineEnd = end;
+			}
+
+			p = skipSpaces(p, lineEnd);
+
+			if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1]))
+			{
+				glm::vec3 position;
+				p = parseFloat(p + 2, lineEnd, position.x);
+				p = parseFloat(p, lineEnd, position.y);
+				parseFloat(p, lineEnd, position.z);
+				chunk.positions.push_back(position);
+			}
+			else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+			{
+				glm::vec2 uv;
+				p = parseFloat(p + 3, lineEnd, uv.x);
+				parseFloat(p, lineEnd, uv.y);
+
+				// OBJ puts v = 0 at the bottom of the image, Vulkan samples with 0 at the top
+				uv.y = 1.0f - uv.y;
+				chunk.uvs.push_back(uv);
+			}
+			else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+			{
+				glm::vec3 normal;
+				p = parseFloat(p + 3, lineEnd, normal.x);
+				p = parseFloat(p, lineEnd, normal.y);
+				parseFloat(p, lineEnd, normal.z);
+				chunk.normals.push_back(normal);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+			{
+				// v, v/vt, v//vn or v/vt/vn per corner, fanned out from the first corner
+				int cornerCount = 0;
+				p += 2;
+
+				while (true)
+				{
+					p = skipSpaces(p, lineEnd);
+					if (p >= lineEnd || !(isDigit(*p) || *p == '-' || *p == '+'))
+					{
+						break;
+					}
+
+					int32_t index;
+					ObjCorner corner = { OBJ_MISSING, OBJ_MISSING, OBJ_MISSING };
+
+					p = parseInt(p, lineEnd, index);
+					if (index == 0)
+					{
+						chunk.bMalformed = true;
+					}
+					corner.position = encodeIndex(index, chunk.positions.size());
+
+					if (p < lineEnd && *p == '/')
+					{
+						p++;
+						if (p < lineEnd && *p != '/')
+						{
+							p = parseInt(p, lineEnd, index);
+							corner.uv = index != 0 ? encodeIndex(index, chunk.uvs.size()) : OBJ_MISSING;
+						}
+
+						if (p < lineEnd && *p == '/')
+						{
+							p = parseInt(p + 1, lineEnd, index);
+							corner.normal = index != 0 ? encodeIndex(index, chunk.normals.size()) : OBJ_MISSING;
+						}
+					}
+
+					if (cornerCount < 2)
+					{
+						polygon[cornerCount] = corner;
+					}
+					else
+					{
+						polygon[2] = corner;
+						chunk.corners.insert(chunk.corners.end(), polygon, polygon + 3);
+						polygon[1] = corner;
+					}
+					cornerCount++;
+
+					// Skip whatever is left of a token we couldn't make sense of
+					while (p < lineEnd && !isSpace(*p))
+					{
+						chunk.bMalformed = true;
+						p++;
+					}
+				}
+
+				if (cornerCount < 3)
+				{
+					chunk.bMalformed = true;
+				}
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+}
+
+void MeshImporter::load(const std::string & filename, MeshData & mesh)
+{
+	FileView source = readFile(filename, FILE_ACCESS_SEQUENTIAL);
+
+	// Everything the imported and optimized mesh depends on
+	DerivedDataKey key("MeshImporter", MESH_CACHE_VERSION);
+	key.addSource(source);
+	key.addSetting("vertexSize", (uint32_t)sizeof(MeshVertex));
+	key.addSetting("vertexCacheSize", (uint32_t)MESH_VERTEX_CACHE_SIZE);
+	key.addSetting("overdrawThreshold", (float)MESH_OVERDRAW_THRESHOLD);
+
+	DerivedDataCache & cache = DerivedDataCache::getInstance();
+
+	FileView cached;
+	if (cache.get(key, cached) && deserialize(cached.data(), cached.size(), mesh))
+	{
+		return;
+	}
+
+	importObj(filename, source, mesh);
+
+	// Only paid once per distinct source, the cache keeps the optimized order
+	MeshOptimizeReport report = MeshOptimizer::optimize(mesh);
+	std::cout << "Imported " << filename << ": " << report.toString() << std::endl;
+
+	cache.put(key, serialize(mesh));
+}
+
+void MeshImporter::importObj(const std::string & filename, MeshData & mesh)
+{
+	importObj(filename, readFile(filename, FILE_ACCESS_SEQUENTIAL), mesh);
+}
+
+void MeshImporter::importObj(const std::string & filename, const FileView & text, MeshData & mesh)
+{
+	try
+	{
+		parseObj(reinterpret_cast<const char *>(text.data()), text.size(), mesh);
+	}
+	catch (const std::runtime_error & error)
+	{
+		throw std::runtime_error(filename + ": " + error.what());
+	}
+}
+
+void MeshImporter::parseObj(const char * text, size_t size, MeshData & mesh)
+{
+	mesh.clear();
+
+	JobSystem & jobSystem = JobSystem::getInstance();
+
+	// Chunks end on a line break, so no line is ever split between two jobs
+	std::vector<ObjChunk> chunks;
+	const char * textEnd = text + size;
+
+	for (const char * p = text; p < textEnd;)
+	{
+		const char * chunkEnd = p + std::min<size_t>(MESH_IMPORT_CHUNK_SIZE, textEnd - p);
+		const char * lineEnd = chunkEnd < textEnd ? static_cast<const char *>(memchr(chunkEnd, '\n', textEnd - chunkEnd)) : nullptr;
+		chunkEnd = lineEnd ? lineEnd + 1 : textEnd;
+
+		ObjChunk chunk;
+		chunk.begin = p;
+		chunk.end = chunkEnd;
+		chunk.positionBase = chunk.uvBase = chunk.normalBase = chunk.cornerBase = 0;
+		chunk.bMalformed = false;
+		chunks.push_back(std::move(chunk));
+
+		p = chunkEnd;
+	}
+
+	jobSystem.parallelFor(0, chunks.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			parseChunk(chunks[i]);
+		}
+	});
+
+	size_t positionCount = 0;
+	size_t uvCount = 0;
+	size_t normalCount = 0;
+	size_t cornerCount = 0;
+
+	for (auto & chunk : chunks)
+	{
+		if (chunk.bMalformed)
+		{
+			throw std::runtime_error("Malformed face in OBJ file!");
+		}
+
+		chunk.positionBase = positionCount;
+		chunk.uvBase = uvCount;
+		chunk.normalBase = normalCount;
+		chunk.cornerBase = cornerCount;
+
+		positionCount += chunk.positions.size();
+		uvCount += chunk.uvs.size();
+		normalCount += chunk.normals.size();
+		cornerCount += chunk.corners.size();
+	}
+
+	if (positionCount >= (size_t)OBJ_RELATIVE_BIAS || uvCount >= (size_t)OBJ_RELATIVE_BIAS || normalCount >= (size_t)OBJ_RELATIVE_BIAS || cornerCount >= MESH_NO_CORNER)
+	{
+		throw std::runtime_error("OBJ file is too large!");
+	}
+
+	// Stitch the chunks' attributes together and turn every corner into absolute indices
+	std::vector<glm::vec3> positions(positionCount);
+	std::vector<glm::vec2> uvs(uvCount);
+	std::vector<glm::vec3> normals(normalCount);
+	std::vector<ResolvedCorner> corners(cornerCount);
+	std::atomic<bool> outOfRange(false);
+
+	jobSystem.parallelFor(0, chunks.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			ObjChunk & chunk = chunks[i];
+
+			std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase);
+			std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + chunk.uvBase);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase);
+
+			for (size_t c = 0; c < chunk.corners.size(); c++)
+			{
+				const ObjCorner & corner = chunk.corners[c];
+				ResolvedCorner & resolved = corners[chunk.cornerBase + c];
+
+				resolved.position = resolveIndex(corner.position, chunk.positionBase, positionCount);
+				resolved.uv = resolveIndex(corner.uv, chunk.uvBase, uvCount);
+				resolved.normal = resolveIndex(corner.normal, chunk.normalBase, normalCount);
+
+				if (resolved.position >= positionCount || resolved.uv == uvCount || resolved.normal == normalCount)
+				{
+					outOfRange.store(true, std::memory_order_relaxed);
+				}
+			}
+
+			// The text is no longer needed, and neither are the chunk's own copies
+			std::vector<glm::vec3>().swap(chunk.positions);
+			std::vector<glm::vec2>().swap(chunk.uvs);
+			std::vector<glm::vec3>().swap(chunk.normals);
+			std::vector<ObjCorner>().swap(chunk.corners);
+		}
+	});
+
+	if (outOfRange.load())
+	{
+		throw std::runtime_error("OBJ face refers to an element that doesn't exist!");
+	}
+
+	auto makeVertex = [&](const ResolvedCorner & corner)
+	{
+		MeshVertex vertex;
+		vertex.position = positions[corner.position];
+		vertex.normal = corner.normal != MESH_NO_ATTRIBUTE ? normals[corner.normal] : glm::vec3(0.0f);
+		vertex.uv = corner.uv != MESH_NO_ATTRIBUTE ? uvs[corner.uv] : glm::vec2(0.0f);
+		return vertex;
+	};
+
+	// Deduplication. Every corner is hashed by value, then bucketed by the top bits of its hash so
+	// each bucket can look for earlier identical corners in its own table without any locking.
+	size_t rangeCount = (cornerCount + MESH_DEDUP_GRAIN - 1) / MESH_DEDUP_GRAIN;
+	std::vector<uint32_t> hashes(cornerCount);
+	std::vector<uint32_t> histograms(rangeCount * MESH_DEDUP_PARTITIONS, 0);
+
+	jobSystem.parallelFor(0, rangeCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t range = begin; range < end; range++)
+		{
+			uint32_t * histogram = &histograms[range * MESH_DEDUP_PARTITIONS];
+			size_t last = std::min<size_t>((range + 1) * MESH_DEDUP_GRAIN, cornerCount);
+
+			for (size_t c = range * MESH_DEDUP_GRAIN; c < last; c++)
+			{
+				MeshVertex vertex = makeVertex(corners[c]);
+				uint64_t hash = Hash::hash64(&vertex, sizeof(vertex));
+
+				hashes[c] = (uint32_t)(hash ^ (hash >> 32));
+				histogram[hashes[c] >> 24]++;
+			}
+		}
+	});
+
+	// Prefix sum partition by partition, so each range scatters into its own slice and the corners
+	// of a partition stay in their original order
+	std::vector<uint32_t> partitionOffsets(MESH_DEDUP_PARTITIONS + 1, 0);
+	uint32_t total = 0;
+	for (size_t partition = 0; partition < MESH_DEDUP_PARTITIONS; partition++)
+	{
+		partitionOffsets[partition] = total;
+		for (size_t range = 0; range < rangeCount; range++)
+		{
+			uint32_t count = histograms[range * MESH_DEDUP_PARTITIONS + partition];
+			histograms[range * MESH_DEDUP_PARTITIONS + partition] = total;
+			total += count;
+		}
+	}
+	partitionOffsets[MESH_DEDUP_PARTITIONS] = total;
+
+	std::vector<uint32_t> order(cornerCount);
+	jobSystem.parallelFor(0, rangeCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t range = begin; range < end; range++)
+		{
+			uint32_t * cursors = &histograms[range * MESH_DEDUP_PARTITIONS];
+			size_t last = std::min<size_t>((range + 1) * MESH_DEDUP_GRAIN, cornerCount);
+
+			for (size_t c = range * MESH_DEDUP_GRAIN; c < last; c++)
+			{
+				order[cursors[hashes[c] >> 24]++] = (uint32_t)c;
+			}
+		}
+	});
+
+	// first[c] is the earliest corner with the same vertex as c
+	std::vector<uint32_t> first(cornerCount);
+	jobSystem.parallelFor(0, MESH_DEDUP_PARTITIONS, 1, [&](size_t begin, size_t end)
+	{
+		std::vector<uint32_t> table;
+
+		for (size_t partition = begin; partition < end; partition++)
+		{
+			uint32_t partitionBegin = partitionOffsets[partition];
+			uint32_t partitionEnd = partitionOffsets[partition + 1];
+
+			size_t tableSize = 16;
+			while (tableSize < (size_t)(partitionEnd - partitionBegin) * 2)
+			{
+				tableSize *= 2;
+			}
+			table.assign(tableSize, MESH_NO_CORNER);
+			uint32_t mask = (uint32_t)tableSize - 1;
+
+			for (uint32_t i = partitionBegin; i < partitionEnd; i++)
+			{
+				uint32_t corner = order[i];
+				uint32_t hash = hashes[corner];
+				const ResolvedCorner & resolved = corners[corner];
+
+				for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask)
+				{
+					uint32_t existing = table[slot];
+					if (existing == MESH_NO_CORNER)
+					{
+						table[slot] = corner;
+						first[corner] = corner;
+						break;
+					}
+
+					if (hashes[existing] != hash)
+					{
+						continue;
+					}
+
+					// Same indices is by far the common case and needs no look at the attributes themselves
+					const ResolvedCorner & other = corners[existing];
+					bool same = resolved.position == other.position && resolved.uv == other.uv && resolved.normal == other.normal;
+
+					if (!same)
+					{
+						MeshVertex vertex = makeVertex(resolved);
+						MeshVertex otherVertex = makeVertex(other);
+						same = memcmp(&vertex, &otherVertex, sizeof(MeshVertex)) == 0;
+					}
+
+					if (same)
+					{
+						first[corner] = existing;
+						break;
+					}
+				}
+			}
+		}
+	});
+
+	// Vertices are numbered in order of first use, which keeps them roughly in the order the faces reference them
+	std::vector<uint32_t> indices(cornerCount);
+	uint32_t vertexCount = 0;
+
+	for (size_t c = 0; c < cornerCount; c++)
+	{
+		indices[c] = first[c] == c ? vertexCount++ : indices[first[c]];
+	}
+
+	mesh.vertices.resize(vertexCount);
+	jobSystem.parallelFor(0, cornerCount, MESH_DEDUP_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; c++)
+		{
+			if (first[c] == c)
+			{
+				mesh.vertices[indices[c]] = makeVertex(corners[c]);
+			}
+		}
+	});
+
+	mesh.setIndices(indices);
+	mesh.computeBounds();
+}
+
+std::vector<uint8_t> MeshImporter::serialize(const MeshData & mesh)
+{
+	MeshCacheHeader header;
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(MeshVertex);
+	header.indexType = mesh.indexType;
+	header.vertexCount = mesh.vertices.size();
+	header.indexCount = mesh.indexCount;
+	header.boundsMin = mesh.boundsMin;
+	header.boundsMax = mesh.boundsMax;
+
+	size_t vertexBytes = mesh.vertices.size() * sizeof(MeshVertex);
+
+	std::vector<uint8_t> data(sizeof(header) + vertexBytes + mesh.indexData.size());
+	memcpy(data.data(), &header, sizeof(header));
+	memcpy(data.data() + sizeof(header), mesh.vertices.data(), vertexBytes);
+	memcpy(data.data() + sizeof(header) + vertexBytes, mesh.indexData.data(), mesh.indexData.size());
+
+	return data;
+}
+
+bool MeshImporter::deserialize(const uint8_t * data, size_t size, MeshData & mesh)
+{
+	MeshCacheHeader header;
+	if (size < sizeof(header))
+	{
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 || header.version != MESH_CACHE_VERSION ||
+		header.vertexSize != sizeof(MeshVertex) || (header.indexType != MESH_INDEX_16 && header.indexType != MESH_INDEX_32))
+	{
+		return false;
+	}
+
+	size_t indexSize = header.indexType == MESH_INDEX_16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	if (header.vertexCount > (size - sizeof(header)) / sizeof(MeshVertex) ||
+		header.indexCount != (size - sizeof(header) - header.vertexCount * sizeof(MeshVertex)) / indexSize ||
+		sizeof(header) + header.vertexCount * sizeof(MeshVertex) + header.indexCount * indexSize != size)
+	{
+		return false;
+	}
+
+	mesh.clear();
+	mesh.indexType = (MESH_INDEX_TYPE)header.indexType;
+	mesh.indexCount = (size_t)header.indexCount;
+	mesh.boundsMin = header.boundsMin;
+	mesh.boundsMax = header.boundsMax;
+
+	const uint8_t * vertices = data + sizeof(header);
+	mesh.vertices.resize((size_t)header.vertexCount);
+	memcpy(mesh.vertices.data(), vertices, mesh.vertices.size() * sizeof(MeshVertex));
+
+	const uint8_t * indices = vertices + mesh.vertices.size() * sizeof(MeshVertex);
+	mesh.indexData.assign(indices, indices + mesh.indexCount * indexSize);
+
+	return true;
+}
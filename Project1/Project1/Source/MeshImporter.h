@@ -0,0 +1,39 @@
+#ifndef __MESH_IMPORTER_H__
+#define __MESH_IMPORTER_H__
+
+#include "Mesh.h"
+#include "FileReader.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define MESH_IMPORT_CHUNK_SIZE (1 << 20) // Bytes of OBJ text per parse job, each chunk is cut at the next line break
+#define MESH_DEDUP_PARTITIONS 256 // Corners are bucketed by hash, every bucket is deduplicated by its own job
+#define MESH_DEDUP_GRAIN 65536 // Corners per hashing / bucketing job
+#define MESH_CACHE_VERSION 3 // 2: meshes go through MeshOptimizer before they are cached, 3: cached in the DerivedDataCache
+
+// Wavefront OBJ importer. The text is cut into chunks at line boundaries and parsed on the job
+// system, then identical position / normal / uv combinations are merged into one vertex. Faces
+// are fan triangulated; materials, groups and smoothing groups are ignored.
+// Imported meshes are kept in the DerivedDataCache, keyed by the OBJ's contents.
+class MeshImporter
+{
+public:
+	// Takes the mesh from the derived data cache when the same source has been imported with the
+	// same version and settings before, by any process sharing the cache. Otherwise imports and
+	// optimizes the OBJ and publishes the result.
+	static void load(const std::string & filename, MeshData & mesh);
+
+	static void importObj(const std::string & filename, MeshData & mesh);
+	static void importObj(const std::string & filename, const FileView & text, MeshData & mesh); // filename only for errors
+	static void parseObj(const char * text, size_t size, MeshData & mesh);
+
+	// The cached form, a header then the vertex and index arrays as they are in memory
+	static std::vector<uint8_t> serialize(const MeshData & mesh);
+
+	// False when data isn't a mesh from this version
+	static bool deserialize(const uint8_t * data, size_t size, MeshData & mesh);
+};
+
+#endif
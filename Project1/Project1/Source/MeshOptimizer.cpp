@@ -0,0 +1,506 @@
+#include "MeshOptimizer.h"
+
+#include <geometric.hpp>
+#include <common.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+
+namespace
+{
+	// FIFO cache by timestamps: a vertex is cached while fewer than cacheSize misses happened since its own
+	class FifoCache
+	{
+	public:
+		FifoCache(size_t vertexCount, unsigned cacheSize) : m_times(vertexCount, 0), m_uiTime(cacheSize + 1), m_uiCacheSize(cacheSize) {}
+
+		// True on a miss
+		bool access(uint32_t vertex)
+		{
+			if (m_uiTime - m_times[vertex] > m_uiCacheSize)
+			{
+				m_times[vertex] = m_uiTime++;
+				return true;
+			}
+			return false;
+		}
+
+		// Forget everything, as if the cache had been flushed
+		void flush() { m_uiTime += m_uiCacheSize + 1; }
+
+	private:
+		std::vector<uint64_t> m_times;
+		uint64_t m_uiTime;
+		unsigned m_uiCacheSize;
+	};
+
+	// Triangles using each vertex, triangles of vertex v are [offsets[v], offsets[v + 1])
+	void buildAdjacency(const uint32_t * indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t> & offsets, std::vector<uint32_t> & triangles)
+	{
+		offsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			offsets[indices[i] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			offsets[v + 1] += offsets[v];
+		}
+
+		std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+		triangles.resize(indexCount);
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			triangles[cursors[indices[i]]++] = (uint32_t)(i / 3);
+		}
+	}
+
+	struct Cluster
+	{
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float sortKey;
+	};
+}
+
+std::string MeshOptimizeReport::toString() const
+{
+	char text[256];
+	snprintf(text, sizeof(text), "ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f, overfetch %.3f -> %.3f",
+		before.acmr, after.acmr, before.atvr, after.atvr, overdrawBefore, overdrawAfter, overfetchBefore, overfetchAfter);
+	return text;
+}
+
+MeshOptimizeReport MeshOptimizer::optimize(MeshData & mesh)
+{
+	MeshOptimizeReport report;
+
+	std::vector<uint32_t> indices = mesh.getIndices();
+	size_t vertexCount = mesh.vertices.size();
+
+	report.before = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+	report.overdrawBefore = analyzeOverdraw(indices.data(), indices.size(), mesh.vertices.data(), vertexCount);
+	report.overfetchBefore = analyzeVertexFetch(indices.data(), indices.size(), vertexCount, sizeof(MeshVertex));
+
+	optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+	optimizeOverdraw(indices.data(), indices.size(), mesh.vertices.data(), vertexCount);
+	mesh.setIndices(indices);
+
+	optimizeVertexFetch(mesh);
+
+	indices = mesh.getIndices();
+	vertexCount = mesh.vertices.size();
+
+	report.after = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+	report.overdrawAfter = analyzeOverdraw(indices.data(), indices.size(), mesh.vertices.data(), vertexCount);
+	report.overfetchAfter = analyzeVertexFetch(indices.data(), indices.size(), vertexCount, sizeof(MeshVertex));
+
+	return report;
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t * indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> adjacency;
+	buildAdjacency(indices, indexCount, vertexCount, offsets, adjacency);
+
+	// Triangles still to be emitted per vertex
+	std::vector<uint32_t> liveCounts(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		liveCounts[v] = offsets[v + 1] - offsets[v];
+	}
+
+	std::vector<uint64_t> cacheTimes(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnds; // Recently used vertices to fall back to when the fan runs out
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+
+	uint64_t time = cacheSize + 1;
+	size_t scanCursor = 0;
+	int64_t fanning = 0;
+
+	while (fanning >= 0)
+	{
+		uint32_t vertex = (uint32_t)fanning;
+		candidates.clear();
+
+		// Emit every remaining triangle around the fanning vertex
+		for (uint32_t a = offsets[vertex]; a < offsets[vertex + 1]; a++)
+		{
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+
+			for (int corner = 0; corner < 3; corner++)
+			{
+				uint32_t v = indices[triangle * 3 + corner];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveCounts[v]--;
+
+				if (time - cacheTimes[v] > cacheSize)
+				{
+					cacheTimes[v] = time++;
+				}
+			}
+
+			emitted[triangle] = 1;
+		}
+
+		// Next fanning vertex: the one that will still be in the cache after its own triangles
+		// went through, and has been in there the longest
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+
+		for (uint32_t v : candidates)
+		{
+			if (liveCounts[v] == 0)
+			{
+				continue;
+			}
+
+			int64_t priority = 0;
+			if ((int64_t)(time - cacheTimes[v]) + 2 * (int64_t)liveCounts[v] <= (int64_t)cacheSize)
+			{
+				priority = (int64_t)(time - cacheTimes[v]);
+			}
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		if (best < 0)
+		{
+			// Dead end, back to the most recently used vertex that still has triangles, then to a scan
+			while (!deadEnds.empty() && best < 0)
+			{
+				uint32_t v = deadEnds.back();
+				deadEnds.pop_back();
+
+				if (liveCounts[v] > 0)
+				{
+					best = v;
+				}
+			}
+
+			while (best < 0 && scanCursor < vertexCount)
+			{
+				if (liveCounts[scanCursor] > 0)
+				{
+					best = (int64_t)scanCursor;
+				}
+				else
+				{
+					scanCursor++;
+				}
+			}
+		}
+
+		fanning = best;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::optimizeOverdraw(uint32_t * indices, size_t indexCount, const MeshVertex * vertices, size_t vertexCount, float threshold, unsigned cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Hard boundaries: wherever the cache optimized order already starts from nothing (all three corners miss)
+	std::vector<uint32_t> hardBoundaries;
+	{
+		FifoCache cache(vertexCount, cacheSize);
+
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			int misses = cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+			if (misses == 3 || t == 0)
+			{
+				hardBoundaries.push_back((uint32_t)t);
+			}
+		}
+		hardBoundaries.push_back((uint32_t)triangleCount);
+	}
+
+	// Soft boundaries: inside each hard cluster, cut wherever the piece so far is about as cache
+	// friendly as the whole cluster, so restarting there costs at most threshold in ACMR
+	std::vector<Cluster> clusters;
+	{
+		FifoCache cache(vertexCount, cacheSize);
+
+		for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+		{
+			uint32_t begin = hardBoundaries[h];
+			uint32_t end = hardBoundaries[h + 1];
+
+			cache.flush();
+			uint32_t clusterMisses = 0;
+			for (uint32_t t = begin; t < end; t++)
+			{
+				clusterMisses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+			}
+			float clusterThreshold = threshold * (float)clusterMisses / (float)(end - begin);
+
+			cache.flush();
+			uint32_t start = begin;
+			uint32_t misses = 0;
+			for (uint32_t t = begin; t < end; t++)
+			{
+				misses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+
+				if ((float)misses / (float)(t - start + 1) <= clusterThreshold || t + 1 == end)
+				{
+					clusters.push_back({ start, t + 1 - start, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f });
+					start = t + 1;
+					misses = 0;
+					cache.flush();
+				}
+			}
+		}
+	}
+
+	// Sort key: how far the cluster's centroid lies out along its own average normal, relative to
+	// the centre of the mesh. Clusters facing out on the outside go first and hide what is behind them.
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (auto & cluster : clusters)
+	{
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+
+		for (uint32_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; t++)
+		{
+			const glm::vec3 & a = vertices[indices[t * 3]].position;
+			const glm::vec3 & b = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3 & c = vertices[indices[t * 3 + 2]].position;
+
+			glm::vec3 cross = glm::cross(b - a, c - a);
+			float triangleArea = glm::length(cross);
+
+			centroid += (a + b + c) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+
+		float normalLength = glm::length(normal);
+		cluster.centroid = area > 0.0f ? centroid / area : vertices[indices[cluster.firstTriangle * 3]].position;
+		cluster.normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f);
+	}
+
+	meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+	for (auto & cluster : clusters)
+	{
+		cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal);
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster & a, const Cluster & b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(triangleCount * 3);
+	for (const auto & cluster : clusters)
+	{
+		sorted.insert(sorted.end(), indices + cluster.firstTriangle * 3, indices + (cluster.firstTriangle + cluster.triangleCount) * 3);
+	}
+
+	std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshData & mesh)
+{
+	std::vector<uint32_t> indices = mesh.getIndices();
+	std::vector<uint32_t> remap(mesh.vertices.size(), 0xFFFFFFFFu);
+	std::vector<MeshVertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+
+	for (auto & index : indices)
+	{
+		if (remap[index] == 0xFFFFFFFFu)
+		{
+			remap[index] = (uint32_t)vertices.size();
+			vertices.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	mesh.vertices.swap(vertices);
+	mesh.setIndices(indices);
+}
+
+MeshCacheStats MeshOptimizer::analyzeVertexCache(const uint32_t * indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+	MeshCacheStats stats;
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<uint8_t> used(vertexCount, 0);
+	size_t usedCount = 0;
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		stats.transformedVertices += cache.access(indices[i]);
+
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = 1;
+			usedCount++;
+		}
+	}
+
+	stats.acmr = indexCount >= 3 ? (float)stats.transformedVertices / (float)(indexCount / 3) : 0.0f;
+	stats.atvr = usedCount > 0 ? (float)stats.transformedVertices / (float)usedCount : 0.0f;
+
+	return stats;
+}
+
+float MeshOptimizer::analyzeOverdraw(const uint32_t * indices, size_t indexCount, const MeshVertex * vertices, size_t vertexCount)
+{
+	if (indexCount < 3 || vertexCount == 0)
+	{
+		return 0.0f;
+	}
+
+	glm::vec3 boundsMin = vertices[0].position;
+	glm::vec3 boundsMax = vertices[0].position;
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		boundsMin = glm::min(boundsMin, vertices[v].position);
+		boundsMax = glm::max(boundsMax, vertices[v].position);
+	}
+
+	glm::vec3 extent = boundsMax - boundsMin;
+	float scale = (float)MESH_OVERDRAW_RESOLUTION / std::max<float>(std::max<float>(extent.x, extent.y), std::max<float>(extent.z, FLT_MIN));
+
+	const int resolution = MESH_OVERDRAW_RESOLUTION;
+	std::vector<float> depthBuffer(resolution * resolution);
+	uint64_t shaded = 0;
+	uint64_t covered = 0;
+
+	// Orthographic views down both directions of every axis, early depth test, back faces culled
+	// (counter clockwise is front facing)
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int uAxis = (axis + 1) % 3;
+		int vAxis = (axis + 2) % 3;
+
+		for (int side = 0; side < 2; side++)
+		{
+			float facing = side == 0 ? 1.0f : -1.0f;
+			std::fill(depthBuffer.begin(), depthBuffer.end(), FLT_MAX);
+
+			for (size_t i = 0; i + 2 < indexCount; i += 3)
+			{
+				float x[3], y[3], z[3];
+				for (int corner = 0; corner < 3; corner++)
+				{
+					glm::vec3 p = (vertices[indices[i + corner]].position - boundsMin) * scale;
+					x[corner] = p[uAxis];
+					y[corner] = p[vAxis];
+					z[corner] = -facing * p[axis]; // Nearer the viewer is smaller
+				}
+
+				float area = ((x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0])) * facing;
+				if (area <= 0.0f)
+				{
+					continue;
+				}
+
+				int minX = std::max<int>((int)std::min<float>(x[0], std::min<float>(x[1], x[2])), 0);
+				int maxX = std::min<int>((int)std::max<float>(x[0], std::max<float>(x[1], x[2])), resolution - 1);
+				int minY = std::max<int>((int)std::min<float>(y[0], std::min<float>(y[1], y[2])), 0);
+				int maxY = std::min<int>((int)std::max<float>(y[0], std::max<float>(y[1], y[2])), resolution - 1);
+
+				for (int py = minY; py <= maxY; py++)
+				{
+					for (int px = minX; px <= maxX; px++)
+					{
+						float cx = px + 0.5f;
+						float cy = py + 0.5f;
+
+						// Barycentric weights, all positive inside for a front facing triangle
+						float w0 = ((x[2] - x[1]) * (cy - y[1]) - (y[2] - y[1]) * (cx - x[1])) * facing;
+						float w1 = ((x[0] - x[2]) * (cy - y[2]) - (y[0] - y[2]) * (cx - x[2])) * facing;
+						float w2 = ((x[1] - x[0]) * (cy - y[0]) - (y[1] - y[0]) * (cx - x[0])) * facing;
+
+						if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						{
+							continue;
+						}
+
+						float depth = (w0 * z[0] + w1 * z[1] + w2 * z[2]) / area;
+						float & stored = depthBuffer[py * resolution + px];
+
+						if (depth < stored)
+						{
+							stored = depth;
+							shaded++;
+						}
+					}
+				}
+			}
+
+			for (float depth : depthBuffer)
+			{
+				covered += depth != FLT_MAX ? 1 : 0;
+			}
+		}
+	}
+
+	return covered > 0 ? (float)shaded / (float)covered : 0.0f;
+}
+
+float MeshOptimizer::analyzeVertexFetch(const uint32_t * indices, size_t indexCount, size_t vertexCount, size_t vertexSize)
+{
+	if (vertexCount == 0)
+	{
+		return 0.0f;
+	}
+
+	// Direct mapped cache of 64 byte lines, every miss fetches a whole line
+	std::vector<uint64_t> lines(MESH_FETCH_CACHE_LINES, ~0ull);
+	uint64_t fetched = 0;
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint64_t first = (uint64_t)indices[i] * vertexSize / 64;
+		uint64_t last = ((uint64_t)indices[i] * vertexSize + vertexSize - 1) / 64;
+
+		for (uint64_t line = first; line <= last; line++)
+		{
+			uint64_t & slot = lines[line % MESH_FETCH_CACHE_LINES];
+			if (slot != line)
+			{
+				slot = line;
+				fetched += 64;
+			}
+		}
+	}
+
+	return (float)fetched / (float)(vertexCount * vertexSize);
+}
@@ -0,0 +1,60 @@
+#ifndef __MESH_OPTIMIZER_H__
+#define __MESH_OPTIMIZER_H__
+
+#include "Mesh.h"
+
+#include <string>
+#include <stdint.h>
+
+#define MESH_VERTEX_CACHE_SIZE 16 // FIFO post-transform cache entries, both for the reordering and the analysis
+#define MESH_OVERDRAW_THRESHOLD 1.05f // How much worse than the cache optimized order a cluster's ACMR may get so overdraw can be reduced
+#define MESH_OVERDRAW_RESOLUTION 256 // Grid the overdraw analysis rasterizes into, per view
+#define MESH_FETCH_CACHE_LINES 256 // 64 byte lines in the simulated vertex fetch cache (16 KB, direct mapped)
+
+struct MeshCacheStats
+{
+	float acmr = 0.0f; // Average cache miss ratio, vertices transformed per triangle (0.5 ideal, 3 worst)
+	float atvr = 0.0f; // Average transformed vertex ratio, vertices transformed per vertex (1 ideal)
+	uint64_t transformedVertices = 0;
+};
+
+struct MeshOptimizeReport
+{
+	MeshCacheStats before;
+	MeshCacheStats after;
+	float overdrawBefore = 0.0f; // Fragments shaded per covered pixel, averaged over six axis views
+	float overdrawAfter = 0.0f;
+	float overfetchBefore = 0.0f; // Bytes fetched from memory per byte of vertex data
+	float overfetchAfter = 0.0f;
+
+	std::string toString() const;
+};
+
+// Offline / import time reordering for GPU vertex throughput, following Sander et al.'s
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw":
+//  1. Tipsify reorders triangles for the post-transform vertex cache
+//  2. the result is cut into clusters that restart the cache cheaply, and the clusters are sorted
+//     so outward facing ones on the outside of the mesh draw first
+//  3. vertices are renumbered in order of first use so fetches walk the vertex buffer linearly
+// None of it changes what is drawn, only the order.
+class MeshOptimizer
+{
+public:
+	// All three steps, returns the analysis from before and after
+	static MeshOptimizeReport optimize(MeshData & mesh);
+
+	static void optimizeVertexCache(uint32_t * indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = MESH_VERTEX_CACHE_SIZE);
+
+	// Expects the indices already optimized for the vertex cache
+	static void optimizeOverdraw(uint32_t * indices, size_t indexCount, const MeshVertex * vertices, size_t vertexCount,
+		float threshold = MESH_OVERDRAW_THRESHOLD, unsigned cacheSize = MESH_VERTEX_CACHE_SIZE);
+
+	// Reorders the vertices and rewrites the indices to match, vertices nothing refers to are dropped
+	static void optimizeVertexFetch(MeshData & mesh);
+
+	static MeshCacheStats analyzeVertexCache(const uint32_t * indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = MESH_VERTEX_CACHE_SIZE);
+	static float analyzeOverdraw(const uint32_t * indices, size_t indexCount, const MeshVertex * vertices, size_t vertexCount);
+	static float analyzeVertexFetch(const uint32_t * indices, size_t indexCount, size_t vertexCount, size_t vertexSize);
+};
+
+#endif
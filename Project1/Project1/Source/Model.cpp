@@ -1,6 +1,13 @@
 #include "Model.h"
+#include "FramePacket.h"
+
+#include <geometric.hpp>
+#include <common.hpp>
+#include <trigonometric.hpp>
+#include <gtc/matrix_transform.hpp>
 
 MVCModel::MVCModel()
+: m_cameraMovement(0.0f)
 {
 	std::cout << "Model Created" << std::endl;
 }
@@ -8,4 +15,203 @@ MVCModel::MVCModel()
 MVCModel::~MVCModel()
 {
 
-}
\ No newline at end of file
+}
+
+void MVCModel::Update(double dt)
+{
+	this->m_previousState = this->m_currentState;
+
+	SimulationState & state = this->m_currentState;
+
+	state.cameraYaw += m_fDeltaYaw * (float)dt;
+	state.cameraPitch = glm::clamp(state.cameraPitch + m_fDeltaPitch * (float)dt, -1.5f, 1.5f);
+
+	if (glm::dot(m_cameraMovement, m_cameraMovement) > 0.0f)
+	{
+		state.cameraPosition += glm::normalize(m_cameraMovement) * m_fCameraSpeed * (float)dt;
+	}
+
+	// Anything the step moved gets its world matrix refreshed before it is handed to the renderer
+	this->m_transforms.update();
+}
+
+void MVCModel::loadScene(const std::string & filename, bool verifyChecksums)
+{
+	// Opened on the side, the current scene stays as it is if anything below throws
+	SceneFile scene;
+	scene.open(filename, verifyChecksums);
+
+	size_t nodeCount, rotationCount, scaleCount, parentCount, levelOffsetCount;
+	const glm::vec3 * positions = scene.getSection<glm::vec3>(SCENE_SECTION_TRANSFORM_POSITIONS, nodeCount);
+	const glm::quat * rotations = scene.getSection<glm::quat>(SCENE_SECTION_TRANSFORM_ROTATIONS, rotationCount);
+	const glm::vec3 * scales = scene.getSection<glm::vec3>(SCENE_SECTION_TRANSFORM_SCALES, scaleCount);
+	const uint32_t * parents = scene.getSection<uint32_t>(SCENE_SECTION_TRANSFORM_PARENTS, parentCount);
+	const uint32_t * levelOffsets = scene.getSection<uint32_t>(SCENE_SECTION_TRANSFORM_LEVELS, levelOffsetCount);
+
+	size_t entityCount, entityMeshCount, entityMaterialCount;
+	const uint32_t * entityTransforms = scene.getSection<uint32_t>(SCENE_SECTION_ENTITY_TRANSFORMS, entityCount);
+	const uint32_t * entityMeshes = scene.getSection<uint32_t>(SCENE_SECTION_ENTITY_MESHES, entityMeshCount);
+	const uint32_t * entityMaterials = scene.getSection<uint32_t>(SCENE_SECTION_ENTITY_MATERIALS, entityMaterialCount);
+
+	if (rotationCount != nodeCount || scaleCount != nodeCount || parentCount != nodeCount || entityMeshCount != entityCount || entityMaterialCount != entityCount)
+	{
+		throw std::runtime_error(filename + " has sections of mismatched lengths!");
+	}
+
+	// Mesh and material ids are only looked up when drawn, but a bad transform index would become a bad handle
+	for (size_t i = 0; i < entityCount; i++)
+	{
+		if (entityTransforms[i] != SCENE_NO_INDEX && entityTransforms[i] >= nodeCount)
+		{
+			throw std::runtime_error(filename + " has an entity referring to a transform that doesn't exist!");
+		}
+	}
+
+	// Nothing gets replaced until the whole file has checked out, load() validates before it touches anything
+	this->m_transforms.load(nodeCount, positions, rotations, scales, parents, levelOffsets, levelOffsetCount);
+	this->m_scene.swap(scene);
+
+	std::vector<Entity> previous;
+	this->m_world.forEachChunk<SceneObject>([&](size_t count, const Entity * entities, SceneObject *)
+	{
+		previous.insert(previous.end(), entities, entities + count);
+	});
+
+	for (const Entity & entity : previous)
+	{
+		this->m_world.destroyEntity(entity);
+	}
+
+	// Transform handles come out of load() equal to their index
+	this->m_world.reserve<SceneObject>(entityCount);
+	for (size_t i = 0; i < entityCount; i++)
+	{
+		SceneObject object;
+		object.transform = entityTransforms[i] != SCENE_NO_INDEX ? entityTransforms[i] : INVALID_TRANSFORM;
+		object.meshId = entityMeshes[i];
+		object.materialId = entityMaterials[i];
+
+		this->m_world.createEntity(object);
+	}
+}
+
+void MVCModel::saveScene(const std::string & filename)
+{
+	// The file stores the transforms in update order, so bring that up to date first
+	this->m_transforms.update();
+
+	size_t nodeCount = m_transforms.getNodeCount();
+	size_t levelOffsetCount = nodeCount > 0 ? m_transforms.getLevelCount() + 1 : 0;
+
+	std::vector<uint32_t> entityTransforms;
+	std::vector<uint32_t> entityMeshes;
+	std::vector<uint32_t> entityMaterials;
+
+	this->m_world.forEachChunk<SceneObject>([&](size_t count, const Entity *, SceneObject * objects)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			entityTransforms.push_back(m_transforms.isValid(objects[i].transform) ? m_transforms.getIndex(objects[i].transform) : SCENE_NO_INDEX);
+			entityMeshes.push_back(objects[i].meshId);
+			entityMaterials.push_back(objects[i].materialId);
+		}
+	});
+
+	SceneWriter writer;
+	writer.addSection(SCENE_SECTION_TRANSFORM_POSITIONS, m_transforms.getLocalPositions(), nodeCount);
+	writer.addSection(SCENE_SECTION_TRANSFORM_ROTATIONS, m_transforms.getLocalRotations(), nodeCount);
+	writer.addSection(SCENE_SECTION_TRANSFORM_SCALES, m_transforms.getLocalScales(), nodeCount);
+	writer.addSection(SCENE_SECTION_TRANSFORM_PARENTS, m_transforms.getParentIndices(), nodeCount);
+	writer.addSection(SCENE_SECTION_TRANSFORM_LEVELS, m_transforms.getLevelOffsets(), levelOffsetCount);
+	writer.addSection(SCENE_SECTION_ENTITY_TRANSFORMS, entityTransforms);
+	writer.addSection(SCENE_SECTION_ENTITY_MESHES, entityMeshes);
+	writer.addSection(SCENE_SECTION_ENTITY_MATERIALS, entityMaterials);
+
+	// Meshes and materials only ever come from a loaded scene so far, they go across untouched.
+	// They are copied out, the mapping has to be closed before the write can replace the file.
+	std::vector<SceneMesh> meshes;
+	std::vector<SceneMaterial> materials;
+	std::vector<char> strings;
+
+	std::string sceneFilename = m_scene.getFilename();
+	if (m_scene.isOpen())
+	{
+		size_t meshCount, materialCount, stringsSize;
+		const SceneMesh * sceneMeshes = m_scene.getSection<SceneMesh>(SCENE_SECTION_MESHES, meshCount);
+		const SceneMaterial * sceneMaterials = m_scene.getSection<SceneMaterial>(SCENE_SECTION_MATERIALS, materialCount);
+		const char * sceneStrings = m_scene.getSection<char>(SCENE_SECTION_STRINGS, stringsSize);
+
+		meshes.assign(sceneMeshes, sceneMeshes + meshCount);
+		materials.assign(sceneMaterials, sceneMaterials + materialCount);
+		strings.assign(sceneStrings, sceneStrings + stringsSize);
+
+		writer.addSection(SCENE_SECTION_MESHES, meshes);
+		writer.addSection(SCENE_SECTION_MATERIALS, materials);
+		writer.addSection(SCENE_SECTION_STRINGS, strings);
+
+		// Windows won't rename over a mapped file, and filename may well be the scene that is open
+		m_scene.close();
+	}
+
+	try
+	{
+		writer.write(filename);
+	}
+	catch (...)
+	{
+		// The rename never happened, so the scene file is still the one that was open
+		if (!sceneFilename.empty())
+		{
+			m_scene.open(sceneFilename);
+		}
+		throw;
+	}
+
+	// The same meshes, materials and strings either way, from the new file when it was saved over
+	if (!sceneFilename.empty())
+	{
+		m_scene.open(sceneFilename);
+	}
+}
+
+MVCModel::SimulationState MVCModel::getInterpolatedState(double alpha) const
+{
+	float t = (float)alpha;
+
+	SimulationState state;
+	state.cameraPosition = glm::mix(m_previousState.cameraPosition, m_currentState.cameraPosition, t);
+	state.cameraYaw = glm::mix(m_previousState.cameraYaw, m_currentState.cameraYaw, t);
+	state.cameraPitch = glm::mix(m_previousState.cameraPitch, m_currentState.cameraPitch, t);
+
+	return state;
+}
+
+bool MVCModel::isStatic() const
+{
+	return m_previousState.cameraPosition == m_currentState.cameraPosition &&
+		m_previousState.cameraYaw == m_currentState.cameraYaw &&
+		m_previousState.cameraPitch == m_currentState.cameraPitch;
+}
+
+void MVCModel::fillFramePacket(FramePacket & packet, double alpha, float aspectRatio) const
+{
+	packet.camera = this->getInterpolatedState(alpha);
+
+	const SimulationState & camera = packet.camera;
+	glm::vec3 forward(sin(camera.cameraYaw) * cos(camera.cameraPitch), sin(camera.cameraPitch), -cos(camera.cameraYaw) * cos(camera.cameraPitch));
+
+	packet.view = glm::lookAt(camera.cameraPosition, camera.cameraPosition + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+	packet.projection = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
+	packet.projection[1][1] *= -1.0f; // Vulkan's clip space Y points down
+
+	// The hard-coded triangle in shader.vert is the only thing in the scene so far
+	FramePacket::ObjectConstants constants;
+	constants.model = glm::mat4(1.0f);
+	packet.objectConstants.push_back(constants);
+
+	FramePacket::DrawItem drawItem;
+	drawItem.meshId = 0;
+	drawItem.vertexCount = 3;
+	drawItem.objectIndex = 0;
+	packet.drawList.push_back(drawItem);
+}
@@ -3,12 +3,74 @@
 
 #include <iostream>
 
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec3.hpp>
+
+#include "ECS.h"
+#include "Transform.h"
+#include "SceneFile.h"
+
+#include <string>
+
+struct FramePacket;
+
 class MVCModel
 {
+public:
+	// Everything the renderer needs from one simulation step, kept small so it can be copied and blended
+	struct SimulationState
+	{
+		glm::vec3 cameraPosition = glm::vec3(0.0f, 0.0f, 2.0f);
+		float cameraYaw = 0.0f;
+		float cameraPitch = 0.0f;
+	};
+
 public:
 	MVCModel();
 	virtual ~MVCModel();
+
+	// Advance the simulation by one fixed step
+	void Update(double dt);
+
+	// Blend between the previous and current step, alpha in [0, 1]
+	SimulationState getInterpolatedState(double alpha) const;
+	const SimulationState & getCurrentState() const { return m_currentState; }
+
+	// Last step left everything where it was
+	bool isStatic() const;
+
+	// Snapshot the interpolated scene into a packet for the render thread
+	void fillFramePacket(FramePacket & packet, double alpha, float aspectRatio) const;
+
+	// Camera input for the next step
+	void setCameraMovement(const glm::vec3 & direction) { m_cameraMovement = direction; }
+	void setCameraRotation(float deltaYaw, float deltaPitch) { m_fDeltaYaw = deltaYaw; m_fDeltaPitch = deltaPitch; }
+
+	// Scene data, only the simulation thread may touch it
+	EntityWorld & getWorld() { return m_world; }
+	TransformHierarchy & getTransforms() { return m_transforms; }
+
+	// Replaces the transforms and SceneObject entities with the file's, or leaves everything as it
+	// was when the file doesn't check out. The file stays mapped, meshes, materials and strings are
+	// read from getScene() in place. saveScene() remaps it, so don't hold pointers into it across one.
+	void loadScene(const std::string & filename, bool verifyChecksums = false);
+	void saveScene(const std::string & filename);
+	const SceneFile & getScene() const { return m_scene; }
+
 private:
+	SimulationState m_previousState;
+	SimulationState m_currentState;
+
+	glm::vec3 m_cameraMovement;
+	float m_fDeltaYaw = 0.0f;
+	float m_fDeltaPitch = 0.0f;
+	float m_fCameraSpeed = 2.0f;
+
+	EntityWorld m_world;
+	TransformHierarchy m_transforms;
+	SceneFile m_scene;
 };
 
-#endif
\ No newline at end of file
+#endif
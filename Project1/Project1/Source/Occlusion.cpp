@@ -0,0 +1,575 @@
+#include "Occlusion.h"
+#include "JobSystem.h"
+
+#include <common.hpp>
+#include <simd/platform.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+#define OCCLUSION_LANES 8
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+#define OCCLUSION_LANES 4
+#else
+#define OCCLUSION_LANES 1
+#endif
+
+#define OCCLUSION_ROW_ALIGNMENT 8 // Rows are a whole number of the widest span
+
+namespace
+{
+	// Edge function a -> b as A * x + B * y + C, positive on the inside of a counter clockwise triangle
+	struct Edge
+	{
+		float a;
+		float b;
+		float c;
+	};
+
+	inline Edge makeEdge(float ax, float ay, float bx, float by, float sign)
+	{
+		Edge edge;
+		edge.a = -(by - ay) * sign;
+		edge.b = (bx - ax) * sign;
+		edge.c = -(edge.a * ax + edge.b * ay);
+		return edge;
+	}
+}
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height)
+: m_uiWidth((width + OCCLUSION_ROW_ALIGNMENT - 1) / OCCLUSION_ROW_ALIGNMENT * OCCLUSION_ROW_ALIGNMENT)
+, m_uiHeight(height)
+, m_viewProjection(1.0f)
+, m_uiTriangleCount(0)
+, m_uiOccludedBoxes(0)
+{
+	if (width == 0 || height == 0)
+	{
+		throw std::runtime_error("Occlusion buffer needs a size!");
+	}
+
+	// Pyramid all the way down to a single texel
+	uint32_t levelWidth = m_uiWidth;
+	uint32_t levelHeight = m_uiHeight;
+	while (true)
+	{
+		m_levels.push_back(std::vector<float>((size_t)levelWidth * levelHeight, 1.0f));
+		m_levelWidths.push_back(levelWidth);
+		m_levelHeights.push_back(levelHeight);
+
+		if (levelWidth == 1 && levelHeight == 1)
+		{
+			break;
+		}
+
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4 & viewProjection)
+{
+	m_viewProjection = viewProjection;
+	m_occluders.clear();
+	m_uiTriangleCount = 0;
+	m_stats = OcclusionStats();
+}
+
+void OcclusionCuller::addOccluder(const glm::vec3 * positions, const uint32_t * indices, size_t triangleCount, const glm::mat4 & model)
+{
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	m_occluders.push_back({ positions, indices, triangleCount, m_uiTriangleCount, m_viewProjection * model });
+	m_uiTriangleCount += triangleCount;
+}
+
+void OcclusionCuller::rasterize()
+{
+	this->transformOccluders();
+
+	JobSystem & jobSystem = JobSystem::getInstance();
+
+	uint32_t bandCount = (m_uiHeight + OCCLUSION_BAND_HEIGHT - 1) / OCCLUSION_BAND_HEIGHT;
+	jobSystem.parallelFor(0, bandCount, 1, [this](size_t begin, size_t end)
+	{
+		for (size_t band = begin; band < end; band++)
+		{
+			int bandMinY = (int)band * OCCLUSION_BAND_HEIGHT;
+			int bandMaxY = std::min<int>(bandMinY + OCCLUSION_BAND_HEIGHT, (int)m_uiHeight) - 1;
+			this->rasterizeBand(bandMinY, bandMaxY);
+		}
+	});
+
+	this->buildHierarchy();
+
+	m_stats.occluderTriangles = m_uiTriangleCount;
+	m_stats.rasterizedTriangles = m_triangles.size();
+}
+
+void OcclusionCuller::transformOccluders()
+{
+	size_t chunkCount = (m_uiTriangleCount + OCCLUSION_TRANSFORM_GRAIN - 1) / OCCLUSION_TRANSFORM_GRAIN;
+	m_chunkTriangles.resize(chunkCount);
+
+	JobSystem::getInstance().parallelFor(0, chunkCount, 1, [this](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; chunk++)
+		{
+			std::vector<ScreenTriangle> & output = m_chunkTriangles[chunk];
+			output.clear();
+
+			size_t first = chunk * OCCLUSION_TRANSFORM_GRAIN;
+			size_t last = std::min<size_t>(first + OCCLUSION_TRANSFORM_GRAIN, m_uiTriangleCount);
+
+			// Last occluder starting at or before the chunk
+			size_t occluderIndex = std::upper_bound(m_occluders.begin(), m_occluders.end(), first, [](size_t triangle, const Occluder & occluder)
+			{
+				return triangle < occluder.firstTriangle;
+			}) - m_occluders.begin() - 1;
+
+			for (size_t triangle = first; triangle < last; triangle++)
+			{
+				while (triangle >= m_occluders[occluderIndex].firstTriangle + m_occluders[occluderIndex].triangleCount)
+				{
+					occluderIndex++;
+				}
+
+				const Occluder & occluder = m_occluders[occluderIndex];
+				const uint32_t * indices = occluder.indices + (triangle - occluder.firstTriangle) * 3;
+
+				glm::vec4 clip[3];
+				for (int v = 0; v < 3; v++)
+				{
+					clip[v] = occluder.modelViewProjection * glm::vec4(occluder.positions[indices[v]], 1.0f);
+				}
+
+				ScreenTriangle screen[2];
+				size_t count = this->clipTriangle(clip, screen);
+				for (size_t i = 0; i < count; i++)
+				{
+					output.push_back(screen[i]);
+				}
+			}
+		}
+	});
+
+	m_triangles.clear();
+	for (const auto & chunk : m_chunkTriangles)
+	{
+		m_triangles.insert(m_triangles.end(), chunk.begin(), chunk.end());
+	}
+}
+
+size_t OcclusionCuller::clipTriangle(const glm::vec4 * clip, ScreenTriangle * out) const
+{
+	// Trivially outside one of the clip planes
+	int outsideLeft = 0, outsideRight = 0, outsideBottom = 0, outsideTop = 0, outsideNear = 0, outsideFar = 0;
+	for (int v = 0; v < 3; v++)
+	{
+		outsideLeft += clip[v].x < -clip[v].w;
+		outsideRight += clip[v].x > clip[v].w;
+		outsideBottom += clip[v].y < -clip[v].w;
+		outsideTop += clip[v].y > clip[v].w;
+		outsideNear += clip[v].z < 0.0f;
+		outsideFar += clip[v].z > clip[v].w;
+	}
+
+	if (outsideLeft == 3 || outsideRight == 3 || outsideBottom == 3 || outsideTop == 3 || outsideNear == 3 || outsideFar == 3)
+	{
+		return 0;
+	}
+
+	// Only the near plane needs real clipping, the rest is handled by the screen bounds
+	glm::vec4 polygon[4];
+	int vertexCount = 0;
+
+	if (outsideNear == 0)
+	{
+		polygon[0] = clip[0];
+		polygon[1] = clip[1];
+		polygon[2] = clip[2];
+		vertexCount = 3;
+	}
+	else
+	{
+		for (int v = 0; v < 3; v++)
+		{
+			const glm::vec4 & current = clip[v];
+			const glm::vec4 & next = clip[(v + 1) % 3];
+
+			if (current.z >= 0.0f)
+			{
+				polygon[vertexCount++] = current;
+			}
+
+			if ((current.z >= 0.0f) != (next.z >= 0.0f))
+			{
+				float t = current.z / (current.z - next.z);
+				polygon[vertexCount++] = current + (next - current) * t;
+			}
+		}
+	}
+
+	float width = (float)m_uiWidth;
+	float height = (float)m_uiHeight;
+
+	glm::vec3 screen[4];
+	for (int v = 0; v < vertexCount; v++)
+	{
+		float inverseW = 1.0f / polygon[v].w;
+		screen[v] = glm::vec3(
+			(polygon[v].x * inverseW * 0.5f + 0.5f) * width,
+			(polygon[v].y * inverseW * 0.5f + 0.5f) * height,
+			polygon[v].z * inverseW);
+	}
+
+	size_t count = 0;
+	for (int v = 1; v + 1 < vertexCount; v++)
+	{
+		const glm::vec3 * corners[3] = { &screen[0], &screen[v], &screen[v + 1] };
+
+		ScreenTriangle & triangle = out[count];
+		float minY = FLT_MAX, maxY = -FLT_MAX;
+		for (int c = 0; c < 3; c++)
+		{
+			triangle.x[c] = corners[c]->x;
+			triangle.y[c] = corners[c]->y;
+			triangle.z[c] = corners[c]->z;
+			minY = std::min<float>(minY, triangle.y[c]);
+			maxY = std::max<float>(maxY, triangle.y[c]);
+		}
+
+		// Rows whose pixel centers fall inside the triangle's y range (clamped first, a vertex next to the near plane can land far off screen)
+		minY = std::max<float>(minY, -1.0f);
+		maxY = std::min<float>(maxY, height + 1.0f);
+		triangle.minY = std::max<int>(0, (int)std::ceil(minY - 0.5f));
+		triangle.maxY = std::min<int>((int)m_uiHeight - 1, (int)std::floor(maxY - 0.5f));
+
+		if (triangle.minY <= triangle.maxY)
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void OcclusionCuller::rasterizeBand(int bandMinY, int bandMaxY)
+{
+	float * depth = m_levels[0].data();
+	std::fill(depth + (size_t)bandMinY * m_uiWidth, depth + (size_t)(bandMaxY + 1) * m_uiWidth, 1.0f);
+
+	for (const ScreenTriangle & triangle : m_triangles)
+	{
+		if (triangle.maxY >= bandMinY && triangle.minY <= bandMaxY)
+		{
+			this->rasterizeTriangle(triangle, bandMinY, bandMaxY);
+		}
+	}
+}
+
+void OcclusionCuller::rasterizeTriangle(const ScreenTriangle & triangle, int bandMinY, int bandMaxY)
+{
+	const float * x = triangle.x;
+	const float * y = triangle.y;
+	const float * z = triangle.z;
+
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (std::fabs(area) < 1e-8f)
+	{
+		return;
+	}
+
+	// Occluders are drawn two sided, so flip clockwise triangles rather than dropping them
+	float sign = area > 0.0f ? 1.0f : -1.0f;
+	Edge edges[3] = {
+		makeEdge(x[0], y[0], x[1], y[1], sign),
+		makeEdge(x[1], y[1], x[2], y[2], sign),
+		makeEdge(x[2], y[2], x[0], y[0], sign),
+	};
+
+	// z / w is linear in screen space
+	float depthX = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	float depthY = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+	float depthC = z[0] - depthX * x[0] - depthY * y[0];
+
+	float minX = std::min<float>(x[0], std::min<float>(x[1], x[2]));
+	float maxX = std::max<float>(x[0], std::max<float>(x[1], x[2]));
+	minX = std::max<float>(minX, -1.0f);
+	maxX = std::min<float>(maxX, (float)m_uiWidth + 1.0f);
+
+	int startX = std::max<int>(0, (int)std::ceil(minX - 0.5f));
+	int endX = std::min<int>((int)m_uiWidth - 1, (int)std::floor(maxX - 0.5f));
+	if (startX > endX)
+	{
+		return;
+	}
+
+	int startY = std::max<int>(triangle.minY, bandMinY);
+	int endY = std::min<int>(triangle.maxY, bandMaxY);
+
+	// Spans start on a lane boundary, the row padding keeps the last one inside the buffer
+	startX &= ~(OCCLUSION_LANES - 1);
+
+	float * depth = m_levels[0].data();
+
+#if OCCLUSION_LANES == 8
+	const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 lastPixel = _mm256_set1_ps((float)endX + 0.5f);
+
+	for (int row = startY; row <= endY; row++)
+	{
+		float * rowDepth = depth + (size_t)row * m_uiWidth;
+		__m256 pixelY = _mm256_set1_ps((float)row + 0.5f);
+
+		__m256 rowEdge0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edges[0].b), pixelY), _mm256_set1_ps(edges[0].c));
+		__m256 rowEdge1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edges[1].b), pixelY), _mm256_set1_ps(edges[1].c));
+		__m256 rowEdge2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edges[2].b), pixelY), _mm256_set1_ps(edges[2].c));
+		__m256 rowDepthBase = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(depthY), pixelY), _mm256_set1_ps(depthC));
+
+		for (int column = startX; column <= endX; column += 8)
+		{
+			__m256 pixelX = _mm256_add_ps(_mm256_set1_ps((float)column), laneOffsets);
+
+			__m256 e0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edges[0].a), pixelX), rowEdge0);
+			__m256 e1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edges[1].a), pixelX), rowEdge1);
+			__m256 e2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edges[2].a), pixelX), rowEdge2);
+
+			// Coverage mask for the span, then a masked depth min
+			__m256 coverage = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(e2, zero, _CMP_GE_OQ), _mm256_cmp_ps(pixelX, lastPixel, _CMP_LE_OQ)));
+
+			if (_mm256_movemask_ps(coverage) == 0)
+			{
+				continue;
+			}
+
+			__m256 triangleDepth = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(depthX), pixelX), rowDepthBase);
+			__m256 bufferDepth = _mm256_loadu_ps(rowDepth + column);
+			_mm256_storeu_ps(rowDepth + column, _mm256_blendv_ps(bufferDepth, _mm256_min_ps(bufferDepth, triangleDepth), coverage));
+		}
+	}
+#elif OCCLUSION_LANES == 4
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 lastPixel = _mm_set1_ps((float)endX + 0.5f);
+
+	for (int row = startY; row <= endY; row++)
+	{
+		float * rowDepth = depth + (size_t)row * m_uiWidth;
+		__m128 pixelY = _mm_set1_ps((float)row + 0.5f);
+
+		__m128 rowEdge0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[0].b), pixelY), _mm_set1_ps(edges[0].c));
+		__m128 rowEdge1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[1].b), pixelY), _mm_set1_ps(edges[1].c));
+		__m128 rowEdge2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[2].b), pixelY), _mm_set1_ps(edges[2].c));
+		__m128 rowDepthBase = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthY), pixelY), _mm_set1_ps(depthC));
+
+		for (int column = startX; column <= endX; column += 4)
+		{
+			__m128 pixelX = _mm_add_ps(_mm_set1_ps((float)column), laneOffsets);
+
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[0].a), pixelX), rowEdge0);
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[1].a), pixelX), rowEdge1);
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[2].a), pixelX), rowEdge2);
+
+			// Coverage mask for the span, then a masked depth min (SSE2 has no blendv, so and / andnot)
+			__m128 coverage = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+				_mm_and_ps(_mm_cmpge_ps(e2, zero), _mm_cmple_ps(pixelX, lastPixel)));
+
+			if (_mm_movemask_ps(coverage) == 0)
+			{
+				continue;
+			}
+
+			__m128 triangleDepth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthX), pixelX), rowDepthBase);
+			__m128 bufferDepth = _mm_loadu_ps(rowDepth + column);
+			__m128 nearest = _mm_min_ps(bufferDepth, triangleDepth);
+			_mm_storeu_ps(rowDepth + column, _mm_or_ps(_mm_and_ps(coverage, nearest), _mm_andnot_ps(coverage, bufferDepth)));
+		}
+	}
+#else
+	for (int row = startY; row <= endY; row++)
+	{
+		float * rowDepth = depth + (size_t)row * m_uiWidth;
+		float pixelY = (float)row + 0.5f;
+
+		for (int column = startX; column <= endX; column++)
+		{
+			float pixelX = (float)column + 0.5f;
+
+			if (edges[0].a * pixelX + edges[0].b * pixelY + edges[0].c >= 0.0f &&
+				edges[1].a * pixelX + edges[1].b * pixelY + edges[1].c >= 0.0f &&
+				edges[2].a * pixelX + edges[2].b * pixelY + edges[2].c >= 0.0f)
+			{
+				rowDepth[column] = std::min<float>(rowDepth[column], depthX * pixelX + depthY * pixelY + depthC);
+			}
+		}
+	}
+#endif
+}
+
+void OcclusionCuller::buildHierarchy()
+{
+	for (size_t level = 1; level < m_levels.size(); level++)
+	{
+		const std::vector<float> & source = m_levels[level - 1];
+		std::vector<float> & target = m_levels[level];
+
+		uint32_t sourceWidth = m_levelWidths[level - 1];
+		uint32_t sourceHeight = m_levelHeights[level - 1];
+		uint32_t width = m_levelWidths[level];
+		uint32_t height = m_levelHeights[level];
+
+		// Farthest of the (up to) four texels below, so a texel never claims more occlusion than its area has
+		for (uint32_t y = 0; y < height; y++)
+		{
+			uint32_t y0 = y * 2;
+			uint32_t y1 = std::min<uint32_t>(y0 + 1, sourceHeight - 1);
+
+			for (uint32_t x = 0; x < width; x++)
+			{
+				uint32_t x0 = x * 2;
+				uint32_t x1 = std::min<uint32_t>(x0 + 1, sourceWidth - 1);
+
+				target[(size_t)y * width + x] = std::max<float>(
+					std::max<float>(source[(size_t)y0 * sourceWidth + x0], source[(size_t)y0 * sourceWidth + x1]),
+					std::max<float>(source[(size_t)y1 * sourceWidth + x0], source[(size_t)y1 * sourceWidth + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::isVisible(const glm::vec3 & min, const glm::vec3 & max) const
+{
+	float screenMinX = FLT_MAX, screenMinY = FLT_MAX, nearestDepth = FLT_MAX;
+	float screenMaxX = -FLT_MAX, screenMaxY = -FLT_MAX;
+
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 position((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z);
+		glm::vec4 clip = m_viewProjection * glm::vec4(position, 1.0f);
+
+		// Reaches the near plane, the projected rectangle means nothing
+		if (clip.z < 0.0f || clip.w <= 1e-6f)
+		{
+			return true;
+		}
+
+		float inverseW = 1.0f / clip.w;
+		float screenX = (clip.x * inverseW * 0.5f + 0.5f) * m_uiWidth;
+		float screenY = (clip.y * inverseW * 0.5f + 0.5f) * m_uiHeight;
+
+		screenMinX = std::min<float>(screenMinX, screenX);
+		screenMaxX = std::max<float>(screenMaxX, screenX);
+		screenMinY = std::min<float>(screenMinY, screenY);
+		screenMaxY = std::max<float>(screenMaxY, screenY);
+		nearestDepth = std::min<float>(nearestDepth, clip.z * inverseW);
+	}
+
+	// Every pixel the rectangle touches
+	screenMinX = std::max<float>(screenMinX, -1.0f);
+	screenMinY = std::max<float>(screenMinY, -1.0f);
+	screenMaxX = std::min<float>(screenMaxX, (float)m_uiWidth + 1.0f);
+	screenMaxY = std::min<float>(screenMaxY, (float)m_uiHeight + 1.0f);
+
+	int x0 = std::max<int>(0, (int)std::floor(screenMinX));
+	int y0 = std::max<int>(0, (int)std::floor(screenMinY));
+	int x1 = std::min<int>((int)m_uiWidth - 1, (int)std::ceil(screenMaxX) - 1);
+	int y1 = std::min<int>((int)m_uiHeight - 1, (int)std::ceil(screenMaxY) - 1);
+
+	if (x0 > x1 || y0 > y1)
+	{
+		// Off screen is the frustum test's call, not ours
+		return true;
+	}
+
+	// Coarsest level where the rectangle covers at most 2x2 texels
+	size_t level = 0;
+	while (level + 1 < m_levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+	{
+		level++;
+	}
+
+	const std::vector<float> & depth = m_levels[level];
+	uint32_t width = m_levelWidths[level];
+
+	float farthest = 0.0f;
+	for (int y = y0 >> level; y <= (y1 >> level); y++)
+	{
+		for (int x = x0 >> level; x <= (x1 >> level); x++)
+		{
+			farthest = std::max<float>(farthest, depth[(size_t)y * width + x]);
+		}
+	}
+
+	return nearestDepth <= farthest;
+}
+
+size_t OcclusionCuller::testBoxes(const BoundingBoxArray & boxes, const uint32_t * indices, size_t count, std::vector<uint32_t> & visible)
+{
+	visible.resize(count);
+
+	size_t chunkCount = (count + OCCLUSION_TEST_GRAIN - 1) / OCCLUSION_TEST_GRAIN;
+	std::vector<size_t> chunkVisible(chunkCount);
+
+	m_uiOccludedBoxes.store(0);
+
+	JobSystem::getInstance().parallelFor(0, chunkCount, 1, [&](size_t first, size_t last)
+	{
+		for (size_t chunk = first; chunk < last; chunk++)
+		{
+			size_t begin = chunk * OCCLUSION_TEST_GRAIN;
+			size_t end = std::min<size_t>(begin + OCCLUSION_TEST_GRAIN, count);
+
+			uint32_t * out = visible.data() + begin;
+			size_t written = 0;
+
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t box = indices ? indices[i] : (uint32_t)i;
+
+				glm::vec3 center(boxes.centerX[box], boxes.centerY[box], boxes.centerZ[box]);
+				glm::vec3 extent(boxes.extentX[box], boxes.extentY[box], boxes.extentZ[box]);
+
+				if (this->isVisible(center - extent, center + extent))
+				{
+					out[written++] = box;
+				}
+			}
+
+			chunkVisible[chunk] = written;
+			m_uiOccludedBoxes.fetch_add((end - begin) - written, std::memory_order_relaxed);
+		}
+	});
+
+	// Pack the per chunk slices together
+	size_t total = 0;
+	for (size_t chunk = 0; chunk < chunkCount; chunk++)
+	{
+		if (total != chunk * OCCLUSION_TEST_GRAIN)
+		{
+			memmove(visible.data() + total, visible.data() + chunk * OCCLUSION_TEST_GRAIN, chunkVisible[chunk] * sizeof(uint32_t));
+		}
+		total += chunkVisible[chunk];
+	}
+
+	visible.resize(total);
+
+	m_stats.testedBoxes += count;
+	m_stats.occludedBoxes += m_uiOccludedBoxes.load();
+
+	return total;
+}
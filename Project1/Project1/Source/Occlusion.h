@@ -0,0 +1,113 @@
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+
+#include "Culling.h"
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec3.hpp>
+#include <vec4.hpp>
+#include <mat4x4.hpp>
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+#define OCCLUSION_DEFAULT_WIDTH 256
+#define OCCLUSION_DEFAULT_HEIGHT 128
+#define OCCLUSION_BAND_HEIGHT 8 // Rows per raster job, each band is owned by one thread so writes never overlap
+#define OCCLUSION_TRANSFORM_GRAIN 256 // Occluder triangles per transform job
+#define OCCLUSION_TEST_GRAIN 256 // Boxes per test job
+
+struct OcclusionStats
+{
+	size_t occluderTriangles = 0; // Queued this frame
+	size_t rasterizedTriangles = 0; // Left after clipping and trivial rejection
+	size_t testedBoxes = 0;
+	size_t occludedBoxes = 0;
+};
+
+// Software occlusion culling. Occluder meshes are rasterized into a small depth buffer on the
+// CPU (8 or 4 pixels at a time with AVX / SSE, horizontal bands spread over the job system),
+// which is then reduced into a hierarchical Z pyramid that bounding boxes are tested against.
+// Depth follows the project's 0..1 convention, smaller is nearer, and the buffer keeps the
+// nearest occluder per pixel while each pyramid level keeps the farthest of the four below it.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller(uint32_t width = OCCLUSION_DEFAULT_WIDTH, uint32_t height = OCCLUSION_DEFAULT_HEIGHT);
+	virtual ~OcclusionCuller();
+
+	OcclusionCuller(const OcclusionCuller &) = delete;
+	void operator=(const OcclusionCuller &) = delete;
+
+	// Clears the occluder list, the buffer is cleared by rasterize()
+	void beginFrame(const glm::mat4 & viewProjection);
+
+	// The mesh data is read by rasterize(), so it has to stay alive until then
+	void addOccluder(const glm::vec3 * positions, const uint32_t * indices, size_t triangleCount, const glm::mat4 & model);
+
+	// Draws every queued occluder and builds the pyramid
+	void rasterize();
+
+	// Conservative: anything crossing the near plane or leaving the screen counts as visible
+	bool isVisible(const glm::vec3 & min, const glm::vec3 & max) const;
+
+	// Tests the boxes listed in indices (all of them when indices is null) on the job system,
+	// writes the visible ones to visible in the same order and returns how many there are
+	size_t testBoxes(const BoundingBoxArray & boxes, const uint32_t * indices, size_t count, std::vector<uint32_t> & visible);
+
+	uint32_t getWidth() const { return m_uiWidth; }
+	uint32_t getHeight() const { return m_uiHeight; }
+	const float * getDepthBuffer() const { return m_levels[0].data(); }
+	size_t getLevelCount() const { return m_levels.size(); }
+
+	const OcclusionStats & getStats() const { return m_stats; }
+
+private:
+	struct Occluder
+	{
+		const glm::vec3 * positions;
+		const uint32_t * indices;
+		size_t triangleCount;
+		size_t firstTriangle; // Across every occluder queued this frame
+		glm::mat4 modelViewProjection;
+	};
+
+	// Screen space, depth already divided by w
+	struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+		int minY;
+		int maxY;
+	};
+
+	void transformOccluders();
+	size_t clipTriangle(const glm::vec4 * clip, ScreenTriangle * out) const;
+	void rasterizeBand(int bandMinY, int bandMaxY);
+	void rasterizeTriangle(const ScreenTriangle & triangle, int bandMinY, int bandMaxY);
+	void buildHierarchy();
+
+	uint32_t m_uiWidth; // Padded to a multiple of 8 so every SIMD span stays inside the row
+	uint32_t m_uiHeight;
+
+	glm::mat4 m_viewProjection;
+
+	std::vector<Occluder> m_occluders;
+	size_t m_uiTriangleCount;
+
+	std::vector<std::vector<ScreenTriangle>> m_chunkTriangles; // One list per transform job
+	std::vector<ScreenTriangle> m_triangles;
+
+	std::vector<std::vector<float>> m_levels; // Level 0 is the depth buffer
+	std::vector<uint32_t> m_levelWidths;
+	std::vector<uint32_t> m_levelHeights;
+
+	std::atomic<size_t> m_uiOccludedBoxes;
+	OcclusionStats m_stats;
+};
+
+#endif
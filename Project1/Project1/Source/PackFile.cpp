@@ -0,0 +1,725 @@
+#include "PackFile.h"
+#include "JobSystem.h"
+#include "Hash.h"
+#include "LZ.h"
+
+#include <fstream>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#endif
+
+namespace
+{
+	const char PACK_FILE_MAGIC[4] = { 'V', 'P', 'A', 'K' };
+
+	uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+	{
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+
+	uint64_t hashHeader(const PackFileHeader & header)
+	{
+		PackFileHeader copy = header;
+		copy.headerChecksum = 0;
+		return Hash::hash64(&copy, sizeof(copy));
+	}
+
+	bool fileExists(const std::string & filename)
+	{
+#ifdef _WIN32
+		struct _stat64 info;
+		return _stat64(filename.c_str(), &info) == 0 && (info.st_mode & _S_IFREG) != 0;
+#else
+		struct stat info;
+		return stat(filename.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+#endif
+	}
+
+	// Paths of every file below directory, relative to it and with forward slashes
+	void listFiles(const std::string & directory, const std::string & relative, std::vector<std::string> & files)
+	{
+		std::string path = relative.empty() ? directory : directory + "/" + relative;
+
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Failed to open directory " + path + "!");
+		}
+
+		do
+		{
+			std::string name = data.cFileName;
+			if (name == "." || name == "..")
+			{
+				continue;
+			}
+
+			std::string child = relative.empty() ? name : relative + "/" + name;
+			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				listFiles(directory, child, files);
+			}
+			else
+			{
+				files.push_back(child);
+			}
+		} while (FindNextFileA(find, &data));
+
+		FindClose(find);
+#else
+		DIR * dir = opendir(path.c_str());
+		if (!dir)
+		{
+			throw std::runtime_error("Failed to open directory " + path + "!");
+		}
+
+		while (dirent * item = readdir(dir))
+		{
+			std::string name = item->d_name;
+			if (name == "." || name == "..")
+			{
+				continue;
+			}
+
+			std::string child = relative.empty() ? name : relative + "/" + name;
+
+			struct stat info;
+			if (stat((directory + "/" + child).c_str(), &info) != 0)
+			{
+				continue;
+			}
+
+			if (S_ISDIR(info.st_mode))
+			{
+				listFiles(directory, child, files);
+			}
+			else if (S_ISREG(info.st_mode))
+			{
+				files.push_back(child);
+			}
+		}
+
+		closedir(dir);
+#endif
+	}
+}
+
+PackFile::PackFile()
+: m_pHeader(nullptr)
+, m_pDirectory(nullptr)
+, m_pStrings(nullptr)
+{
+}
+
+PackFile::~PackFile()
+{
+	this->close();
+}
+
+void PackFile::open(const std::string & filename)
+{
+	this->close();
+
+	// Entries are read wherever their lookups land
+	m_file = FileView::open(filename, FILE_ACCESS_RANDOM);
+	m_filename = filename;
+
+	try
+	{
+		const uint8_t * data = m_file.data();
+		size_t size = m_file.size();
+
+		if (size < sizeof(PackFileHeader))
+		{
+			throw std::runtime_error(filename + " is too small to be a pack file!");
+		}
+
+		const PackFileHeader * header = reinterpret_cast<const PackFileHeader *>(data);
+
+		if (memcmp(header->magic, PACK_FILE_MAGIC, sizeof(PACK_FILE_MAGIC)) != 0)
+		{
+			throw std::runtime_error(filename + " is not a pack file!");
+		}
+
+		if (header->version != PACK_FILE_VERSION)
+		{
+			throw std::runtime_error(filename + " is pack file version " + std::to_string(header->version) + ", expected " + std::to_string(PACK_FILE_VERSION) + "!");
+		}
+
+		if (header->headerSize != sizeof(PackFileHeader) || header->headerChecksum != hashHeader(*header))
+		{
+			throw std::runtime_error(filename + " has a corrupt header!");
+		}
+
+		if (header->fileSize != size)
+		{
+			throw std::runtime_error(filename + " is truncated!");
+		}
+
+		// A power of two with at least one free slot, so every probe ends
+		uint32_t capacity = header->directoryCapacity;
+		if (capacity == 0 || (capacity & (capacity - 1)) != 0 || header->entryCount >= capacity || header->blockSize == 0)
+		{
+			throw std::runtime_error(filename + " has a corrupt directory!");
+		}
+
+		uint64_t directorySize = (uint64_t)capacity * sizeof(PackEntry);
+		if (header->directoryOffset % PACK_DIRECTORY_ALIGNMENT != 0 || header->directoryOffset > size || directorySize > size - header->directoryOffset ||
+			header->stringsOffset != header->directoryOffset + directorySize || header->stringsSize > size - header->stringsOffset ||
+			header->stringsSize == 0 || data[header->stringsOffset + header->stringsSize - 1] != '\0')
+		{
+			throw std::runtime_error(filename + " has a corrupt directory!");
+		}
+
+		if (Hash::hash64(data + header->directoryOffset, (size_t)(directorySize + header->stringsSize)) != header->directoryChecksum)
+		{
+			throw std::runtime_error(filename + " failed its directory checksum, the file is corrupt!");
+		}
+
+		const PackEntry * directory = reinterpret_cast<const PackEntry *>(data + header->directoryOffset);
+
+		uint32_t entryCount = 0;
+		for (uint32_t i = 0; i < capacity; i++)
+		{
+			const PackEntry & entry = directory[i];
+			if (!(entry.flags & PACK_ENTRY_USED))
+			{
+				continue;
+			}
+
+			if (entry.offset > header->directoryOffset || entry.storedSize > header->directoryOffset - entry.offset || entry.pathOffset >= header->stringsSize ||
+				(!(entry.flags & PACK_ENTRY_COMPRESSED) && entry.storedSize != entry.size))
+			{
+				throw std::runtime_error(filename + " has an entry that is out of range!");
+			}
+
+			entryCount++;
+		}
+
+		if (entryCount != header->entryCount)
+		{
+			throw std::runtime_error(filename + " has a corrupt directory!");
+		}
+
+		m_pHeader = header;
+		m_pDirectory = directory;
+		m_pStrings = reinterpret_cast<const char *>(data + header->stringsOffset);
+	}
+	catch (...)
+	{
+		this->close();
+		throw;
+	}
+}
+
+void PackFile::close()
+{
+	m_file.reset();
+	m_filename.clear();
+
+	m_pHeader = nullptr;
+	m_pDirectory = nullptr;
+	m_pStrings = nullptr;
+}
+
+const PackEntry * PackFile::findEntry(const std::string & path) const
+{
+	if (!this->isOpen())
+	{
+		return nullptr;
+	}
+
+	std::string normalized = normalizePath(path);
+	uint64_t hash = Hash::hash64(normalized);
+	uint32_t mask = m_pHeader->directoryCapacity - 1;
+
+	for (uint32_t slot = (uint32_t)hash & mask; ; slot = (slot + 1) & mask)
+	{
+		const PackEntry & entry = m_pDirectory[slot];
+
+		if (!(entry.flags & PACK_ENTRY_USED))
+		{
+			return nullptr;
+		}
+
+		// The hash almost always settles it, the path only has to be compared on a match
+		if (entry.pathHash == hash && normalized == this->getPath(entry))
+		{
+			return &entry;
+		}
+	}
+}
+
+const char * PackFile::getPath(const PackEntry & entry) const
+{
+	return m_pStrings + entry.pathOffset;
+}
+
+FileView PackFile::read(const PackEntry & entry) const
+{
+	if (!(entry.flags & PACK_ENTRY_COMPRESSED))
+	{
+		return m_file.subView((size_t)entry.offset, (size_t)entry.size);
+	}
+
+	return decompress(entry, m_pHeader->blockSize, m_file.data() + entry.offset, this->getPath(entry));
+}
+
+FileView PackFile::decompress(const PackEntry & entry, uint32_t entryBlockSize, const uint8_t * stored, const std::string & path)
+{
+	uint64_t blockSize = entryBlockSize;
+	size_t blockCount = (size_t)((entry.size + blockSize - 1) / blockSize);
+
+	if (entry.storedSize < blockCount * sizeof(uint32_t))
+	{
+		throw std::runtime_error("Pack entry " + path + " is corrupt!");
+	}
+
+	// Where each block starts, the table only has their sizes. Read bytewise, the entry may not be 4 byte aligned.
+	std::vector<uint32_t> blockTable(blockCount);
+	std::vector<uint64_t> blockOffsets(blockCount + 1);
+	blockOffsets[0] = blockCount * sizeof(uint32_t);
+	for (size_t i = 0; i < blockCount; i++)
+	{
+		blockTable[i] = Hash::read32(stored + i * sizeof(uint32_t));
+		blockOffsets[i + 1] = blockOffsets[i] + (blockTable[i] & ~PACK_BLOCK_STORED);
+	}
+
+	if (blockOffsets[blockCount] != entry.storedSize)
+	{
+		throw std::runtime_error("Pack entry " + path + " is corrupt!");
+	}
+
+	std::shared_ptr<uint8_t> buffer = allocateFileBuffer((size_t)entry.size);
+	std::atomic<bool> bCorrupt(false);
+
+	auto decompressBlocks = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			uint64_t blockStart = i * blockSize;
+			size_t size = (size_t)std::min<uint64_t>(blockSize, entry.size - blockStart);
+			size_t storedSize = (size_t)(blockOffsets[i + 1] - blockOffsets[i]);
+
+			if (blockTable[i] & PACK_BLOCK_STORED)
+			{
+				if (storedSize != size)
+				{
+					bCorrupt = true;
+					continue;
+				}
+				memcpy(buffer.get() + blockStart, stored + blockOffsets[i], size);
+			}
+			else if (!LZ::decompress(stored + blockOffsets[i], storedSize, buffer.get() + blockStart, size))
+			{
+				bCorrupt = true;
+			}
+		}
+	};
+
+	if (blockCount > 1)
+	{
+		JobSystem::getInstance().parallelFor(0, blockCount, 1, decompressBlocks);
+	}
+	else
+	{
+		decompressBlocks(0, blockCount);
+	}
+
+	if (bCorrupt)
+	{
+		throw std::runtime_error("Pack entry " + path + " is corrupt!");
+	}
+
+	return FileView::fromMemory(buffer.get(), (size_t)entry.size, buffer);
+}
+
+bool PackFile::readFile(const std::string & filename, FILE_ACCESS_HINT hint, FileView & view)
+{
+	const PackEntry * entry = this->findEntry(filename);
+	if (!entry)
+	{
+		return false;
+	}
+
+	view = this->read(*entry);
+
+	if (hint != FILE_ACCESS_NORMAL)
+	{
+		view.advise(hint);
+	}
+
+	return true;
+}
+
+bool PackFile::locateFile(const std::string & filename, FileLocation & location)
+{
+	const PackEntry * entry = this->findEntry(filename);
+	if (!entry)
+	{
+		return false;
+	}
+
+	if (!(entry->flags & PACK_ENTRY_COMPRESSED))
+	{
+		// Already mapped, there is nothing to read
+		location.data = m_file.subView((size_t)entry->offset, (size_t)entry->size);
+		return true;
+	}
+
+	location.filename = m_filename;
+	location.offset = entry->offset;
+	location.size = entry->storedSize;
+
+	// Copied, the read may well finish after the pack is closed
+	PackEntry copy = *entry;
+	uint32_t blockSize = m_pHeader->blockSize;
+	std::string path = this->getPath(*entry);
+
+	location.decode = [copy, blockSize, path](const FileView & stored)
+	{
+		if (stored.size() != copy.storedSize)
+		{
+			throw std::runtime_error("Pack entry " + path + " is corrupt!");
+		}
+		return decompress(copy, blockSize, stored.data(), path);
+	};
+
+	return true;
+}
+
+bool PackFile::verify() const
+{
+	std::vector<const PackEntry *> entries;
+	this->forEachEntry([&](const PackEntry & entry) { entries.push_back(&entry); });
+
+	std::atomic<bool> bValid(true);
+
+	JobSystem::getInstance().parallelFor(0, entries.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end && bValid; i++)
+		{
+			try
+			{
+				FileView data = this->read(*entries[i]);
+				if (Hash::hash64(data.data(), data.size()) != entries[i]->checksum)
+				{
+					bValid = false;
+				}
+			}
+			catch (const std::runtime_error &)
+			{
+				bValid = false;
+			}
+		}
+	});
+
+	return bValid;
+}
+
+std::string PackFile::normalizePath(const std::string & path)
+{
+	std::string normalized;
+	normalized.reserve(path.size());
+
+	for (char c : path)
+	{
+		c = c == '\\' ? '/' : c;
+
+		if (c == '/' && (normalized.empty() || normalized.back() == '/'))
+		{
+			// Leading and doubled slashes
+			continue;
+		}
+
+		normalized.push_back(c);
+
+		if (normalized == "./")
+		{
+			normalized.clear();
+		}
+	}
+
+	return normalized;
+}
+
+std::shared_ptr<PackFile> PackFile::mount(const std::string & filename)
+{
+	if (!fileExists(filename))
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<PackFile> pack = std::make_shared<PackFile>();
+	pack->open(filename);
+	mountFileSource(pack);
+
+	return pack;
+}
+
+PackBuilder::PackBuilder()
+{
+}
+
+PackBuilder::~PackBuilder()
+{
+}
+
+void PackBuilder::addFile(const std::string & path, const std::string & sourceFilename, bool compress, uint32_t alignment)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+	{
+		throw std::runtime_error("Pack entry alignment has to be a power of two!");
+	}
+
+	std::string normalized = PackFile::normalizePath(path);
+
+	// readFile is only ever asked for relative paths, anything else would sit in the pack unused
+	bool bValid = !normalized.empty() && path[0] != '/' && path[0] != '\\' && normalized.find(':') == std::string::npos;
+	for (size_t start = 0; bValid && start < normalized.size();)
+	{
+		size_t end = std::min<size_t>(normalized.find('/', start), normalized.size());
+		bValid = normalized.compare(start, end - start, "..") != 0;
+		start = end + 1;
+	}
+
+	if (!bValid)
+	{
+		throw std::runtime_error("Pack path " + path + " has to be relative, without \"..\"!");
+	}
+
+	m_entries.push_back({ normalized, sourceFilename, FileView(), compress, alignment });
+}
+
+void PackBuilder::addData(const std::string & path, const FileView & data, bool compress, uint32_t alignment)
+{
+	this->addFile(path, std::string(), compress, alignment);
+	m_entries.back().data = data;
+}
+
+size_t PackBuilder::addDirectory(const std::string & directory, const std::string & prefix, bool compress)
+{
+	std::vector<std::string> files;
+	listFiles(directory, std::string(), files);
+
+	std::sort(files.begin(), files.end());
+
+	for (const std::string & file : files)
+	{
+		this->addFile(prefix.empty() ? file : prefix + "/" + file, directory + "/" + file, compress);
+	}
+
+	return files.size();
+}
+
+void PackBuilder::write(const std::string & filename)
+{
+	// Sorted so the same input always gives the same pack
+	std::vector<Entry *> entries;
+	for (auto & entry : m_entries)
+	{
+		entries.push_back(&entry);
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry * a, const Entry * b) { return a->path < b->path; });
+
+	std::unordered_map<uint64_t, const std::string *> hashes;
+	for (const Entry * entry : entries)
+	{
+		auto inserted = hashes.insert(std::make_pair(Hash::hash64(entry->path), &entry->path));
+		if (!inserted.second)
+		{
+			if (*inserted.first->second == entry->path)
+			{
+				throw std::runtime_error("Pack has " + entry->path + " twice!");
+			}
+
+			throw std::runtime_error("Pack paths " + *inserted.first->second + " and " + entry->path + " have the same hash, rename one of them!");
+		}
+	}
+
+	std::string temporary = filename + ".tmp";
+	std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open " + temporary + " for writing!");
+	}
+
+	static const char padding[4096] = {};
+
+	auto writePadding = [&](uint64_t count)
+	{
+		while (count > 0)
+		{
+			uint64_t chunk = std::min<uint64_t>(count, sizeof(padding));
+			file.write(padding, (std::streamsize)chunk);
+			count -= chunk;
+		}
+	};
+
+	// The header goes in last, once the offsets are known
+	PackFileHeader header = {};
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	std::vector<PackEntry> packEntries(entries.size());
+	std::string strings(1, '\0'); // Never empty, even for a pack without entries
+	uint64_t offset = sizeof(header);
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const Entry & entry = *entries[i];
+		FileView data = entry.data.data() || entry.sourceFilename.empty() ? entry.data : FileView::open(entry.sourceFilename, FILE_ACCESS_SEQUENTIAL);
+
+		PackEntry & packEntry = packEntries[i];
+		packEntry.pathHash = Hash::hash64(entry.path);
+		packEntry.size = data.size();
+		packEntry.checksum = Hash::hash64(data.data(), data.size());
+		packEntry.pathOffset = (uint32_t)strings.size();
+		packEntry.flags = PACK_ENTRY_USED;
+
+		strings += entry.path;
+		strings.push_back('\0');
+
+		// Blocks are compressed independently, so they can be spread over the job system both ways
+		size_t blockCount = (data.size() + PACK_BLOCK_SIZE - 1) / PACK_BLOCK_SIZE;
+		std::vector<std::vector<uint8_t>> blocks(entry.bCompress ? blockCount : 0);
+
+		JobSystem::getInstance().parallelFor(0, blocks.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t block = begin; block < end; block++)
+			{
+				const uint8_t * source = data.data() + block * PACK_BLOCK_SIZE;
+				size_t size = std::min<size_t>(PACK_BLOCK_SIZE, data.size() - block * PACK_BLOCK_SIZE);
+
+				blocks[block].resize(size);
+				size_t compressedSize = LZ::compress(source, size, blocks[block].data(), size - 1);
+				blocks[block].resize(compressedSize); // Empty when it didn't shrink
+			}
+		});
+
+		std::vector<uint32_t> blockTable(blocks.size());
+		uint64_t storedSize = blockTable.size() * sizeof(uint32_t);
+		for (size_t block = 0; block < blocks.size(); block++)
+		{
+			size_t size = std::min<size_t>(PACK_BLOCK_SIZE, data.size() - block * PACK_BLOCK_SIZE);
+			blockTable[block] = blocks[block].empty() ? (uint32_t)size | PACK_BLOCK_STORED : (uint32_t)blocks[block].size();
+			storedSize += blockTable[block] & ~PACK_BLOCK_STORED;
+		}
+
+		bool bCompressed = !blocks.empty() && (double)storedSize <= (double)data.size() * PACK_MIN_SAVING;
+
+		uint64_t aligned = alignOffset(offset, entry.alignment);
+		writePadding(aligned - offset);
+		offset = aligned;
+
+		packEntry.offset = offset;
+
+		if (bCompressed)
+		{
+			packEntry.flags |= PACK_ENTRY_COMPRESSED;
+			packEntry.storedSize = storedSize;
+
+			file.write(reinterpret_cast<const char *>(blockTable.data()), blockTable.size() * sizeof(uint32_t));
+			for (size_t block = 0; block < blocks.size(); block++)
+			{
+				if (blockTable[block] & PACK_BLOCK_STORED)
+				{
+					file.write(reinterpret_cast<const char *>(data.data()) + block * PACK_BLOCK_SIZE, blockTable[block] & ~PACK_BLOCK_STORED);
+				}
+				else
+				{
+					file.write(reinterpret_cast<const char *>(blocks[block].data()), blocks[block].size());
+				}
+			}
+		}
+		else
+		{
+			packEntry.storedSize = data.size();
+			file.write(reinterpret_cast<const char *>(data.data()), data.size());
+		}
+
+		offset += packEntry.storedSize;
+	}
+
+	// At most half full, so a miss stops at an empty slot after a probe or two
+	uint32_t capacity = 16;
+	while (capacity < packEntries.size() * 2)
+	{
+		capacity *= 2;
+	}
+
+	// Directory and strings are written back to back, one checksum covers both
+	std::vector<uint8_t> directory(capacity * sizeof(PackEntry) + strings.size(), 0);
+	PackEntry * slots = reinterpret_cast<PackEntry *>(directory.data());
+
+	for (const PackEntry & packEntry : packEntries)
+	{
+		uint32_t slot = (uint32_t)packEntry.pathHash & (capacity - 1);
+		while (slots[slot].flags & PACK_ENTRY_USED)
+		{
+			slot = (slot + 1) & (capacity - 1);
+		}
+		slots[slot] = packEntry;
+	}
+
+	memcpy(directory.data() + capacity * sizeof(PackEntry), strings.data(), strings.size());
+
+	uint64_t directoryOffset = alignOffset(offset, PACK_DIRECTORY_ALIGNMENT);
+	writePadding(directoryOffset - offset);
+	file.write(reinterpret_cast<const char *>(directory.data()), directory.size());
+
+	memcpy(header.magic, PACK_FILE_MAGIC, sizeof(PACK_FILE_MAGIC));
+	header.version = PACK_FILE_VERSION;
+	header.headerSize = sizeof(PackFileHeader);
+	header.entryCount = (uint32_t)packEntries.size();
+	header.directoryCapacity = capacity;
+	header.blockSize = PACK_BLOCK_SIZE;
+	header.directoryOffset = directoryOffset;
+	header.stringsOffset = directoryOffset + capacity * sizeof(PackEntry);
+	header.stringsSize = strings.size();
+	header.fileSize = directoryOffset + directory.size();
+	header.directoryChecksum = Hash::hash64(directory.data(), directory.size());
+	header.headerChecksum = hashHeader(header);
+
+	file.seekp(0);
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.close();
+
+	if (file.fail())
+	{
+		std::remove(temporary.c_str());
+		throw std::runtime_error("Failed to write " + temporary + "!");
+	}
+
+#ifdef _WIN32
+	BOOL renamed = MoveFileExA(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	bool renamed = std::rename(temporary.c_str(), filename.c_str()) == 0;
+#endif
+	if (!renamed)
+	{
+		std::remove(temporary.c_str());
+		throw std::runtime_error("Failed to replace " + filename + ", is it still open?");
+	}
+}
+
+void PackBuilder::clear()
+{
+	m_entries.clear();
+}
@@ -0,0 +1,174 @@
+#ifndef __PACK_FILE_H__
+#define __PACK_FILE_H__
+
+#include "FileReader.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <stdint.h>
+
+#define PACK_FILE_VERSION 1
+#define PACK_DEFAULT_FILENAME "Data.pack" // Mounted at startup when it exists
+#define PACK_DEFAULT_ALIGNMENT 64 // Stored entries start on a cache line, enough for any element type
+#define PACK_BLOCK_SIZE (64 * 1024) // Compressed entries are split into blocks this size, decompressed side by side
+#define PACK_BLOCK_STORED 0x80000000u // Block table flag, the block didn't shrink and is kept as it is
+#define PACK_MIN_SAVING 0.97 // Entries compressing to more than this fraction of their size are stored as they are
+#define PACK_DIRECTORY_ALIGNMENT 64
+
+enum PACK_ENTRY_FLAGS
+{
+	PACK_ENTRY_USED = 1, // Directory slot holds an entry
+	PACK_ENTRY_COMPRESSED = 2, // Block table then LZ blocks, otherwise the data as it is
+};
+
+// Everything is little endian and offsets are from the start of the file. Layout: the header,
+// the entries' data, the directory (an open addressing table of PackEntry slots, probed linearly
+// from pathHash & (capacity - 1)) and the path strings.
+struct PackFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t entryCount;
+	uint32_t directoryCapacity; // Slots, a power of two
+	uint32_t blockSize;
+	uint64_t directoryOffset;
+	uint64_t stringsOffset;
+	uint64_t stringsSize;
+	uint64_t fileSize;
+	uint64_t directoryChecksum; // Hash::hash64 of the directory and strings
+	uint64_t headerChecksum; // Hash::hash64 of this header with headerChecksum = 0
+};
+
+static_assert(sizeof(PackFileHeader) == 72, "PackFileHeader layout changed");
+
+struct PackEntry
+{
+	uint64_t pathHash; // Hash::hash64 of the normalized path
+	uint64_t offset;
+	uint64_t storedSize; // Bytes in the pack, block table included
+	uint64_t size; // Once decompressed
+	uint64_t checksum; // Hash::hash64 of the decompressed data
+	uint32_t pathOffset; // Into the strings, nul terminated
+	uint32_t flags;
+};
+
+static_assert(sizeof(PackEntry) == 48, "PackEntry layout changed");
+
+// Read only pack archive. Opening maps the one file and checks the header and directory, after
+// which a lookup is a hash and a probe or two, no matter how many files the pack holds.
+// Stored entries are handed out as views straight into the mapping, compressed ones are
+// decompressed into an aligned buffer (on the job system when there are several blocks).
+// Mounted with mountFileSource, it answers readFile for every path it contains, and IOService
+// reads compressed entries as a range of the pack file.
+class PackFile : public FileSource
+{
+public:
+	PackFile();
+	virtual ~PackFile();
+
+	PackFile(const PackFile &) = delete;
+	void operator=(const PackFile &) = delete;
+
+	void open(const std::string & filename);
+	void close();
+
+	bool isOpen() const { return m_pHeader != nullptr; }
+	const std::string & getFilename() const { return m_filename; }
+	uint32_t getEntryCount() const { return isOpen() ? m_pHeader->entryCount : 0; }
+
+	// nullptr when the pack doesn't have the path
+	const PackEntry * findEntry(const std::string & path) const;
+	const char * getPath(const PackEntry & entry) const;
+
+	// Throws when the entry is corrupt
+	FileView read(const PackEntry & entry) const;
+
+	bool readFile(const std::string & filename, FILE_ACCESS_HINT hint, FileView & view) override;
+	bool locateFile(const std::string & filename, FileLocation & location) override;
+
+	// Decompresses and hashes every entry on the job system, false on the first mismatch
+	bool verify() const;
+
+	// Calls visit(entry) for every entry, in directory order
+	template <typename Visit>
+	void forEachEntry(const Visit & visit) const;
+
+	// Paths in the pack use forward slashes and no leading "./", lookups go through this too
+	static std::string normalizePath(const std::string & path);
+
+	// Opens and mounts the pack when the file exists, nullptr otherwise
+	static std::shared_ptr<PackFile> mount(const std::string & filename);
+
+private:
+	// stored is the entry's storedSize bytes, wherever they were read from
+	static FileView decompress(const PackEntry & entry, uint32_t blockSize, const uint8_t * stored, const std::string & path);
+
+	FileView m_file;
+	std::string m_filename;
+
+	const PackFileHeader * m_pHeader;
+	const PackEntry * m_pDirectory;
+	const char * m_pStrings;
+};
+
+// Builds a pack. Files are only read and compressed by write(), one at a time with the blocks
+// spread over the job system, so packing a large tree never holds more than one file in memory.
+class PackBuilder
+{
+public:
+	PackBuilder();
+	virtual ~PackBuilder();
+
+	PackBuilder(const PackBuilder &) = delete;
+	void operator=(const PackBuilder &) = delete;
+
+	// path is what readFile will be asked for, sourceFilename where the data comes from. Throws
+	// when path can't be looked up, i.e. it is absolute or climbs out with ".."
+	void addFile(const std::string & path, const std::string & sourceFilename, bool compress = true, uint32_t alignment = PACK_DEFAULT_ALIGNMENT);
+
+	// Data that isn't on disk, the view keeps it alive until write()
+	void addData(const std::string & path, const FileView & data, bool compress = true, uint32_t alignment = PACK_DEFAULT_ALIGNMENT);
+
+	// Every file below directory as prefix/ + its path relative to directory, returns how many were added
+	size_t addDirectory(const std::string & directory, const std::string & prefix = "", bool compress = true);
+
+	// Writes to a temporary next to filename and renames it over, so readers never see half a file
+	void write(const std::string & filename);
+
+	void clear();
+
+	size_t getEntryCount() const { return m_entries.size(); }
+
+private:
+	struct Entry
+	{
+		std::string path;
+		std::string sourceFilename;
+		FileView data;
+		bool bCompress;
+		uint32_t alignment;
+	};
+
+	std::vector<Entry> m_entries;
+};
+
+template <typename Visit>
+void PackFile::forEachEntry(const Visit & visit) const
+{
+	if (!this->isOpen())
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < m_pHeader->directoryCapacity; i++)
+	{
+		if (m_pDirectory[i].flags & PACK_ENTRY_USED)
+		{
+			visit(m_pDirectory[i]);
+		}
+	}
+}
+
+#endif
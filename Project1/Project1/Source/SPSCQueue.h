@@ -0,0 +1,84 @@
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+// Bounded lock-free single producer / single consumer queue.
+// Exactly one thread may push and exactly one (possibly different) thread may pop.
+template <typename T>
+class SPSCQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit SPSCQueue(size_t capacity)
+	: m_head(0)
+	, m_tail(0)
+	{
+		m_capacity = 1;
+		while (m_capacity < capacity)
+		{
+			m_capacity <<= 1;
+		}
+
+		m_mask = m_capacity - 1;
+		m_items.reset(new T[m_capacity]);
+	}
+
+	SPSCQueue(const SPSCQueue &) = delete;
+	void operator=(const SPSCQueue &) = delete;
+
+	// Producer only, fails when full
+	bool push(const T & item)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+
+		if (tail - m_head.load(std::memory_order_acquire) >= m_capacity)
+		{
+			return false;
+		}
+
+		m_items[tail & m_mask] = item;
+		m_tail.store(tail + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Consumer only, fails when empty
+	bool pop(T & item)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+
+		if (head == m_tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		item = m_items[head & m_mask];
+		m_head.store(head + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Approximate when called from anything but the consumer
+	bool isEmpty() const
+	{
+		return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+	}
+
+	size_t getCapacity() const { return m_capacity; }
+
+private:
+	// Producer and consumer indices on separate cache lines
+	std::atomic<size_t> m_head;
+	char m_padding0[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_tail;
+	char m_padding1[64 - sizeof(std::atomic<size_t>)];
+
+	std::unique_ptr<T[]> m_items;
+	size_t m_capacity;
+	size_t m_mask;
+};
+
+#endif
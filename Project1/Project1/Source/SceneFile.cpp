@@ -0,0 +1,350 @@
+#include "SceneFile.h"
+#include "JobSystem.h"
+#include "Hash.h"
+
+#include <fstream>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+namespace
+{
+	const char SCENE_FILE_MAGIC[4] = { 'V', 'S', 'C', 'N' };
+
+	uint64_t alignOffset(uint64_t offset)
+	{
+		return (offset + SCENE_SECTION_ALIGNMENT - 1) & ~(uint64_t)(SCENE_SECTION_ALIGNMENT - 1);
+	}
+
+	uint64_t hashHeader(const SceneFileHeader & header)
+	{
+		SceneFileHeader copy = header;
+		copy.headerChecksum = 0;
+		return Hash::hash64(&copy, sizeof(copy));
+	}
+}
+
+SceneFile::SceneFile()
+: m_pData(nullptr)
+, m_uiSize(0)
+, m_pHeader(nullptr)
+, m_pSections(nullptr)
+, m_pStrings(nullptr)
+, m_uiStringsSize(0)
+{
+}
+
+SceneFile::~SceneFile()
+{
+	this->close();
+}
+
+void SceneFile::open(const std::string & filename, bool verifyChecksums)
+{
+	this->close();
+
+	// Sections are read where they are needed rather than front to back
+	m_file = FileView::open(filename, FILE_ACCESS_RANDOM);
+	m_pData = m_file.data();
+	m_uiSize = m_file.size();
+
+	m_filename = filename;
+
+	try
+	{
+		if (m_uiSize < sizeof(SceneFileHeader))
+		{
+			throw std::runtime_error(filename + " is too small to be a scene file!");
+		}
+
+		m_pHeader = reinterpret_cast<const SceneFileHeader *>(m_pData);
+
+		if (memcmp(m_pHeader->magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) != 0)
+		{
+			throw std::runtime_error(filename + " is not a scene file!");
+		}
+
+		if (m_pHeader->version != SCENE_FILE_VERSION)
+		{
+			throw std::runtime_error(filename + " is scene file version " + std::to_string(m_pHeader->version) + ", expected " + std::to_string(SCENE_FILE_VERSION) + "!");
+		}
+
+		if (m_pHeader->headerSize != sizeof(SceneFileHeader) || m_pHeader->headerChecksum != hashHeader(*m_pHeader))
+		{
+			throw std::runtime_error(filename + " has a corrupt scene file header!");
+		}
+
+		if (m_pHeader->fileSize != m_uiSize)
+		{
+			throw std::runtime_error(filename + " is truncated!");
+		}
+
+		uint64_t tableSize = (uint64_t)m_pHeader->sectionCount * sizeof(SceneSectionEntry);
+		if (tableSize > m_uiSize - sizeof(SceneFileHeader))
+		{
+			throw std::runtime_error(filename + " has a corrupt section table!");
+		}
+
+		m_pSections = reinterpret_cast<const SceneSectionEntry *>(m_pData + sizeof(SceneFileHeader));
+
+		if (Hash::hash64(m_pSections, (size_t)tableSize) != m_pHeader->sectionTableChecksum)
+		{
+			throw std::runtime_error(filename + " has a corrupt section table!");
+		}
+
+		// Every section has to lie inside the file and be aligned for its elements
+		for (uint32_t i = 0; i < m_pHeader->sectionCount; i++)
+		{
+			const SceneSectionEntry & section = m_pSections[i];
+
+			if (section.count == 0)
+			{
+				continue;
+			}
+
+			if (section.elementSize == 0 || section.offset % SCENE_SECTION_ALIGNMENT != 0 || section.offset > m_uiSize ||
+				section.count > (m_uiSize - section.offset) / section.elementSize)
+			{
+				throw std::runtime_error(filename + " has a section outside the file!");
+			}
+		}
+
+		const SceneSectionEntry * strings = this->findSection(SCENE_SECTION_STRINGS);
+		if (strings && strings->count > 0)
+		{
+			m_pStrings = reinterpret_cast<const char *>(m_pData + strings->offset);
+			m_uiStringsSize = (size_t)strings->count;
+
+			if (m_pStrings[m_uiStringsSize - 1] != '\0')
+			{
+				throw std::runtime_error(filename + " has an unterminated string section!");
+			}
+		}
+
+		if (verifyChecksums && !this->verify())
+		{
+			throw std::runtime_error(filename + " failed its checksum, the file is corrupt!");
+		}
+	}
+	catch (...)
+	{
+		this->close();
+		throw;
+	}
+}
+
+void SceneFile::close()
+{
+	m_file.reset();
+	m_pData = nullptr;
+	m_uiSize = 0;
+
+	m_filename.clear();
+	m_pHeader = nullptr;
+	m_pSections = nullptr;
+	m_pStrings = nullptr;
+	m_uiStringsSize = 0;
+}
+
+void SceneFile::swap(SceneFile & other)
+{
+	std::swap(m_file, other.m_file);
+	std::swap(m_pData, other.m_pData);
+	std::swap(m_uiSize, other.m_uiSize);
+
+	std::swap(m_filename, other.m_filename);
+	std::swap(m_pHeader, other.m_pHeader);
+	std::swap(m_pSections, other.m_pSections);
+	std::swap(m_pStrings, other.m_pStrings);
+	std::swap(m_uiStringsSize, other.m_uiStringsSize);
+}
+
+bool SceneFile::verify() const
+{
+	std::atomic<bool> valid(true);
+
+	JobSystem::getInstance().parallelFor(0, m_pHeader->sectionCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end && valid.load(std::memory_order_relaxed); i++)
+		{
+			const SceneSectionEntry & section = m_pSections[i];
+			size_t size = (size_t)(section.count * section.elementSize);
+
+			if (Hash::hash64(m_pData + section.offset, size) != section.checksum)
+			{
+				valid.store(false, std::memory_order_relaxed);
+			}
+		}
+	});
+
+	return valid.load();
+}
+
+const SceneSectionEntry * SceneFile::findSection(uint32_t type) const
+{
+	for (uint32_t i = 0; i < m_pHeader->sectionCount; i++)
+	{
+		if (m_pSections[i].type == type)
+		{
+			return &m_pSections[i];
+		}
+	}
+
+	return nullptr;
+}
+
+const char * SceneFile::getString(uint32_t offset) const
+{
+	if (offset == SCENE_NO_STRING)
+	{
+		return nullptr;
+	}
+
+	if (offset >= m_uiStringsSize)
+	{
+		throw std::runtime_error("Scene file string offset is out of range!");
+	}
+
+	return m_pStrings + offset;
+}
+
+SceneWriter::SceneWriter()
+{
+}
+
+SceneWriter::~SceneWriter()
+{
+
+}
+
+void SceneWriter::addSection(uint32_t type, uint32_t elementSize, const void * data, size_t count)
+{
+	if (type == SCENE_SECTION_STRINGS && !m_strings.empty())
+	{
+		throw std::runtime_error("Scene writer already has strings from addString!");
+	}
+
+	for (const auto & section : m_sections)
+	{
+		if (section.type == type)
+		{
+			throw std::runtime_error("Scene file section " + std::to_string(type) + " was added twice!");
+		}
+	}
+
+	m_sections.push_back({ type, elementSize, data, count });
+}
+
+uint32_t SceneWriter::addString(const std::string & text)
+{
+	auto it = m_stringOffsets.find(text);
+	if (it != m_stringOffsets.end())
+	{
+		return it->second;
+	}
+
+	uint32_t offset = (uint32_t)m_strings.size();
+	m_strings.insert(m_strings.end(), text.begin(), text.end());
+	m_strings.push_back('\0');
+
+	m_stringOffsets.emplace(text, offset);
+	return offset;
+}
+
+void SceneWriter::write(const std::string & filename)
+{
+	std::vector<Section> sections = m_sections;
+	if (!m_strings.empty())
+	{
+		sections.push_back({ SCENE_SECTION_STRINGS, 1, m_strings.data(), m_strings.size() });
+	}
+
+	std::vector<SceneSectionEntry> table(sections.size());
+
+	uint64_t offset = alignOffset(sizeof(SceneFileHeader) + table.size() * sizeof(SceneSectionEntry));
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		table[i].type = sections[i].type;
+		table[i].elementSize = sections[i].elementSize;
+		table[i].count = sections[i].count;
+		table[i].offset = sections[i].count > 0 ? offset : 0;
+
+		offset = alignOffset(offset + sections[i].count * sections[i].elementSize);
+	}
+
+	// The sections are the bulk of the file, hash them side by side
+	JobSystem::getInstance().parallelFor(0, sections.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			table[i].checksum = Hash::hash64(sections[i].data, sections[i].count * sections[i].elementSize);
+		}
+	});
+
+	SceneFileHeader header;
+	memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC));
+	header.version = SCENE_FILE_VERSION;
+	header.headerSize = sizeof(SceneFileHeader);
+	header.sectionCount = (uint32_t)table.size();
+	header.fileSize = offset;
+	header.sectionTableChecksum = Hash::hash64(table.data(), table.size() * sizeof(SceneSectionEntry));
+	header.headerChecksum = hashHeader(header);
+
+	std::string temporary = filename + ".tmp";
+	std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open " + temporary + " for writing!");
+	}
+
+	static const char padding[SCENE_SECTION_ALIGNMENT] = {};
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(SceneSectionEntry));
+
+	uint64_t written = sizeof(header) + table.size() * sizeof(SceneSectionEntry);
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		if (sections[i].count == 0)
+		{
+			continue;
+		}
+
+		file.write(padding, (std::streamsize)(table[i].offset - written));
+		file.write(static_cast<const char *>(sections[i].data), (std::streamsize)(sections[i].count * sections[i].elementSize));
+		written = table[i].offset + sections[i].count * sections[i].elementSize;
+	}
+	file.write(padding, (std::streamsize)(header.fileSize - written));
+
+	file.close();
+	if (file.fail())
+	{
+		std::remove(temporary.c_str());
+		throw std::runtime_error("Failed to write " + temporary + "!");
+	}
+
+#ifdef _WIN32
+	BOOL renamed = MoveFileExA(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	bool renamed = std::rename(temporary.c_str(), filename.c_str()) == 0;
+#endif
+	if (!renamed)
+	{
+		std::remove(temporary.c_str());
+		throw std::runtime_error("Failed to replace " + filename + ", is it still open?");
+	}
+}
+
+void SceneWriter::clear()
+{
+	m_sections.clear();
+	m_strings.clear();
+	m_stringOffsets.clear();
+}
@@ -0,0 +1,213 @@
+#ifndef __SCENE_FILE_H__
+#define __SCENE_FILE_H__
+
+#include "Transform.h"
+#include "FileReader.h"
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec3.hpp>
+#include <vec4.hpp>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <type_traits>
+#include <stdexcept>
+#include <stdint.h>
+
+#define SCENE_FILE_VERSION 1 // Bump whenever a section's layout changes, older readers refuse newer files
+#define SCENE_SECTION_ALIGNMENT 64 // Every section starts on a cache line, the mapping itself is page aligned
+#define SCENE_NO_STRING 0xFFFFFFFFu
+#define SCENE_NO_INDEX 0xFFFFFFFFu
+
+// Section types. Each one is a plain array laid out exactly like the runtime array it is loaded into.
+enum SCENE_SECTION
+{
+	SCENE_SECTION_TRANSFORM_POSITIONS = 1, // glm::vec3, TransformHierarchy order (sorted by depth)
+	SCENE_SECTION_TRANSFORM_ROTATIONS, // glm::quat
+	SCENE_SECTION_TRANSFORM_SCALES, // glm::vec3
+	SCENE_SECTION_TRANSFORM_PARENTS, // uint32_t index of the parent, SCENE_NO_INDEX for roots
+	SCENE_SECTION_TRANSFORM_LEVELS, // uint32_t, level n is [levels[n], levels[n + 1])
+	SCENE_SECTION_ENTITY_TRANSFORMS, // uint32_t transform index per entity
+	SCENE_SECTION_ENTITY_MESHES, // uint32_t index into SCENE_SECTION_MESHES
+	SCENE_SECTION_ENTITY_MATERIALS, // uint32_t index into SCENE_SECTION_MATERIALS
+	SCENE_SECTION_MESHES, // SceneMesh
+	SCENE_SECTION_MATERIALS, // SceneMaterial
+	SCENE_SECTION_STRINGS, // char, null terminated strings referred to by offset
+};
+
+// File layout, little endian throughout
+//   SceneFileHeader
+//   SceneSectionEntry[sectionCount]
+//   sections, each padded to SCENE_SECTION_ALIGNMENT
+// Every offset is relative to the start of the file (strings: to the start of the string section),
+// so the file can be mapped anywhere and used in place.
+struct SceneFileHeader
+{
+	char magic[4]; // "VSCN"
+	uint32_t version;
+	uint32_t headerSize; // sizeof(SceneFileHeader)
+	uint32_t sectionCount;
+	uint64_t fileSize;
+	uint64_t sectionTableChecksum; // Hash::hash64 of the section table
+	uint64_t headerChecksum; // Hash::hash64 of the header with this field zeroed
+};
+
+struct SceneSectionEntry
+{
+	uint32_t type;
+	uint32_t elementSize;
+	uint64_t offset;
+	uint64_t count;
+	uint64_t checksum; // Hash::hash64 of the section's count * elementSize bytes
+};
+
+struct SceneMesh
+{
+	uint32_t path; // String offset
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t flags;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+struct SceneMaterial
+{
+	glm::vec4 baseColor;
+	float metallic;
+	float roughness;
+	uint32_t albedoTexture; // String offsets, SCENE_NO_STRING when unused
+	uint32_t normalTexture;
+};
+
+static_assert(sizeof(SceneFileHeader) == 40 && sizeof(SceneSectionEntry) == 32, "Scene file header layout changed, bump SCENE_FILE_VERSION");
+static_assert(sizeof(SceneMesh) == 40 && sizeof(SceneMaterial) == 32, "Scene file section layout changed, bump SCENE_FILE_VERSION");
+
+// The entity table's row as an ECS component
+struct SceneObject
+{
+	TransformHandle transform;
+	uint32_t meshId;
+	uint32_t materialId;
+};
+
+// Read only view of a scene file. The file is memory mapped rather than read, sections are handed
+// out as pointers into the mapping, so opening costs a few header checks and the data is only
+// paged in as it gets touched.
+class SceneFile
+{
+public:
+	SceneFile();
+	virtual ~SceneFile();
+
+	SceneFile(const SceneFile &) = delete;
+	void operator=(const SceneFile &) = delete;
+
+	// Checks the header and section table, the section checksums only when verifyChecksums is set
+	// since that reads the whole file
+	void open(const std::string & filename, bool verifyChecksums = false);
+	void close();
+
+	// Lets a file be opened and checked on the side, then put in place in one step
+	void swap(SceneFile & other);
+
+	bool isOpen() const { return m_pData != nullptr; }
+	const std::string & getFilename() const { return m_filename; }
+	uint32_t getVersion() const { return m_pHeader->version; }
+	size_t getSize() const { return m_uiSize; }
+
+	// Hashes every section on the job system, false on the first mismatch
+	bool verify() const;
+
+	// nullptr when the file doesn't have the section
+	const SceneSectionEntry * findSection(uint32_t type) const;
+
+	// nullptr and a count of 0 when the section is missing or empty, throws when the element size doesn't match T
+	template <typename T>
+	const T * getSection(uint32_t type, size_t & count) const;
+
+	// nullptr for SCENE_NO_STRING
+	const char * getString(uint32_t offset) const;
+
+private:
+	FileView m_file;
+	const uint8_t * m_pData; // m_file's contents
+
+	size_t m_uiSize;
+	std::string m_filename;
+
+	const SceneFileHeader * m_pHeader;
+	const SceneSectionEntry * m_pSections;
+	const char * m_pStrings;
+	size_t m_uiStringsSize;
+};
+
+// Collects sections and writes them out as a scene file. Section data is only referenced, it
+// has to stay alive until write() returns.
+class SceneWriter
+{
+public:
+	SceneWriter();
+	virtual ~SceneWriter();
+
+	SceneWriter(const SceneWriter &) = delete;
+	void operator=(const SceneWriter &) = delete;
+
+	void addSection(uint32_t type, uint32_t elementSize, const void * data, size_t count);
+
+	template <typename T>
+	void addSection(uint32_t type, const T * data, size_t count)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Scene sections must be plain data");
+		this->addSection(type, sizeof(T), data, count);
+	}
+
+	template <typename T>
+	void addSection(uint32_t type, const std::vector<T> & data) { this->addSection(type, data.data(), data.size()); }
+
+	// Offset into the string section the writer builds, identical strings are stored once
+	uint32_t addString(const std::string & text);
+
+	// Writes to a temporary next to filename and renames it over, so readers never see half a file
+	void write(const std::string & filename);
+
+	void clear();
+
+private:
+	struct Section
+	{
+		uint32_t type;
+		uint32_t elementSize;
+		const void * data;
+		size_t count;
+	};
+
+	std::vector<Section> m_sections;
+	std::vector<char> m_strings;
+	std::unordered_map<std::string, uint32_t> m_stringOffsets;
+};
+
+template <typename T>
+const T * SceneFile::getSection(uint32_t type, size_t & count) const
+{
+	count = 0;
+
+	const SceneSectionEntry * section = this->findSection(type);
+	if (!section || section->count == 0)
+	{
+		return nullptr;
+	}
+
+	if (section->elementSize != sizeof(T))
+	{
+		throw std::runtime_error("Scene file section " + std::to_string(type) + " doesn't have the expected element size!");
+	}
+
+	count = (size_t)section->count;
+	return reinterpret_cast<const T *>(m_pData + section->offset);
+}
+
+#endif
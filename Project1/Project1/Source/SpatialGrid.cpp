@@ -0,0 +1,507 @@
+#include "SpatialGrid.h"
+
+#include <geometric.hpp>
+#include <common.hpp>
+#include <vector_relational.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <cmath>
+#include <cfloat>
+
+#define SPATIAL_GRID_KEY_BITS 21 // Per axis, three of them pack into one 64 bit key
+#define SPATIAL_GRID_KEY_BIAS (1 << (SPATIAL_GRID_KEY_BITS - 1))
+
+namespace
+{
+	inline bool overlaps(const glm::vec3 & minA, const glm::vec3 & maxA, const glm::vec3 & minB, const glm::vec3 & maxB)
+	{
+		return glm::all(glm::lessThanEqual(minA, maxB)) && glm::all(glm::lessThanEqual(minB, maxA));
+	}
+
+	inline bool contains(const glm::ivec3 & cellMin, const glm::ivec3 & cellMax, const glm::ivec3 & cell)
+	{
+		return glm::all(glm::lessThanEqual(cellMin, cell)) && glm::all(glm::lessThanEqual(cell, cellMax));
+	}
+
+	inline glm::ivec3 decodeCellKey(uint64_t key)
+	{
+		const uint64_t mask = (1ull << SPATIAL_GRID_KEY_BITS) - 1;
+		return glm::ivec3(
+			(int)((key >> (SPATIAL_GRID_KEY_BITS * 2)) & mask) - SPATIAL_GRID_KEY_BIAS,
+			(int)((key >> SPATIAL_GRID_KEY_BITS) & mask) - SPATIAL_GRID_KEY_BIAS,
+			(int)(key & mask) - SPATIAL_GRID_KEY_BIAS);
+	}
+
+	// Point where three planes meet
+	inline glm::vec3 intersectPlanes(const glm::vec4 & a, const glm::vec4 & b, const glm::vec4 & c)
+	{
+		glm::vec3 na(a), nb(b), nc(c);
+		glm::vec3 bc = glm::cross(nb, nc);
+		return -(a.w * bc + b.w * glm::cross(nc, na) + c.w * glm::cross(na, nb)) / glm::dot(na, bc);
+	}
+}
+
+SpatialGrid::SpatialGrid(float cellSize)
+: m_fCellSize(cellSize)
+, m_fInverseCellSize(1.0f / cellSize)
+, m_uiObjectCount(0)
+{
+	if (cellSize <= 0.0f)
+	{
+		throw std::runtime_error("Spatial grid cell size has to be positive!");
+	}
+}
+
+SpatialGrid::~SpatialGrid()
+{
+
+}
+
+uint64_t SpatialGrid::getCellKey(const glm::ivec3 & cell)
+{
+	const uint64_t mask = (1ull << SPATIAL_GRID_KEY_BITS) - 1;
+	return ((uint64_t)(cell.x + SPATIAL_GRID_KEY_BIAS) & mask) << (SPATIAL_GRID_KEY_BITS * 2) |
+		((uint64_t)(cell.y + SPATIAL_GRID_KEY_BIAS) & mask) << SPATIAL_GRID_KEY_BITS |
+		((uint64_t)(cell.z + SPATIAL_GRID_KEY_BIAS) & mask);
+}
+
+glm::ivec3 SpatialGrid::getCell(const glm::vec3 & position) const
+{
+	// Clamped so far away positions pile into the border cells instead of wrapping around the key
+	glm::vec3 cell = glm::clamp(glm::floor(position * m_fInverseCellSize), glm::vec3((float)-SPATIAL_GRID_KEY_BIAS), glm::vec3((float)(SPATIAL_GRID_KEY_BIAS - 1)));
+	return glm::ivec3(cell);
+}
+
+bool SpatialGrid::isOversized(const glm::ivec3 & cellMin, const glm::ivec3 & cellMax) const
+{
+	glm::ivec3 size = cellMax - cellMin + glm::ivec3(1);
+	return (int64_t)size.x * size.y * size.z > SPATIAL_GRID_MAX_OBJECT_CELLS;
+}
+
+void SpatialGrid::addToCells(SpatialProxy proxy, const glm::ivec3 & cellMin, const glm::ivec3 & cellMax, const glm::ivec3 * skipMin, const glm::ivec3 * skipMax)
+{
+	for (int x = cellMin.x; x <= cellMax.x; x++)
+	{
+		for (int y = cellMin.y; y <= cellMax.y; y++)
+		{
+			for (int z = cellMin.z; z <= cellMax.z; z++)
+			{
+				glm::ivec3 cell(x, y, z);
+				if (skipMin && contains(*skipMin, *skipMax, cell))
+				{
+					continue;
+				}
+
+				m_cells[getCellKey(cell)].push_back(proxy);
+			}
+		}
+	}
+}
+
+void SpatialGrid::removeFromCells(SpatialProxy proxy, const glm::ivec3 & cellMin, const glm::ivec3 & cellMax, const glm::ivec3 * keepMin, const glm::ivec3 * keepMax)
+{
+	for (int x = cellMin.x; x <= cellMax.x; x++)
+	{
+		for (int y = cellMin.y; y <= cellMax.y; y++)
+		{
+			for (int z = cellMin.z; z <= cellMax.z; z++)
+			{
+				glm::ivec3 cell(x, y, z);
+				if (keepMin && contains(*keepMin, *keepMax, cell))
+				{
+					continue;
+				}
+
+				auto found = m_cells.find(getCellKey(cell));
+				if (found == m_cells.end())
+				{
+					continue;
+				}
+
+				this->removeFromList(found->second, proxy);
+				if (found->second.empty())
+				{
+					m_cells.erase(found);
+				}
+			}
+		}
+	}
+}
+
+void SpatialGrid::removeFromList(std::vector<SpatialProxy> & list, SpatialProxy proxy)
+{
+	auto found = std::find(list.begin(), list.end(), proxy);
+	if (found != list.end())
+	{
+		*found = list.back();
+		list.pop_back();
+	}
+}
+
+SpatialProxy SpatialGrid::insert(const glm::vec3 & min, const glm::vec3 & max, uint32_t userData)
+{
+	std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	SpatialProxy proxy;
+	if (!m_freeProxies.empty())
+	{
+		proxy = m_freeProxies.back();
+		m_freeProxies.pop_back();
+	}
+	else
+	{
+		proxy = (SpatialProxy)m_objects.size();
+		m_objects.push_back(SpatialObject());
+	}
+
+	SpatialObject & object = m_objects[proxy];
+	object.boundsMin = min;
+	object.boundsMax = max;
+	object.cellMin = this->getCell(min);
+	object.cellMax = this->getCell(max);
+	object.userData = userData;
+	object.bAlive = true;
+	object.bOversized = this->isOversized(object.cellMin, object.cellMax);
+
+	if (object.bOversized)
+	{
+		m_oversized.push_back(proxy);
+	}
+	else
+	{
+		this->addToCells(proxy, object.cellMin, object.cellMax, nullptr, nullptr);
+	}
+
+	m_uiObjectCount++;
+
+	return proxy;
+}
+
+void SpatialGrid::move(SpatialProxy proxy, const glm::vec3 & min, const glm::vec3 & max)
+{
+	std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	if (proxy >= m_objects.size() || !m_objects[proxy].bAlive)
+	{
+		throw std::runtime_error("Moving a spatial grid proxy that doesn't exist!");
+	}
+
+	SpatialObject & object = m_objects[proxy];
+	object.boundsMin = min;
+	object.boundsMax = max;
+
+	glm::ivec3 cellMin = this->getCell(min);
+	glm::ivec3 cellMax = this->getCell(max);
+
+	// The common case, still inside the same cells
+	if (cellMin == object.cellMin && cellMax == object.cellMax)
+	{
+		return;
+	}
+
+	bool oversized = this->isOversized(cellMin, cellMax);
+
+	if (object.bOversized && oversized)
+	{
+		// Still not in any cell
+	}
+	else if (object.bOversized)
+	{
+		this->removeFromList(m_oversized, proxy);
+		this->addToCells(proxy, cellMin, cellMax, nullptr, nullptr);
+	}
+	else if (oversized)
+	{
+		this->removeFromCells(proxy, object.cellMin, object.cellMax, nullptr, nullptr);
+		m_oversized.push_back(proxy);
+	}
+	else
+	{
+		// Only the cells it left and the ones it entered change
+		this->removeFromCells(proxy, object.cellMin, object.cellMax, &cellMin, &cellMax);
+		this->addToCells(proxy, cellMin, cellMax, &object.cellMin, &object.cellMax);
+	}
+
+	object.cellMin = cellMin;
+	object.cellMax = cellMax;
+	object.bOversized = oversized;
+}
+
+void SpatialGrid::remove(SpatialProxy proxy)
+{
+	std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	if (proxy >= m_objects.size() || !m_objects[proxy].bAlive)
+	{
+		return;
+	}
+
+	SpatialObject & object = m_objects[proxy];
+
+	if (object.bOversized)
+	{
+		this->removeFromList(m_oversized, proxy);
+	}
+	else
+	{
+		this->removeFromCells(proxy, object.cellMin, object.cellMax, nullptr, nullptr);
+	}
+
+	object.bAlive = false;
+	m_freeProxies.push_back(proxy);
+	m_uiObjectCount--;
+}
+
+void SpatialGrid::clear()
+{
+	std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	m_objects.clear();
+	m_freeProxies.clear();
+	m_oversized.clear();
+	m_cells.clear();
+	m_uiObjectCount = 0;
+}
+
+bool SpatialGrid::isValid(SpatialProxy proxy) const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+	return proxy < m_objects.size() && m_objects[proxy].bAlive;
+}
+
+uint32_t SpatialGrid::getUserData(SpatialProxy proxy) const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+	return m_objects[proxy].userData;
+}
+
+void SpatialGrid::getBounds(SpatialProxy proxy, glm::vec3 & min, glm::vec3 & max) const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+	min = m_objects[proxy].boundsMin;
+	max = m_objects[proxy].boundsMax;
+}
+
+size_t SpatialGrid::getObjectCount() const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+	return m_uiObjectCount;
+}
+
+size_t SpatialGrid::getCellCount() const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+	return m_cells.size();
+}
+
+template <typename Visit>
+void SpatialGrid::visitRegion(const glm::ivec3 & cellMin, const glm::ivec3 & cellMax, const Visit & visit) const
+{
+	// An object spanning several cells of the region is only reported from the first one, the cell
+	// at the max of its own and the region's lowest cell. That avoids any per query visited set.
+	auto visitCell = [&](const glm::ivec3 & cell, const std::vector<SpatialProxy> & proxies)
+	{
+		for (SpatialProxy proxy : proxies)
+		{
+			if (glm::max(m_objects[proxy].cellMin, cellMin) == cell)
+			{
+				visit(proxy);
+			}
+		}
+	};
+
+	glm::ivec3 size = cellMax - cellMin + glm::ivec3(1);
+	int64_t regionCells = (int64_t)size.x * size.y * size.z;
+
+	if (regionCells > (int64_t)m_cells.size())
+	{
+		// Cheaper to walk the occupied cells than the empty ones in a huge region
+		for (const auto & cell : m_cells)
+		{
+			glm::ivec3 coordinate = decodeCellKey(cell.first);
+			if (contains(cellMin, cellMax, coordinate))
+			{
+				visitCell(coordinate, cell.second);
+			}
+		}
+	}
+	else
+	{
+		for (int x = cellMin.x; x <= cellMax.x; x++)
+		{
+			for (int y = cellMin.y; y <= cellMax.y; y++)
+			{
+				for (int z = cellMin.z; z <= cellMax.z; z++)
+				{
+					glm::ivec3 coordinate(x, y, z);
+					auto found = m_cells.find(getCellKey(coordinate));
+					if (found != m_cells.end())
+					{
+						visitCell(coordinate, found->second);
+					}
+				}
+			}
+		}
+	}
+
+	for (SpatialProxy proxy : m_oversized)
+	{
+		visit(proxy);
+	}
+}
+
+size_t SpatialGrid::queryBox(const glm::vec3 & min, const glm::vec3 & max, std::vector<SpatialProxy> & results) const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	size_t startSize = results.size();
+
+	this->visitRegion(this->getCell(min), this->getCell(max), [&](SpatialProxy proxy)
+	{
+		const SpatialObject & object = m_objects[proxy];
+		if (overlaps(object.boundsMin, object.boundsMax, min, max))
+		{
+			results.push_back(proxy);
+		}
+	});
+
+	return results.size() - startSize;
+}
+
+size_t SpatialGrid::querySphere(const glm::vec3 & center, float radius, std::vector<SpatialProxy> & results) const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	size_t startSize = results.size();
+	float radiusSquared = radius * radius;
+
+	this->visitRegion(this->getCell(center - glm::vec3(radius)), this->getCell(center + glm::vec3(radius)), [&](SpatialProxy proxy)
+	{
+		const SpatialObject & object = m_objects[proxy];
+		glm::vec3 offset = center - glm::clamp(center, object.boundsMin, object.boundsMax);
+		if (glm::dot(offset, offset) <= radiusSquared)
+		{
+			results.push_back(proxy);
+		}
+	});
+
+	return results.size() - startSize;
+}
+
+size_t SpatialGrid::queryFrustum(const Frustum & frustum, std::vector<SpatialProxy> & results) const
+{
+	// Bounding box of the eight corners, then the exact plane test per object
+	glm::vec3 frustumMin(FLT_MAX), frustumMax(-FLT_MAX);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 point = intersectPlanes(
+			frustum.planes[(corner & 1) ? FRUSTUM_PLANE_RIGHT : FRUSTUM_PLANE_LEFT],
+			frustum.planes[(corner & 2) ? FRUSTUM_PLANE_TOP : FRUSTUM_PLANE_BOTTOM],
+			frustum.planes[(corner & 4) ? FRUSTUM_PLANE_FAR : FRUSTUM_PLANE_NEAR]);
+
+		frustumMin = glm::min(frustumMin, point);
+		frustumMax = glm::max(frustumMax, point);
+	}
+
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	size_t startSize = results.size();
+
+	this->visitRegion(this->getCell(frustumMin), this->getCell(frustumMax), [&](SpatialProxy proxy)
+	{
+		const SpatialObject & object = m_objects[proxy];
+		if (frustum.intersectsBox((object.boundsMin + object.boundsMax) * 0.5f, (object.boundsMax - object.boundsMin) * 0.5f))
+		{
+			results.push_back(proxy);
+		}
+	});
+
+	return results.size() - startSize;
+}
+
+size_t SpatialGrid::queryNeighbors(SpatialProxy proxy, float radius, std::vector<SpatialProxy> & results) const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	if (proxy >= m_objects.size() || !m_objects[proxy].bAlive)
+	{
+		return 0;
+	}
+
+	glm::vec3 min = m_objects[proxy].boundsMin - glm::vec3(radius);
+	glm::vec3 max = m_objects[proxy].boundsMax + glm::vec3(radius);
+
+	size_t startSize = results.size();
+
+	this->visitRegion(this->getCell(min), this->getCell(max), [&](SpatialProxy other)
+	{
+		const SpatialObject & object = m_objects[other];
+		if (other != proxy && overlaps(object.boundsMin, object.boundsMax, min, max))
+		{
+			results.push_back(other);
+		}
+	});
+
+	return results.size() - startSize;
+}
+
+size_t SpatialGrid::findOverlappingPairs(std::vector<std::pair<SpatialProxy, SpatialProxy>> & pairs) const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+	size_t startSize = pairs.size();
+
+	for (const auto & cell : m_cells)
+	{
+		const std::vector<SpatialProxy> & proxies = cell.second;
+		if (proxies.size() < 2)
+		{
+			continue;
+		}
+
+		glm::ivec3 coordinate = decodeCellKey(cell.first);
+
+		for (size_t i = 0; i < proxies.size(); i++)
+		{
+			const SpatialObject & a = m_objects[proxies[i]];
+
+			for (size_t j = i + 1; j < proxies.size(); j++)
+			{
+				const SpatialObject & b = m_objects[proxies[j]];
+
+				// Two objects share a block of cells, only the lowest one reports them
+				if (glm::max(a.cellMin, b.cellMin) != coordinate || !overlaps(a.boundsMin, a.boundsMax, b.boundsMin, b.boundsMax))
+				{
+					continue;
+				}
+
+				pairs.push_back(std::make_pair(std::min<SpatialProxy>(proxies[i], proxies[j]), std::max<SpatialProxy>(proxies[i], proxies[j])));
+			}
+		}
+	}
+
+	for (SpatialProxy oversized : m_oversized)
+	{
+		const SpatialObject & a = m_objects[oversized];
+
+		for (SpatialProxy other = 0; other < (SpatialProxy)m_objects.size(); other++)
+		{
+			const SpatialObject & b = m_objects[other];
+
+			// Pairs of oversized objects come up twice, keep the one where this is the lower proxy
+			if (!b.bAlive || other == oversized || (b.bOversized && other < oversized))
+			{
+				continue;
+			}
+
+			if (overlaps(a.boundsMin, a.boundsMax, b.boundsMin, b.boundsMax))
+			{
+				pairs.push_back(std::make_pair(std::min<SpatialProxy>(oversized, other), std::max<SpatialProxy>(oversized, other)));
+			}
+		}
+	}
+
+	return pairs.size() - startSize;
+}
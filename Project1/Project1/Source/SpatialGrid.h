@@ -0,0 +1,98 @@
+#ifndef __SPATIAL_GRID_H__
+#define __SPATIAL_GRID_H__
+
+#include "Culling.h"
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec3.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <utility>
+#include <stdint.h>
+
+#define SPATIAL_GRID_DEFAULT_CELL_SIZE 4.0f // World units, roughly the size of a typical moving object
+#define SPATIAL_GRID_MAX_OBJECT_CELLS 64 // Objects covering more cells than this skip the grid and go in the oversized list
+#define SPATIAL_GRID_INVALID_PROXY 0xFFFFFFFFu
+
+typedef uint32_t SpatialProxy;
+
+// Sparse uniform grid for moving objects. Only occupied cells exist, found by hashing their
+// quantized glm::ivec3 coordinate. An object is listed in every cell its bounds overlap, so a
+// move that stays inside the same cells only rewrites its bounds.
+// Any number of threads can query at once; insert / move / remove take the lock exclusively.
+class SpatialGrid
+{
+public:
+	SpatialGrid(float cellSize = SPATIAL_GRID_DEFAULT_CELL_SIZE);
+	virtual ~SpatialGrid();
+
+	SpatialGrid(const SpatialGrid &) = delete;
+	void operator=(const SpatialGrid &) = delete;
+
+	SpatialProxy insert(const glm::vec3 & min, const glm::vec3 & max, uint32_t userData = 0);
+	void move(SpatialProxy proxy, const glm::vec3 & min, const glm::vec3 & max);
+	void remove(SpatialProxy proxy);
+	void clear();
+
+	bool isValid(SpatialProxy proxy) const;
+	uint32_t getUserData(SpatialProxy proxy) const;
+	void getBounds(SpatialProxy proxy, glm::vec3 & min, glm::vec3 & max) const;
+
+	// Proxies whose bounds touch the region, appended to results (each one once), returns how many were added
+	size_t queryBox(const glm::vec3 & min, const glm::vec3 & max, std::vector<SpatialProxy> & results) const;
+	size_t querySphere(const glm::vec3 & center, float radius, std::vector<SpatialProxy> & results) const;
+	size_t queryFrustum(const Frustum & frustum, std::vector<SpatialProxy> & results) const;
+
+	// Everything within radius of the proxy's bounds, not counting the proxy itself
+	size_t queryNeighbors(SpatialProxy proxy, float radius, std::vector<SpatialProxy> & results) const;
+
+	// Broadphase: every pair of proxies whose bounds overlap, each pair once with first < second
+	size_t findOverlappingPairs(std::vector<std::pair<SpatialProxy, SpatialProxy>> & pairs) const;
+
+	float getCellSize() const { return m_fCellSize; }
+	size_t getObjectCount() const;
+	size_t getCellCount() const;
+
+	glm::ivec3 getCell(const glm::vec3 & position) const;
+
+private:
+	struct SpatialObject
+	{
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::ivec3 cellMin;
+		glm::ivec3 cellMax;
+		uint32_t userData;
+		bool bAlive;
+		bool bOversized;
+	};
+
+	static uint64_t getCellKey(const glm::ivec3 & cell);
+
+	bool isOversized(const glm::ivec3 & cellMin, const glm::ivec3 & cellMax) const;
+	void addToCells(SpatialProxy proxy, const glm::ivec3 & cellMin, const glm::ivec3 & cellMax, const glm::ivec3 * skipMin, const glm::ivec3 * skipMax);
+	void removeFromCells(SpatialProxy proxy, const glm::ivec3 & cellMin, const glm::ivec3 & cellMax, const glm::ivec3 * keepMin, const glm::ivec3 * keepMax);
+	void removeFromList(std::vector<SpatialProxy> & list, SpatialProxy proxy);
+
+	// Calls visit(proxy) once for every proxy listed in a cell inside [cellMin, cellMax] or in the oversized list.
+	// Caller holds the shared lock.
+	template <typename Visit>
+	void visitRegion(const glm::ivec3 & cellMin, const glm::ivec3 & cellMax, const Visit & visit) const;
+
+	float m_fCellSize;
+	float m_fInverseCellSize;
+
+	std::vector<SpatialObject> m_objects; // Indexed by proxy
+	std::vector<SpatialProxy> m_freeProxies;
+	std::vector<SpatialProxy> m_oversized;
+	std::unordered_map<uint64_t, std::vector<SpatialProxy>> m_cells;
+	size_t m_uiObjectCount;
+
+	mutable std::shared_timed_mutex m_mutex;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <chrono>
+#include <stdint.h>
+
+// High resolution monotonic timer (QueryPerformanceCounter backed on MSVC)
+class Timer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	Timer()
+	: m_start(Clock::now())
+	{
+	}
+
+	// Time since start / last reset
+	double getElapsedSeconds() const
+	{
+		return std::chrono::duration<double>(Clock::now() - m_start).count();
+	}
+
+	void reset()
+	{
+		m_start = Clock::now();
+	}
+
+	// Returns the elapsed time and restarts the timer
+	double lap()
+	{
+		Clock::time_point now = Clock::now();
+		double elapsed = std::chrono::duration<double>(now - m_start).count();
+		m_start = now;
+		return elapsed;
+	}
+
+	// Absolute timestamps, only meaningful relative to each other
+	static int64_t getTimestampNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	static double getTimestampSeconds()
+	{
+		return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+	}
+
+private:
+	Clock::time_point m_start;
+};
+
+#endif
@@ -0,0 +1,434 @@
+#include "Transform.h"
+#include "JobSystem.h"
+
+#include <gtc/type_ptr.hpp>
+#include <simd/matrix.h>
+
+#include <stdexcept>
+#include <cstring>
+
+namespace
+{
+	const int32_t DEPTH_UNKNOWN = -1;
+	const int32_t DEPTH_DEAD = -2;
+
+	// Parent * local, with TRS composed straight into the columns
+	inline void composeWorld(const glm::mat4 * parent, const glm::vec3 & position, const glm::quat & rotation, const glm::vec3 & scale, glm::mat4 & world)
+	{
+		glm::mat3 basis = glm::mat3_cast(rotation);
+
+		glm::mat4 local;
+		local[0] = glm::vec4(basis[0] * scale.x, 0.0f);
+		local[1] = glm::vec4(basis[1] * scale.y, 0.0f);
+		local[2] = glm::vec4(basis[2] * scale.z, 0.0f);
+		local[3] = glm::vec4(position, 1.0f);
+
+		if (!parent)
+		{
+			world = local;
+			return;
+		}
+
+		const float * p = glm::value_ptr(*parent);
+		const float * l = glm::value_ptr(local);
+		float * out = glm::value_ptr(world);
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+		// Two output columns per 256 bit register, each lane picks its own column's elements
+		__m256 p0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(p + 0));
+		__m256 p1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(p + 4));
+		__m256 p2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(p + 8));
+		__m256 p3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(p + 12));
+
+		__m256 l01 = _mm256_loadu_ps(l + 0);
+		__m256 l23 = _mm256_loadu_ps(l + 8);
+
+		__m256 c01 = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(p0, _mm256_shuffle_ps(l01, l01, _MM_SHUFFLE(0, 0, 0, 0))), _mm256_mul_ps(p1, _mm256_shuffle_ps(l01, l01, _MM_SHUFFLE(1, 1, 1, 1)))),
+			_mm256_add_ps(_mm256_mul_ps(p2, _mm256_shuffle_ps(l01, l01, _MM_SHUFFLE(2, 2, 2, 2))), _mm256_mul_ps(p3, _mm256_shuffle_ps(l01, l01, _MM_SHUFFLE(3, 3, 3, 3)))));
+		__m256 c23 = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(p0, _mm256_shuffle_ps(l23, l23, _MM_SHUFFLE(0, 0, 0, 0))), _mm256_mul_ps(p1, _mm256_shuffle_ps(l23, l23, _MM_SHUFFLE(1, 1, 1, 1)))),
+			_mm256_add_ps(_mm256_mul_ps(p2, _mm256_shuffle_ps(l23, l23, _MM_SHUFFLE(2, 2, 2, 2))), _mm256_mul_ps(p3, _mm256_shuffle_ps(l23, l23, _MM_SHUFFLE(3, 3, 3, 3)))));
+
+		_mm256_storeu_ps(out + 0, c01);
+		_mm256_storeu_ps(out + 8, c23);
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+		// glm::mat4 is only 4 byte aligned unless GLM_FORCE_ALIGNED, so go through unaligned loads
+		glm_vec4 parentColumns[4] = { _mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), _mm_loadu_ps(p + 12) };
+		glm_vec4 localColumns[4] = { _mm_loadu_ps(l), _mm_loadu_ps(l + 4), _mm_loadu_ps(l + 8), _mm_loadu_ps(l + 12) };
+		glm_vec4 worldColumns[4];
+
+		glm_mat4_mul(parentColumns, localColumns, worldColumns);
+
+		_mm_storeu_ps(out, worldColumns[0]);
+		_mm_storeu_ps(out + 4, worldColumns[1]);
+		_mm_storeu_ps(out + 8, worldColumns[2]);
+		_mm_storeu_ps(out + 12, worldColumns[3]);
+#else
+		world = *parent * local;
+#endif
+	}
+}
+
+TransformHierarchy::TransformHierarchy()
+: m_uiDirtyCount(0)
+, m_uiDeadCount(0)
+, m_bOrderDirty(false)
+, m_bWorldChanged(false)
+{
+}
+
+TransformHierarchy::~TransformHierarchy()
+{
+
+}
+
+TransformHandle TransformHierarchy::createNode(TransformHandle parent, const glm::vec3 & position, const glm::quat & rotation, const glm::vec3 & scale)
+{
+	if (parent != INVALID_TRANSFORM && !this->isValid(parent))
+	{
+		throw std::runtime_error("Creating a transform under a parent that doesn't exist!");
+	}
+
+	TransformHandle handle;
+	if (!m_freeHandles.empty())
+	{
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	else
+	{
+		handle = (TransformHandle)m_indices.size();
+		m_indices.push_back(INVALID_TRANSFORM);
+	}
+
+	uint32_t index = (uint32_t)m_handles.size();
+	m_indices[handle] = index;
+
+	m_positions.push_back(position);
+	m_rotations.push_back(rotation);
+	m_scales.push_back(scale);
+	m_parents.push_back(parent != INVALID_TRANSFORM ? m_indices[parent] : INVALID_TRANSFORM);
+	m_localDirty.push_back(1);
+	m_worldChanged.push_back(0);
+	m_worldMatrices.push_back(glm::mat4(1.0f));
+	m_handles.push_back(handle);
+
+	m_uiDirtyCount++;
+
+	// Appended after its parent so the order still holds, only the level table is stale
+	m_bOrderDirty = true;
+
+	return handle;
+}
+
+void TransformHierarchy::destroyNode(TransformHandle node)
+{
+	if (!this->isValid(node))
+	{
+		return;
+	}
+
+	// Children go with it at the next update, the slot is compacted away then too
+	uint32_t index = m_indices[node];
+	m_handles[index] = INVALID_TRANSFORM;
+	m_indices[node] = INVALID_TRANSFORM;
+	m_freeHandles.push_back(node);
+
+	m_uiDeadCount++;
+	m_bOrderDirty = true;
+}
+
+void TransformHierarchy::setParent(TransformHandle node, TransformHandle parent)
+{
+	if (!this->isValid(node) || (parent != INVALID_TRANSFORM && !this->isValid(parent)))
+	{
+		throw std::runtime_error("Parenting a transform that doesn't exist!");
+	}
+
+	uint32_t index = m_indices[node];
+	uint32_t parentIndex = parent != INVALID_TRANSFORM ? m_indices[parent] : INVALID_TRANSFORM;
+
+	// Walk up from the new parent, finding the node on the way would make a cycle
+	for (uint32_t ancestor = parentIndex; ancestor != INVALID_TRANSFORM; ancestor = m_parents[ancestor])
+	{
+		if (ancestor == index)
+		{
+			throw std::runtime_error("Parenting a transform under its own child!");
+		}
+	}
+
+	m_parents[index] = parentIndex;
+
+	this->markDirty(index);
+	m_bOrderDirty = true;
+}
+
+TransformHandle TransformHierarchy::getParent(TransformHandle node) const
+{
+	uint32_t parentIndex = m_parents[m_indices[node]];
+	return parentIndex != INVALID_TRANSFORM ? m_handles[parentIndex] : INVALID_TRANSFORM;
+}
+
+void TransformHierarchy::setLocalPosition(TransformHandle node, const glm::vec3 & position)
+{
+	uint32_t index = m_indices[node];
+	m_positions[index] = position;
+	this->markDirty(index);
+}
+
+void TransformHierarchy::setLocalRotation(TransformHandle node, const glm::quat & rotation)
+{
+	uint32_t index = m_indices[node];
+	m_rotations[index] = rotation;
+	this->markDirty(index);
+}
+
+void TransformHierarchy::setLocalScale(TransformHandle node, const glm::vec3 & scale)
+{
+	uint32_t index = m_indices[node];
+	m_scales[index] = scale;
+	this->markDirty(index);
+}
+
+void TransformHierarchy::setLocalTransform(TransformHandle node, const glm::vec3 & position, const glm::quat & rotation, const glm::vec3 & scale)
+{
+	uint32_t index = m_indices[node];
+	m_positions[index] = position;
+	m_rotations[index] = rotation;
+	m_scales[index] = scale;
+	this->markDirty(index);
+}
+
+void TransformHierarchy::markDirty(uint32_t index)
+{
+	if (!m_localDirty[index])
+	{
+		m_localDirty[index] = 1;
+		m_uiDirtyCount++;
+	}
+}
+
+void TransformHierarchy::update()
+{
+	if (m_bOrderDirty)
+	{
+		this->rebuildOrder();
+	}
+
+	if (m_uiDirtyCount == 0)
+	{
+		// Nothing moved, just make sure last update's change flags don't linger
+		if (m_bWorldChanged)
+		{
+			memset(m_worldChanged.data(), 0, m_worldChanged.size());
+			m_bWorldChanged = false;
+		}
+		return;
+	}
+
+	JobSystem & jobSystem = JobSystem::getInstance();
+
+	// A level only reads the level above it, which is finished by the time it starts
+	for (size_t level = 0; level + 1 < m_levelOffsets.size(); level++)
+	{
+		jobSystem.parallelFor(m_levelOffsets[level], m_levelOffsets[level + 1], TRANSFORM_UPDATE_GRAIN, [this](size_t begin, size_t end)
+		{
+			this->updateRange(begin, end);
+		});
+	}
+
+	m_uiDirtyCount = 0;
+	m_bWorldChanged = true;
+}
+
+void TransformHierarchy::load(size_t nodeCount, const glm::vec3 * positions, const glm::quat * rotations, const glm::vec3 * scales,
+	const uint32_t * parents, const uint32_t * levelOffsets, size_t levelOffsetCount)
+{
+	if (nodeCount > 0 && (levelOffsetCount < 2 || levelOffsets[0] != 0 || levelOffsets[levelOffsetCount - 1] != nodeCount))
+	{
+		throw std::runtime_error("Transform levels don't cover the nodes!");
+	}
+
+	// Every parent has to sit in the level right above its child, which is all update() relies on
+	for (size_t level = 0; level + 1 < levelOffsetCount; level++)
+	{
+		if (levelOffsets[level] > levelOffsets[level + 1])
+		{
+			throw std::runtime_error("Transform levels are out of order!");
+		}
+
+		for (uint32_t i = levelOffsets[level]; i < levelOffsets[level + 1]; i++)
+		{
+			bool valid = level == 0 ? parents[i] == INVALID_TRANSFORM : parents[i] >= levelOffsets[level - 1] && parents[i] < levelOffsets[level];
+			if (!valid)
+			{
+				throw std::runtime_error("Transform parent isn't in the level above its child!");
+			}
+		}
+	}
+
+	m_positions.assign(positions, positions + nodeCount);
+	m_rotations.assign(rotations, rotations + nodeCount);
+	m_scales.assign(scales, scales + nodeCount);
+	m_parents.assign(parents, parents + nodeCount);
+	m_localDirty.assign(nodeCount, 1);
+	m_worldChanged.assign(nodeCount, 0);
+	m_worldMatrices.assign(nodeCount, glm::mat4(1.0f));
+
+	if (nodeCount > 0)
+	{
+		m_levelOffsets.assign(levelOffsets, levelOffsets + levelOffsetCount);
+	}
+	else
+	{
+		m_levelOffsets.clear();
+	}
+
+	m_handles.resize(nodeCount);
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		m_handles[i] = (TransformHandle)i;
+	}
+	m_indices = m_handles;
+	m_freeHandles.clear();
+
+	m_uiDirtyCount = nodeCount;
+	m_uiDeadCount = 0;
+	m_bOrderDirty = false;
+	m_bWorldChanged = false;
+}
+
+void TransformHierarchy::updateRange(size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		uint32_t parent = m_parents[i];
+		bool dirty = m_localDirty[i] || (parent != INVALID_TRANSFORM && m_worldChanged[parent]);
+
+		m_worldChanged[i] = dirty ? 1 : 0;
+
+		if (dirty)
+		{
+			composeWorld(parent != INVALID_TRANSFORM ? &m_worldMatrices[parent] : nullptr, m_positions[i], m_rotations[i], m_scales[i], m_worldMatrices[i]);
+			m_localDirty[i] = 0;
+		}
+	}
+}
+
+void TransformHierarchy::rebuildOrder()
+{
+	size_t nodeCount = m_handles.size();
+
+	// Depth of every node, anything under a destroyed node is destroyed as well
+	std::vector<int32_t> depths(nodeCount, DEPTH_UNKNOWN);
+	std::vector<uint32_t> chain;
+	int32_t maxDepth = -1;
+
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		uint32_t current = (uint32_t)i;
+		chain.clear();
+
+		while (depths[current] == DEPTH_UNKNOWN)
+		{
+			if (m_handles[current] == INVALID_TRANSFORM)
+			{
+				depths[current] = DEPTH_DEAD;
+				break;
+			}
+
+			if (m_parents[current] == INVALID_TRANSFORM)
+			{
+				depths[current] = 0;
+				break;
+			}
+
+			chain.push_back(current);
+			current = m_parents[current];
+		}
+
+		int32_t depth = depths[current];
+		for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+		{
+			depth = depth == DEPTH_DEAD ? DEPTH_DEAD : depth + 1;
+			depths[*it] = depth;
+		}
+
+		maxDepth = std::max<int32_t>(maxDepth, depths[i]);
+	}
+
+	// Counting sort by depth, stable so siblings keep their relative order
+	m_levelOffsets.assign(maxDepth + 2, 0);
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		if (depths[i] >= 0)
+		{
+			m_levelOffsets[depths[i] + 1]++;
+		}
+	}
+	for (size_t level = 1; level < m_levelOffsets.size(); level++)
+	{
+		m_levelOffsets[level] += m_levelOffsets[level - 1];
+	}
+
+	size_t liveCount = m_levelOffsets.back();
+
+	std::vector<uint32_t> newIndices(nodeCount, INVALID_TRANSFORM);
+	std::vector<uint32_t> cursors(m_levelOffsets.begin(), m_levelOffsets.end() - 1);
+
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		if (depths[i] >= 0)
+		{
+			newIndices[i] = cursors[depths[i]]++;
+		}
+		else if (m_handles[i] != INVALID_TRANSFORM)
+		{
+			// Died with an ancestor
+			m_indices[m_handles[i]] = INVALID_TRANSFORM;
+			m_freeHandles.push_back(m_handles[i]);
+		}
+	}
+
+	std::vector<glm::vec3> positions(liveCount);
+	std::vector<glm::quat> rotations(liveCount);
+	std::vector<glm::vec3> scales(liveCount);
+	std::vector<uint32_t> parents(liveCount);
+	std::vector<uint8_t> localDirty(liveCount);
+	std::vector<uint8_t> worldChanged(liveCount);
+	std::vector<glm::mat4> worldMatrices(liveCount);
+	std::vector<TransformHandle> handles(liveCount);
+
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		uint32_t index = newIndices[i];
+		if (index == INVALID_TRANSFORM)
+		{
+			continue;
+		}
+
+		positions[index] = m_positions[i];
+		rotations[index] = m_rotations[i];
+		scales[index] = m_scales[i];
+		parents[index] = m_parents[i] != INVALID_TRANSFORM ? newIndices[m_parents[i]] : INVALID_TRANSFORM;
+		localDirty[index] = m_localDirty[i];
+		worldChanged[index] = m_worldChanged[i];
+		worldMatrices[index] = m_worldMatrices[i];
+		handles[index] = m_handles[i];
+
+		m_indices[m_handles[i]] = index;
+	}
+
+	m_positions.swap(positions);
+	m_rotations.swap(rotations);
+	m_scales.swap(scales);
+	m_parents.swap(parents);
+	m_localDirty.swap(localDirty);
+	m_worldChanged.swap(worldChanged);
+	m_worldMatrices.swap(worldMatrices);
+	m_handles.swap(handles);
+
+	m_uiDeadCount = 0;
+	m_bOrderDirty = false;
+}
@@ -0,0 +1,105 @@
+#ifndef __TRANSFORM_H__
+#define __TRANSFORM_H__
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec3.hpp>
+#include <mat4x4.hpp>
+#include <gtc/quaternion.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+typedef uint32_t TransformHandle;
+
+#define INVALID_TRANSFORM 0xFFFFFFFFu
+#define TRANSFORM_UPDATE_GRAIN 2048 // Nodes per job when a level is updated in parallel
+
+// Scene graph transforms in structure-of-arrays layout.
+// Nodes are kept sorted by depth, so every parent comes before its children and a single
+// pass over the arrays (one level at a time, each level spread over the job system)
+// produces every world matrix. Only nodes whose local transform changed, and everything
+// below them, get recomputed.
+class TransformHierarchy
+{
+public:
+	TransformHierarchy();
+	virtual ~TransformHierarchy();
+
+	TransformHierarchy(const TransformHierarchy &) = delete;
+	void operator=(const TransformHierarchy &) = delete;
+
+	TransformHandle createNode(TransformHandle parent = INVALID_TRANSFORM,
+		const glm::vec3 & position = glm::vec3(0.0f), const glm::quat & rotation = glm::quat(), const glm::vec3 & scale = glm::vec3(1.0f));
+
+	// Destroys the node and everything below it
+	void destroyNode(TransformHandle node);
+	bool isValid(TransformHandle node) const { return node < m_indices.size() && m_indices[node] != INVALID_TRANSFORM; }
+
+	void setParent(TransformHandle node, TransformHandle parent);
+	TransformHandle getParent(TransformHandle node) const;
+
+	void setLocalPosition(TransformHandle node, const glm::vec3 & position);
+	void setLocalRotation(TransformHandle node, const glm::quat & rotation);
+	void setLocalScale(TransformHandle node, const glm::vec3 & scale);
+	void setLocalTransform(TransformHandle node, const glm::vec3 & position, const glm::quat & rotation, const glm::vec3 & scale);
+
+	const glm::vec3 & getLocalPosition(TransformHandle node) const { return m_positions[m_indices[node]]; }
+	const glm::quat & getLocalRotation(TransformHandle node) const { return m_rotations[m_indices[node]]; }
+	const glm::vec3 & getLocalScale(TransformHandle node) const { return m_scales[m_indices[node]]; }
+
+	// Valid after update()
+	const glm::mat4 & getWorldMatrix(TransformHandle node) const { return m_worldMatrices[m_indices[node]]; }
+	bool hasWorldChanged(TransformHandle node) const { return m_worldChanged[m_indices[node]] != 0; }
+
+	// Re-sorts after structural changes, then recomputes the dirty world matrices
+	void update();
+
+	// Replaces every node with arrays already in update order (parents before children, level n is
+	// [levelOffsets[n], levelOffsets[n + 1])), e.g. straight out of a scene file. Handles are the
+	// indices, and every world matrix is recomputed by the next update().
+	void load(size_t nodeCount, const glm::vec3 * positions, const glm::quat * rotations, const glm::vec3 * scales,
+		const uint32_t * parents, const uint32_t * levelOffsets, size_t levelOffsetCount);
+
+	size_t getNodeCount() const { return m_worldMatrices.size() - m_uiDeadCount; }
+	size_t getLevelCount() const { return m_levelOffsets.empty() ? 0 : m_levelOffsets.size() - 1; }
+
+	// Raw arrays in update order (valid after update(), until the next structural change)
+	const glm::mat4 * getWorldMatrices() const { return m_worldMatrices.data(); }
+	const TransformHandle * getHandles() const { return m_handles.data(); }
+	const glm::vec3 * getLocalPositions() const { return m_positions.data(); }
+	const glm::quat * getLocalRotations() const { return m_rotations.data(); }
+	const glm::vec3 * getLocalScales() const { return m_scales.data(); }
+	const uint32_t * getParentIndices() const { return m_parents.data(); }
+	const uint32_t * getLevelOffsets() const { return m_levelOffsets.data(); }
+	uint32_t getIndex(TransformHandle node) const { return m_indices[node]; }
+
+private:
+	void markDirty(uint32_t index);
+	void rebuildOrder();
+	void updateRange(size_t begin, size_t end);
+
+	// Sorted by depth, index space
+	std::vector<glm::vec3> m_positions;
+	std::vector<glm::quat> m_rotations;
+	std::vector<glm::vec3> m_scales;
+	std::vector<uint32_t> m_parents; // Index of the parent, INVALID_TRANSFORM for roots
+	std::vector<uint8_t> m_localDirty;
+	std::vector<uint8_t> m_worldChanged; // World matrix was recomputed by the last update
+	std::vector<glm::mat4> m_worldMatrices;
+	std::vector<TransformHandle> m_handles; // INVALID_TRANSFORM once destroyed
+
+	std::vector<uint32_t> m_levelOffsets; // Level n is [m_levelOffsets[n], m_levelOffsets[n + 1])
+
+	// Handle space
+	std::vector<uint32_t> m_indices;
+	std::vector<TransformHandle> m_freeHandles;
+
+	size_t m_uiDirtyCount;
+	size_t m_uiDeadCount;
+	bool m_bOrderDirty;
+	bool m_bWorldChanged;
+};
+
+#endif
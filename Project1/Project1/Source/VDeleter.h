@@ -43,7 +43,22 @@ public:
 		cleanup();
 		return &object;
 	}
-	
+
+	// Gives up ownership without destroying, the returned function destroys the object when called
+	std::function<void()> release()
+	{
+		if (object == VK_NULL_HANDLE)
+		{
+			return nullptr;
+		}
+
+		T obj = object;
+		std::function<void(T)> deletef = deleter;
+		object = VK_NULL_HANDLE;
+
+		return [obj, deletef]() { deletef(obj); };
+	}
+
 	operator T() const
 	{
 		return object;
@@ -0,0 +1,106 @@
+#ifndef __VULKAN_DELETION_QUEUE_H__
+#define __VULKAN_DELETION_QUEUE_H__
+
+#include "VDeleter.h"
+
+#include <deque>
+#include <mutex>
+#include <algorithm>
+
+// Holds on to released Vulkan objects until the GPU work that last used them has retired.
+// Every entry is tagged with the frame / submission value that last touched it and is
+// destroyed once collect() is told that value has completed.
+class VDeletionQueue
+{
+public:
+	VDeletionQueue() {}
+
+	~VDeletionQueue()
+	{
+		flush();
+	}
+
+	VDeletionQueue(const VDeletionQueue &) = delete;
+	void operator=(const VDeletionQueue &) = delete;
+
+	// Queue a deleter to run once retireValue has completed
+	void push(uint64_t retireValue, std::function<void()> deletef)
+	{
+		if (!deletef)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// Values are almost always pushed in order, only search when they are not
+		if (m_pending.empty() || m_pending.back().retireValue <= retireValue)
+		{
+			m_pending.push_back({ retireValue, std::move(deletef) });
+		}
+		else
+		{
+			auto it = std::upper_bound(m_pending.begin(), m_pending.end(), retireValue,
+				[](uint64_t value, const PendingDeletion & pending) { return value < pending.retireValue; });
+			m_pending.insert(it, { retireValue, std::move(deletef) });
+		}
+	}
+
+	// Take ownership of a wrapped object and destroy it once retireValue has completed
+	template <typename T>
+	void release(VDeleter<T> & object, uint64_t retireValue)
+	{
+		this->push(retireValue, object.release());
+	}
+
+	// Destroy everything whose work has retired, returns the number of objects destroyed
+	size_t collect(uint64_t completedValue)
+	{
+		std::deque<PendingDeletion> retired;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			auto it = m_pending.begin();
+			while (it != m_pending.end() && it->retireValue <= completedValue)
+			{
+				++it;
+			}
+
+			retired.insert(retired.end(), std::make_move_iterator(m_pending.begin()), std::make_move_iterator(it));
+			m_pending.erase(m_pending.begin(), it);
+		}
+
+		// Run the deleters outside the lock so they can't stall anyone pushing
+		for (auto & pending : retired)
+		{
+			pending.deleter();
+		}
+
+		return retired.size();
+	}
+
+	// Destroy everything regardless of value, the caller must make sure the device is idle
+	void flush()
+	{
+		this->collect(UINT64_MAX);
+	}
+
+	size_t size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_pending.size();
+	}
+
+private:
+	struct PendingDeletion
+	{
+		uint64_t retireValue;
+		std::function<void()> deleter;
+	};
+
+	std::deque<PendingDeletion> m_pending;
+	std::mutex m_mutex;
+};
+
+#endif
@@ -0,0 +1,341 @@
+#include "VFrameScheduler.h"
+
+#include <algorithm>
+
+VFrameScheduler::VFrameScheduler(const VDeleter<VkDevice> & device)
+: m_device(device)
+, m_timeline{ device, vkDestroySemaphore }
+{
+}
+
+VFrameScheduler::~VFrameScheduler()
+{
+	this->shutdown();
+}
+
+void VFrameScheduler::init(bool useTimelineSemaphore)
+{
+	this->m_bTimelineSemaphore = false;
+
+#ifdef VK_KHR_timeline_semaphore
+	if (useTimelineSemaphore)
+	{
+		VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+
+		if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, m_timeline.replace()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create Timeline Semaphore!");
+		}
+
+		m_pfnGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(m_device, "vkGetSemaphoreCounterValueKHR");
+		m_pfnWaitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(m_device, "vkWaitSemaphoresKHR");
+
+		this->m_bTimelineSemaphore = m_pfnGetSemaphoreCounterValue != nullptr && m_pfnWaitSemaphores != nullptr;
+	}
+#endif
+
+	std::cout << "Frame Scheduler using " << (m_bTimelineSemaphore ? "Timeline Semaphore" : "Fences") << std::endl;
+}
+
+void VFrameScheduler::shutdown()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if ((VkDevice)m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (const auto & pending : m_pendingSubmissions)
+	{
+		vkWaitForFences(m_device, 1, &pending.fence, VK_TRUE, UINT64_MAX);
+		vkDestroyFence(m_device, pending.fence, nullptr);
+	}
+
+	for (VkFence fence : m_freeFences)
+	{
+		vkDestroyFence(m_device, fence, nullptr);
+	}
+
+	for (VkFence fence : m_retiredFences)
+	{
+		vkDestroyFence(m_device, fence, nullptr);
+	}
+
+	m_pendingSubmissions.clear();
+	m_freeFences.clear();
+	m_retiredFences.clear();
+}
+
+uint64_t VFrameScheduler::submit(VkQueue queue, const VkSubmitInfo & submitInfo)
+{
+	if (!m_bTimelineSemaphore)
+	{
+		// Fences can't be waited on by the GPU, so a chain onto another queue is resolved on the host.
+		// Work on the same queue already executes in submission order.
+		std::vector<VkFence> fences;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			for (const auto & pending : m_pendingSubmissions)
+			{
+				if (pending.value <= m_uiChainValue && pending.queue != queue)
+				{
+					fences.push_back(pending.fence);
+					m_fenceWaiters[pending.fence]++;
+				}
+			}
+		}
+
+		this->waitForFences(fences, UINT64_MAX);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	uint64_t value = m_uiSubmittedValue + 1;
+
+#ifdef VK_KHR_timeline_semaphore
+	if (m_bTimelineSemaphore)
+	{
+		// Binary semaphores in the submission ignore their entry in the value arrays
+		std::vector<VkSemaphore> waitSemaphores(submitInfo.pWaitSemaphores, submitInfo.pWaitSemaphores + submitInfo.waitSemaphoreCount);
+		std::vector<VkPipelineStageFlags> waitStages(submitInfo.pWaitDstStageMask, submitInfo.pWaitDstStageMask + submitInfo.waitSemaphoreCount);
+		std::vector<uint64_t> waitValues(submitInfo.waitSemaphoreCount, 0);
+
+		// Every queue signals the same timeline and each signal has to be greater than the value it
+		// already holds, so work on a different queue than the last submission waits for that one.
+		// Otherwise the two could signal out of order and a later, lower signal would report work
+		// as done that is still running.
+		uint64_t waitValue = m_uiChainValue;
+		VkPipelineStageFlags waitStage = m_chainStages;
+		if (m_lastQueue != VK_NULL_HANDLE && queue != m_lastQueue)
+		{
+			waitValue = m_uiSubmittedValue;
+			waitStage |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		}
+
+		if (waitValue > 0)
+		{
+			waitSemaphores.push_back(m_timeline);
+			waitStages.push_back(waitStage);
+			waitValues.push_back(waitValue);
+		}
+
+		std::vector<VkSemaphore> signalSemaphores(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+		std::vector<uint64_t> signalValues(submitInfo.signalSemaphoreCount, 0);
+
+		signalSemaphores.push_back(m_timeline);
+		signalValues.push_back(value);
+
+		VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineInfo.pNext = submitInfo.pNext;
+		timelineInfo.waitSemaphoreValueCount = (uint32_t)waitValues.size();
+		timelineInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineInfo.signalSemaphoreValueCount = (uint32_t)signalValues.size();
+		timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+		VkSubmitInfo timelineSubmitInfo = submitInfo;
+		timelineSubmitInfo.pNext = &timelineInfo;
+		timelineSubmitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+		timelineSubmitInfo.pWaitSemaphores = waitSemaphores.data();
+		timelineSubmitInfo.pWaitDstStageMask = waitStages.data();
+		timelineSubmitInfo.signalSemaphoreCount = (uint32_t)signalSemaphores.size();
+		timelineSubmitInfo.pSignalSemaphores = signalSemaphores.data();
+
+		if (vkQueueSubmit(queue, 1, &timelineSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit to Queue!");
+		}
+
+		m_lastQueue = queue;
+	}
+	else
+#endif
+	{
+		// Recycle whatever has finished before grabbing a fence, keeps the pool at the in-flight count
+		this->retireFences();
+
+		VkFence fence = this->acquireFence();
+
+		if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+		{
+			m_freeFences.push_back(fence);
+			throw std::runtime_error("Failed to submit to Queue!");
+		}
+
+		m_pendingSubmissions.push_back({ value, queue, fence });
+	}
+
+	m_uiSubmittedValue = value;
+	m_uiChainValue = 0;
+	m_chainStages = 0;
+
+	return value;
+}
+
+void VFrameScheduler::chain(uint64_t value, VkPipelineStageFlags waitStage)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// One wait on the newest value covers every older one on the same timeline
+	m_uiChainValue = std::max(m_uiChainValue, value);
+	m_chainStages |= waitStage;
+}
+
+bool VFrameScheduler::poll(uint64_t value)
+{
+	return this->getCompletedValue() >= value;
+}
+
+bool VFrameScheduler::wait(uint64_t value, uint64_t timeout)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// A timeline wait on it would never return
+		if (value > m_uiSubmittedValue)
+		{
+			throw std::runtime_error("Waiting on a Frame Scheduler value that was never submitted!");
+		}
+	}
+
+#ifdef VK_KHR_timeline_semaphore
+	if (m_bTimelineSemaphore)
+	{
+		VkSemaphore timeline = m_timeline;
+
+		VkSemaphoreWaitInfoKHR waitInfo = {};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &timeline;
+		waitInfo.pValues = &value;
+
+		return m_pfnWaitSemaphores(m_device, &waitInfo, timeout) == VK_SUCCESS;
+	}
+#endif
+
+	// Submissions on different queues can finish in any order, and value is only complete once
+	// everything before it is, so wait on all of them rather than just the one that signals value
+	std::vector<VkFence> fences;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (const auto & pending : m_pendingSubmissions)
+		{
+			if (pending.value <= value)
+			{
+				fences.push_back(pending.fence);
+				m_fenceWaiters[pending.fence]++;
+			}
+		}
+	}
+
+	// Once they've all signaled retireFences has moved the completed value up to at least value
+	return this->waitForFences(fences, timeout);
+}
+
+uint64_t VFrameScheduler::getCompletedValue()
+{
+#ifdef VK_KHR_timeline_semaphore
+	if (m_bTimelineSemaphore)
+	{
+		uint64_t value = 0;
+		m_pfnGetSemaphoreCounterValue(m_device, m_timeline, &value);
+		return value;
+	}
+#endif
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	this->retireFences();
+
+	return m_uiCompletedValue;
+}
+
+uint64_t VFrameScheduler::getSubmittedValue()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_uiSubmittedValue;
+}
+
+VkFence VFrameScheduler::acquireFence()
+{
+	if (!m_freeFences.empty())
+	{
+		VkFence fence = m_freeFences.back();
+		m_freeFences.pop_back();
+		return fence;
+	}
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkFence fence = VK_NULL_HANDLE;
+	if (vkCreateFence(m_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create Fence!");
+	}
+
+	return fence;
+}
+
+void VFrameScheduler::retireFences()
+{
+	// Submissions are pushed in value order, stop at the first one still executing
+	while (!m_pendingSubmissions.empty())
+	{
+		PendingSubmission & pending = m_pendingSubmissions.front();
+
+		if (vkGetFenceStatus(m_device, pending.fence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		m_retiredFences.push_back(pending.fence);
+		m_uiCompletedValue = pending.value;
+
+		m_pendingSubmissions.pop_front();
+	}
+
+	// A fence another thread is still inside vkWaitForFences on can't be reset and handed out
+	// again until that thread is back
+	auto recyclable = std::partition(m_retiredFences.begin(), m_retiredFences.end(), [this](VkFence fence)
+	{
+		return m_fenceWaiters.count(fence) != 0;
+	});
+
+	if (recyclable != m_retiredFences.end())
+	{
+		vkResetFences(m_device, (uint32_t)(m_retiredFences.end() - recyclable), &*recyclable);
+		m_freeFences.insert(m_freeFences.end(), recyclable, m_retiredFences.end());
+		m_retiredFences.erase(recyclable, m_retiredFences.end());
+	}
+}
+
+bool VFrameScheduler::waitForFences(const std::vector<VkFence> & fences, uint64_t timeout)
+{
+	// Without the lock, so submits and polls from other threads carry on meanwhile
+	bool signaled = fences.empty() || vkWaitForFences(m_device, (uint32_t)fences.size(), fences.data(), VK_TRUE, timeout) == VK_SUCCESS;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (VkFence fence : fences)
+	{
+		auto waiters = m_fenceWaiters.find(fence);
+		if (--waiters->second == 0)
+		{
+			m_fenceWaiters.erase(waiters);
+		}
+	}
+
+	this->retireFences();
+
+	return signaled;
+}
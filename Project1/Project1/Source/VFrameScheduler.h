@@ -0,0 +1,86 @@
+#ifndef __VULKAN_FRAME_SCHEDULER_H__
+#define __VULKAN_FRAME_SCHEDULER_H__
+
+#include "VDeleter.h"
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+// Gives every queue submission a monotonically increasing value on a single timeline.
+// Host code can poll or wait for any value that has been handed out, and the next
+// submission can be chained to wait on an earlier one.
+//
+// Backed by a VK_KHR_timeline_semaphore when the headers and device support it (a submission
+// to another queue than the previous one waits for it, which keeps the signals in order), otherwise
+// falls back to a recycled pool of fences (one per in-flight submission) that emulates the
+// same timeline on the host.
+class VFrameScheduler
+{
+public:
+	VFrameScheduler(const VDeleter<VkDevice> & device);
+	virtual ~VFrameScheduler();
+
+	VFrameScheduler(const VFrameScheduler &) = delete;
+	void operator=(const VFrameScheduler &) = delete;
+
+	void init(bool useTimelineSemaphore);
+	void shutdown();
+
+	// Submits the work and signals the next timeline value, which is returned
+	uint64_t submit(VkQueue queue, const VkSubmitInfo & submitInfo);
+
+	// Makes the next submission wait until value has completed
+	void chain(uint64_t value, VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+	bool poll(uint64_t value);
+	bool wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+	uint64_t getCompletedValue();
+	uint64_t getSubmittedValue();
+
+	bool isTimelineSemaphore() { return m_bTimelineSemaphore; }
+
+private:
+	struct PendingSubmission
+	{
+		uint64_t value;
+		VkQueue queue;
+		VkFence fence;
+	};
+
+	VkFence acquireFence();
+	void retireFences();
+
+	// Waits with the lock released, the caller counts itself into m_fenceWaiters under the lock beforehand
+	bool waitForFences(const std::vector<VkFence> & fences, uint64_t timeout);
+
+	const VDeleter<VkDevice> & m_device;
+
+	bool m_bTimelineSemaphore = false;
+	VDeleter<VkSemaphore> m_timeline;
+
+#ifdef VK_KHR_timeline_semaphore
+	PFN_vkGetSemaphoreCounterValueKHR m_pfnGetSemaphoreCounterValue = nullptr;
+	PFN_vkWaitSemaphoresKHR m_pfnWaitSemaphores = nullptr;
+#endif
+
+	// Fence fallback
+	std::deque<PendingSubmission> m_pendingSubmissions;
+	std::vector<VkFence> m_freeFences;
+	std::vector<VkFence> m_retiredFences; // Signaled, recycled once no thread is waiting on them
+	std::unordered_map<VkFence, uint32_t> m_fenceWaiters; // Threads inside vkWaitForFences on each fence
+
+	uint64_t m_uiSubmittedValue = 0;
+	uint64_t m_uiCompletedValue = 0;
+
+	VkQueue m_lastQueue = VK_NULL_HANDLE; // Queue of the last timeline submission, see submit()
+
+	uint64_t m_uiChainValue = 0;
+	VkPipelineStageFlags m_chainStages = 0;
+
+	std::mutex m_mutex;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "VertexFormat.h"
+#include "JobSystem.h"
+
+#include <packing.hpp>
+#include <gtc/packing.hpp>
+#include <geometric.hpp>
+#include <common.hpp>
+
+#include <cstring>
+#include <cfloat>
+
+VertexQuantization VertexFormat::getQuantization(const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+{
+	// A flat axis still needs a non zero scale to divide by
+	glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(FLT_MIN));
+
+	VertexQuantization quantization;
+	quantization.positionOffset = glm::vec4(boundsMin, 0.0f);
+	quantization.positionScale = glm::vec4(extent, 0.0f);
+
+	return quantization;
+}
+
+void VertexFormat::quantize(const MeshData & mesh, std::vector<QuantizedVertex> & vertices, VertexQuantization & quantization)
+{
+	quantization = getQuantization(mesh.boundsMin, mesh.boundsMax);
+	vertices.resize(mesh.vertices.size());
+
+	JobSystem::getInstance().parallelFor(0, mesh.vertices.size(), VERTEX_QUANTIZE_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			vertices[i] = encode(mesh.vertices[i], quantization);
+		}
+	});
+}
+
+QuantizedVertex VertexFormat::encode(const MeshVertex & vertex, const VertexQuantization & quantization)
+{
+	QuantizedVertex quantized;
+
+	glm::vec3 relative = (vertex.position - glm::vec3(quantization.positionOffset)) / glm::vec3(quantization.positionScale);
+	uint64_t position = glm::packUnorm4x16(glm::vec4(relative, 1.0f));
+	memcpy(quantized.position, &position, sizeof(quantized.position));
+
+	quantized.normal = glm::packSnorm2x16(encodeOctahedral(vertex.normal));
+	quantized.uv = glm::packHalf2x16(vertex.uv);
+
+	return quantized;
+}
+
+MeshVertex VertexFormat::decode(const QuantizedVertex & vertex, const VertexQuantization & quantization)
+{
+	uint64_t position;
+	memcpy(&position, vertex.position, sizeof(position));
+
+	MeshVertex decoded;
+	decoded.position = glm::vec3(quantization.positionOffset) + glm::vec3(glm::unpackUnorm4x16(position)) * glm::vec3(quantization.positionScale);
+	decoded.normal = decodeOctahedral(glm::unpackSnorm2x16(vertex.normal));
+	decoded.uv = glm::unpackHalf2x16(vertex.uv);
+
+	return decoded;
+}
+
+glm::vec2 VertexFormat::encodeOctahedral(const glm::vec3 & normal)
+{
+	float length = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+	if (length == 0.0f)
+	{
+		// Missing normals come out pointing along +z rather than as garbage
+		return glm::vec2(0.0f);
+	}
+
+	glm::vec2 encoded = glm::vec2(normal) / length;
+
+	// The lower hemisphere folds over the diagonals into the corners
+	if (normal.z < 0.0f)
+	{
+		glm::vec2 folded = 1.0f - glm::abs(glm::vec2(encoded.y, encoded.x));
+		encoded.x = encoded.x >= 0.0f ? folded.x : -folded.x;
+		encoded.y = encoded.y >= 0.0f ? folded.y : -folded.y;
+	}
+
+	return encoded;
+}
+
+glm::vec3 VertexFormat::decodeOctahedral(const glm::vec2 & encoded)
+{
+	glm::vec3 normal(encoded.x, encoded.y, 1.0f - glm::abs(encoded.x) - glm::abs(encoded.y));
+
+	float fold = glm::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+
+	return glm::normalize(normal);
+}
@@ -0,0 +1,57 @@
+#ifndef __VERTEX_FORMAT_H__
+#define __VERTEX_FORMAT_H__
+
+#include "Mesh.h"
+
+// GLM
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <vec2.hpp>
+#include <vec3.hpp>
+#include <vec4.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+#define VERTEX_QUANTIZE_GRAIN 16384 // Vertices per job when a mesh is quantized
+
+// MeshVertex (32 bytes) packed into 16, laid out so a vertex fetch can decode most of it:
+//   position: VK_FORMAT_R16G16B16A16_UNORM, relative to the mesh bounds, w unused
+//   normal  : VK_FORMAT_R16G16_SNORM, octahedral
+//   uv      : VK_FORMAT_R16G16_SFLOAT
+struct QuantizedVertex
+{
+	uint16_t position[4];
+	uint32_t normal;
+	uint32_t uv;
+};
+
+static_assert(sizeof(QuantizedVertex) == 16, "QuantizedVertex is expected to be tightly packed");
+
+// Per mesh constants that turn the unorm position back into object space:
+// position = positionOffset.xyz + position * positionScale.xyz. vec4s so it can go straight into a push constant block.
+struct VertexQuantization
+{
+	glm::vec4 positionOffset;
+	glm::vec4 positionScale;
+};
+
+class VertexFormat
+{
+public:
+	static VertexQuantization getQuantization(const glm::vec3 & boundsMin, const glm::vec3 & boundsMax);
+
+	// Whole mesh on the job system, against the mesh's own bounds
+	static void quantize(const MeshData & mesh, std::vector<QuantizedVertex> & vertices, VertexQuantization & quantization);
+
+	static QuantizedVertex encode(const MeshVertex & vertex, const VertexQuantization & quantization);
+
+	// For tools and for checking the precision, a vertex shader decodes it the same way
+	static MeshVertex decode(const QuantizedVertex & vertex, const VertexQuantization & quantization);
+
+	// Unit vector to the [-1, 1] square and back
+	static glm::vec2 encodeOctahedral(const glm::vec3 & normal);
+	static glm::vec3 decodeOctahedral(const glm::vec2 & encoded);
+};
+
+#endif
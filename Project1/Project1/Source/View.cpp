@@ -8,7 +8,12 @@ MVCView::MVCView(MVCModel * model)
 
 MVCView::~MVCView()
 {
-
+	if ((VkDevice)m_device != VK_NULL_HANDLE)
+	{
+		// Nothing can still be in flight once we get here
+		vkDeviceWaitIdle(m_device);
+		m_deletionQueue.flush();
+	}
 }
 
 
@@ -46,9 +51,37 @@ BOOL MVCView::CreateVulkanWindow(const char * title, int width, int height, int
 		static_cast<InputHandler*>(glfwGetWindowUserPointer(window))->Mouse_Callback(button, action, mods);
 	};
 
+	// For setting cursor position callback
+	auto InputHandler_Cursor_CallBack = [](GLFWwindow * window, double x, double y)
+	{
+		static_cast<InputHandler*>(glfwGetWindowUserPointer(window))->Cursor_Callback(x, y);
+	};
+
+	// For setting scroll callback
+	auto InputHandler_Scroll_CallBack = [](GLFWwindow * window, double xOffset, double yOffset)
+	{
+		static_cast<InputHandler*>(glfwGetWindowUserPointer(window))->Scroll_Callback(xOffset, yOffset);
+	};
+
+	// For setting window focus callback
+	auto InputHandler_Focus_CallBack = [](GLFWwindow * window, int focused)
+	{
+		static_cast<InputHandler*>(glfwGetWindowUserPointer(window))->Focus_Callback(focused);
+	};
+
+	// For setting window iconify callback
+	auto InputHandler_Iconify_CallBack = [](GLFWwindow * window, int iconified)
+	{
+		static_cast<InputHandler*>(glfwGetWindowUserPointer(window))->Iconify_Callback(iconified);
+	};
+
 	// Setting Callbacks
 	glfwSetKeyCallback(m_window, InputHandler_Key_CallBack);
 	glfwSetMouseButtonCallback(m_window, InputHandler_Mouse_CallBack);
+	glfwSetCursorPosCallback(m_window, InputHandler_Cursor_CallBack);
+	glfwSetScrollCallback(m_window, InputHandler_Scroll_CallBack);
+	glfwSetWindowFocusCallback(m_window, InputHandler_Focus_CallBack);
+	glfwSetWindowIconifyCallback(m_window, InputHandler_Iconify_CallBack);
 
 	if (!InitVulkan())
 	{
@@ -66,6 +99,7 @@ BOOL MVCView::CreateVulkanWindow(const char * title, int width, int height, int
 	this->createCommandPool();
 	this->createCommandBuffers();
 	this->createSemaphores();
+	this->createFrameScheduler();
 
 	// Moving the window to the middle of the monitor screen
 	glfwSetWindowPos(this->m_window, ((float)(glfwGetVideoMode(glfwGetPrimaryMonitor())->width) * 0.5f) - ((float)(width)*  0.5f), ((float)(glfwGetVideoMode(glfwGetPrimaryMonitor())->height) * 0.5f) - ((float)(height) * 0.5f));
@@ -92,8 +126,19 @@ BOOL MVCView::InitVulkan()
 
 	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	createInfo.enabledExtensionCount = glfwExtensionCount;
-	createInfo.ppEnabledExtensionNames = glfwExtensions;
+	std::vector<const char *> instanceExtensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+
+#ifdef VK_KHR_timeline_semaphore
+	// Needed by VK_KHR_timeline_semaphore on a 1.0 instance
+	if (this->isInstanceExtensionAvailable(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+	{
+		instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		this->m_bTimelineSemaphores = true;
+	}
+#endif
+
+	createInfo.enabledExtensionCount = (uint32_t)instanceExtensions.size();
+	createInfo.ppEnabledExtensionNames = instanceExtensions.data();
 	
 	createInfo.enabledLayerCount = 0;
 
@@ -262,8 +307,37 @@ void MVCView::createLogicalDevice()
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.queueCreateInfoCount = (uint32_t)queueCreateInfos.size();
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = deviceExtensions.size();
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+	// Optional Device Extensions
+	std::vector<const char *> enabledExtensions = deviceExtensions;
+
+#ifdef VK_KHR_timeline_semaphore
+	// The feature is guaranteed whenever the extension is exposed
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	timelineFeatures.timelineSemaphore = VK_TRUE;
+
+	this->m_bTimelineSemaphores = this->m_bTimelineSemaphores && this->isDeviceExtensionAvailable(this->m_physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+	if (this->m_bTimelineSemaphores)
+	{
+		enabledExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		createInfo.pNext = &timelineFeatures;
+	}
+#endif
+
+#ifdef VK_GOOGLE_display_timing
+	// Real display times for the input latency numbers
+	this->m_bDisplayTiming = this->isDeviceExtensionAvailable(this->m_physicalDevice, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+
+	if (this->m_bDisplayTiming)
+	{
+		enabledExtensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+	}
+#endif
+
+	createInfo.enabledExtensionCount = (uint32_t)enabledExtensions.size();
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 	createInfo.enabledLayerCount = 0;
 
 
@@ -274,6 +348,14 @@ void MVCView::createLogicalDevice()
 
 	vkGetDeviceQueue(this->m_device, indices.graphicsFamily, 0, &this->graphicsQueue);
 	vkGetDeviceQueue(this->m_device, indices.presentFamily, 0, &this->presentQueue);
+
+#ifdef VK_GOOGLE_display_timing
+	if (this->m_bDisplayTiming)
+	{
+		this->m_pfnGetPastPresentationTiming = (PFN_vkGetPastPresentationTimingGOOGLE)vkGetDeviceProcAddr(this->m_device, "vkGetPastPresentationTimingGOOGLE");
+		this->m_bDisplayTiming = this->m_pfnGetPastPresentationTiming != nullptr;
+	}
+#endif
 }
 
 void MVCView::createSurface()
@@ -579,7 +661,7 @@ void MVCView::createCommandPool()
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-	poolInfo.flags = 0; // Optional
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Command buffers are re-recorded every frame
 
 	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, m_commandPool.replace()) != VK_SUCCESS) 
 	{
@@ -601,43 +683,48 @@ void MVCView::createCommandBuffers()
 	{
 		throw std::runtime_error("Failed to allocate Command Buffers!");
 	}
+}
 
-	for (size_t i = 0; i < m_commandBuffers.size(); i++)
-	{
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = nullptr; // Optional
+void MVCView::recordCommandBuffer(uint32_t imageIndex, const FramePacket & packet)
+{
+	VkCommandBuffer commandBuffer = m_commandBuffers[imageIndex];
 
-		vkBeginCommandBuffer(m_commandBuffers[i], &beginInfo);
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr; // Optional
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = m_renderPass;
-		renderPassInfo.framebuffer = m_swapChainFramebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = m_swapChainExtent;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-		renderPassInfo.clearValueCount = 1;
-		renderPassInfo.pClearValues = &clearColor;
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = m_renderPass;
+	renderPassInfo.framebuffer = m_swapChainFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = m_swapChainExtent;
 
-		vkCmdBeginRenderPass(m_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearColor;
 
-		// Bind Graphics Pipeline
-		vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		// Draw
-		vkCmdDraw(m_commandBuffers[i], 3, 1, 0, 0);
+	// Bind Graphics Pipeline
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
 
-		// End Render Pass
-		vkCmdEndRenderPass(m_commandBuffers[i]);
+	// Draw everything the simulation put in the packet
+	for (const auto & drawItem : packet.drawList)
+	{
+		vkCmdDraw(commandBuffer, drawItem.vertexCount, 1, 0, 0);
+	}
 
-		// Finish Recording Command Buffer
-		if (vkEndCommandBuffer(m_commandBuffers[i]) != VK_SUCCESS) 
-		{
-			throw std::runtime_error("Failed to record Command Buffer!");
-		}
+	// End Render Pass
+	vkCmdEndRenderPass(commandBuffer);
+
+	// Finish Recording Command Buffer
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) 
+	{
+		throw std::runtime_error("Failed to record Command Buffer!");
 	}
 }
 
@@ -654,12 +741,18 @@ void MVCView::createSemaphores()
 	}
 }
 
-void MVCView::createShaderModule(const std::vector<char> & code, VDeleter<VkShaderModule> & shaderModule)
+void MVCView::createFrameScheduler()
+{
+	this->m_frameScheduler.init(this->m_bTimelineSemaphores);
+	this->m_commandBufferValues.assign(this->m_commandBuffers.size(), 0);
+}
+
+void MVCView::createShaderModule(const FileView & code, VDeleter<VkShaderModule> & shaderModule)
 {
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	createInfo.codeSize = code.size();
-	createInfo.pCode = (uint32_t*)code.data();
+	createInfo.pCode = code.as<uint32_t>(); // Throws unless the code is 4 byte aligned and sized
 
 	if (vkCreateShaderModule(this->m_device, &createInfo, nullptr, shaderModule.replace()) != VK_SUCCESS)
 	{
@@ -686,6 +779,44 @@ bool MVCView::checkDeviceExtensionSupport(VkPhysicalDevice device)
 	return requiredExtensions.empty();
 }
 
+bool MVCView::isDeviceExtensionAvailable(VkPhysicalDevice device, const char * extensionName)
+{
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto & extension : availableExtensions)
+	{
+		if (strcmp(extension.extensionName, extensionName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool MVCView::isInstanceExtensionAvailable(const char * extensionName)
+{
+	uint32_t extensionCount;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto & extension : availableExtensions)
+	{
+		if (strcmp(extension.extensionName, extensionName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 MVCView::SwapChainSupportDetails MVCView::querySwapChainSupport(VkPhysicalDevice device)
 {
 	SwapChainSupportDetails details;
@@ -761,11 +892,34 @@ VkExtent2D MVCView::chooseSwapExtent(const VkSurfaceCapabilitiesKHR & capabiliti
 	}
 }
 
-void MVCView::drawFrame()
+void MVCView::drawFrame(const FramePacket & packet)
 {
+	FrameSample frameSample;
+	frameSample.frameNumber = packet.frameNumber;
+	frameSample.timesMs[METRIC_CPU_FRAME] = (float)(m_frameTimer.lap() * 1000.0);
+	frameSample.timesMs[METRIC_SIMULATION] = packet.simulationMs;
+
+	Timer phaseTimer;
+
 	uint32_t imageIndex;
 	vkAcquireNextImageKHR(m_device, m_swapChain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
 
+	frameSample.timesMs[METRIC_ACQUIRE] = (float)(phaseTimer.lap() * 1000.0);
+
+	// The command buffer for this image may still be executing from an earlier frame
+	if (m_commandBufferValues[imageIndex] > 0)
+	{
+		m_frameScheduler.wait(m_commandBufferValues[imageIndex]);
+	}
+
+	frameSample.timesMs[METRIC_FENCE_WAIT] = (float)(phaseTimer.lap() * 1000.0);
+
+	this->retireCompletedFrames();
+
+	phaseTimer.reset();
+	this->recordCommandBuffer(imageIndex, packet);
+	frameSample.timesMs[METRIC_RECORD] = (float)(phaseTimer.lap() * 1000.0);
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -782,10 +936,9 @@ void MVCView::drawFrame()
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) 
-	{
-		throw std::runtime_error("Failed to submit Draw Command Buffer!");
-	}
+	phaseTimer.reset();
+	m_commandBufferValues[imageIndex] = m_frameScheduler.submit(graphicsQueue, submitInfo);
+	frameSample.timesMs[METRIC_SUBMIT] = (float)(phaseTimer.lap() * 1000.0);
 
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -799,7 +952,118 @@ void MVCView::drawFrame()
 
 	presentInfo.pImageIndices = &imageIndex;
 
+	uint32_t presentId = (uint32_t)packet.frameNumber;
+
+#ifdef VK_GOOGLE_display_timing
+	VkPresentTimeGOOGLE presentTime = {};
+	presentTime.presentID = presentId;
+	presentTime.desiredPresentTime = 0; // As soon as possible
+
+	VkPresentTimesInfoGOOGLE presentTimesInfo = {};
+	presentTimesInfo.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE;
+	presentTimesInfo.swapchainCount = 1;
+	presentTimesInfo.pTimes = &presentTime;
+
+	if (m_bDisplayTiming)
+	{
+		presentInfo.pNext = &presentTimesInfo;
+	}
+#endif
+
 	vkQueuePresentKHR(presentQueue, &presentInfo);
+	frameSample.timesMs[METRIC_PRESENT] = (float)(phaseTimer.lap() * 1000.0);
+
+	FrameStats::getInstance().record(frameSample);
+
+	this->recordInputLatency(packet, presentId);
+	this->collectPresentationTiming();
+}
+
+void MVCView::recordInputLatency(const FramePacket & packet, uint32_t presentId)
+{
+	// Only the first frame to reflect an event counts, later ones just keep showing it
+	if (packet.inputEventId == 0 || packet.inputEventId == m_uiLastInputEventId)
+	{
+		return;
+	}
+
+	m_uiLastInputEventId = packet.inputEventId;
+
+	int64_t presentCallNs = Timer::getTimestampNs();
+	int64_t latencyNs = presentCallNs - packet.inputTimestampNs;
+
+	if (latencyNs >= 0)
+	{
+		FrameStats::getInstance().recordLatency(LATENCY_INPUT_TO_PRESENT, (uint64_t)(latencyNs / 1000));
+	}
+
+	if (m_bDisplayTiming)
+	{
+		m_pendingPresents.push_back({ presentId, packet.inputTimestampNs, presentCallNs });
+
+		// Timing never comes back for presents the driver skipped, don't let them pile up
+		while (m_pendingPresents.size() > MAX_PENDING_PRESENTS)
+		{
+			m_pendingPresents.pop_front();
+		}
+	}
+}
+
+void MVCView::collectPresentationTiming()
+{
+#ifdef VK_GOOGLE_display_timing
+	if (!m_bDisplayTiming || m_pendingPresents.empty())
+	{
+		return;
+	}
+
+	uint32_t timingCount = 0;
+	if (m_pfnGetPastPresentationTiming(m_device, m_swapChain, &timingCount, nullptr) != VK_SUCCESS || timingCount == 0)
+	{
+		return;
+	}
+
+	std::vector<VkPastPresentationTimingGOOGLE> timings(timingCount);
+	if (m_pfnGetPastPresentationTiming(m_device, m_swapChain, &timingCount, timings.data()) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < timingCount; i++)
+	{
+		const VkPastPresentationTimingGOOGLE & timing = timings[i];
+
+		// Timings arrive in present order, anything older than this one will never be reported
+		while (!m_pendingPresents.empty() && m_pendingPresents.front().presentId != timing.presentID &&
+			(int32_t)(m_pendingPresents.front().presentId - timing.presentID) < 0)
+		{
+			m_pendingPresents.pop_front();
+		}
+
+		if (m_pendingPresents.empty() || m_pendingPresents.front().presentId != timing.presentID)
+		{
+			continue;
+		}
+
+		const PendingPresent & pending = m_pendingPresents.front();
+		int64_t actualPresentNs = (int64_t)timing.actualPresentTime;
+
+		// The display clock is only comparable when it is the same monotonic clock as ours,
+		// anything that doesn't land shortly after the present call is from another time domain
+		if (actualPresentNs >= pending.presentCallNs && actualPresentNs - pending.presentCallNs < DISPLAY_TIMING_MAX_DELAY_NS)
+		{
+			FrameStats::getInstance().recordLatency(LATENCY_INPUT_TO_DISPLAY, (uint64_t)((actualPresentNs - pending.inputTimestampNs) / 1000));
+		}
+
+		m_pendingPresents.pop_front();
+	}
+#endif
+}
+
+void MVCView::retireCompletedFrames()
+{
+	// Destroy anything released by submissions that have now finished
+	m_deletionQueue.collect(m_frameScheduler.getCompletedValue());
 }
 
 int MVCView::getWindowWidth()
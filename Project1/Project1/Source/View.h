@@ -22,19 +22,28 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <deque>
 #include <algorithm>
 #include <stdexcept>
 #include <functional>
 
 // MVC
 #include "Model.h"
+#include "FramePacket.h"
 
 // Vulkan Deleter Wrapper
 #include "VDeleter.h"
+#include "VDeletionQueue.h"
+#include "VFrameScheduler.h"
 
 // Core
 #include "InputHandler.h"
 #include "FileReader.h"
+#include "FrameStats.h"
+#include "Timer.h"
+
+#define MAX_PENDING_PRESENTS 64 // Presents kept around waiting for their display timing
+#define DISPLAY_TIMING_MAX_DELAY_NS 1000000000LL // Longer than this after the present call means the clocks don't match
 
 // Required Device Extensions
 const std::vector<const char *> deviceExtensions = 
@@ -91,22 +100,42 @@ public:
 	void createFrameBuffers();
 	void createCommandPool();
 	void createCommandBuffers();
+	void recordCommandBuffer(uint32_t imageIndex, const FramePacket & packet);
 	void createSemaphores();
-	void createShaderModule(const std::vector<char> &, VDeleter<VkShaderModule> &);
+	void createFrameScheduler();
+	void createShaderModule(const FileView &, VDeleter<VkShaderModule> &);
 	bool checkDeviceExtensionSupport(VkPhysicalDevice);
+	bool isDeviceExtensionAvailable(VkPhysicalDevice, const char *);
+	bool isInstanceExtensionAvailable(const char *);
 	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice);
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &);
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &);
 
 public:
-	void drawFrame();
+	// Called from the render thread
+	void drawFrame(const FramePacket & packet);
 
 	GLFWwindow * getWindow() { return m_window; }
 	
 	int getWindowWidth();
 	int getWindowHeight();
 
+	// Deferred Deletion
+	template <typename T>
+	void deferDestroy(VDeleter<T> & object) { m_deletionQueue.release(object, m_frameScheduler.getSubmittedValue()); }
+	VDeletionQueue & getDeletionQueue() { return m_deletionQueue; }
+
+	// Timeline shared by every queue submission
+	VFrameScheduler & getFrameScheduler() { return m_frameScheduler; }
+
+private:
+	void retireCompletedFrames();
+
+	// Input to present latency
+	void recordInputLatency(const FramePacket & packet, uint32_t presentId);
+	void collectPresentationTiming();
+
 private:
 	GLFWwindow * m_window;
 	VkViewport m_viewport;
@@ -142,6 +171,32 @@ private:
 	VDeleter<VkSemaphore> m_imageAvailableSemaphore{ m_device, vkDestroySemaphore };
 	VDeleter<VkSemaphore> m_renderFinishedSemaphore{ m_device, vkDestroySemaphore };
 
+	bool m_bTimelineSemaphores = false; // VK_KHR_timeline_semaphore enabled on the device
+	VFrameScheduler m_frameScheduler{ m_device };
+
+	// Timeline value of the last submission that used each command buffer
+	std::vector<uint64_t> m_commandBufferValues;
+
+	Timer m_frameTimer; // Render thread frame to frame time
+
+	struct PendingPresent
+	{
+		uint32_t presentId;
+		int64_t inputTimestampNs;
+		int64_t presentCallNs;
+	};
+
+	uint64_t m_uiLastInputEventId = 0; // Newest input event already reflected by a presented frame
+
+	bool m_bDisplayTiming = false; // VK_GOOGLE_display_timing enabled on the device
+	std::deque<PendingPresent> m_pendingPresents; // Presents waiting on their display time
+#ifdef VK_GOOGLE_display_timing
+	PFN_vkGetPastPresentationTimingGOOGLE m_pfnGetPastPresentationTiming = nullptr;
+#endif
+
+	// Declared after the device so it is destroyed first
+	VDeletionQueue m_deletionQueue;
+
 	MVCModel * MVC_Model;
 };
 
@@ -1,13 +1,131 @@
 #include "Model.h"
 #include "View.h"
 #include "Controller.h"
+#include "JobSystem.h"
+#include "IOService.h"
+#include "PackFile.h"
+#include "DerivedDataCache.h"
+#include "Benchmark.h"
 
-void main()
+#include <string>
+#include <iostream>
+#include <cstdlib>
+
+// Command line
+//   --record <file>       records the input stream to file
+//   --replay <file>       replays a recording at its original pace
+//   --replay-fast <file>  replays a recording as fast as frames can be produced
+//   --fps <rate>          caps the frame rate
+//   --no-idle             keeps rendering while nothing changes
+//   --build-pack <directory> <file> [prefix]  packs every file below directory into file and exits,
+//                         the entries are prefix/<path below directory>, prefix defaults to the directory's name
+//   --benchmark-culling [count]  times frustum culling of count random bounds (1000000) against a reference and exits
+//   --benchmark-transforms [count] [frames]  times frames (10) transform updates of count nodes (1000000) and exits
+//   --benchmark-import [triangles]  times importing a generated OBJ (1000000 triangles) cold and from the cache and exits
+//   --benchmark-optimizer [triangles]  optimizes a generated grid (1000000 triangles) in row and in random order and exits
+int main(int argc, char * argv[])
 {
+	JobSystem::getInstance().init(); // Start the worker threads before anything wants to use them
+
+	if ((argc == 4 || argc == 5) && std::string(argv[1]) == "--build-pack")
+	{
+		// Entries have to match the paths the files are opened by, e.g. Shaders/vert.spv, so whatever
+		// leads up to the directory (an absolute path, "../") is dropped
+		std::string prefix = argc == 5 ? argv[4] : PackFile::normalizePath(argv[2]);
+		if (argc == 4)
+		{
+			while (!prefix.empty() && prefix.back() == '/')
+			{
+				prefix.pop_back();
+			}
+			prefix = prefix.substr(prefix.find_last_of('/') + 1);
+			prefix = prefix == "." || prefix == ".." ? std::string() : prefix;
+		}
+
+		PackBuilder builder;
+		size_t count = builder.addDirectory(argv[2], prefix);
+		builder.write(argv[3]);
+
+		std::cout << "Packed " << count << " files into " << argv[3] << std::endl;
+
+		JobSystem::getInstance().shutdown();
+		return 0;
+	}
+
+	if ((argc == 2 || argc == 3) && std::string(argv[1]) == "--benchmark-culling")
+	{
+		bool passed = Benchmark::culling(argc == 3 ? strtoul(argv[2], nullptr, 10) : 1000000);
+
+		JobSystem::getInstance().shutdown();
+		return passed ? 0 : 1;
+	}
+
+	if (argc >= 2 && argc <= 4 && std::string(argv[1]) == "--benchmark-transforms")
+	{
+		bool passed = Benchmark::transforms(argc >= 3 ? strtoul(argv[2], nullptr, 10) : 1000000, argc == 4 ? atoi(argv[3]) : 10);
+
+		JobSystem::getInstance().shutdown();
+		return passed ? 0 : 1;
+	}
+
+	if ((argc == 2 || argc == 3) && std::string(argv[1]) == "--benchmark-import")
+	{
+		bool passed = Benchmark::import(argc == 3 ? strtoul(argv[2], nullptr, 10) : 1000000);
+
+		JobSystem::getInstance().shutdown();
+		return passed ? 0 : 1;
+	}
+
+	if ((argc == 2 || argc == 3) && std::string(argv[1]) == "--benchmark-optimizer")
+	{
+		bool passed = Benchmark::optimizer(argc == 3 ? strtoul(argv[2], nullptr, 10) : 1000000);
+
+		JobSystem::getInstance().shutdown();
+		return passed ? 0 : 1;
+	}
+
+	IOService::getInstance().init(); // Completions are delivered on the job system, so after it
+
+	// Shipped builds read everything from one pack, without it the loose files are used
+	std::shared_ptr<PackFile> pack = PackFile::mount(PACK_DEFAULT_FILENAME);
+
+	// Imported assets, shared with any other instance or tool started from the same directory
+	DerivedDataCache::getInstance().init();
+
 	MVCModel * MVC_Model = new MVCModel();
 	MVCView * MVC_View = new MVCView(MVC_Model);
 	MVCController * MVC_Controller = new MVCController(MVC_Model, MVC_View);
 
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--no-idle")
+		{
+			MVC_Controller->setIdleEnabled(false);
+		}
+		else if (i + 1 >= argc)
+		{
+			break;
+		}
+		else if (argument == "--fps")
+		{
+			MVC_Controller->setFrameRateLimit(atof(argv[++i]));
+		}
+		else if (argument == "--record")
+		{
+			MVC_Controller->setInputRecording(argv[++i]);
+		}
+		else if (argument == "--replay")
+		{
+			MVC_Controller->setInputReplay(argv[++i], true);
+		}
+		else if (argument == "--replay-fast")
+		{
+			MVC_Controller->setInputReplay(argv[++i], false);
+		}
+	}
+
 	MVC_Controller->RunLoop();
 
 	if (MVC_Controller)
@@ -27,4 +145,15 @@ void main()
 		delete MVC_Model;
 		MVC_Model = nullptr;
 	}
+
+	if (pack)
+	{
+		unmountFileSource(pack);
+		pack = nullptr;
+	}
+
+	IOService::getInstance().shutdown();
+	JobSystem::getInstance().shutdown();
+
+	return 0;
 }
\ No newline at end of file